@@ -0,0 +1,599 @@
+/**
+ * ============== Router micro-benchmark (host) ===============
+ * Measures how long it takes to route a request and to look up its URI params, for:
+ *
+ *  - Both ways of routing: "legacy" (every route registered in esp_http_server and matched by
+ *    esp_cchi_uri_match_fn) and "router" (Router object with a single catch-all handler)
+ *  - Route counts of 1, 10, 100 and 1000, the request always targets the last registered route,
+ *    that's the worst case for esp_http_server, which tries the routes in registration order
+ *  - Pattern shapes: static, single param, multi param and suffix after param
+ *  - Short and long URIs (length of the param values, or of the last static segment)
+ *
+ * The routing cost (ns/match) is the cost of handing the request to a handler that does nothing.
+ * The lookup cost (ns/lookup) is timed inside the handler, it's the cost per URI param of reading
+ * every param with the esp_cchi_get_uri_param_len + esp_cchi_get_uri_param pattern ("copy"), with
+ * esp_cchi_find_uri_param ("capture") or with esp_cchi_get_uri_param_view ("view"). Every figure is
+ * the best of BENCH_SAMPLES runs after a warm-up, and the handlers check the values they get, so a
+ * matcher that routes or captures wrong fails the benchmark instead of looking fast
+ *
+ * A second table ("api") routes a few URIs of a small, realistic API (esp_cchi_bench_routes.txt)
+ * with the two ways above and with the route table compiled at build time ("compiled")
+ *
+ * A third table ("stack") is the peak stack that a request takes in the task that handles it, with
+ * the full middleware chain (logger, rate limit, Content-Type check, body limit and a form body
+ * read by the handler), a 405 and a static file larger than the chunk of the static handler, next
+ * to a request with no middlewares as the reference (the host stand-in and libc take their part).
+ * Every request runs in a thread whose stack is painted beforehand, the peak is what was written
+ *
+ * Usage: esp_cchi_bench [min_ms_per_measure]
+*/
+#include <esp_cchi/router.h>
+#include <esp_cchi/compiled.h>
+#include <esp_cchi/static.h>
+#include <esp_http_server.h>
+#include <middlewares.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "bench_api_routes.h"
+
+#define BENCH_LOOKUP_REPS 32
+#define BENCH_SAMPLES 5
+#define BENCH_STACK_SIZE (64 * 1024)
+#define BENCH_STACK_PAINT 0xA5
+
+enum bench_mode {
+    BENCH_MODE_LEGACY,
+    BENCH_MODE_ROUTER,
+};
+
+enum bench_lookup {
+    BENCH_LOOKUP_NONE,
+    BENCH_LOOKUP_COPY,
+    BENCH_LOOKUP_CAPTURE,
+    BENCH_LOOKUP_VIEW,
+};
+
+struct bench_shape {
+    const char *name;
+    const char *pattern_fmt;
+    const char *uri_fmt;
+    const char *const *params;
+    size_t params_len;
+};
+
+static const char *const bench_single_params[] = { "id" };
+static const char *const bench_multi_params[] = { "a", "b", "c" };
+static const char *const bench_suffix_params[] = { "name" };
+
+// "%zu" is the route index and "%s" is the segment/param value
+static const struct bench_shape bench_shapes[] = {
+    { "static", "/api/r%zu/%s", "/api/r%zu/%s", NULL, 0 },
+    { "param", "/api/r%zu/{id}", "/api/r%zu/%s", bench_single_params, 1 },
+    { "multi", "/api/r%zu/{a}/{b}/{c}", "/api/r%zu/%s/%s/%s", bench_multi_params, 3 },
+    { "suffix", "/api/r%zu/{name}.json", "/api/r%zu/%s.json", bench_suffix_params, 1 },
+};
+
+static const size_t bench_route_counts[] = { 1, 10, 100, 1000 };
+static const size_t bench_value_lens[] = { 4, 64 };
+
+static enum bench_lookup bench_lookup = BENCH_LOOKUP_NONE;
+static const struct bench_shape *bench_shape = NULL;
+static const char *bench_value = NULL;
+static volatile size_t bench_sink = 0;
+static double bench_min_ns = 2e7;
+// Time spent in the lookups and how many of them were made, reset by bench_measure
+static double bench_lookup_ns = 0;
+static size_t bench_lookups = 0;
+
+static double bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void bench_fail(httpd_req_t *r, const char *what) {
+    fprintf(stderr, "request %s: %s\n", r->uri, what);
+    exit(EXIT_FAILURE);
+}
+
+static esp_err_t bench_handler(httpd_req_t *r) {
+    if (bench_lookup == BENCH_LOOKUP_NONE) {
+        return ESP_OK;
+    }
+    for (size_t i = 0; i < bench_shape->params_len; i++) {
+        esp_cchi_view_t view;
+        if (esp_cchi_get_uri_param_view(r, bench_shape->params[i], &view) != ESP_OK ||
+            view.len != strlen(bench_value) || memcmp(view.data, bench_value, view.len) != 0)
+        {
+            bench_fail(r, "wrong URI param value");
+        }
+    }
+
+    double start = bench_now_ns();
+    if (bench_lookup == BENCH_LOOKUP_COPY) {
+        for (size_t rep = 0; rep < BENCH_LOOKUP_REPS; rep++) {
+            for (size_t i = 0; i < bench_shape->params_len; i++) {
+                size_t param_len = esp_cchi_get_uri_param_len(r, bench_shape->params[i]);
+                char param_content[param_len + 1];
+                size_t bytes_written = 0;
+                esp_cchi_get_uri_param(r,
+                                       bench_shape->params[i],
+                                       param_content,
+                                       param_len,
+                                       &bytes_written);
+                bench_sink += bytes_written;
+            }
+        }
+    } else if (bench_lookup == BENCH_LOOKUP_CAPTURE) {
+        for (size_t rep = 0; rep < BENCH_LOOKUP_REPS; rep++) {
+            for (size_t i = 0; i < bench_shape->params_len; i++) {
+                esp_cchi_uri_param_t param;
+                esp_cchi_find_uri_param(r, bench_shape->params[i], &param);
+                bench_sink += param.len;
+            }
+        }
+    } else if (bench_lookup == BENCH_LOOKUP_VIEW) {
+        for (size_t rep = 0; rep < BENCH_LOOKUP_REPS; rep++) {
+            for (size_t i = 0; i < bench_shape->params_len; i++) {
+                esp_cchi_view_t view;
+                esp_cchi_get_uri_param_view(r, bench_shape->params[i], &view);
+                bench_sink += view.len;
+            }
+        }
+    }
+    bench_lookup_ns += bench_now_ns() - start;
+    bench_lookups += BENCH_LOOKUP_REPS * bench_shape->params_len;
+    return ESP_OK;
+}
+
+static double bench_sample(httpd_host_exchange_t *exchange, size_t iterations) {
+    bench_lookup_ns = 0;
+    bench_lookups = 0;
+    double start = bench_now_ns();
+    for (size_t i = 0; i < iterations; i++) {
+        if (httpd_host_exchange_run(exchange) != ESP_OK) {
+            bench_fail(&exchange->req, "not routed");
+        }
+    }
+    return bench_now_ns() - start;
+}
+
+/**
+ * Finds how many runs of the exchange take bench_min_ns / 4 (that's the warm-up), then keeps the
+ * best of BENCH_SAMPLES samples of that many runs
+ *
+ * @param[out] lookup_ns ns per lookup of the best sample, 0 if the handler made none, can be NULL
+ *
+ * @returns ns per run
+*/
+static double bench_measure(httpd_host_exchange_t *exchange, double *lookup_ns) {
+    size_t iterations = 16;
+    while (bench_sample(exchange, iterations) < bench_min_ns / 4) {
+        iterations *= 2;
+    }
+
+    double best_ns = 0;
+    double best_lookup_ns = 0;
+    for (size_t sample = 0; sample < BENCH_SAMPLES; sample++) {
+        double run_ns = bench_sample(exchange, iterations) / (double)iterations;
+        if (sample == 0 || run_ns < best_ns) {
+            best_ns = run_ns;
+        }
+        double sample_lookup_ns = bench_lookups > 0 ? bench_lookup_ns / (double)bench_lookups : 0;
+        if (sample == 0 || sample_lookup_ns < best_lookup_ns) {
+            best_lookup_ns = sample_lookup_ns;
+        }
+    }
+    if (lookup_ns != NULL) {
+        *lookup_ns = best_lookup_ns;
+    }
+    return best_ns;
+}
+
+static size_t bench_api_params = 0;
+
+esp_err_t bench_api_handler(httpd_req_t *r) {
+    bench_api_params = esp_cchi_get_uri_param_count(r);
+    return ESP_OK;
+}
+
+// Same routes as esp_cchi_bench_routes.txt
+static const httpd_uri_t bench_api_uris[] = {
+    { .uri = "/health", .method = HTTP_GET },
+    { .uri = "/api/status", .method = HTTP_GET },
+    { .uri = "/api/version", .method = HTTP_GET },
+    { .uri = "/api/users", .method = HTTP_GET },
+    { .uri = "/api/users", .method = HTTP_POST },
+    { .uri = "/api/users/me", .method = HTTP_GET },
+    { .uri = "/api/users/{id:[0-9]+}", .method = HTTP_GET },
+    { .uri = "/api/users/{id:[0-9]+}", .method = HTTP_PUT },
+    { .uri = "/api/users/{id:[0-9]+}", .method = HTTP_DELETE },
+    { .uri = "/api/users/{name}", .method = HTTP_GET },
+    { .uri = "/api/users/{id:[0-9]+}/posts", .method = HTTP_GET },
+    { .uri = "/api/posts/{post}/comments/{comment}", .method = HTTP_GET },
+    { .uri = "/api/devices/{mac:[0-9a-f]{12}}", .method = HTTP_GET },
+    { .uri = "/api/devices/{mac:[0-9a-f]{12}}/reboot", .method = HTTP_POST },
+    { .uri = "/files/{name}.{ext}", .method = HTTP_GET },
+};
+
+// Requests and the number of URI params of the route they must reach
+static const struct {
+    const char *uri;
+    size_t params;
+} bench_api_requests[] = {
+    { "/health", 0 },
+    { "/api/version", 0 },
+    { "/api/users/me", 0 },
+    { "/api/users/42", 1 },
+    { "/api/users/alice", 1 },
+    { "/api/users/42/posts", 1 },
+    { "/api/posts/7/comments/3", 2 },
+    { "/api/devices/0123456789ab", 1 },
+    { "/files/index.html", 2 },
+};
+
+#define BENCH_API_URIS_LEN (sizeof(bench_api_uris) / sizeof(bench_api_uris[0]))
+#define BENCH_API_REQUESTS_LEN (sizeof(bench_api_requests) / sizeof(bench_api_requests[0]))
+
+static void bench_api(void) {
+    httpd_uri_t hd_uris[BENCH_API_URIS_LEN];
+    double results[3][BENCH_API_REQUESTS_LEN];
+
+    for (int mode = 0; mode < 3; mode++) {
+        httpd_config_t hd_config = HTTPD_DEFAULT_CONFIG();
+        hd_config.max_uri_handlers = BENCH_API_URIS_LEN + 1;
+        esp_cchi_setup_hd_config(&hd_config);
+        httpd_handle_t server = NULL;
+        ESP_ERROR_CHECK(httpd_start(&server, &hd_config));
+
+        esp_cchi_router_handle_t router = NULL;
+        if (mode == 1) {
+            ESP_ERROR_CHECK(esp_cchi_router_create(&router));
+        }
+        for (size_t i = 0; i < BENCH_API_URIS_LEN && mode != 2; i++) {
+            hd_uris[i] = bench_api_uris[i];
+            hd_uris[i].handler = bench_api_handler;
+            if (mode == 0) {
+                ESP_ERROR_CHECK(esp_cchi_setup_hd_uri(&hd_uris[i]));
+                ESP_ERROR_CHECK(httpd_register_uri_handler(server, &hd_uris[i]));
+            } else {
+                ESP_ERROR_CHECK(esp_cchi_router_handle(router, &hd_uris[i]));
+            }
+        }
+        if (mode == 1) {
+            ESP_ERROR_CHECK(esp_cchi_router_attach(router, server));
+        } else if (mode == 2) {
+            ESP_ERROR_CHECK(esp_cchi_compiled_attach(&bench_api_routes, server));
+        }
+
+        for (size_t i = 0; i < BENCH_API_REQUESTS_LEN; i++) {
+            httpd_host_exchange_t exchange;
+            ESP_ERROR_CHECK(httpd_host_exchange_init(&exchange,
+                                                     server,
+                                                     HTTP_GET,
+                                                     bench_api_requests[i].uri));
+            bench_api_params = SIZE_MAX;
+            results[mode][i] = bench_measure(&exchange, NULL);
+            if (bench_api_params != bench_api_requests[i].params) {
+                bench_fail(&exchange.req, "wrong number of URI params");
+            }
+        }
+
+        httpd_stop(server);
+        for (size_t i = 0; i < BENCH_API_URIS_LEN && mode == 0; i++) {
+            esp_cchi_delete_hd_uri(&hd_uris[i], true);
+        }
+        if (mode == 1) {
+            esp_cchi_router_delete(router);
+        }
+    }
+
+    printf("\n%-28s %10s %10s %10s\n", "api request", "legacy", "router", "compiled");
+    printf("%-28s %10s %10s %10s\n", "", "ns/match", "ns/match", "ns/match");
+    for (size_t i = 0; i < BENCH_API_REQUESTS_LEN; i++) {
+        printf("%-28s %10.1f %10.1f %10.1f\n",
+               bench_api_requests[i].uri,
+               results[0][i],
+               results[1][i],
+               results[2][i]);
+    }
+}
+
+middlewares_rate_limit(bench_rate_limit, 1000, 1000, 8)
+middlewares_allow_content_types(bench_allow_form, "application/x-www-form-urlencoded")
+middlewares_limit_body(bench_limit_body, 4096)
+
+static esp_err_t bench_form_field(httpd_req_t *r,
+                                  const char *key,
+                                  size_t key_len,
+                                  const char *value,
+                                  size_t value_len,
+                                  void *arg)
+{
+    (void)r;
+    (void)key;
+    (void)key_len;
+    (void)value;
+    *(size_t*)arg += value_len;
+    return ESP_OK;
+}
+
+static esp_err_t bench_form_handler(httpd_req_t *r) {
+    char field_buf[64];
+    size_t values_len = 0;
+    middlewares_form_parser_t form;
+    middlewares_form_parser_init(&form, field_buf, sizeof(field_buf), bench_form_field,
+                                 &values_len);
+    esp_err_t err = middlewares_body_read(r, 4096, middlewares_form_feed, &form);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return httpd_resp_sendstr(r, values_len > 0 ? "ok" : "empty");
+}
+
+static esp_err_t bench_ping_handler(httpd_req_t *r) {
+    return httpd_resp_sendstr(r, "ok");
+}
+
+static void *bench_stack_run(void *arg) {
+    httpd_host_exchange_run(arg);
+    return NULL;
+}
+
+/**
+ * Runs the exchange in a thread with a painted stack
+ *
+ * @returns Bytes of the stack written by the thread
+*/
+static size_t bench_stack_peak(httpd_host_exchange_t *exchange) {
+    unsigned char *stack = malloc(BENCH_STACK_SIZE);
+    pthread_attr_t attr;
+    pthread_t thread;
+    if (stack == NULL || pthread_attr_init(&attr) != 0) {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(stack, BENCH_STACK_PAINT, BENCH_STACK_SIZE);
+    pthread_attr_setstack(&attr, stack, BENCH_STACK_SIZE);
+    if (pthread_create(&thread, &attr, bench_stack_run, exchange) != 0) {
+        fprintf(stderr, "the thread can't be created\n");
+        exit(EXIT_FAILURE);
+    }
+    pthread_join(thread, NULL);
+    pthread_attr_destroy(&attr);
+
+    // The stack grows down, the bytes still painted at its bottom were never reached
+    size_t untouched = 0;
+    while (untouched < BENCH_STACK_SIZE && stack[untouched] == BENCH_STACK_PAINT) {
+        untouched++;
+    }
+    free(stack);
+    return BENCH_STACK_SIZE - untouched;
+}
+
+static void bench_stack(void) {
+    char base_path[] = "/tmp/esp_cchi_bench_XXXXXX";
+    char file_path[sizeof(base_path) + 16];
+    if (mkdtemp(base_path) == NULL) {
+        fprintf(stderr, "the static directory can't be created\n");
+        exit(EXIT_FAILURE);
+    }
+    snprintf(file_path, sizeof(file_path), "%s/big.txt", base_path);
+    FILE *file = fopen(file_path, "wb");
+    for (size_t i = 0; file != NULL && i < 8 * 1024; i++) {
+        fputc('a' + (int)(i % 26), file);
+    }
+    if (file == NULL || fclose(file) != 0) {
+        fprintf(stderr, "the static file can't be written\n");
+        exit(EXIT_FAILURE);
+    }
+    const esp_cchi_static_config_t static_config = { .base_path = base_path };
+
+    httpd_config_t hd_config = HTTPD_DEFAULT_CONFIG();
+    esp_cchi_setup_hd_config(&hd_config);
+    httpd_handle_t server = NULL;
+    ESP_ERROR_CHECK(httpd_start(&server, &hd_config));
+    esp_cchi_router_handle_t router = NULL;
+    esp_cchi_router_handle_t api = NULL;
+    ESP_ERROR_CHECK(esp_cchi_router_create(&router));
+    ESP_ERROR_CHECK(esp_cchi_router_route(router, "/api", &api));
+    ESP_ERROR_CHECK(esp_cchi_router_use(api, middlewares_logger));
+    ESP_ERROR_CHECK(esp_cchi_router_use(api, bench_rate_limit));
+    ESP_ERROR_CHECK(esp_cchi_router_use(api, bench_allow_form));
+    ESP_ERROR_CHECK(esp_cchi_router_use(api, bench_limit_body));
+    const httpd_uri_t form_uri = {
+        .uri = "/forms/{id}",
+        .method = HTTP_POST,
+        .handler = bench_form_handler,
+    };
+    const httpd_uri_t ping_uri = {
+        .uri = "/ping",
+        .method = HTTP_GET,
+        .handler = bench_ping_handler,
+    };
+    ESP_ERROR_CHECK(esp_cchi_router_handle(api, &form_uri));
+    ESP_ERROR_CHECK(esp_cchi_router_handle(router, &ping_uri));
+    ESP_ERROR_CHECK(esp_cchi_router_static(router, "/www", &static_config));
+    ESP_ERROR_CHECK(esp_cchi_router_attach(router, server));
+
+    static const char form_body[] = "name=bench&value=a%20b&x=1";
+    static const struct {
+        const char *name;
+        httpd_method_t method;
+        const char *uri;
+        const char *status;
+    } requests[] = {
+        { "GET, no middlewares", HTTP_GET, "/ping", HTTPD_200 },
+        { "form POST, full chain", HTTP_POST, "/api/forms/1", HTTPD_200 },
+        { "405", HTTP_DELETE, "/api/forms/1", "405 Method Not Allowed" },
+        { "static file, 8 KiB", HTTP_GET, "/www/big.txt", HTTPD_200 },
+    };
+
+    char form_len[24];
+    snprintf(form_len, sizeof(form_len), "%zu", strlen(form_body));
+    printf("\n%-28s %10s\n", "stack", "peak bytes");
+    for (size_t i = 0; i < sizeof(requests) / sizeof(requests[0]); i++) {
+        httpd_host_exchange_t exchange;
+        ESP_ERROR_CHECK(httpd_host_exchange_init(&exchange,
+                                                 server,
+                                                 requests[i].method,
+                                                 requests[i].uri));
+        httpd_host_exchange_add_hdr(&exchange, "Content-Type", "application/x-www-form-urlencoded");
+        httpd_host_exchange_add_hdr(&exchange, "Content-Length", form_len);
+        httpd_host_exchange_add_hdr(&exchange, "Accept-Encoding", "gzip, deflate, br");
+        httpd_host_exchange_set_body(&exchange, form_body, strlen(form_body));
+        // The first run binds the libc symbols and builds the lazy tables, it's not counted
+        httpd_host_exchange_t warm_up = exchange;
+        httpd_host_exchange_run(&warm_up);
+        size_t peak = bench_stack_peak(&exchange);
+        if (strcmp(exchange.status, requests[i].status) != 0) {
+            bench_fail(&exchange.req, exchange.status);
+        }
+        printf("%-28s %10zu\n", requests[i].name, peak);
+    }
+
+    httpd_stop(server);
+    esp_cchi_router_delete(router);
+    unlink(file_path);
+    rmdir(base_path);
+}
+
+static void bench_format(char *buf,
+                         size_t buf_len,
+                         const char *fmt,
+                         size_t route_index,
+                         const char *value)
+{
+    snprintf(buf, buf_len, fmt, route_index, value, value, value);
+}
+
+static void bench_run(enum bench_mode mode,
+                      const struct bench_shape *shape,
+                      size_t routes_len,
+                      size_t value_len)
+{
+    char value[value_len + 1];
+    memset(value, 'x', value_len);
+    value[value_len] = '\0';
+
+    httpd_config_t hd_config = HTTPD_DEFAULT_CONFIG();
+    hd_config.max_uri_handlers = routes_len + 1;
+    esp_cchi_setup_hd_config(&hd_config);
+    httpd_handle_t server = NULL;
+    ESP_ERROR_CHECK(httpd_start(&server, &hd_config));
+
+    esp_cchi_router_handle_t router = NULL;
+    if (mode == BENCH_MODE_ROUTER) {
+        ESP_ERROR_CHECK(esp_cchi_router_create(&router));
+    }
+
+    char **patterns = calloc(routes_len, sizeof(char*));
+    httpd_uri_t *hd_uris = calloc(routes_len, sizeof(httpd_uri_t));
+    if (patterns == NULL || hd_uris == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < routes_len; i++) {
+        char pattern[HTTPD_MAX_URI_LEN];
+        bench_format(pattern, sizeof(pattern), shape->pattern_fmt, i, value);
+        patterns[i] = strdup(pattern);
+        hd_uris[i] = (httpd_uri_t){
+            .uri = patterns[i],
+            .method = HTTP_GET,
+            .handler = bench_handler,
+        };
+        if (mode == BENCH_MODE_LEGACY) {
+            ESP_ERROR_CHECK(esp_cchi_setup_hd_uri(&hd_uris[i]));
+            ESP_ERROR_CHECK(httpd_register_uri_handler(server, &hd_uris[i]));
+        } else {
+            ESP_ERROR_CHECK(esp_cchi_router_handle(router, &hd_uris[i]));
+        }
+    }
+    if (mode == BENCH_MODE_ROUTER) {
+        ESP_ERROR_CHECK(esp_cchi_router_attach(router, server));
+    }
+
+    char uri[HTTPD_MAX_URI_LEN];
+    bench_format(uri, sizeof(uri), shape->uri_fmt, routes_len - 1, value);
+    httpd_host_exchange_t exchange;
+    ESP_ERROR_CHECK(httpd_host_exchange_init(&exchange, server, HTTP_GET, uri));
+
+    bench_shape = shape;
+    bench_value = value;
+    bench_lookup = BENCH_LOOKUP_NONE;
+    double match_ns = bench_measure(&exchange, NULL);
+
+    double copy_ns = 0;
+    double capture_ns = 0;
+    double view_ns = 0;
+    if (shape->params_len > 0) {
+        bench_lookup = BENCH_LOOKUP_COPY;
+        bench_measure(&exchange, &copy_ns);
+        bench_lookup = BENCH_LOOKUP_CAPTURE;
+        bench_measure(&exchange, &capture_ns);
+        bench_lookup = BENCH_LOOKUP_VIEW;
+        bench_measure(&exchange, &view_ns);
+    }
+
+    printf("%-7s %-7s %7zu %8zu %10.1f",
+           mode == BENCH_MODE_LEGACY ? "legacy" : "router",
+           shape->name,
+           routes_len,
+           strlen(uri),
+           match_ns);
+    if (shape->params_len > 0) {
+        printf(" %12.1f %12.1f %12.1f\n", copy_ns, capture_ns, view_ns);
+    } else {
+        printf(" %12s %12s %12s\n", "-", "-", "-");
+    }
+
+    httpd_stop(server);
+    for (size_t i = 0; i < routes_len; i++) {
+        if (mode == BENCH_MODE_LEGACY) {
+            esp_cchi_delete_hd_uri(&hd_uris[i], true);
+        }
+        free(patterns[i]);
+    }
+    if (mode == BENCH_MODE_ROUTER) {
+        esp_cchi_router_delete(router);
+    }
+    free(hd_uris);
+    free(patterns);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        bench_min_ns = atof(argv[1]) * 1e6;
+    }
+
+    printf("%-7s %-7s %7s %8s %10s %12s %12s %12s\n",
+           "mode", "shape", "routes", "uri_len", "ns/match", "ns/lookup", "ns/lookup", "ns/lookup");
+    printf("%-7s %-7s %7s %8s %10s %12s %12s %12s\n",
+           "", "", "", "", "", "(copy)", "(capture)", "(view)");
+
+    for (size_t shape = 0; shape < sizeof(bench_shapes) / sizeof(bench_shapes[0]); shape++) {
+        for (size_t len = 0; len < sizeof(bench_value_lens) / sizeof(bench_value_lens[0]); len++) {
+            for (size_t count = 0;
+                 count < sizeof(bench_route_counts) / sizeof(bench_route_counts[0]);
+                 count++)
+            {
+                bench_run(BENCH_MODE_LEGACY,
+                          &bench_shapes[shape],
+                          bench_route_counts[count],
+                          bench_value_lens[len]);
+                bench_run(BENCH_MODE_ROUTER,
+                          &bench_shapes[shape],
+                          bench_route_counts[count],
+                          bench_value_lens[len]);
+            }
+        }
+    }
+    bench_api();
+    bench_stack();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,539 @@
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+struct httpd_host_server {
+    httpd_config_t config;
+    httpd_uri_t *handlers;
+    size_t handlers_len;
+};
+
+#define HTTPD_HOST_EXCHANGE(r) ((httpd_host_exchange_t*)(r)->aux)
+
+// Guards .async_pending of every exchange, the async copies are completed from other threads
+static pthread_mutex_t httpd_host_async_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t httpd_host_async_done = PTHREAD_COND_INITIALIZER;
+
+const char *http_method_str(enum http_method m) {
+    static const char *const names[] = {
+        "DELETE", "GET", "HEAD", "POST", "PUT", "CONNECT", "OPTIONS", "TRACE", "COPY", "LOCK",
+        "MKCOL", "MOVE", "PROPFIND", "PROPPATCH", "SEARCH", "UNLOCK", "BIND", "REBIND", "UNBIND",
+        "ACL", "REPORT", "MKACTIVITY", "CHECKOUT", "MERGE", "M-SEARCH", "NOTIFY", "SUBSCRIBE",
+        "UNSUBSCRIBE", "PATCH", "PURGE", "MKCALENDAR", "LINK", "UNLINK",
+    };
+    if ((size_t)m >= sizeof(names) / sizeof(names[0])) {
+        return "<unknown>";
+    }
+    return names[m];
+}
+
+const char *esp_err_to_name(esp_err_t code) {
+    switch (code) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_HTTPD_HANDLERS_FULL: return "ESP_ERR_HTTPD_HANDLERS_FULL";
+    case ESP_ERR_HTTPD_HANDLER_EXISTS: return "ESP_ERR_HTTPD_HANDLER_EXISTS";
+    case ESP_ERR_HTTPD_RESULT_TRUNC: return "ESP_ERR_HTTPD_RESULT_TRUNC";
+    default: return "UNKNOWN ERROR";
+    }
+}
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config) {
+    if (handle == NULL || config == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct httpd_host_server *server = calloc(1, sizeof(struct httpd_host_server));
+    if (server == NULL) {
+        return ESP_ERR_HTTPD_ALLOC_MEM;
+    }
+    server->handlers = calloc(config->max_uri_handlers, sizeof(httpd_uri_t));
+    if (server->handlers == NULL) {
+        free(server);
+        return ESP_ERR_HTTPD_ALLOC_MEM;
+    }
+    server->config = *config;
+    *handle = server;
+    return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle) {
+    struct httpd_host_server *server = handle;
+    if (server == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < server->handlers_len; i++) {
+        free((char*)server->handlers[i].uri);
+    }
+    if (server->config.global_user_ctx_free_fn != NULL) {
+        server->config.global_user_ctx_free_fn(server->config.global_user_ctx);
+    }
+    free(server->handlers);
+    free(server);
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler) {
+    struct httpd_host_server *server = handle;
+    if (server == NULL || uri_handler == NULL || uri_handler->uri == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < server->handlers_len; i++) {
+        if (server->handlers[i].method == uri_handler->method &&
+            strcmp(server->handlers[i].uri, uri_handler->uri) == 0)
+        {
+            return ESP_ERR_HTTPD_HANDLER_EXISTS;
+        }
+    }
+    if (server->handlers_len == server->config.max_uri_handlers) {
+        return ESP_ERR_HTTPD_HANDLERS_FULL;
+    }
+    // Like the real server, the URI is copied
+    httpd_uri_t *slot = &server->handlers[server->handlers_len];
+    *slot = *uri_handler;
+    slot->uri = strdup(uri_handler->uri);
+    if (slot->uri == NULL) {
+        return ESP_ERR_HTTPD_ALLOC_MEM;
+    }
+    server->handlers_len++;
+    return ESP_OK;
+}
+
+esp_err_t httpd_unregister_uri_handler(httpd_handle_t handle,
+                                       const char *uri,
+                                       httpd_method_t method)
+{
+    struct httpd_host_server *server = handle;
+    if (server == NULL || uri == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < server->handlers_len; i++) {
+        if (server->handlers[i].method == method && strcmp(server->handlers[i].uri, uri) == 0) {
+            free((char*)server->handlers[i].uri);
+            memmove(&server->handlers[i],
+                    &server->handlers[i + 1],
+                    sizeof(httpd_uri_t) * (server->handlers_len - i - 1));
+            server->handlers_len--;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_unregister_uri(httpd_handle_t handle, const char *uri) {
+    struct httpd_host_server *server = handle;
+    if (server == NULL || uri == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    bool found = false;
+    size_t i = 0;
+    while (i < server->handlers_len) {
+        if (strcmp(server->handlers[i].uri, uri) != 0) {
+            i++;
+            continue;
+        }
+        free((char*)server->handlers[i].uri);
+        memmove(&server->handlers[i],
+                &server->handlers[i + 1],
+                sizeof(httpd_uri_t) * (server->handlers_len - i - 1));
+        server->handlers_len--;
+        found = true;
+    }
+    return found ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+bool httpd_uri_match_wildcard(const char *uri_template,
+                              const char *uri_to_match,
+                              size_t match_upto)
+{
+    size_t exact_len = strlen(uri_template);
+    bool asterisk = false;
+    bool quest = false;
+    while (exact_len > 0 &&
+           (uri_template[exact_len - 1] == '*' || uri_template[exact_len - 1] == '?'))
+    {
+        asterisk |= uri_template[exact_len - 1] == '*';
+        quest |= uri_template[exact_len - 1] == '?';
+        exact_len--;
+    }
+    // With '?' the character before it is optional
+    size_t required_len = (quest && exact_len > 0) ? exact_len - 1 : exact_len;
+    if (match_upto < required_len || strncmp(uri_template, uri_to_match, required_len) != 0) {
+        return false;
+    }
+    if (match_upto == required_len) {
+        return true;
+    }
+    if (required_len != exact_len) {
+        if (uri_to_match[required_len] != uri_template[required_len]) {
+            return asterisk;
+        }
+        required_len++;
+    }
+    return asterisk || match_upto == required_len;
+}
+
+int httpd_req_to_sockfd(httpd_req_t *r) {
+    if (r == NULL || r->aux == NULL) {
+        return -1;
+    }
+    return HTTPD_HOST_EXCHANGE(r)->sockfd;
+}
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len) {
+    if (r == NULL || r->aux == NULL || buf == NULL) {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    httpd_host_exchange_t *exchange = HTTPD_HOST_EXCHANGE(r);
+    size_t remaining = r->content_len - exchange->body_read;
+    if (buf_len > remaining) {
+        buf_len = remaining;
+    }
+    memcpy(buf, exchange->body + exchange->body_read, buf_len);
+    exchange->body_read += buf_len;
+    return (int)buf_len;
+}
+
+static const char *httpd_host_find_hdr(const httpd_host_hdr_t *hdrs,
+                                       size_t hdrs_len,
+                                       const char *field)
+{
+    for (size_t i = 0; i < hdrs_len; i++) {
+        if (strcasecmp(hdrs[i].field, field) == 0) {
+            return hdrs[i].value;
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t httpd_host_copy_trunc(const char *src,
+                                       size_t src_len,
+                                       char *dst,
+                                       size_t dst_size)
+{
+    if (dst_size == 0) {
+        return ESP_ERR_HTTPD_RESULT_TRUNC;
+    }
+    size_t copy_len = src_len < dst_size - 1 ? src_len : dst_size - 1;
+    memcpy(dst, src, copy_len);
+    dst[copy_len] = '\0';
+    return copy_len < src_len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field) {
+    if (r == NULL || r->aux == NULL || field == NULL) {
+        return 0;
+    }
+    httpd_host_exchange_t *exchange = HTTPD_HOST_EXCHANGE(r);
+    const char *value = httpd_host_find_hdr(exchange->req_hdrs, exchange->req_hdrs_len, field);
+    return value != NULL ? strlen(value) : 0;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r,
+                                      const char *field,
+                                      char *val,
+                                      size_t val_size)
+{
+    if (r == NULL || r->aux == NULL || field == NULL || val == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    httpd_host_exchange_t *exchange = HTTPD_HOST_EXCHANGE(r);
+    const char *value = httpd_host_find_hdr(exchange->req_hdrs, exchange->req_hdrs_len, field);
+    if (value == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return httpd_host_copy_trunc(value, strlen(value), val, val_size);
+}
+
+size_t httpd_req_get_url_query_len(httpd_req_t *r) {
+    if (r == NULL) {
+        return 0;
+    }
+    const char *query = strchr(r->uri, '?');
+    return query != NULL ? strcspn(query + 1, "#") : 0;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len) {
+    if (r == NULL || buf == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const char *query = strchr(r->uri, '?');
+    if (query == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return httpd_host_copy_trunc(query + 1, strcspn(query + 1, "#"), buf, buf_len);
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size) {
+    if (qry == NULL || key == NULL || val == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t key_len = strlen(key);
+    const char *it = qry;
+    while ((*it) != '\0') {
+        size_t pair_len = strcspn(it, "&");
+        const char *eq = memchr(it, '=', pair_len);
+        size_t this_key_len = eq != NULL ? (size_t)(eq - it) : pair_len;
+        if (this_key_len == key_len && strncmp(it, key, key_len) == 0) {
+            const char *value = eq != NULL ? eq + 1 : it + pair_len;
+            return httpd_host_copy_trunc(value, it + pair_len - value, val, val_size);
+        }
+        it += pair_len;
+        if ((*it) == '&') {
+            it++;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status) {
+    if (r == NULL || r->aux == NULL || status == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    httpd_host_exchange_t *exchange = HTTPD_HOST_EXCHANGE(r);
+    snprintf(exchange->status, sizeof(exchange->status), "%s", status);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type) {
+    if (r == NULL || r->aux == NULL || type == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    HTTPD_HOST_EXCHANGE(r)->type = type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value) {
+    if (r == NULL || r->aux == NULL || field == NULL || value == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    httpd_host_exchange_t *exchange = HTTPD_HOST_EXCHANGE(r);
+    if (exchange->resp_hdrs_sent) {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+    if (exchange->resp_hdrs_len == HTTPD_HOST_MAX_HDRS) {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+    exchange->resp_hdrs[exchange->resp_hdrs_len++] = (httpd_host_hdr_t){ field, value };
+    return ESP_OK;
+}
+
+// Copies the response header values into the exchange, the values truncated don't fit in it
+static void httpd_host_send_hdrs(httpd_host_exchange_t *exchange) {
+    if (exchange->resp_hdrs_sent) {
+        return;
+    }
+    size_t used = 0;
+    for (size_t i = 0; i < exchange->resp_hdrs_len; i++) {
+        const char *value = exchange->resp_hdrs[i].value;
+        size_t len = strnlen(value, sizeof(exchange->resp_hdrs_buf) - used - 1);
+        char *copy = exchange->resp_hdrs_buf + used;
+        memcpy(copy, value, len);
+        copy[len] = '\0';
+        exchange->resp_hdrs[i].value = copy;
+        used += len + (used + len + 1 < sizeof(exchange->resp_hdrs_buf) ? 1 : 0);
+    }
+    exchange->resp_hdrs_sent = true;
+}
+
+static void httpd_host_record_body(httpd_host_exchange_t *exchange,
+                                   const char *buf,
+                                   size_t buf_len)
+{
+    if (exchange->resp_buf != NULL && exchange->resp_len < exchange->resp_buf_size) {
+        size_t room = exchange->resp_buf_size - exchange->resp_len;
+        memcpy(exchange->resp_buf + exchange->resp_len, buf, buf_len < room ? buf_len : room);
+    }
+    exchange->resp_len += buf_len;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+    if (r == NULL || r->aux == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    httpd_host_exchange_t *exchange = HTTPD_HOST_EXCHANGE(r);
+    if (exchange->resp_sent) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    if (buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = buf != NULL ? (ssize_t)strlen(buf) : 0;
+    }
+    httpd_host_send_hdrs(exchange);
+    if (buf != NULL) {
+        httpd_host_record_body(exchange, buf, (size_t)buf_len);
+    }
+    exchange->resp_sent = true;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+    if (r == NULL || r->aux == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    httpd_host_exchange_t *exchange = HTTPD_HOST_EXCHANGE(r);
+    if (exchange->resp_sent) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    if (buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = buf != NULL ? (ssize_t)strlen(buf) : 0;
+    }
+    httpd_host_send_hdrs(exchange);
+    exchange->resp_chunked = true;
+    if (buf == NULL || buf_len == 0) {
+        exchange->resp_sent = true;
+        return ESP_OK;
+    }
+    httpd_host_record_body(exchange, buf, (size_t)buf_len);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *r, httpd_err_code_t error, const char *usr_msg) {
+    static const char *const statuses[HTTPD_ERR_CODE_MAX] = {
+        [HTTPD_500_INTERNAL_SERVER_ERROR] = "500 Internal Server Error",
+        [HTTPD_501_METHOD_NOT_IMPLEMENTED] = "501 Method Not Implemented",
+        [HTTPD_505_VERSION_NOT_SUPPORTED] = "505 Version Not Supported",
+        [HTTPD_400_BAD_REQUEST] = "400 Bad Request",
+        [HTTPD_401_UNAUTHORIZED] = "401 Unauthorized",
+        [HTTPD_403_FORBIDDEN] = "403 Forbidden",
+        [HTTPD_404_NOT_FOUND] = "404 Not Found",
+        [HTTPD_405_METHOD_NOT_ALLOWED] = "405 Method Not Allowed",
+        [HTTPD_408_REQ_TIMEOUT] = "408 Request Timeout",
+        [HTTPD_411_LENGTH_REQUIRED] = "411 Length Required",
+        [HTTPD_414_URI_TOO_LONG] = "414 URI Too Long",
+        [HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE] = "431 Request Header Fields Too Large",
+    };
+    if (r == NULL || r->aux == NULL || error >= HTTPD_ERR_CODE_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    httpd_resp_set_status(r, statuses[error]);
+    httpd_resp_set_type(r, HTTPD_TYPE_TEXT);
+    return httpd_resp_send(r, usr_msg != NULL ? usr_msg : statuses[error], HTTPD_RESP_USE_STRLEN);
+}
+
+esp_err_t httpd_req_async_handler_begin(httpd_req_t *r, httpd_req_t **out) {
+    if (r == NULL || out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    httpd_req_t *copy = malloc(sizeof(httpd_req_t));
+    if (copy == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(copy, r, sizeof(httpd_req_t));
+    pthread_mutex_lock(&httpd_host_async_lock);
+    HTTPD_HOST_EXCHANGE(r)->async_pending++;
+    pthread_mutex_unlock(&httpd_host_async_lock);
+    *out = copy;
+    return ESP_OK;
+}
+
+esp_err_t httpd_req_async_handler_complete(httpd_req_t *r) {
+    if (r == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&httpd_host_async_lock);
+    HTTPD_HOST_EXCHANGE(r)->async_pending--;
+    pthread_cond_broadcast(&httpd_host_async_done);
+    pthread_mutex_unlock(&httpd_host_async_lock);
+    free(r);
+    return ESP_OK;
+}
+
+esp_err_t httpd_host_exchange_init(httpd_host_exchange_t *exchange,
+                                   httpd_handle_t handle,
+                                   httpd_method_t method,
+                                   const char *uri)
+{
+    if (exchange == NULL || handle == NULL || uri == NULL || strlen(uri) > HTTPD_MAX_URI_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(exchange, 0, sizeof(httpd_host_exchange_t));
+    exchange->req.handle = handle;
+    exchange->req.method = method;
+    exchange->req.aux = exchange;
+    strcpy((char*)exchange->req.uri, uri);
+    snprintf(exchange->status, sizeof(exchange->status), "%s", HTTPD_200);
+    exchange->type = HTTPD_TYPE_TEXT;
+    return ESP_OK;
+}
+
+esp_err_t httpd_host_exchange_add_hdr(httpd_host_exchange_t *exchange,
+                                      const char *field,
+                                      const char *value)
+{
+    if (exchange == NULL || field == NULL || value == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (exchange->req_hdrs_len == HTTPD_HOST_MAX_HDRS) {
+        return ESP_ERR_NO_MEM;
+    }
+    exchange->req_hdrs[exchange->req_hdrs_len++] = (httpd_host_hdr_t){ field, value };
+    return ESP_OK;
+}
+
+esp_err_t httpd_host_exchange_set_body(httpd_host_exchange_t *exchange,
+                                       const char *body,
+                                       size_t body_len)
+{
+    if (exchange == NULL || (body == NULL && body_len != 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    exchange->body = body;
+    exchange->body_read = 0;
+    exchange->req.content_len = body_len;
+    return ESP_OK;
+}
+
+esp_err_t httpd_host_exchange_run(httpd_host_exchange_t *exchange) {
+    if (exchange == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    httpd_req_t *r = &exchange->req;
+    struct httpd_host_server *server = r->handle;
+    size_t uri_len = strcspn(r->uri, "?#");
+
+    httpd_err_code_t error = HTTPD_404_NOT_FOUND;
+    for (size_t i = 0; i < server->handlers_len; i++) {
+        const httpd_uri_t *uri = &server->handlers[i];
+        bool matched = server->config.uri_match_fn != NULL ?
+                       server->config.uri_match_fn(uri->uri, r->uri, uri_len) :
+                       (strlen(uri->uri) == uri_len && strncmp(uri->uri, r->uri, uri_len) == 0);
+        if (!matched) {
+            continue;
+        }
+        if ((int)uri->method != HTTP_ANY && (int)uri->method != r->method) {
+            error = HTTPD_405_METHOD_NOT_ALLOWED;
+            continue;
+        }
+        r->user_ctx = uri->user_ctx;
+        return uri->handler(r);
+    }
+    // Like the real server, the session is closed after a 404/405
+    httpd_resp_send_err(r, error, NULL);
+    return ESP_FAIL;
+}
+
+const char *httpd_host_exchange_resp_hdr(const httpd_host_exchange_t *exchange, const char *field) {
+    if (exchange == NULL || field == NULL) {
+        return NULL;
+    }
+    return httpd_host_find_hdr(exchange->resp_hdrs, exchange->resp_hdrs_len, field);
+}
+
+void httpd_host_exchange_wait(httpd_host_exchange_t *exchange) {
+    pthread_mutex_lock(&httpd_host_async_lock);
+    while (exchange->async_pending > 0) {
+        pthread_cond_wait(&httpd_host_async_done, &httpd_host_async_lock);
+    }
+    pthread_mutex_unlock(&httpd_host_async_lock);
+}
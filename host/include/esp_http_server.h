@@ -0,0 +1,282 @@
+/**
+ * ============== Host stand-in ===============
+ * Minimal subset of the ESP-IDF esp_http_server API, only for building and measuring esp_cchi on
+ * a Linux host. The types keep the layout of the real ones (httpd_req_t has its URI inline, the
+ * registered URIs are copied, etc.) and the URI handlers are looked up the same way the real
+ * server does it: calling .uri_match_fn once per registered handler, in registration order.
+ *
+ * There are no sockets, requests are fed with the httpd_host_* functions at the end of this file
+ * and the response is recorded in the same exchange
+*/
+#pragma once
+
+#include <esp_err.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ESP_ERR_HTTPD_BASE              (0xb000)
+#define ESP_ERR_HTTPD_HANDLERS_FULL     (ESP_ERR_HTTPD_BASE +  1)
+#define ESP_ERR_HTTPD_HANDLER_EXISTS    (ESP_ERR_HTTPD_BASE +  2)
+#define ESP_ERR_HTTPD_INVALID_REQ       (ESP_ERR_HTTPD_BASE +  3)
+#define ESP_ERR_HTTPD_RESULT_TRUNC      (ESP_ERR_HTTPD_BASE +  4)
+#define ESP_ERR_HTTPD_RESP_HDR          (ESP_ERR_HTTPD_BASE +  5)
+#define ESP_ERR_HTTPD_RESP_SEND         (ESP_ERR_HTTPD_BASE +  6)
+#define ESP_ERR_HTTPD_ALLOC_MEM         (ESP_ERR_HTTPD_BASE +  7)
+#define ESP_ERR_HTTPD_TASK              (ESP_ERR_HTTPD_BASE +  8)
+
+#define HTTPD_MAX_REQ_HDR_LEN CONFIG_HTTPD_MAX_REQ_HDR_LEN
+#define HTTPD_MAX_URI_LEN CONFIG_HTTPD_MAX_URI_LEN
+
+#define HTTPD_SOCK_ERR_FAIL      -1
+#define HTTPD_SOCK_ERR_INVALID   -2
+#define HTTPD_SOCK_ERR_TIMEOUT   -3
+
+#define HTTPD_200      "200 OK"
+#define HTTPD_204      "204 No Content"
+#define HTTPD_207      "207 Multi-Status"
+#define HTTPD_400      "400 Bad Request"
+#define HTTPD_404      "404 Not Found"
+#define HTTPD_408      "408 Request Timeout"
+#define HTTPD_500      "500 Internal Server Error"
+
+#define HTTPD_TYPE_JSON   "application/json"
+#define HTTPD_TYPE_TEXT   "text/html"
+#define HTTPD_TYPE_OCTET  "application/octet-stream"
+
+#define HTTPD_RESP_USE_STRLEN -1
+
+typedef enum http_method {
+    HTTP_DELETE = 0,
+    HTTP_GET,
+    HTTP_HEAD,
+    HTTP_POST,
+    HTTP_PUT,
+    HTTP_CONNECT,
+    HTTP_OPTIONS,
+    HTTP_TRACE,
+    HTTP_COPY,
+    HTTP_LOCK,
+    HTTP_MKCOL,
+    HTTP_MOVE,
+    HTTP_PROPFIND,
+    HTTP_PROPPATCH,
+    HTTP_SEARCH,
+    HTTP_UNLOCK,
+    HTTP_BIND,
+    HTTP_REBIND,
+    HTTP_UNBIND,
+    HTTP_ACL,
+    HTTP_REPORT,
+    HTTP_MKACTIVITY,
+    HTTP_CHECKOUT,
+    HTTP_MERGE,
+    HTTP_MSEARCH,
+    HTTP_NOTIFY,
+    HTTP_SUBSCRIBE,
+    HTTP_UNSUBSCRIBE,
+    HTTP_PATCH,
+    HTTP_PURGE,
+    HTTP_MKCALENDAR,
+    HTTP_LINK,
+    HTTP_UNLINK,
+} httpd_method_t;
+
+// Method of a handler that matches requests of any method (ESP-IDF >= 5.0)
+#define HTTP_ANY -1
+
+const char *http_method_str(enum http_method m);
+
+typedef enum {
+    HTTPD_500_INTERNAL_SERVER_ERROR = 0,
+    HTTPD_501_METHOD_NOT_IMPLEMENTED,
+    HTTPD_505_VERSION_NOT_SUPPORTED,
+    HTTPD_400_BAD_REQUEST,
+    HTTPD_401_UNAUTHORIZED,
+    HTTPD_403_FORBIDDEN,
+    HTTPD_404_NOT_FOUND,
+    HTTPD_405_METHOD_NOT_ALLOWED,
+    HTTPD_408_REQ_TIMEOUT,
+    HTTPD_411_LENGTH_REQUIRED,
+    HTTPD_414_URI_TOO_LONG,
+    HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE,
+    HTTPD_ERR_CODE_MAX
+} httpd_err_code_t;
+
+typedef void *httpd_handle_t;
+typedef void (*httpd_free_ctx_fn_t)(void *ctx);
+typedef bool (*httpd_uri_match_func_t)(const char *reference_uri,
+                                       const char *uri_to_match,
+                                       size_t match_upto);
+
+typedef struct httpd_config {
+    unsigned task_priority;
+    size_t stack_size;
+    uint16_t server_port;
+    uint16_t max_open_sockets;
+    uint16_t max_uri_handlers;
+    uint16_t max_resp_headers;
+    void *global_user_ctx;
+    httpd_free_ctx_fn_t global_user_ctx_free_fn;
+    httpd_uri_match_func_t uri_match_fn;
+} httpd_config_t;
+
+#define HTTPD_DEFAULT_CONFIG() {                        \
+        .task_priority      = 5,                        \
+        .stack_size         = 4096,                     \
+        .server_port        = 80,                       \
+        .max_open_sockets   = 7,                        \
+        .max_uri_handlers   = 8,                        \
+        .max_resp_headers   = 8,                        \
+        .global_user_ctx = NULL,                        \
+        .global_user_ctx_free_fn = NULL,                \
+        .uri_match_fn = NULL                            \
+}
+
+typedef struct httpd_req {
+    httpd_handle_t handle;
+    int method;
+    const char uri[HTTPD_MAX_URI_LEN + 1];
+    size_t content_len;
+    void *aux;
+    void *user_ctx;
+    void *sess_ctx;
+    httpd_free_ctx_fn_t free_ctx;
+    bool ignore_sess_ctx_changes;
+} httpd_req_t;
+
+typedef struct httpd_uri {
+    const char *uri;
+    httpd_method_t method;
+    esp_err_t (*handler)(httpd_req_t *r);
+    void *user_ctx;
+} httpd_uri_t;
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config);
+esp_err_t httpd_stop(httpd_handle_t handle);
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler);
+esp_err_t httpd_unregister_uri_handler(httpd_handle_t handle,
+                                       const char *uri,
+                                       httpd_method_t method);
+esp_err_t httpd_unregister_uri(httpd_handle_t handle, const char *uri);
+
+bool httpd_uri_match_wildcard(const char *uri_template,
+                              const char *uri_to_match,
+                              size_t match_upto);
+
+int httpd_req_to_sockfd(httpd_req_t *r);
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len);
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field);
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r,
+                                      const char *field,
+                                      char *val,
+                                      size_t val_size);
+size_t httpd_req_get_url_query_len(httpd_req_t *r);
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len);
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size);
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status);
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type);
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value);
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len);
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len);
+esp_err_t httpd_resp_send_err(httpd_req_t *r, httpd_err_code_t error, const char *usr_msg);
+
+/**
+ * "out" is a heap copy of "r" that stays valid (and keeps the exchange open) until
+ * httpd_req_async_handler_complete, so it can be handled from another task
+*/
+esp_err_t httpd_req_async_handler_begin(httpd_req_t *r, httpd_req_t **out);
+esp_err_t httpd_req_async_handler_complete(httpd_req_t *r);
+
+static inline esp_err_t httpd_resp_sendstr(httpd_req_t *r, const char *str) {
+    return httpd_resp_send(r, str, (str == NULL) ? 0 : HTTPD_RESP_USE_STRLEN);
+}
+
+static inline esp_err_t httpd_resp_sendstr_chunk(httpd_req_t *r, const char *str) {
+    return httpd_resp_send_chunk(r, str, (str == NULL) ? 0 : HTTPD_RESP_USE_STRLEN);
+}
+
+/**
+ * ============== Host only ===============
+ * An exchange is a request fed to the server plus the response recorded by it. The request header
+ * values and the body are not copied, they must outlive the exchange. The response header values
+ * are copied when the headers are sent, as the real server only needs them until then
+*/
+
+#define HTTPD_HOST_MAX_HDRS     16
+#define HTTPD_HOST_HDRS_BUF_LEN 512
+
+typedef struct httpd_host_hdr {
+    const char *field;
+    const char *value;
+} httpd_host_hdr_t;
+
+typedef struct httpd_host_exchange {
+    httpd_req_t req;
+    int sockfd;
+    httpd_host_hdr_t req_hdrs[HTTPD_HOST_MAX_HDRS];
+    size_t req_hdrs_len;
+    const char *body;
+    size_t body_read;
+    char status[64];
+    const char *type;
+    httpd_host_hdr_t resp_hdrs[HTTPD_HOST_MAX_HDRS];
+    size_t resp_hdrs_len;
+    char resp_hdrs_buf[HTTPD_HOST_HDRS_BUF_LEN];
+    bool resp_hdrs_sent;
+    bool resp_sent;
+    bool resp_chunked;
+    size_t resp_len;
+    // Optional buffer where the response body is recorded (truncated to resp_buf_size)
+    char *resp_buf;
+    size_t resp_buf_size;
+    // Copies of the request made by httpd_req_async_handler_begin that are not completed
+    size_t async_pending;
+} httpd_host_exchange_t;
+
+/**
+ * Initializes "exchange" as a new request to "handle", .req.uri is a copy of "uri"
+*/
+esp_err_t httpd_host_exchange_init(httpd_host_exchange_t *exchange,
+                                   httpd_handle_t handle,
+                                   httpd_method_t method,
+                                   const char *uri);
+
+esp_err_t httpd_host_exchange_add_hdr(httpd_host_exchange_t *exchange,
+                                      const char *field,
+                                      const char *value);
+
+esp_err_t httpd_host_exchange_set_body(httpd_host_exchange_t *exchange,
+                                       const char *body,
+                                       size_t body_len);
+
+/**
+ * Looks up the URI handler of the request the same way the real server does and runs it, if no
+ * handler matches, the 404/405 error response is recorded
+ *
+ * @returns What the handler returned
+*/
+esp_err_t httpd_host_exchange_run(httpd_host_exchange_t *exchange);
+
+/**
+ * @returns Value of the response header "field", NULL if it was not set
+*/
+const char *httpd_host_exchange_resp_hdr(const httpd_host_exchange_t *exchange, const char *field);
+
+/**
+ * Waits until every async copy of the request is completed, the response is final after this
+*/
+void httpd_host_exchange_wait(httpd_host_exchange_t *exchange);
+
+#ifdef __cplusplus
+}
+#endif
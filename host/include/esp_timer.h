@@ -0,0 +1,19 @@
+/**
+ * ============== Host stand-in ===============
+*/
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @returns Microseconds of a monotonic clock
+*/
+int64_t esp_timer_get_time(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,31 @@
+/**
+ * ============== Host stand-in ===============
+ * Minimal subset of FreeRTOS, the tasks are threads and a tick is a millisecond
+*/
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+
+#define pdFALSE 0
+#define pdTRUE  1
+#define pdPASS  pdTRUE
+#define pdFAIL  pdFALSE
+
+#define errQUEUE_FULL  0
+#define errQUEUE_EMPTY 0
+
+#define portTICK_PERIOD_MS 1
+#define portMAX_DELAY      UINT32_MAX
+#define pdMS_TO_TICKS(ms)  ((TickType_t)(ms))
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct host_queue *QueueHandle_t;
+
+/**
+ * Fixed queue of "len" items of "item_size" bytes, copied in and out, NULL if it can't be allocated
+*/
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t item_size);
+
+/**
+ * Copies "item" to the back of the queue, waiting up to "ticks" for a free slot
+ *
+ * @returns pdPASS if it was queued, errQUEUE_FULL if the queue was still full
+*/
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks);
+
+/**
+ * Copies the front item of the queue to "item" and removes it, waiting up to "ticks" for one
+ *
+ * @returns pdPASS if an item was received, pdFAIL if the queue was still empty
+*/
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks);
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue);
+
+void vQueueDelete(QueueHandle_t queue);
+
+#ifdef __cplusplus
+}
+#endif
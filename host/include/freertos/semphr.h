@@ -0,0 +1,29 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct host_semaphore *SemaphoreHandle_t;
+
+/**
+ * Mutex backed by a pthread mutex, NULL if it can't be allocated
+*/
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+
+/**
+ * Only waiting forever (portMAX_DELAY) and not waiting (0) are supported
+ *
+ * @returns pdTRUE if the mutex was taken, pdFALSE otherwise
+*/
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks);
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore);
+
+#ifdef __cplusplus
+}
+#endif
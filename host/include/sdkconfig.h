@@ -0,0 +1,14 @@
+/**
+ * ============== Host stand-in ===============
+ * The host build has no menuconfig, every option of esp_cchi falls back to the default of its
+ * Kconfig entry. Options can be overridden with -D flags
+*/
+#pragma once
+
+#ifndef CONFIG_HTTPD_MAX_REQ_HDR_LEN
+#define CONFIG_HTTPD_MAX_REQ_HDR_LEN 512
+#endif
+
+#ifndef CONFIG_HTTPD_MAX_URI_LEN
+#define CONFIG_HTTPD_MAX_URI_LEN 512
+#endif
@@ -0,0 +1,102 @@
+/**
+ * ============== Request arena ===============
+ * Every request routed by esp_cchi (esp_cchi_setup_hd_uri, Router object, compiled tables) and
+ * every middleware chain built with esp_cchi_mw_build or esp_cchi_mw_build_static has a request
+ * arena: a fixed buffer of CONFIG_ESP_CCHI_REQ_ARENA_SIZE bytes where the middlewares and the
+ * final handler can allocate memory that lives until the request is finished. Allocating is a
+ * pointer bump and there is nothing to free, the whole arena is dropped when the request ends.
+ *
+ * The buffer lives in the stack of the task that handles the request (the httpd task), so the
+ * .stack_size of httpd_config_t must account for it. The middlewares and handlers of esp_cchi keep
+ * their larger buffers (Content-Type, body chunks, static files) in it as well, the ones that don't
+ * fit are taken from the heap (esp_cchi_arena_take), so the arena is the only large buffer of a
+ * request in the stack.
+ *
+ * Usage:
+ *
+ * static esp_err_t handle_echo(httpd_req_t *r) {
+ *     size_t len = httpd_req_get_hdr_value_len(r, "X-Echo");
+ *     char *echo = esp_cchi_arena_alloc(r, len + 1);
+ *     if (echo == NULL) {
+ *         return httpd_resp_send_err(r, HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE, NULL);
+ *     }
+ *     httpd_req_get_hdr_value_str(r, "X-Echo", echo, len + 1);
+ *     return httpd_resp_sendstr(r, echo);
+ * }
+*/
+#pragma once
+
+#include <esp_http_server.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @param r Pointer to httpd_req_t
+ *
+ * @returns Pointer to "size" bytes aligned for any type, valid until the request is finished.
+ *          NULL if the request has no arena or there is not enough space left in it
+*/
+void *esp_cchi_arena_alloc(httpd_req_t *r, size_t size);
+
+/**
+ * @param r Pointer to httpd_req_t
+ *
+ * @returns Bytes left in the arena of the request (before alignment), 0 if it has no arena
+*/
+size_t esp_cchi_arena_available(httpd_req_t *r);
+
+/**
+ * @param r Pointer to httpd_req_t
+ *
+ * @returns Whether the request has an arena in the current task
+*/
+bool esp_cchi_arena_is_active(httpd_req_t *r);
+
+/**
+ * Takes a scratch buffer of "size" bytes for the duration of a call, from the arena of "r" if it
+ * has room and from the heap otherwise, so the buffers that don't always fit in the arena are
+ * kept out of the stack of the httpd task. It must be given back with esp_cchi_arena_release
+ *
+ * @param r Pointer to httpd_req_t, can have no arena
+ *
+ * @returns Pointer to "size" bytes aligned for any type, NULL if there is no memory available
+*/
+void *esp_cchi_arena_take(httpd_req_t *r, size_t size);
+
+/**
+ * Gives back a buffer of esp_cchi_arena_take, "size" must be the one it was taken with. A heap
+ * buffer is freed, an arena buffer is returned to the arena if nothing was allocated after it
+*/
+void esp_cchi_arena_release(httpd_req_t *r, void *buf, size_t size);
+
+typedef void (*esp_cchi_arena_done_fn_t)(httpd_req_t *r, esp_err_t err, void *arg);
+
+/**
+ * Registers "fn" to be called when the arena of "r" is dropped, after the handler has returned
+ * ("err" is what it returned) and while the arena memory is still valid. The callbacks are called
+ * in the reverse order of registration
+ *
+ * @returns
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_ARG if "r" or "fn" are NULL
+ *  - ESP_ERR_INVALID_STATE if the request has no arena
+ *  - ESP_ERR_NO_MEM if there is not enough space left in the arena
+*/
+esp_err_t esp_cchi_arena_on_done(httpd_req_t *r, esp_cchi_arena_done_fn_t fn, void *arg);
+
+/**
+ * Calls "handler" with an arena for "r" and drops the arena when it returns. If "r" already has an
+ * arena, "handler" is called directly and the arena is kept. The dispatchers of esp_cchi and the
+ * middleware chains call this, it's only needed for handlers that are not called by them
+ *
+ * @returns What "handler" returned, ESP_ERR_INVALID_ARG if any of the arguments are NULL
+*/
+esp_err_t esp_cchi_arena_run(httpd_req_t *r, esp_err_t (*handler)(httpd_req_t *r));
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,109 @@
+/**
+ * ============== Worker pool ===============
+ * The httpd task handles one request at a time, so a slow handler (flash writes, a call to another
+ * service, crypto) stalls every other client. esp_cchi_async_submit hands the request to a pool of
+ * worker tasks with httpd_req_async_handler_begin and returns at once, the httpd task goes on with
+ * the next request while a worker runs the handler and sends the response. Only the routes that
+ * are wrapped are offloaded, every other route keeps running inline in the httpd task.
+ *
+ * The requests wait in a queue of .queue_len slots. When it's full the request is not queued,
+ * it's answered with 503 and a Retry-After header straight from the httpd task, so a burst never
+ * grows memory nor blocks the server.
+ *
+ * The handler runs with a request arena of the worker task, and the URI params, the route and the
+ * .user_ctx of the route are readable from it as usual (the middlewares of the route, if any,
+ * already ran in the httpd task). The metrics and the access log of an offloaded route measure the
+ * hand-off, not the handler.
+ *
+ * It needs ESP-IDF v5.1 or newer (httpd_req_async_handler_begin), and every queued or running
+ * request keeps its socket open, so .max_open_sockets of httpd_config_t must leave room for
+ * .workers + .queue_len of them besides the clients served inline. The routes must not be deleted
+ * while they have requests in the pool.
+ *
+ * Usage:
+ *
+ * static esp_err_t handle_upload(httpd_req_t *r);
+ *
+ * esp_cchi_async_handler(handle_upload_async, handle_upload)
+ *
+ * esp_cchi_async_config_t async_config = ESP_CCHI_ASYNC_DEFAULT_CONFIG();
+ * ESP_ERROR_CHECK(esp_cchi_async_start(&async_config));
+ * httpd_uri_t upload_uri = {
+ *     .uri = "/upload/{name}",
+ *     .method = HTTP_POST,
+ *     .handler = handle_upload_async,
+ * };
+ * esp_cchi_router_handle(router, &upload_uri);
+*/
+#pragma once
+
+#include <esp_http_server.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct esp_cchi_async_config {
+    size_t workers;
+    size_t queue_len;
+    unsigned task_priority;
+    size_t stack_size;
+    uint32_t retry_after_s;
+} esp_cchi_async_config_t;
+
+#define ESP_CCHI_ASYNC_DEFAULT_CONFIG() {                       \
+        .workers            = 2,                                \
+        .queue_len          = 4,                                \
+        .task_priority      = 5,                                \
+        .stack_size         = 4096,                             \
+        .retry_after_s      = 1,                                \
+}
+
+/**
+ * Starts the worker tasks and creates the queue, only one pool can be started. The workers
+ * should not have a higher priority than the httpd task
+ *
+ * @returns
+ *  - ESP_OK on success, the pool may have less workers than asked for if some of them could not
+ *    be created
+ *  - ESP_ERR_INVALID_ARG if "config" is NULL or .workers or .queue_len are 0
+ *  - ESP_ERR_INVALID_STATE if it was already started
+ *  - ESP_ERR_NO_MEM if the queue or the first worker could not be created
+*/
+esp_err_t esp_cchi_async_start(const esp_cchi_async_config_t *config);
+
+/**
+ * Queues "r" to be handled by "handler" in a worker task. If the queue is full, responds 503 with
+ * a Retry-After header instead. If the pool is not started, "handler" is called right away
+ *
+ * @returns
+ *  - ESP_OK if the request was queued
+ *  - What "handler" returned if it was called right away
+ *  - ESP_ERR_INVALID_ARG if "r" or "handler" are NULL
+ *  - Otherwise, what sending the 503 (or the 500 if the request could not be copied) returned
+*/
+esp_err_t esp_cchi_async_submit(httpd_req_t *r, esp_err_t (*handler)(httpd_req_t *r));
+
+/**
+ * @returns Number of requests answered with 503 because the queue was full
+*/
+uint32_t esp_cchi_async_rejected(void);
+
+/**
+ * Generates a handler named handler_fn_name that offloads the requests to the worker pool, where
+ * they are handled by "handler"
+ *
+ * Usage:
+ *
+ * esp_cchi_async_handler(handle_report_async, handle_report)
+*/
+#define esp_cchi_async_handler(handler_fn_name, handler)                                         \
+esp_err_t handler_fn_name(httpd_req_t *r) {                                                      \
+    return esp_cchi_async_submit(r, (handler));                                                  \
+}
+
+#ifdef __cplusplus
+}
+#endif
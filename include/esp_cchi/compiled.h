@@ -0,0 +1,165 @@
+/**
+ * ============== Compiled route tables ===============
+ * When the routes are known at build time, the route list can be compiled by the build system
+ * into a const route table (it stays in flash) with a matcher specialized for those routes: the
+ * literal routes are found by a generated switch on the URI length and on the characters that tell
+ * them apart, and the routes with URI params by a radix tree built at build time, the same kind
+ * of tree (and the same matcher) of the Router object, with the same precedence of
+ * esp_cchi_setup_hd_config and the regexps already compiled. Nothing is validated, compiled or
+ * allocated at runtime, attaching the table only registers the catch-all handlers.
+ *
+ * The handlers use esp_cchi_get_uri_param_view, esp_cchi_get_user_ctx and the rest of the URI
+ * param functions the same way they do with the Router object.
+ *
+ * Quick Usage:
+ *
+ * # routes.txt, one "<method> <pattern> <handler> [<user_ctx>]" per line, the "include" lines
+ * # are copied to the generated source
+ * include "handlers.h"
+ * GET     /health             handle_health
+ * GET     /users/{id:[0-9]+}  handle_user     &users_ctx
+ * POST    /users              handle_new_user
+ *
+ * # CMakeLists.txt of the component that owns the handlers
+ * idf_component_register(SRCS "main.c" "handlers.c"
+ *                        REQUIRES esp_http_server esp-cchi-router)
+ * esp_cchi_compile_routes(${COMPONENT_LIB} ROUTES "routes.txt" NAME app_routes)
+ *
+ * // main.c
+ * #include "app_routes.h"
+ *
+ * httpd_config_t hd_config = HTTPD_DEFAULT_CONFIG();
+ * esp_cchi_setup_hd_config(&hd_config);
+ * httpd_handle_t server = NULL;
+ * httpd_start(&server, &hd_config);
+ * esp_cchi_compiled_attach(&app_routes, server);
+ *
+ * An invalid pattern or regexp fails the build, pointing to the line of the route list
+*/
+#pragma once
+
+#include <esp_http_server.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ESP_CCHI_CONSTRAINT_MAX_ATOMS 8
+#define ESP_CCHI_CONSTRAINT_UNBOUNDED UINT16_MAX
+
+/**
+ * Compiled regexp of a URI param, a sequence of character classes (bitset of the 256 byte values)
+ * with repetition bounds. The layout is public only so the generated tables can be const, it's
+ * filled by the generator, not by hand
+*/
+typedef struct esp_cchi_atom {
+    uint32_t set[8];
+    uint16_t min;
+    uint16_t max;
+} esp_cchi_atom_t;
+
+typedef struct esp_cchi_constraint {
+    size_t atoms_len;
+    esp_cchi_atom_t atoms[ESP_CCHI_CONSTRAINT_MAX_ATOMS];
+} esp_cchi_constraint_t;
+
+/**
+ * Node of a radix tree of patterns, the Router object builds one at runtime and the generator
+ * emits one (const) for the routes with URI params of a table, both are walked by the same
+ * matcher. Static nodes have a literal "prefix" edge. Param nodes have the "name" of the param
+ * (pointing into a pattern, see esp_cchi_get_uri_param_at), its compiled regexp (NULL if it has
+ * none), the "tail" that follows the param in the pattern ('\0' if the param ends it), whether it's
+ * a "wildcard" and the shortest value it takes. The params of a node are sorted in specificity
+ * order: the ones with a regexp before the ones without it, all of them before the wildcards, and
+ * among those the ones followed by a literal character (in character order) before the ones that
+ * end the pattern.
+ *
+ * A node where a pattern ends has the "pattern" (with its regexps) and its "endpoint" (the routes
+ * of the Router object, the esp_cchi_compiled_group_t of a table), "patterns" is the number of
+ * those nodes in the subtree of the node, itself included
+*/
+typedef struct esp_cchi_tree_node {
+    const char *prefix;
+    size_t prefix_len;
+    const char *name;
+    const esp_cchi_constraint_t *constraint;
+    char tail;
+    bool wildcard;
+    size_t min_len;
+    const struct esp_cchi_tree_node *const *children;
+    size_t children_len;
+    const struct esp_cchi_tree_node *const *params;
+    size_t params_len;
+    size_t patterns;
+    const char *pattern;
+    const void *endpoint;
+} esp_cchi_tree_node_t;
+
+/**
+ * "metrics" points to the slot of the route in the metrics (see esp_cchi/metrics.h), the only
+ * mutable part of a table, resolved by esp_cchi_compiled_attach
+*/
+typedef struct esp_cchi_compiled_route {
+    httpd_method_t method;
+    esp_err_t (*handler)(httpd_req_t *r);
+    void *user_ctx;
+    struct esp_cchi_metrics_route **metrics;
+} esp_cchi_compiled_route_t;
+
+/**
+ * Routes that share a pattern, one per method. "pattern" has the regexps stripped ("{id}" instead
+ * of "{id:[0-9]+}"), they are already compiled in the nodes of the tree
+*/
+typedef struct esp_cchi_compiled_group {
+    const char *pattern;
+    const esp_cchi_compiled_route_t *routes;
+    size_t routes_len;
+} esp_cchi_compiled_group_t;
+
+/**
+ * "groups" has the "static_len" literal groups first and then the groups with URI params.
+ * "find_static" returns the index of the literal group equal to "path", -1 if there is none.
+ * "tree" is the root of the tree of the groups with URI params, its endpoints point into "groups".
+ * "methods" has the bit (1 << method) of every method used
+*/
+typedef struct esp_cchi_compiled_table {
+    const esp_cchi_compiled_group_t *groups;
+    size_t groups_len;
+    size_t static_len;
+    int (*find_static)(const char *path, size_t path_len);
+    const esp_cchi_tree_node_t *tree;
+    uint64_t methods;
+} esp_cchi_compiled_table_t;
+
+/**
+ * Registers in "server" the catch-all handler (ESP_CCHI_ROUTER_CATCH_ALL_URI) of the table, a
+ * single one with HTTP_ANY when esp_http_server supports it, otherwise one per method used by the
+ * table. The server must be configured with esp_cchi_setup_hd_config. A path that matches routes
+ * of other methods only is answered with 405 and an "Allow" header listing them
+ *
+ * @param table Pointer to a generated table, must not be NULL
+ * @param server Handle of a started server, must not be NULL
+ *
+ * @returns
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_ARG if any of the arguments are NULL
+ *  - Any error of httpd_register_uri_handler, the handlers registered before the failure are
+ *    unregistered
+*/
+esp_err_t esp_cchi_compiled_attach(const esp_cchi_compiled_table_t *table, httpd_handle_t server);
+
+/**
+ * Unregisters the catch-all handlers registered by esp_cchi_compiled_attach
+ *
+ * @returns
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_ARG if any of the arguments are NULL
+*/
+esp_err_t esp_cchi_compiled_detach(const esp_cchi_compiled_table_t *table, httpd_handle_t server);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,93 @@
+/**
+ * ============== Route metrics ===============
+ * With CONFIG_ESP_CCHI_METRICS enabled, every request routed by esp_cchi (esp_cchi_setup_hd_uri,
+ * Router object, compiled tables) is counted in the route (pattern and method) that handled it:
+ * hits, errors (the handler didn't return ESP_OK) and a histogram of the handler latency with
+ * fixed buckets, from 100us to 1s. The requests that the Router object or a compiled table
+ * answered with 404/405 are counted apart.
+ *
+ * The counters live in a static table of CONFIG_ESP_CCHI_METRICS_MAX_ROUTES routes and are
+ * updated with atomics, recording never takes a lock nor allocates. The slot of a route is looked
+ * up once, when the route is registered (the Router object when it's attached, the compiled tables
+ * when they are attached), and recording a request only updates its counters. The routes that
+ * don't fit in the table are not counted, only the number of dropped samples is.
+ *
+ * esp_cchi_metrics_handler exports everything in the Prometheus text format:
+ *
+ * httpd_uri_t metrics_uri = {
+ *     .uri = "/metrics",
+ *     .method = HTTP_GET,
+ *     .handler = esp_cchi_metrics_handler,
+ * };
+ *
+ * esp_cchi_requests_total{method="GET",route="/users/{id}"} 42
+ * esp_cchi_errors_total{method="GET",route="/users/{id}"} 1
+ * esp_cchi_request_duration_seconds_bucket{method="GET",route="/users/{id}",le="0.0001"} 40
+ * ...
+*/
+#pragma once
+
+#include <esp_http_server.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ESP_CCHI_METRICS_BUCKETS 14
+
+/**
+ * Entry of a route (pattern and method) in the table of the metrics
+*/
+typedef struct esp_cchi_metrics_route *esp_cchi_metrics_slot_t;
+
+/**
+ * Looks up the slot of "route" and "method", inserting it if it's not in the table. The pattern is
+ * copied whole into the heap the first time, so this is meant to be called when the route is
+ * registered, not for every request
+ *
+ * @returns The slot, NULL if the table is full or there is no memory for the copy of the pattern
+*/
+esp_cchi_metrics_slot_t esp_cchi_metrics_slot(const char *route, httpd_method_t method);
+
+/**
+ * Counts a request in "slot", the routers call it when CONFIG_ESP_CCHI_METRICS is enabled
+ *
+ * @param slot Slot of the route (esp_cchi_metrics_slot), NULL counts a dropped sample
+ * @param err What the handler returned, anything but ESP_OK counts as an error
+ * @param latency_us Time spent in the handler
+*/
+void esp_cchi_metrics_record_slot(esp_cchi_metrics_slot_t slot,
+                                  esp_err_t err,
+                                  uint32_t latency_us);
+
+/**
+ * Counts a request in the metrics of "route", looking its slot up first. It's public so handlers
+ * dispatched in other ways (e.g. from the after hooks of a middleware chain) can be counted too,
+ * handlers called often should keep the slot instead (esp_cchi_metrics_slot)
+ *
+ * @param route Pattern of the route, it's copied the first time, NULL counts a request that
+ *        matched no route
+ * @param method Method of the request
+ * @param err What the handler returned, anything but ESP_OK counts as an error
+ * @param latency_us Time spent in the handler
+ *
+ * @returns
+ *  - ESP_OK on success
+ *  - ESP_ERR_NO_MEM if the route doesn't fit in the table (or its pattern in the heap), the
+ *    sample is dropped
+*/
+esp_err_t esp_cchi_metrics_record(const char *route,
+                                  httpd_method_t method,
+                                  esp_err_t err,
+                                  uint32_t latency_us);
+
+/**
+ * Handler that responds with the metrics of every route in the Prometheus text format (version
+ * 0.0.4), sent in chunks from a small stack buffer
+*/
+esp_err_t esp_cchi_metrics_handler(httpd_req_t *r);
+
+#ifdef __cplusplus
+}
+#endif
@@ -6,17 +6,30 @@
 #define __ESP_CCHI_MIDDLEWARE_HEADER
 
 #include <esp_http_server.h>
+#include <esp_cchi/arena.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 /**
- * Type that represents a middleware group or middleware chain
+ * Returned by a middleware that already sent the whole response (e.g. from a cache): the chain
+ * stops as with an error, the after hooks see this code, but ESP_OK is returned to esp_http_server
+ * so the connection is kept open
+*/
+#define ESP_CCHI_MW_RESPONDED 0x10CC41
+
+/**
+ * Type that represents a middleware group or middleware chain, the array grows by doubling its
+ * capacity, so adding N middlewares takes O(log N) allocations
 */
 typedef struct esp_cchi_mw_group {
     esp_err_t (**__mw_array)(httpd_req_t *);
     size_t __mw_array_len;
+    size_t __mw_array_cap;
+    void (**__after_array)(httpd_req_t *, esp_err_t);
+    size_t __after_array_len;
+    size_t __after_array_cap;
 } esp_cchi_mw_group_t;
 
 /**
@@ -50,6 +63,24 @@ esp_err_t esp_cchi_mw_delete_group(esp_cchi_mw_group_t *mw_group);
 */
 esp_err_t esp_cchi_mw_use(esp_cchi_mw_group_t *mw_group, esp_err_t (*middleware)(httpd_req_t *));
 
+/**
+ * Adds a hook that runs after the chain: once the final handler returns, or once a middleware
+ * stops the chain, the hooks are called in the reverse order they were added, with what the chain
+ * is going to return (they can't change it). Together with a middleware that runs first, they
+ * wrap the handler, e.g. for timing it
+ *
+ * @param mw_group Pointer to middleware group type, must not be NULL
+ * @param hook Pointer to the hook function, must not be NULL
+ *
+ * @returns
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_ARG if some of the arguments are NULL
+ *  - ESP_ERR_NO_MEM if there is no memory available to allocate the hook (the middleware group
+ *    will not be modified nor freed up)
+*/
+esp_err_t esp_cchi_mw_use_after(esp_cchi_mw_group_t *mw_group,
+                                void (*hook)(httpd_req_t *, esp_err_t));
+
 /**
  * @param handler_fn_name Unique name which you gonna call the function that is going to be created
  * @param mw_group Pointer to scoped middleware group type
@@ -60,18 +91,95 @@ esp_err_t esp_cchi_mw_use(esp_cchi_mw_group_t *mw_group, esp_err_t (*middleware)
  * 
  * @note if you want the generated function to be static, you need to add "static" just before
  *       calling this macro
+ *
+ * @note The middlewares and the final handler share the request arena (see esp_cchi/arena.h), if
+ *       the request doesn't have one yet, the chain creates it
 */
 #define esp_cchi_mw_build(handler_fn_name, mw_group, final_handler)                              \
 esp_err_t handler_fn_name(httpd_req_t *r) {                                                      \
-    esp_err_t err;                                                                               \
-    for (size_t i = 0; i < (mw_group)->__mw_array_len; i++) {                                    \
-        if (err = (mw_group)->__mw_array[i](r)) {                                                \
-            return err;                                                                          \
+    if (!esp_cchi_arena_is_active(r)) {                                                          \
+        return esp_cchi_arena_run(r, handler_fn_name);                                           \
+    }                                                                                            \
+    esp_err_t err = ESP_OK;                                                                      \
+    size_t i = 0;                                                                                \
+    for (; i < (mw_group)->__mw_array_len; i++) {                                                \
+        if ((err = (mw_group)->__mw_array[i](r)) != ESP_OK) {                                    \
+            break;                                                                               \
         }                                                                                        \
     }                                                                                            \
+    if (i == (mw_group)->__mw_array_len) {                                                       \
+        err = (final_handler)(r);                                                                \
+    }                                                                                            \
+    for (i = (mw_group)->__after_array_len; i > 0; i--) {                                        \
+        (mw_group)->__after_array[i - 1](r, err);                                                \
+    }                                                                                            \
+    return err == ESP_CCHI_MW_RESPONDED ? ESP_OK : err;                                          \
+}
+
+/**
+ * Same as esp_cchi_mw_build, but the middlewares are listed at compile time instead of being added
+ * to a middleware group, so the chain needs no heap and no middleware group, and the generated
+ * function calls every middleware directly (they can be inlined), in the order they are listed.
+ * As in esp_cchi_mw_build, the first middleware that doesn't return ESP_OK stops the chain and its
+ * error is returned (ESP_OK for ESP_CCHI_MW_RESPONDED)
+ *
+ * Usage:
+ *
+ * esp_cchi_mw_build_static(handle_users_chain, handle_users, middlewares_logger, check_auth);
+ *
+ * @param handler_fn_name Unique name which you gonna call the function that is going to be created
+ * @param final_handler Pointer to function handler that is going to act as the final handler of
+ *        the middleware chain
+ * @param ... From 1 to 16 middlewares, same type as .handler struct member of httpd_uri_t type
+ *
+ * @returns Function that must be in global scope
+ *
+ * @note if you want the generated function to be static, you need to add "static" just before
+ *       calling this macro
+ *
+ * @note Static chains have no after hooks, a middleware can run code after the final handler
+ *       with esp_cchi_arena_on_done
+*/
+#define esp_cchi_mw_build_static(handler_fn_name, final_handler, ...)                            \
+esp_err_t handler_fn_name(httpd_req_t *r) {                                                      \
+    if (!esp_cchi_arena_is_active(r)) {                                                          \
+        return esp_cchi_arena_run(r, handler_fn_name);                                           \
+    }                                                                                            \
+    esp_err_t err;                                                                               \
+    __ESP_CCHI_MW_FOR_EACH(__ESP_CCHI_MW_CALL, __VA_ARGS__)                                       \
     return (final_handler)(r);                                                                   \
 }
 
+#define __ESP_CCHI_MW_CALL(middleware)                                                           \
+    if ((err = (middleware)(r)) != ESP_OK) {                                                     \
+        return err == ESP_CCHI_MW_RESPONDED ? ESP_OK : err;                                      \
+    }
+
+#define __ESP_CCHI_MW_CAT(a, b) __ESP_CCHI_MW_CAT_(a, b)
+#define __ESP_CCHI_MW_CAT_(a, b) a##b
+#define __ESP_CCHI_MW_NARGS(...)                                                                 \
+    __ESP_CCHI_MW_NARGS_(__VA_ARGS__, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define __ESP_CCHI_MW_NARGS_(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15,    \
+                             _16, n, ...) n
+#define __ESP_CCHI_MW_FOR_EACH(m, ...)                                                           \
+    __ESP_CCHI_MW_CAT(__ESP_CCHI_MW_FOR_EACH_, __ESP_CCHI_MW_NARGS(__VA_ARGS__))(m, __VA_ARGS__)
+#define __ESP_CCHI_MW_FOR_EACH_1(m, x) m(x)
+#define __ESP_CCHI_MW_FOR_EACH_2(m, x, ...) m(x) __ESP_CCHI_MW_FOR_EACH_1(m, __VA_ARGS__)
+#define __ESP_CCHI_MW_FOR_EACH_3(m, x, ...) m(x) __ESP_CCHI_MW_FOR_EACH_2(m, __VA_ARGS__)
+#define __ESP_CCHI_MW_FOR_EACH_4(m, x, ...) m(x) __ESP_CCHI_MW_FOR_EACH_3(m, __VA_ARGS__)
+#define __ESP_CCHI_MW_FOR_EACH_5(m, x, ...) m(x) __ESP_CCHI_MW_FOR_EACH_4(m, __VA_ARGS__)
+#define __ESP_CCHI_MW_FOR_EACH_6(m, x, ...) m(x) __ESP_CCHI_MW_FOR_EACH_5(m, __VA_ARGS__)
+#define __ESP_CCHI_MW_FOR_EACH_7(m, x, ...) m(x) __ESP_CCHI_MW_FOR_EACH_6(m, __VA_ARGS__)
+#define __ESP_CCHI_MW_FOR_EACH_8(m, x, ...) m(x) __ESP_CCHI_MW_FOR_EACH_7(m, __VA_ARGS__)
+#define __ESP_CCHI_MW_FOR_EACH_9(m, x, ...) m(x) __ESP_CCHI_MW_FOR_EACH_8(m, __VA_ARGS__)
+#define __ESP_CCHI_MW_FOR_EACH_10(m, x, ...) m(x) __ESP_CCHI_MW_FOR_EACH_9(m, __VA_ARGS__)
+#define __ESP_CCHI_MW_FOR_EACH_11(m, x, ...) m(x) __ESP_CCHI_MW_FOR_EACH_10(m, __VA_ARGS__)
+#define __ESP_CCHI_MW_FOR_EACH_12(m, x, ...) m(x) __ESP_CCHI_MW_FOR_EACH_11(m, __VA_ARGS__)
+#define __ESP_CCHI_MW_FOR_EACH_13(m, x, ...) m(x) __ESP_CCHI_MW_FOR_EACH_12(m, __VA_ARGS__)
+#define __ESP_CCHI_MW_FOR_EACH_14(m, x, ...) m(x) __ESP_CCHI_MW_FOR_EACH_13(m, __VA_ARGS__)
+#define __ESP_CCHI_MW_FOR_EACH_15(m, x, ...) m(x) __ESP_CCHI_MW_FOR_EACH_14(m, __VA_ARGS__)
+#define __ESP_CCHI_MW_FOR_EACH_16(m, x, ...) m(x) __ESP_CCHI_MW_FOR_EACH_15(m, __VA_ARGS__)
+
 #ifdef __cplusplus
 }
 #endif
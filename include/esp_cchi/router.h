@@ -9,30 +9,22 @@
  * 
  * static esp_err_t handle_ping(httpd_req_t *r) {
  * 
- *     // esp_cchi_get_uri_param_len is the function for extracting the URI param length from the
- *     // request, this will return the param_len, not counting the NUL character that ends it
- *     size_t param_len = esp_cchi_get_uri_param_len(r, "my_param");
- *     if (param_len == 0) {
+ *     // esp_cchi_get_uri_param_view is the function for extracting the URI param from the
+ *     // request, the view points into r->uri so nothing is copied, keep in mind that the value is
+ *     // NOT NUL terminated, always use view.len
+ *     esp_cchi_view_t my_param;
+ *     if (esp_cchi_get_uri_param_view(r, "my_param", &my_param) != ESP_OK) {
  *         return ESP_FAIL;
  *     }
- *     char param_content[param_len + 1];
- *     size_t bytes_written = 0;
  * 
- *     if (esp_cchi_get_uri_param(r, "my_param", param_content, param_len, &bytes_written) != ESP_OK) {
- *         return ESP_FAIL;
- *     }
- * 
- *     // Most likely bytes_written and param_len will be the same value if you use the
- *     // esp_cchi_get_uri_param_len function, but if you don't, you will prefer using the
- *     // bytes_written value as a best practice to find the end of the string and add the NUL char
- *     // yourself
- *     param_content[bytes_written] = '\0';
- * 
- *     printf("my_param = %s\n", param_content);
+ *     printf("my_param = %.*s\n", (int)my_param.len, my_param.data);
  * 
- *     return httpd_resp_send(r, param_content, bytes_written);
+ *     return httpd_resp_send(r, my_param.data, my_param.len);
  * }
  * 
+ * // If you need a NUL terminated copy, esp_cchi_get_uri_param_len and esp_cchi_get_uri_param
+ * // copy the URI param into your own buffer
+ * 
  * static httpd_uri_t ping_uri = {
  *     .uri = "/{my_param}",
  *     .method = HTTPD_GET,
@@ -78,6 +70,8 @@
 
 #include <esp_http_server.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -97,11 +91,40 @@ extern "C" {
  * If no regular expression is specified, this will mean that is going to match anything except for
  * empty string
  *
+ * The regular expression must match the whole value of "uri_param", it's compiled once by
+ * esp_cchi_setup_hd_uri and it supports a small subset of the syntax: literal characters, ".",
+ * escapes ("\d", "\w", "\s" and their negations), character classes ("[a-f0-9]", "[^-]") and the
+ * quantifiers "*", "+", "?", "{n}", "{n,}" and "{n,m}", e.g. "/users/{id:[0-9]+}". Groups and
+ * alternations are not supported. If the value doesn't match, the route is discarded and the next
+ * one is tried, so "/users/{id:[0-9]+}" and "/users/{name}" can live together
+ *
+ * When several routes set up with esp_cchi_setup_hd_uri match the same URI, the most specific one
+ * handles it, no matter the order they were registered in: a literal route ("/users/me") beats the
+ * routes with URI params, and among those, walking the pattern from the left, a literal character
+ * beats a URI param, a URI param beats a wildcard and a URI param (or wildcard) with a regular
+ * expression beats one without it. Routes that
+ * were not set up (like ESP_CCHI_ROUTER_CATCH_ALL_URI) only match if none of the set up routes
+ * does. The literal routes are found with a hash lookup of the URI.
+ *
+ * The precedence only looks at the URI, if "/users/me" is set up for POST only, a GET request to
+ * "/users/me" gets a 405 response even if "/users/{id}" is set up for GET
+ *
  * The URI param will match until next characters matches or if there is no more characters, will
  * match until next forward slash, as an example "/{my_param}-foo"; the URIs that matches with this
  * pattern could be "/hello-foo", "/hello-world-foo", etc. but this will not match "/-foo",
  * "/hello-foo/bar", etc.
  *
+ * A URI param whose name ends with "..." is a wildcard, its value can cross forward slashes, so
+ * "/files/{path...}/meta" matches "/files/a/b/meta" with "path" being "a/b" (the longest value is
+ * tried first). It's retrieved by its name without the dots and it can have a regular expression
+ * too ("{path...:[a-z/]+}"). A "*" that ends the pattern right after a forward slash is a wildcard
+ * named "*" that also matches an empty value: "/static/" "*" matches "/static/" and every URI under
+ * it, but not "/static"
+ *
+ * The matcher also treats ESP_CCHI_ROUTER_CATCH_ALL_URI ("*") as a pattern that matches any URI,
+ * that's the URI used by the Router object for its catch-all handlers. It's not a valid pattern,
+ * so it can't clash with a route set up as "/" "*"
+ *
  * @param hd_cfg Pointer to a httpd_config_t, must not be NULL
  *
  * @returns
@@ -114,15 +137,56 @@ esp_err_t esp_cchi_setup_hd_config(httpd_config_t *hd_cfg);
  * Function that sets the .user_ctx member of uri to a data structure that holds all of the URI
  * params
  *
+ * If .handler is set, it's replaced by a function that captures all of the URI params in one pass
+ * before calling your handler (and runs it in the request arena, timing it if
+ * CONFIG_ESP_CCHI_METRICS is enabled), esp_cchi_delete_hd_uri puts it back. If .handler is NULL,
+ * it's left alone and can be set afterwards, as it always could: the handler then receives the
+ * data structure as .user_ctx and the URI params are captured on every lookup. Either way the
+ * original .user_ctx can be retrieved in the handler with esp_cchi_get_user_ctx
+ *
+ * Every route set up takes part in the precedence described in esp_cchi_setup_hd_config, so only
+ * set up the routes that are registered in the server, and call esp_cchi_delete_hd_uri on the ones
+ * that are unregistered
+ *
+ * The routes set up are kept in a registry shared by every server, which the matcher reads while
+ * it handles requests. The registry has no lock: set up and delete the routes while no server
+ * configured with esp_cchi_setup_hd_config can be handling a request (before httpd_start or after
+ * httpd_stop), or from a handler when there is a single server, since it runs them in its task
+ *
  * @param uri Pointer to a httpd_uri_t, must not be NULL
  *
  * @returns
  *  - ESP_OK on success
- *  - ESP_ERR_INVALID_ARG if "uri" is NULL
+ *  - ESP_ERR_INVALID_ARG if "uri" is NULL, .uri is not a valid pattern (or has more than
+ *    CONFIG_ESP_CCHI_MAX_URI_PARAMS params, or a regular expression that can't be compiled) or
+ *    "uri" is already set up
+ *  - ESP_ERR_NO_MEM if there is no memory available
 */
 esp_err_t esp_cchi_setup_hd_uri(httpd_uri_t *hd_uri);
 
 /**
+ * Same as calling esp_cchi_setup_hd_uri on every element of "hd_uris", but the contexts of all of
+ * them (and their compiled regexps) are placed in a single allocation, so setting up N routes
+ * takes one allocation instead of N. The allocation is freed when the last of the routes is
+ * deleted with esp_cchi_delete_hd_uri. Nothing is set up if any of the routes is invalid
+ *
+ * @param hd_uris Array of httpd_uri_t, must not be NULL
+ * @param len Number of elements of "hd_uris", must not be 0
+ *
+ * @returns
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_ARG if "hd_uris" is NULL, "len" is 0 or any of the routes would be rejected
+ *    by esp_cchi_setup_hd_uri
+ *  - ESP_ERR_NO_MEM if there is no memory available
+*/
+esp_err_t esp_cchi_setup_hd_uris(httpd_uri_t *hd_uris, size_t len);
+
+/**
+ * Frees the data structure set up by esp_cchi_setup_hd_uri and restores the original .handler (if
+ * it was replaced). The routes set up together by esp_cchi_setup_hd_uris share their memory, it's
+ * freed with the last one. Like setting up, it changes the registry shared by every server (see
+ * esp_cchi_setup_hd_uri)
+ *
  * @param hd_uri Pointer to httpd_uri_t, must not be NULL
  * @param no_dangling_ctx Boolean value that indicates if the .user_ctx struct member will be set
  * to NULL or not. "true" sets .user_ctx to NULL, "false" doesn't
@@ -163,6 +227,450 @@ esp_err_t esp_cchi_get_uri_param(httpd_req_t *r,
 */
 size_t esp_cchi_get_uri_param_len(httpd_req_t *r, const char *uri_param);
 
+/**
+ * Read-only view of a string that lives somewhere else, it's NOT NUL terminated
+*/
+typedef struct esp_cchi_view {
+    const char *data;
+    size_t len;
+} esp_cchi_view_t;
+
+/**
+ * @returns Whether the view has the same content as the NUL terminated string "str"
+*/
+static inline bool esp_cchi_view_eq(esp_cchi_view_t view, const char *str) {
+    // Walked byte by byte, the view may have a NUL (a decoded "%00") before "str" ends
+    size_t i = 0;
+    for (; i < view.len; i++) {
+        if (str[i] == '\0' || view.data[i] != str[i]) {
+            return false;
+        }
+    }
+    return str[i] == '\0';
+}
+
+/**
+ * Zero-copy version of esp_cchi_get_uri_param, "view" points into r->uri, so it's valid as long as
+ * the request is
+ *
+ * @param[in] r Pointer to httpd_req_t, the request must have been routed by esp_cchi
+ * @param[in] uri_param Pointer to null terminated string that contains the name of the URI param
+ * @param[out] view Pointer to esp_cchi_view_t, must not be NULL
+ *
+ * @returns
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_ARG if any of the arguments are NULL or are invalid
+ *  - ESP_ERR_NOT_FOUND if the URI param doesn't exists
+*/
+esp_err_t esp_cchi_get_uri_param_view(httpd_req_t *r, const char *uri_param, esp_cchi_view_t *view);
+
+/**
+ * ============== Typed URI params ===============
+ * Parse the URI param in place (from r->uri, without copying it) into a number, a bool or one of
+ * the values of an enum table. The whole value must be valid, there is no whitespace skipping and
+ * no partial parsing like strtol does.
+ *
+ * All of them return:
+ *  - ESP_OK on success, "value" is written only in this case
+ *  - ESP_ERR_INVALID_ARG if any of the arguments are NULL or are invalid
+ *  - ESP_ERR_NOT_FOUND if the URI param doesn't exists
+ *  - ESP_FAIL if the URI param is malformed (empty, unexpected character, not in the enum table)
+ *  - ESP_ERR_INVALID_SIZE if the URI param is well formed but doesn't fit in the type (overflow)
+ *
+ * The esp_cchi_view_to_* functions do the same over any view, with the same return values (except
+ * ESP_ERR_NOT_FOUND)
+*/
+
+/**
+ * Entry of an enum table, maps the text of the URI param to "value"
+*/
+typedef struct esp_cchi_enum_entry {
+    const char *name;
+    int value;
+} esp_cchi_enum_entry_t;
+
+/**
+ * Decimal digits only, from 0 to UINT32_MAX
+*/
+esp_err_t esp_cchi_view_to_u32(esp_cchi_view_t view, uint32_t *value);
+
+/**
+ * Optional '+' or '-' followed by decimal digits, from INT64_MIN to INT64_MAX
+*/
+esp_err_t esp_cchi_view_to_i64(esp_cchi_view_t view, int64_t *value);
+
+/**
+ * Hexadecimal digits only (either case, no "0x" prefix), from 0 to UINT64_MAX
+*/
+esp_err_t esp_cchi_view_to_hex(esp_cchi_view_t view, uint64_t *value);
+
+/**
+ * "1", "true", "0" or "false", the words are case insensitive
+*/
+esp_err_t esp_cchi_view_to_bool(esp_cchi_view_t view, bool *value);
+
+/**
+ * Exact (case sensitive) match against the names of "table", "value" is the value of the entry
+*/
+esp_err_t esp_cchi_view_to_enum(esp_cchi_view_t view,
+                                const esp_cchi_enum_entry_t *table,
+                                size_t table_len,
+                                int *value);
+
+esp_err_t esp_cchi_get_uri_param_u32(httpd_req_t *r, const char *uri_param, uint32_t *value);
+
+esp_err_t esp_cchi_get_uri_param_i64(httpd_req_t *r, const char *uri_param, int64_t *value);
+
+esp_err_t esp_cchi_get_uri_param_hex(httpd_req_t *r, const char *uri_param, uint64_t *value);
+
+esp_err_t esp_cchi_get_uri_param_bool(httpd_req_t *r, const char *uri_param, bool *value);
+
+esp_err_t esp_cchi_get_uri_param_enum(httpd_req_t *r,
+                                      const char *uri_param,
+                                      const esp_cchi_enum_entry_t *table,
+                                      size_t table_len,
+                                      int *value);
+
+/**
+ * ============== URI param captures ===============
+ * The URI params of a request are captured once while the request is matched, the following
+ * functions read that capture table, so every lookup is O(1) by index or a short name compare
+ * instead of walking the URI again
+*/
+
+/**
+ * Captured URI param, "name" points into the route pattern and is not NUL terminated, the value is
+ * the "len" bytes that start at r->uri + "offset"
+*/
+typedef struct esp_cchi_uri_param {
+    const char *name;
+    size_t name_len;
+    size_t offset;
+    size_t len;
+} esp_cchi_uri_param_t;
+
+/**
+ * @param r Pointer to httpd_req_t, the request must have been routed by esp_cchi
+ *
+ * @returns Number of URI params captured, 0 if "r" is invalid
+*/
+size_t esp_cchi_get_uri_param_count(httpd_req_t *r);
+
+/**
+ * @param[in] r Pointer to httpd_req_t, the request must have been routed by esp_cchi
+ * @param[in] index Index of the param, in the same order they appear in the pattern
+ * @param[out] param Pointer to esp_cchi_uri_param_t, must not be NULL
+ *
+ * @returns
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_ARG if any of the arguments are NULL or are invalid
+ *  - ESP_ERR_NOT_FOUND if "index" is out of range
+*/
+esp_err_t esp_cchi_get_uri_param_at(httpd_req_t *r, size_t index, esp_cchi_uri_param_t *param);
+
+/**
+ * @param[in] r Pointer to httpd_req_t, the request must have been routed by esp_cchi
+ * @param[in] uri_param Pointer to null terminated string that contains the name of the URI param
+ * @param[out] param Pointer to esp_cchi_uri_param_t, must not be NULL
+ *
+ * @returns
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_ARG if any of the arguments are NULL or are invalid
+ *  - ESP_ERR_NOT_FOUND if the URI param doesn't exists
+*/
+esp_err_t esp_cchi_find_uri_param(httpd_req_t *r,
+                                  const char *uri_param,
+                                  esp_cchi_uri_param_t *param);
+
+/**
+ * @param r Pointer to httpd_req_t, the request must have been routed by esp_cchi
+ *
+ * @returns The .user_ctx member of the httpd_uri_t that handled the request, NULL if "r" is
+ * invalid
+ *
+ * @note esp_cchi uses the .user_ctx member of the request for its own data, so this is the way of
+ *       retrieving yours
+*/
+void *esp_cchi_get_user_ctx(httpd_req_t *r);
+
+/**
+ * @param r Pointer to httpd_req_t
+ *
+ * @returns Pattern of the route that is handling the request (with the regexps stripped for
+ * compiled tables), NULL if the request was not routed by esp_cchi. It's valid while the route is
+ * registered
+*/
+const char *esp_cchi_get_route_pattern(httpd_req_t *r);
+
+/**
+ * ============== Query string ===============
+ * The query string of a routed request is indexed the first time any of these functions is
+ * called: it's copied into the request arena (see esp_cchi/arena.h) while it's percent-decoded
+ * ("%XX" escapes and '+' as space) and the offsets of every key and value are recorded, so reading
+ * N keys scans the query string once instead of N times like httpd_query_key_value does. The views
+ * point into the arena, they are valid until the request is finished.
+ *
+ * Keys are compared after decoding and are case sensitive, if a key appears several times the
+ * first one is found (esp_cchi_get_query_param_at reaches the rest). A key without "=" has an empty
+ * value.
+ *
+ * Besides the return values of their URI param counterparts, they return ESP_ERR_NO_MEM if the
+ * index doesn't fit in the request arena, and ESP_ERR_INVALID_ARG if the request was not routed by
+ * esp_cchi (the handler was called directly or by a middleware chain without a router)
+*/
+
+/**
+ * Item of the query string, both views are decoded and NOT NUL terminated
+*/
+typedef struct esp_cchi_query_param {
+    esp_cchi_view_t key;
+    esp_cchi_view_t value;
+} esp_cchi_query_param_t;
+
+/**
+ * Query string version of esp_cchi_get_uri_param, the value is copied decoded
+*/
+esp_err_t esp_cchi_get_query_param(httpd_req_t *r,
+                                   const char *key,
+                                   char *buf,
+                                   size_t buf_len,
+                                   size_t *bytes_written);
+
+/**
+ * @returns Length of the decoded value of "key", 0 if it doesn't exist or the request is invalid
+*/
+size_t esp_cchi_get_query_param_len(httpd_req_t *r, const char *key);
+
+/**
+ * Zero-copy version of esp_cchi_get_query_param, "view" points into the request arena
+ *
+ * @returns
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_ARG if any of the arguments are NULL or are invalid
+ *  - ESP_ERR_NOT_FOUND if the key doesn't exist
+ *  - ESP_ERR_NO_MEM if the index doesn't fit in the request arena
+*/
+esp_err_t esp_cchi_get_query_param_view(httpd_req_t *r, const char *key, esp_cchi_view_t *view);
+
+/**
+ * @returns Number of items of the query string, 0 if the request is invalid
+*/
+size_t esp_cchi_get_query_param_count(httpd_req_t *r);
+
+/**
+ * @param index Index of the item, in the order they appear in the query string
+ *
+ * @returns
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_ARG if any of the arguments are NULL or are invalid
+ *  - ESP_ERR_NOT_FOUND if "index" is out of range
+ *  - ESP_ERR_NO_MEM if the index doesn't fit in the request arena
+*/
+esp_err_t esp_cchi_get_query_param_at(httpd_req_t *r,
+                                      size_t index,
+                                      esp_cchi_query_param_t *param);
+
+/**
+ * Typed query params, same parsing and return values as the typed URI params
+*/
+
+esp_err_t esp_cchi_get_query_param_u32(httpd_req_t *r, const char *key, uint32_t *value);
+
+esp_err_t esp_cchi_get_query_param_i64(httpd_req_t *r, const char *key, int64_t *value);
+
+esp_err_t esp_cchi_get_query_param_hex(httpd_req_t *r, const char *key, uint64_t *value);
+
+esp_err_t esp_cchi_get_query_param_bool(httpd_req_t *r, const char *key, bool *value);
+
+esp_err_t esp_cchi_get_query_param_enum(httpd_req_t *r,
+                                        const char *key,
+                                        const esp_cchi_enum_entry_t *table,
+                                        size_t table_len,
+                                        int *value);
+
+/**
+ * ============== Router object ===============
+ * Instead of registering every httpd_uri_t in esp_http_server (which calls the .uri_match_fn
+ * once per registered URI on every request), the routes can be registered in a router object.
+ * The router compiles all of the patterns into a radix tree and registers a single catch-all
+ * handler in esp_http_server, so the cost of a lookup depends on the URI length and not on the
+ * number of routes.
+ *
+ * The patterns follow the same syntax and precedence of esp_cchi_setup_hd_config, and the
+ * handlers can use esp_cchi_get_uri_param and esp_cchi_get_uri_param_len the same way
+ *
+ * Quick Usage:
+ *
+ * esp_cchi_router_handle_t router = NULL;
+ * esp_cchi_router_create(&router);
+ * esp_cchi_router_handle(router, &ping_uri);
+ * esp_cchi_router_handle(router, &users_uri);
+ *
+ * httpd_config_t hd_config = HTTPD_DEFAULT_CONFIG();
+ * esp_cchi_setup_hd_config(&hd_config);
+ * httpd_handle_t server = NULL;
+ * httpd_start(&server, &hd_config);
+ * esp_cchi_router_attach(router, server);
+ *
+ * // Shutting down
+ * httpd_stop(server);
+ * esp_cchi_router_delete(router);
+*/
+
+/**
+ * URI under which the router registers its catch-all handler(s) in esp_http_server, the matcher
+ * installed by esp_cchi_setup_hd_config (or httpd_uri_match_wildcard) matches any URI with it.
+ * It doesn't start with a forward slash, so no route can be set up with it
+*/
+#define ESP_CCHI_ROUTER_CATCH_ALL_URI "*"
+
+typedef struct esp_cchi_router *esp_cchi_router_handle_t;
+
+/**
+ * @param[out] router Pointer to router handle, must not be NULL
+ *
+ * @returns
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_ARG if "router" is NULL
+ *  - ESP_ERR_NO_MEM if there is no memory available
+*/
+esp_err_t esp_cchi_router_create(esp_cchi_router_handle_t *router);
+
+/**
+ * Frees the router and all of its routes and groups. The catch-all handlers are not unregistered,
+ * so the router must be deleted after httpd_stop (like esp_cchi_delete_hd_uri) or after
+ * esp_cchi_router_detach
+ *
+ * @param router Router handle, must not be NULL
+ *
+ * @returns
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_ARG if "router" is NULL
+ *  - ESP_ERR_INVALID_STATE if "router" is a route group
+*/
+esp_err_t esp_cchi_router_delete(esp_cchi_router_handle_t router);
+
+/**
+ * Registers "hd_uri" in the router, the .uri, .method, .handler and .user_ctx members are copied,
+ * so "hd_uri" can be discarded after this call
+ *
+ * If "router" is a route group, .uri is relative to the group and the route is registered with the
+ * prefixes of the group and of the groups above it
+ *
+ * @param router Router handle, must not be NULL
+ * @param hd_uri Pointer to httpd_uri_t, must not be NULL and .uri must be a valid pattern
+ *
+ * @returns
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_ARG if some of the arguments are NULL or the pattern is invalid
+ *  - ESP_ERR_NO_MEM if there is no memory available
+ *  - ESP_ERR_HTTPD_HANDLER_EXISTS if the pattern is already registered with the same method
+ *  - Any error returned by httpd_register_uri_handler if the router is already attached and the
+ *    method is new to the router
+*/
+esp_err_t esp_cchi_router_handle(esp_cchi_router_handle_t router, const httpd_uri_t *hd_uri);
+
+/**
+ * Registers the catch-all handler of the router in "server": a single one for every method when
+ * esp_http_server supports HTTP_ANY, otherwise one per method used by the routes. Routes added
+ * after this call are served as well. A path that matches routes of other methods only is
+ * answered with 405 and an "Allow" header listing them
+ *
+ * @param router Router handle, must not be NULL
+ * @param server Handle of a started server, its .uri_match_fn must be the one installed by
+ *        esp_cchi_setup_hd_config or httpd_uri_match_wildcard
+ *
+ * @returns
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_ARG if some of the arguments are NULL
+ *  - ESP_ERR_INVALID_STATE if the router is already attached or is a route group
+ *  - Any error returned by httpd_register_uri_handler
+*/
+esp_err_t esp_cchi_router_attach(esp_cchi_router_handle_t router, httpd_handle_t server);
+
+/**
+ * Unregisters the catch-all handlers of the router from the server it is attached to
+ *
+ * @param router Router handle, must not be NULL
+ *
+ * @returns
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_ARG if "router" is NULL
+ *  - ESP_ERR_INVALID_STATE if the router is not attached
+*/
+esp_err_t esp_cchi_router_detach(esp_cchi_router_handle_t router);
+
+/**
+ * ============== Route groups ===============
+ * A route group is a prefix plus its own routes, middlewares and nested groups, like the
+ * Route/Mount of chi. The routes of a group are stored with their full pattern in the tree of the
+ * router on top, so the common prefix of a group is walked once per request and the whole group
+ * is pruned as soon as its prefix doesn't match. The middlewares of a group are added once and run
+ * before the handler of every route of the group, after the ones of the groups above it.
+ *
+ * A group is a router handle that can only be used with esp_cchi_router_handle,
+ * esp_cchi_router_route, esp_cchi_router_mount and esp_cchi_router_use, it's owned (and freed) by
+ * the router on top.
+ *
+ * Usage:
+ *
+ * esp_cchi_router_handle_t devices = NULL;
+ * esp_cchi_router_route(router, "/api/v1/devices/{id:[0-9]+}", &devices);
+ * esp_cchi_router_use(devices, check_auth);
+ * esp_cchi_router_handle(devices, &device_uri);       // "/" -> "/api/v1/devices/{id:[0-9]+}/"
+ * esp_cchi_router_handle(devices, &device_state_uri); // "/state"
+*/
+
+/**
+ * Creates a route group under "prefix" of "router" (which can be a group as well)
+ *
+ * @param router Router handle, must not be NULL
+ * @param prefix Valid pattern that doesn't end with '/', it's copied
+ * @param[out] group Handle of the new group
+ *
+ * @returns
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_ARG if some of the arguments are NULL or "prefix" is invalid
+ *  - ESP_ERR_NO_MEM if there is no memory available
+*/
+esp_err_t esp_cchi_router_route(esp_cchi_router_handle_t router,
+                                const char *prefix,
+                                esp_cchi_router_handle_t *group);
+
+/**
+ * Turns "sub", a router built apart, into a route group under "prefix" of "router". Its routes
+ * and groups are moved to "router", and from now on "sub" is owned by "router", so it must not be
+ * deleted
+ *
+ * @param router Router handle, must not be NULL
+ * @param prefix Valid pattern that doesn't end with '/', it's copied
+ * @param sub Router handle that is neither attached, a group nor the router on top of "router"
+ *
+ * @returns
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_ARG if some of the arguments are NULL or "prefix" is invalid
+ *  - ESP_ERR_INVALID_STATE if "sub" can't be mounted
+ *  - Any error returned by esp_cchi_router_handle for the routes moved, "sub" is mounted anyway
+ *    and the routes moved before the failure are kept
+*/
+esp_err_t esp_cchi_router_mount(esp_cchi_router_handle_t router,
+                                const char *prefix,
+                                esp_cchi_router_handle_t sub);
+
+/**
+ * Adds a middleware to the router or group, it runs before the handler of every route of the
+ * router or group (including the nested groups and the routes already registered). The first
+ * middleware that doesn't return ESP_OK stops the request and its error is returned
+ * (ESP_OK for ESP_CCHI_MW_RESPONDED)
+ *
+ * @returns
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_ARG if some of the arguments are NULL
+ *  - ESP_ERR_NO_MEM if there is no memory available
+*/
+esp_err_t esp_cchi_router_use(esp_cchi_router_handle_t router,
+                              esp_err_t (*middleware)(httpd_req_t *r));
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,83 @@
+/**
+ * ============== Static files ===============
+ * Serves the files of a directory of the VFS (SPIFFS, LittleFS, FAT, or any directory on the host
+ * build) under a prefix of the URI, e.g. "/ui/app.js" from "/www/app.js". The files are streamed
+ * with httpd_resp_send_chunk from a buffer of CONFIG_ESP_CCHI_STATIC_CHUNK_LEN bytes taken from the
+ * request arena (the heap if the arena has no room for it, see esp_cchi/arena.h), so serving a
+ * file takes the same memory whatever its size.
+ *
+ * - If the client accepts gzip (Accept-Encoding) and "<file>.gz" exists, it's sent instead with
+ *   Content-Encoding: gzip, so the assets can be stored precompressed
+ * - Every response has a strong ETag (size and modification time of the file sent, or a hash of
+ *   its content if the filesystem has no modification times), and a request whose If-None-Match
+ *   has it is answered 304 without reading the file
+ * - The Content-Type is deduced from the extension, and Cache-Control is set from the config
+ * - A URI that ends with '/' serves the index file of that directory
+ * - The path is percent-decoded, and paths with ".." segments are answered 404
+ *
+ * Usage:
+ *
+ * static const esp_cchi_static_config_t www = {
+ *     .base_path = "/littlefs/www",
+ *     .cache_control = "public, max-age=86400",
+ * };
+ * esp_cchi_router_static(router, "/ui", &www);  // "/ui/" "*"
+ *
+ * Any other dispatcher of esp_cchi can serve them with a trailing "*" wildcard:
+ *
+ * httpd_uri_t www_uri = {
+ *     .uri = "/ui/" "*",
+ *     .method = HTTP_GET,
+ *     .handler = esp_cchi_static_handler,
+ *     .user_ctx = (void*)&www,
+ * };
+ * esp_cchi_setup_hd_uri(&www_uri);
+*/
+#pragma once
+
+#include <esp_http_server.h>
+#include <esp_cchi/router.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct esp_cchi_static_config {
+    // Directory where the files are, without a trailing '/'
+    const char *base_path;
+    // File served for the URIs that end with '/', "index.html" if NULL
+    const char *index;
+    // Value of the Cache-Control header, not set if NULL
+    const char *cache_control;
+} esp_cchi_static_config_t;
+
+/**
+ * Handler that serves the file named by the "*" wildcard of the route (see the top of this file),
+ * the .user_ctx of the route must be a esp_cchi_static_config_t
+ *
+ * @returns
+ *  - ESP_OK if the file was sent, or a 304, 404 or 500 response
+ *  - ESP_FAIL if the file could not be read after the response was started, it's cut short
+ *  - What sending the response returned if it failed
+*/
+esp_err_t esp_cchi_static_handler(httpd_req_t *r);
+
+/**
+ * Registers a GET route "prefix/" "*" in "router" that serves the files of "config"
+ *
+ * @param router Router handle, must not be NULL
+ * @param prefix Valid pattern that doesn't end with '/', "" serves the files at the root
+ * @param config Must outlive the route
+ *
+ * @returns
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_ARG if some of the arguments are NULL or .base_path is NULL
+ *  - Any error returned by esp_cchi_router_handle
+*/
+esp_err_t esp_cchi_router_static(esp_cchi_router_handle_t router,
+                                 const char *prefix,
+                                 const esp_cchi_static_config_t *config);
+
+#ifdef __cplusplus
+}
+#endif
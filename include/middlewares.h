@@ -1,59 +1,568 @@
 #pragma once
 
 #include <esp_http_server.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#ifndef MIDDLEWARES_LOGGER_ROUTE_LEN
+#define MIDDLEWARES_LOGGER_ROUTE_LEN 32
+#endif
+
+typedef struct middlewares_logger_config {
+    unsigned task_priority;
+    size_t stack_size;
+    uint32_t flush_period_ms;
+} middlewares_logger_config_t;
+
+#define MIDDLEWARES_LOGGER_DEFAULT_CONFIG() {                   \
+        .task_priority      = 1,                                \
+        .stack_size         = 3072,                             \
+        .flush_period_ms    = 200,                              \
+}
+
+/**
+ * Access log middleware. When the request is finished it writes a binary record (method, route,
+ * result of the handler, latency in us and request Content-Length) into a lock-free ring of
+ * CONFIG_ESP_CCHI_LOGGER_RING_LEN records, so the httpd task never waits for the log output. The
+ * records are formatted and logged by the task started with middlewares_logger_start. When the
+ * ring is full the record is dropped, never blocking, and counted in middlewares_logger_dropped.
+ *
+ * esp_http_server doesn't expose the status nor the size of the response, so the lines have what
+ * the handler returned and the length of the request body instead:
+ *
+ * GET /api/users/{id} handler=ESP_OK 412us req_len=0
+ *
+ * The route is the pattern that routed the request (or the URI path if it was not routed by
+ * esp_cchi), the ones longer than MIDDLEWARES_LOGGER_ROUTE_LEN - 1 characters are cut and end
+ * with "...". It needs room for 2 pointers and an int64_t in the request arena
+ *
+ * @returns ESP_OK always, the request is never stopped
+*/
 esp_err_t middlewares_logger(httpd_req_t *r);
 
+/**
+ * Starts the task that logs the records of middlewares_logger every .flush_period_ms, it should
+ * have a lower priority than the httpd task. Only one can be started
+ *
+ * @returns
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_ARG if "config" is NULL
+ *  - ESP_ERR_INVALID_STATE if it was already started
+ *  - ESP_ERR_NO_MEM if the task could not be created
+*/
+esp_err_t middlewares_logger_start(const middlewares_logger_config_t *config);
+
+/**
+ * Logs every record pending in the ring, the task started by middlewares_logger_start calls this,
+ * so it must only be called when the task is not started (the ring has a single consumer)
+ *
+ * @returns Number of records logged
+*/
+size_t middlewares_logger_flush(void);
+
+/**
+ * @returns Number of records dropped since boot because the ring was full or the request arena
+ * had no room
+*/
+uint32_t middlewares_logger_dropped(void);
+
+#ifndef MIDDLEWARES_CONTENT_TYPE_MAX_LEN
+#define MIDDLEWARES_CONTENT_TYPE_MAX_LEN 128
+#endif
+
+typedef struct middlewares_media_type_slot {
+    const char *media_type;
+    size_t len;
+    uint32_t hash;
+} middlewares_media_type_slot_t;
+
+/**
+ * Allow-list of media types built by middlewares_allow_content_types, "slots" is a hash table
+ * filled from "list" the first time it's used ("state" tracks it), so it must have more slots
+ * than entries
+*/
+typedef struct middlewares_content_types {
+    const char *const *list;
+    size_t list_len;
+    middlewares_media_type_slot_t *slots;
+    size_t slots_len;
+    int state;
+} middlewares_content_types_t;
+
+/**
+ * Checks the Content-Type of the request against "allowed", responds 400 if the request has no
+ * Content-Type or it's malformed and 415 if it's not allowed
+ *
+ * @returns
+ *  - ESP_OK if the Content-Type is allowed
+ *  - ESP_FAIL if it's not, or there was no memory to read the header (500), the response was
+ *    already sent
+*/
+esp_err_t middlewares_check_content_type(httpd_req_t *r, middlewares_content_types_t *allowed);
+
+/**
+ * Middleware that only lets through the requests whose Content-Type is one of the listed ones,
+ * responds 400 if the request has no Content-Type or it's malformed and 415 if it's not allowed.
+ *
+ * Only the type/subtype is compared, case-insensitively, and its parameters are ignored, so
+ * "Application/JSON; charset=utf-8" is allowed by "application/json". The list is hashed the
+ * first time the middleware runs, checking a request is a hash lookup with the header read into a
+ * buffer of up to MIDDLEWARES_CONTENT_TYPE_MAX_LEN bytes taken from the request arena (longer media
+ * types are never allowed)
+ *
+ * Usage:
+ *
+ * middlewares_allow_content_types(allow_json_or_text, "application/json", "text/plain")
+*/
 #define middlewares_allow_content_types(middleware_fn_name, ...)                                 \
 esp_err_t middleware_fn_name(httpd_req_t *r) {                                                   \
-    char* content_types[] = {__VA_ARGS__};                                                       \
-    size_t content_types_len = sizeof(content_types) / sizeof(char *);                           \
-    if (content_types_len == 0) {                                                                \
-        return ESP_OK;                                                                           \
-    }                                                                                            \
-    char *status;                                                                                \
-    esp_err_t err = ESP_OK;                                                                      \
-    size_t req_ct_len = httpd_req_get_hdr_value_len(r, "Content-Type");                          \
-    if (req_ct_len == 0) {                                                                       \
-        status = HTTPD_400;                                                                      \
-        err = ESP_FAIL;                                                                          \
-        goto exit;                                                                               \
-    }                                                                                            \
-    char* ct_buf = malloc(req_ct_len + 1);                                                       \
-    if (ct_buf == NULL) {                                                                        \
-        status = HTTPD_500;                                                                      \
-        err = ESP_ERR_NO_MEM;                                                                    \
-        goto exit;                                                                               \
-    }                                                                                            \
-    err = httpd_req_get_hdr_value_str(r, "Content-Type", ct_buf, req_ct_len + 1);                \
-    if (err != ESP_OK) {                                                                         \
-        status = HTTPD_500;                                                                      \
-        err = ESP_FAIL;                                                                          \
-        goto exit;                                                                               \
-    }                                                                                            \
-    for (size_t i = 0; i < content_types_len; i++) {                                             \
-        size_t allow_ct_len = strlen(content_types[i]);                                          \
-        if (allow_ct_len != req_ct_len) {                                                        \
-            continue;                                                                            \
-        }                                                                                        \
-        if (strncmp(ct_buf, content_types[i], req_ct_len) == 0) {                                \
-            goto exit;                                                                           \
-        }                                                                                        \
-    }                                                                                            \
-    /* Content type not found in allowed content types array, setting status to 415 */           \
-    err = ESP_FAIL;                                                                              \
-    status = "415 Unsupported Media Type";                                                       \
-exit:                                                                                            \
-    if (err != ESP_OK) {                                                                         \
-        httpd_resp_set_status(r, status);                                                        \
-        httpd_resp_send(r, NULL, 0);                                                             \
-    }                                                                                            \
-    free(ct_buf);                                                                                \
-    return err;                                                                                  \
+    static const char *const content_types[] = {__VA_ARGS__};                                    \
+    static middlewares_media_type_slot_t slots[2 * sizeof(content_types) / sizeof(char *) + 1];  \
+    static middlewares_content_types_t allowed = {                                               \
+        .list = content_types,                                                                   \
+        .list_len = sizeof(content_types) / sizeof(char *),                                      \
+        .slots = slots,                                                                          \
+        .slots_len = sizeof(slots) / sizeof(slots[0]),                                           \
+    };                                                                                           \
+    return middlewares_check_content_type(r, &allowed);                                          \
+}
+
+#ifndef MIDDLEWARES_BODY_CHUNK_LEN
+#define MIDDLEWARES_BODY_CHUNK_LEN 256
+#endif
+
+/**
+ * Checks the framing of the body before anything is read: responds 411 if the body has no
+ * Content-Length (e.g. it's sent with Transfer-Encoding: chunked) and 413 if its Content-Length
+ * is larger than "max_len"
+ *
+ * @returns
+ *  - ESP_OK if the body can be read
+ *  - ESP_FAIL if it can't, the response was already sent
+*/
+esp_err_t middlewares_check_body_len(httpd_req_t *r, size_t max_len);
+
+/**
+ * Middleware that rejects the requests whose body is larger than "max_len" bytes (413) or has no
+ * Content-Length (411) before any byte of the body is received
+ *
+ * Usage:
+ *
+ * middlewares_limit_body(limit_body_4k, 4096)
+*/
+#define middlewares_limit_body(middleware_fn_name, max_len)                                      \
+esp_err_t middleware_fn_name(httpd_req_t *r) {                                                   \
+    return middlewares_check_body_len(r, (max_len));                                             \
+}
+
+/**
+ * Called by middlewares_body_read with every chunk of the body as it's received, and one last time
+ * with "len" 0 once the whole body was read. "chunk" is only valid during the call
+*/
+typedef esp_err_t (*middlewares_body_chunk_fn_t)(httpd_req_t *r,
+                                                 const char *chunk,
+                                                 size_t len,
+                                                 void *arg);
+
+/**
+ * Streams the body of "r" through "fn" in chunks of up to MIDDLEWARES_BODY_CHUNK_LEN bytes,
+ * received into a buffer taken from the request arena (the heap if it has no room, see
+ * esp_cchi_arena_take), so reading a body takes the same memory whatever its size. The length is
+ * checked as in middlewares_check_body_len before anything is received. Receive timeouts are
+ * retried, if the client stops sending the request is answered with 408
+ *
+ * Usage:
+ *
+ * static esp_err_t write_chunk(httpd_req_t *r, const char *chunk, size_t len, void *arg) {
+ *     return len == 0 ? ESP_OK : ota_write(arg, chunk, len);
+ * }
+ *
+ * esp_err_t err = middlewares_body_read(r, OTA_MAX_LEN, write_chunk, ota_handle);
+ *
+ * @returns
+ *  - ESP_OK if the whole body was passed to "fn"
+ *  - ESP_ERR_INVALID_ARG if "r" or "fn" are NULL
+ *  - ESP_FAIL if the body was rejected or could not be received (500 if there was no memory for
+ *    the chunk buffer), the response was already sent unless the connection was lost
+ *  - What "fn" returned if it was not ESP_OK, the rest of the body is not read
+*/
+esp_err_t middlewares_body_read(httpd_req_t *r,
+                                size_t max_len,
+                                middlewares_body_chunk_fn_t fn,
+                                void *arg);
+
+/**
+ * Called by the form parser with every field of the body, "key" and "value" are percent-decoded
+ * ('+' is a space) and NUL-terminated, they are only valid during the call
+*/
+typedef esp_err_t (*middlewares_form_field_fn_t)(httpd_req_t *r,
+                                                 const char *key,
+                                                 size_t key_len,
+                                                 const char *value,
+                                                 size_t value_len,
+                                                 void *arg);
+
+/**
+ * Incremental parser of application/x-www-form-urlencoded bodies, fed chunk by chunk, so a field
+ * can be split across chunks. The field being parsed is decoded into "buf", which bounds the
+ * length of a field (key and value plus 2 bytes), the body as a whole is never buffered
+*/
+typedef struct middlewares_form_parser {
+    char *buf;
+    size_t buf_size;
+    size_t len;
+    size_t key_len;
+    bool in_value;
+    // Escape being decoded: 0 if none, 1 after the '%', 2 after its first hex digit
+    int escape;
+    char escape_digit;
+    middlewares_form_field_fn_t fn;
+    void *arg;
+} middlewares_form_parser_t;
+
+/**
+ * @param buf Buffer of the field being parsed, at least 2 bytes (the NULs of the key and value)
+ *
+ * @returns
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_ARG if "parser", "buf" or "fn" are NULL or "buf_size" is less than 2, the
+ *    parser (if any) is left in a state that middlewares_form_feed rejects
+*/
+esp_err_t middlewares_form_parser_init(middlewares_form_parser_t *parser,
+                                       char *buf,
+                                       size_t buf_size,
+                                       middlewares_form_field_fn_t fn,
+                                       void *arg);
+
+/**
+ * Chunk callback of middlewares_body_read that feeds "arg", a middlewares_form_parser_t, the last
+ * field is passed to the field callback when the empty chunk arrives
+ *
+ * Usage:
+ *
+ * char field_buf[64];
+ * middlewares_form_parser_t form;
+ * ESP_ERROR_CHECK(middlewares_form_parser_init(&form, field_buf, sizeof(field_buf), on_field,
+ *                                              &settings));
+ * esp_err_t err = middlewares_body_read(r, 1024, middlewares_form_feed, &form);
+ *
+ * @returns
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_ARG if "arg" is NULL or was not initialized
+ *  - ESP_ERR_INVALID_SIZE if a field doesn't fit in the buffer of the parser
+ *  - What the field callback returned if it was not ESP_OK
+*/
+esp_err_t middlewares_form_feed(httpd_req_t *r, const char *chunk, size_t len, void *arg);
+
+// Containers (objects and arrays) the JSON tokenizer can be nested in
+#define MIDDLEWARES_JSON_MAX_DEPTH 32
+
+typedef enum {
+    MIDDLEWARES_JSON_OBJECT_BEGIN,
+    MIDDLEWARES_JSON_OBJECT_END,
+    MIDDLEWARES_JSON_ARRAY_BEGIN,
+    MIDDLEWARES_JSON_ARRAY_END,
+    MIDDLEWARES_JSON_KEY,
+    MIDDLEWARES_JSON_STRING,
+    MIDDLEWARES_JSON_NUMBER,
+    MIDDLEWARES_JSON_TRUE,
+    MIDDLEWARES_JSON_FALSE,
+    MIDDLEWARES_JSON_NULL,
+} middlewares_json_token_t;
+
+/**
+ * Called by the JSON tokenizer with every token of the body, in order. "text" is the unescaped
+ * (UTF-8) key or string, or the number as it was written, NUL-terminated and only valid during
+ * the call, it's NULL for the other tokens. "depth" is the number of containers the token is in,
+ * 0 for the top-level value, so the keys of the top-level object and its closing brace are at 1
+ * and 0
+*/
+typedef esp_err_t (*middlewares_json_token_fn_t)(httpd_req_t *r,
+                                                 middlewares_json_token_t token,
+                                                 const char *text,
+                                                 size_t len,
+                                                 size_t depth,
+                                                 void *arg);
+
+/**
+ * Incremental JSON (RFC 8259) tokenizer, fed chunk by chunk like the form parser. Only the key,
+ * string or number being read is kept, in "buf", which bounds their length (plus the NUL); the
+ * nesting is a bit per container. The document is validated as it's read, a handler that applies
+ * the tokens as they come must be ready to undo them if the body turns out invalid
+*/
+typedef struct middlewares_json_parser {
+    char *buf;
+    size_t buf_size;
+    size_t len;
+    // What is expected next and what is being read, see esp_cchi_middlewares.c
+    uint8_t expect;
+    uint8_t lex;
+    bool is_key;
+    uint8_t depth;
+    // Bit i is set if the container at depth i + 1 is an array
+    uint32_t arrays;
+    // \uXXXX escape: digits read and their value, and a high surrogate waiting for its pair
+    uint8_t unicode_digits;
+    uint16_t unicode;
+    uint16_t high_surrogate;
+    // true, false or null being read
+    const char *literal;
+    uint8_t literal_len;
+    middlewares_json_token_fn_t fn;
+    void *arg;
+} middlewares_json_parser_t;
+
+/**
+ * @param buf Buffer of the key, string or number being read, at least 1 byte
+ *
+ * @returns
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_ARG if "parser", "buf" or "fn" are NULL or "buf_size" is 0, the parser (if
+ *    any) is left in a state that middlewares_json_feed rejects
+*/
+esp_err_t middlewares_json_parser_init(middlewares_json_parser_t *parser,
+                                       char *buf,
+                                       size_t buf_size,
+                                       middlewares_json_token_fn_t fn,
+                                       void *arg);
+
+/**
+ * Chunk callback of middlewares_body_read that feeds "arg", a middlewares_json_parser_t. The
+ * empty chunk ends the document, it fails if the document is not complete
+ *
+ * Usage:
+ *
+ * static esp_err_t on_token(httpd_req_t *r,
+ *                           middlewares_json_token_t token,
+ *                           const char *text,
+ *                           size_t len,
+ *                           size_t depth,
+ *                           void *arg)
+ * {
+ *     struct settings_parse *parse = arg;
+ *     if (token == MIDDLEWARES_JSON_KEY && depth == 1) {
+ *         parse->key = settings_key_of(text);
+ *     } else if (token == MIDDLEWARES_JSON_NUMBER && depth == 1) {
+ *         settings_set(parse->key, strtol(text, NULL, 10));
+ *     }
+ *     return ESP_OK;
+ * }
+ *
+ * char token_buf[64];
+ * middlewares_json_parser_t json;
+ * ESP_ERROR_CHECK(middlewares_json_parser_init(&json, token_buf, sizeof(token_buf), on_token,
+ *                                              &parse));
+ * esp_err_t err = middlewares_body_read(r, 4096, middlewares_json_feed, &json);
+ *
+ * @returns
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_ARG if the body is not valid JSON, or "arg" is NULL or was not initialized
+ *  - ESP_ERR_INVALID_SIZE if a key, string or number doesn't fit in the buffer of the parser, or
+ *    the containers are nested deeper than MIDDLEWARES_JSON_MAX_DEPTH
+ *  - What the token callback returned if it was not ESP_OK
+*/
+esp_err_t middlewares_json_feed(httpd_req_t *r, const char *chunk, size_t len, void *arg);
+
+#ifndef MIDDLEWARES_CACHE_KEY_LEN
+#define MIDDLEWARES_CACHE_KEY_LEN 96
+#endif
+
+#define MIDDLEWARES_CACHE_ETAG_LEN 32
+
+#ifndef MIDDLEWARES_CACHE_BUCKETS
+#define MIDDLEWARES_CACHE_BUCKETS 32
+#endif
+
+/**
+ * Response cache of GET routes, the bodies are kept in the heap within a budget of bytes, the
+ * least recently used entries are evicted to make room. Initialized by middlewares_cache_init.
+ * The entries are in the LRU list ("head" is the most recently used) and in the chain of their
+ * bucket, which lookups walk instead of the whole list. "generation" changes on every
+ * invalidation, so a body built before it is not stored after it. "hits" and "misses" count the
+ * lookups
+*/
+typedef struct middlewares_cache {
+    size_t budget;
+    size_t used;
+    struct middlewares_cache_entry *head;
+    struct middlewares_cache_entry *tail;
+    struct middlewares_cache_entry *buckets[MIDDLEWARES_CACHE_BUCKETS];
+    void *lock;
+    uint32_t generation;
+    uint32_t hits;
+    uint32_t misses;
+} middlewares_cache_t;
+
+/**
+ * @param budget Bytes that the entries can take, counting their bodies, keys and bookkeeping
+ *
+ * @returns
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_ARG if "cache" is NULL
+ *  - ESP_ERR_NO_MEM if the lock could not be created
+*/
+esp_err_t middlewares_cache_init(middlewares_cache_t *cache, size_t budget);
+
+/**
+ * Frees every entry and the lock, no request may be using the cache
+*/
+void middlewares_cache_deinit(middlewares_cache_t *cache);
+
+/**
+ * Serves GET requests from "cache": a request whose If-None-Match has the ETag of the cached body
+ * is answered 304, any other hit is answered with the cached body, and the chain is stopped with
+ * ESP_CCHI_MW_RESPONDED. On a miss the request goes on and the final handler responds with
+ * middlewares_cache_send, which stores the body.
+ *
+ * The entries are keyed on the pattern of the route plus the values of the URI params (the URI
+ * path if the request was not routed by esp_cchi), the query string is not part of the key.
+ * Requests whose key is longer than MIDDLEWARES_CACHE_KEY_LEN - 1 bytes are not cached. The
+ * final handler must run in the same task as the middleware (not offloaded to the worker pool)
+ *
+ * @returns
+ *  - ESP_OK if the request was not served from the cache
+ *  - ESP_CCHI_MW_RESPONDED if it was
+ *  - What sending the response returned if it failed
+*/
+esp_err_t middlewares_cache_serve(httpd_req_t *r, middlewares_cache_t *cache);
+
+/**
+ * Middleware that serves the requests from "cache" with middlewares_cache_serve
+ *
+ * Usage:
+ *
+ * static middlewares_cache_t api_cache;
+ * middlewares_cache(cache_api, &api_cache)
+ *
+ * ESP_ERROR_CHECK(middlewares_cache_init(&api_cache, 4096));
+ * esp_cchi_router_use(api_group, cache_api);
+ *
+ * static esp_err_t handle_info(httpd_req_t *r) {
+ *     char body[128];
+ *     int len = snprintf(body, sizeof(body), "{\"name\":\"%s\"}", device_name);
+ *     return middlewares_cache_send(r, HTTPD_TYPE_JSON, body, len);
+ * }
+ *
+ * // When the device is renamed
+ * middlewares_cache_invalidate(&api_cache, "/api/info");
+*/
+#define middlewares_cache(middleware_fn_name, cache)                                             \
+esp_err_t middleware_fn_name(httpd_req_t *r) {                                                   \
+    return middlewares_cache_serve(r, (cache));                                                  \
+}
+
+/**
+ * Sends "body" as a 200 response with a strong ETag computed from it, 304 if it matches the
+ * If-None-Match of the request. If the request missed a cache (see middlewares_cache_serve), the
+ * body is stored there as well, it's not stored if it doesn't fit in the budget.
+ *
+ * esp_http_server doesn't tell the status nor the headers set on a response, a handler that
+ * sets them with httpd_resp_set_status or httpd_resp_set_hdr("Cache-Control") must respond with
+ * middlewares_cache_send_with instead, otherwise its response would be stored as a 200 one
+ *
+ * @param type Content-Type of the body, must be a string that outlives the cache (a literal)
+ * @param len Length of "body", HTTPD_RESP_USE_STRLEN if it's NUL-terminated
+ *
+ * @returns What sending the response returned
+*/
+esp_err_t middlewares_cache_send(httpd_req_t *r, const char *type, const char *body, ssize_t len);
+
+/**
+ * middlewares_cache_send with the status "status" and the Cache-Control "cache_control". The body
+ * is stored only if the status is 200 and the Cache-Control doesn't have the no-store directive,
+ * the hits are then sent with the same Cache-Control
+ *
+ * @param status Status line of the response (HTTPD_200, "404 Not Found", ...)
+ * @param cache_control Value of the Cache-Control header, NULL for none. Like "type", it must be a
+ *        string that outlives the cache
+ *
+ * @returns What sending the response returned
+*/
+esp_err_t middlewares_cache_send_with(httpd_req_t *r,
+                                      const char *status,
+                                      const char *cache_control,
+                                      const char *type,
+                                      const char *body,
+                                      ssize_t len);
+
+/**
+ * Drops the cached responses of the route "route" (a pattern, the same one it was registered
+ * with, or a URI path for the requests not routed by esp_cchi), for every value of its URI
+ * params. NULL drops every response
+*/
+void middlewares_cache_invalidate(middlewares_cache_t *cache, const char *route);
+
+#ifndef MIDDLEWARES_RATE_MAX_PROBES
+#define MIDDLEWARES_RATE_MAX_PROBES 8
+#endif
+
+/**
+ * Bucket of a client, "key" is the hash of its address (0 if the slot is free), "tat" is the time
+ * at which its bucket is full again, the low 32 bits of esp_timer_get_time (us)
+*/
+typedef struct middlewares_rate_slot {
+    uint32_t key;
+    uint32_t tat;
+} middlewares_rate_slot_t;
+
+/**
+ * Token bucket per client of middlewares_rate_limit: every client can make .burst requests in a
+ * row, refilled at .rate_per_s requests per second (up to 1000000, the interval between two
+ * tokens is a whole number of us). A bucket refills in about half an hour at most, a longer
+ * .burst / .rate_per_s is capped. "limited" counts the requests answered with 429 and "untracked"
+ * the ones let through because the table had no room for their client
+*/
+typedef struct middlewares_rate_limit {
+    uint32_t rate_per_s;
+    uint32_t burst;
+    middlewares_rate_slot_t *slots;
+    size_t slots_len;
+    uint32_t limited;
+    uint32_t untracked;
+} middlewares_rate_limit_t;
+
+/**
+ * Takes a token from the bucket of the client of "r", responds 429 with a Retry-After header if
+ * there is none. The client is the IP address of the peer of the socket (the socket itself if its
+ * address can't be read), every connection of a client shares its bucket
+ *
+ * @returns
+ *  - ESP_OK if the request can go on
+ *  - ESP_FAIL if it was limited, the response was already sent and the connection is closed, so
+ *    its socket is free for the other clients
+*/
+esp_err_t middlewares_check_rate(httpd_req_t *r, middlewares_rate_limit_t *limit);
+
+/**
+ * Middleware that limits every client to "burst_len" requests in a row, refilled at
+ * "requests_per_s" requests per second, and answers 429 to the rest before any other work is
+ * done. The buckets are in a static table of "clients" slots (8 bytes each) updated with atomics,
+ * taking a token never locks nor allocates. The buckets of idle clients are reused, if none is
+ * found in MIDDLEWARES_RATE_MAX_PROBES slots the request is let through.
+ *
+ * Every generated middleware has its own table, so a route group can have its own limits:
+ *
+ * middlewares_rate_limit(limit_api, 10, 20, 32)
+ * middlewares_rate_limit(limit_ota, 1, 2, 4)
+ *
+ * esp_cchi_router_use(api_group, limit_api);
+ * esp_cchi_router_use(ota_group, limit_ota);
+*/
+#define middlewares_rate_limit(middleware_fn_name, requests_per_s, burst_len, clients)           \
+esp_err_t middleware_fn_name(httpd_req_t *r) {                                                   \
+    static middlewares_rate_slot_t slots[(clients)];                                             \
+    static middlewares_rate_limit_t limit = {                                                    \
+        .rate_per_s = (requests_per_s),                                                          \
+        .burst = (burst_len),                                                                    \
+        .slots = slots,                                                                          \
+        .slots_len = (clients),                                                                  \
+    };                                                                                           \
+    return middlewares_check_rate(r, &limit);                                                    \
 }
 
 #ifdef __cplusplus
@@ -0,0 +1,34 @@
+# Included by ESP-IDF in the project (and by the host build), so the components can use
+# esp_cchi_compile_routes in their CMakeLists.txt
+set(ESP_CCHI_GEN_ROUTES "${CMAKE_CURRENT_LIST_DIR}/tools/esp_cchi_gen_routes.py")
+
+# esp_cchi_compile_routes(<target> ROUTES <route list> NAME <table name>)
+#
+# Compiles the route list into <table name>.c/.h (see include/esp_cchi/compiled.h), the source is
+# added to <target> and the header can be included by the sources of <target>
+function(esp_cchi_compile_routes target)
+    cmake_parse_arguments(arg "" "ROUTES;NAME" "" ${ARGN})
+    if(NOT arg_ROUTES OR NOT arg_NAME)
+        message(FATAL_ERROR "esp_cchi_compile_routes: ROUTES and NAME are required")
+    endif()
+
+    if(COMMAND idf_build_get_property)
+        idf_build_get_property(python PYTHON)
+    else()
+        find_package(Python3 REQUIRED COMPONENTS Interpreter)
+        set(python "${Python3_EXECUTABLE}")
+    endif()
+
+    get_filename_component(routes "${arg_ROUTES}" ABSOLUTE)
+    set(output_dir "${CMAKE_CURRENT_BINARY_DIR}/esp_cchi_routes")
+    add_custom_command(OUTPUT "${output_dir}/${arg_NAME}.c" "${output_dir}/${arg_NAME}.h"
+                       COMMAND "${python}" "${ESP_CCHI_GEN_ROUTES}"
+                               --name "${arg_NAME}"
+                               --output-dir "${output_dir}"
+                               "${routes}"
+                       DEPENDS "${routes}" "${ESP_CCHI_GEN_ROUTES}"
+                       COMMENT "Compiling route list ${arg_ROUTES}"
+                       VERBATIM)
+    target_sources(${target} PRIVATE "${output_dir}/${arg_NAME}.c")
+    target_include_directories(${target} PRIVATE "${output_dir}")
+endfunction()
@@ -0,0 +1,125 @@
+#include <esp_http_server.h>
+#include <esp_cchi/arena.h>
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "sdkconfig.h"
+
+#ifndef CONFIG_ESP_CCHI_REQ_ARENA_SIZE
+#define CONFIG_ESP_CCHI_REQ_ARENA_SIZE 1280
+#endif
+
+struct esp_cchi_arena_done {
+    esp_cchi_arena_done_fn_t fn;
+    void *arg;
+    struct esp_cchi_arena_done *next;
+};
+
+struct esp_cchi_arena {
+    httpd_req_t *r;
+    char *buf;
+    size_t used;
+    struct esp_cchi_arena_done *done;
+    struct esp_cchi_arena *prev;
+};
+
+// Arena of the request being handled by this task, every httpd server has its own task and handles
+// one request at a time
+static _Thread_local struct esp_cchi_arena *esp_cchi_arena_current = NULL;
+
+static struct esp_cchi_arena *esp_cchi_arena_of(httpd_req_t *r) {
+    struct esp_cchi_arena *arena = esp_cchi_arena_current;
+    return (arena != NULL && r != NULL && arena->r == r) ? arena : NULL;
+}
+
+void *esp_cchi_arena_alloc(httpd_req_t *r, size_t size) {
+    struct esp_cchi_arena *arena = esp_cchi_arena_of(r);
+    if (arena == NULL) {
+        return NULL;
+    }
+    size_t start = (arena->used + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+    if (start > CONFIG_ESP_CCHI_REQ_ARENA_SIZE || size > CONFIG_ESP_CCHI_REQ_ARENA_SIZE - start) {
+        return NULL;
+    }
+    arena->used = start + size;
+    return arena->buf + start;
+}
+
+size_t esp_cchi_arena_available(httpd_req_t *r) {
+    struct esp_cchi_arena *arena = esp_cchi_arena_of(r);
+    if (arena == NULL) {
+        return 0;
+    }
+    return CONFIG_ESP_CCHI_REQ_ARENA_SIZE - arena->used;
+}
+
+void *esp_cchi_arena_take(httpd_req_t *r, size_t size) {
+    // Never empty, so an arena buffer is always inside the arena
+    size = size > 0 ? size : 1;
+    void *buf = esp_cchi_arena_alloc(r, size);
+    return buf != NULL ? buf : malloc(size);
+}
+
+void esp_cchi_arena_release(httpd_req_t *r, void *buf, size_t size) {
+    struct esp_cchi_arena *arena = esp_cchi_arena_of(r);
+    uintptr_t offset = (uintptr_t)buf - (uintptr_t)(arena != NULL ? arena->buf : NULL);
+    if (arena == NULL || offset >= CONFIG_ESP_CCHI_REQ_ARENA_SIZE) {
+        free(buf);
+        return;
+    }
+    // Only the last allocation can be undone, the ones before it are still in use
+    if (offset + (size > 0 ? size : 1) == arena->used) {
+        arena->used = (size_t)offset;
+    }
+}
+
+bool esp_cchi_arena_is_active(httpd_req_t *r) {
+    return esp_cchi_arena_of(r) != NULL;
+}
+
+esp_err_t esp_cchi_arena_on_done(httpd_req_t *r, esp_cchi_arena_done_fn_t fn, void *arg) {
+    if (r == NULL || fn == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct esp_cchi_arena *arena = esp_cchi_arena_of(r);
+    if (arena == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    struct esp_cchi_arena_done *done = esp_cchi_arena_alloc(r, sizeof(struct esp_cchi_arena_done));
+    if (done == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    done->fn = fn;
+    done->arg = arg;
+    done->next = arena->done;
+    arena->done = done;
+    return ESP_OK;
+}
+
+esp_err_t esp_cchi_arena_run(httpd_req_t *r, esp_err_t (*handler)(httpd_req_t *r)) {
+    if (r == NULL || handler == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (esp_cchi_arena_of(r) != NULL) {
+        return handler(r);
+    }
+
+    alignas(max_align_t) char buf[CONFIG_ESP_CCHI_REQ_ARENA_SIZE > 0 ?
+                                  CONFIG_ESP_CCHI_REQ_ARENA_SIZE : 1];
+    struct esp_cchi_arena arena = {
+        .r = r,
+        .buf = buf,
+        .used = 0,
+        .done = NULL,
+        .prev = esp_cchi_arena_current,
+    };
+    esp_cchi_arena_current = &arena;
+    esp_err_t err = handler(r);
+    for (struct esp_cchi_arena_done *done = arena.done; done != NULL; done = done->next) {
+        done->fn(r, err, done->arg);
+    }
+    esp_cchi_arena_current = arena.prev;
+    return err;
+}
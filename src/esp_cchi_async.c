@@ -0,0 +1,125 @@
+#include <esp_http_server.h>
+#include <esp_cchi/arena.h>
+#include <esp_cchi/async.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "esp_cchi_req.h"
+
+/**
+ * Request queued for a worker, copied by value into the queue. "req_ctx" is a snapshot of the
+ * request context the dispatcher had set ("routed"), as the original one lives in its stack
+*/
+struct esp_cchi_async_job {
+    httpd_req_t *r;
+    esp_err_t (*handler)(httpd_req_t *r);
+    bool routed;
+    struct esp_cchi_req_ctx req_ctx;
+};
+
+static int esp_cchi_async_started = 0;
+static QueueHandle_t esp_cchi_async_queue = NULL;
+static char esp_cchi_async_retry_after[12];
+static uint32_t esp_cchi_async_rejected_count = 0;
+
+static void esp_cchi_async_worker(void *arg) {
+    (void)arg;
+    struct esp_cchi_async_job job;
+    for (;;) {
+        if (xQueueReceive(esp_cchi_async_queue, &job, portMAX_DELAY) != pdPASS) {
+            continue;
+        }
+        httpd_req_t *r = job.r;
+        if (job.routed) {
+            // The captures are offsets, they are valid in the copy of the URI
+            job.req_ctx.params.base = r->uri;
+            r->user_ctx = &job.req_ctx;
+        }
+        esp_cchi_arena_run(r, job.handler);
+        httpd_req_async_handler_complete(r);
+    }
+}
+
+esp_err_t esp_cchi_async_start(const esp_cchi_async_config_t *config) {
+    if (config == NULL || config->workers == 0 || config->queue_len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int expected = 0;
+    if (!__atomic_compare_exchange_n(&esp_cchi_async_started, &expected, 1, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    snprintf(esp_cchi_async_retry_after, sizeof(esp_cchi_async_retry_after), "%" PRIu32,
+             config->retry_after_s);
+    QueueHandle_t queue = xQueueCreate(config->queue_len, sizeof(struct esp_cchi_async_job));
+    if (queue == NULL) {
+        __atomic_store_n(&esp_cchi_async_started, 0, __ATOMIC_RELEASE);
+        return ESP_ERR_NO_MEM;
+    }
+    esp_cchi_async_queue = queue;
+    size_t workers = 0;
+    while (workers < config->workers &&
+           xTaskCreate(esp_cchi_async_worker, "cchi_async", config->stack_size, NULL,
+                       config->task_priority, NULL) == pdPASS)
+    {
+        workers++;
+    }
+    if (workers == 0) {
+        esp_cchi_async_queue = NULL;
+        vQueueDelete(queue);
+        __atomic_store_n(&esp_cchi_async_started, 0, __ATOMIC_RELEASE);
+        return ESP_ERR_NO_MEM;
+    }
+    // Published last, the httpd task only queues requests once the workers are running
+    __atomic_store_n(&esp_cchi_async_started, 2, __ATOMIC_RELEASE);
+    return ESP_OK;
+}
+
+// Answers "r" with 503 from the httpd task, the queue was full
+static esp_err_t esp_cchi_async_reject(httpd_req_t *r) {
+    __atomic_fetch_add(&esp_cchi_async_rejected_count, 1, __ATOMIC_RELAXED);
+    httpd_resp_set_status(r, "503 Service Unavailable");
+    httpd_resp_set_type(r, HTTPD_TYPE_TEXT);
+    httpd_resp_set_hdr(r, "Retry-After", esp_cchi_async_retry_after);
+    return httpd_resp_sendstr(r, "Service Unavailable");
+}
+
+esp_err_t esp_cchi_async_submit(httpd_req_t *r, esp_err_t (*handler)(httpd_req_t *r)) {
+    if (r == NULL || handler == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (__atomic_load_n(&esp_cchi_async_started, __ATOMIC_ACQUIRE) != 2) {
+        return esp_cchi_arena_run(r, handler);
+    }
+    // Checked first so a full queue costs no copy of the request
+    if (uxQueueSpacesAvailable(esp_cchi_async_queue) == 0) {
+        return esp_cchi_async_reject(r);
+    }
+
+    struct esp_cchi_async_job job;
+    job.handler = handler;
+    job.routed = esp_cchi_ctx_tag(r->user_ctx) == __ESP_CCHI_REQ_CTX_TAG;
+    if (job.routed) {
+        job.req_ctx = *(const struct esp_cchi_req_ctx*)r->user_ctx;
+        // The index of the query string is in the arena of this task, the worker builds its own
+        job.req_ctx.query = NULL;
+    }
+    if (httpd_req_async_handler_begin(r, &job.r) != ESP_OK) {
+        return httpd_resp_send_err(r, HTTPD_500_INTERNAL_SERVER_ERROR, NULL);
+    }
+    // Another server task may have taken the last slot since it was checked
+    if (xQueueSend(esp_cchi_async_queue, &job, 0) != pdPASS) {
+        httpd_req_async_handler_complete(job.r);
+        return esp_cchi_async_reject(r);
+    }
+    return ESP_OK;
+}
+
+uint32_t esp_cchi_async_rejected(void) {
+    return __atomic_load_n(&esp_cchi_async_rejected_count, __ATOMIC_RELAXED);
+}
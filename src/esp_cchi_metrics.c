@@ -0,0 +1,264 @@
+#include <esp_http_server.h>
+#include <esp_cchi/metrics.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+
+#ifndef CONFIG_ESP_CCHI_METRICS_MAX_ROUTES
+#define CONFIG_ESP_CCHI_METRICS_MAX_ROUTES 32
+#endif
+
+#define ESP_CCHI_METRICS_OUT_SIZE  384
+
+#define ESP_CCHI_METRICS_EMPTY    0
+#define ESP_CCHI_METRICS_CLAIMED  1
+#define ESP_CCHI_METRICS_READY    2
+
+// Upper bounds of the buckets in us, the last bucket is +Inf
+static const uint32_t esp_cchi_metrics_bounds_us[ESP_CCHI_METRICS_BUCKETS - 1] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000,
+};
+static const char *const esp_cchi_metrics_bounds_le[ESP_CCHI_METRICS_BUCKETS] = {
+    "0.0001", "0.00025", "0.0005", "0.001", "0.0025", "0.005", "0.01", "0.025", "0.05", "0.1",
+    "0.25", "0.5", "1", "+Inf",
+};
+
+/**
+ * "state" goes from EMPTY to CLAIMED (by the task that inserts the route) to READY (key and
+ * pattern written), it only goes back to EMPTY if the pattern can't be copied. "route" is a heap
+ * copy of the whole pattern. The latency sum is split in 2 words so it's updated
+ * without 64-bit atomics, which need locks on 32-bit targets
+*/
+struct esp_cchi_metrics_route {
+    uint32_t state;
+    uint32_t hash;
+    uint32_t method;
+    char *route;
+    uint32_t hits;
+    uint32_t errors;
+    uint32_t buckets[ESP_CCHI_METRICS_BUCKETS];
+    uint32_t sum_us_lo;
+    uint32_t sum_us_hi;
+};
+
+static struct esp_cchi_metrics_route esp_cchi_metrics_routes[CONFIG_ESP_CCHI_METRICS_MAX_ROUTES];
+static uint32_t esp_cchi_metrics_unmatched = 0;
+static uint32_t esp_cchi_metrics_dropped = 0;
+
+static uint32_t esp_cchi_metrics_hash(const char *route, size_t len, httpd_method_t method) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char)route[i]) * 16777619u;
+    }
+    return (hash ^ (uint32_t)method) * 16777619u;
+}
+
+esp_cchi_metrics_slot_t esp_cchi_metrics_slot(const char *route, httpd_method_t method) {
+    if (route == NULL) {
+        return NULL;
+    }
+    size_t len = strlen(route);
+    uint32_t hash = esp_cchi_metrics_hash(route, len, method);
+    size_t i = hash % CONFIG_ESP_CCHI_METRICS_MAX_ROUTES;
+    for (size_t probes = 0; probes < CONFIG_ESP_CCHI_METRICS_MAX_ROUTES; probes++) {
+        struct esp_cchi_metrics_route *slot = &esp_cchi_metrics_routes[i];
+        uint32_t state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+        if (state == ESP_CCHI_METRICS_EMPTY &&
+            __atomic_compare_exchange_n(&slot->state, &state, ESP_CCHI_METRICS_CLAIMED, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+        {
+            slot->route = malloc(len + 1);
+            if (slot->route == NULL) {
+                __atomic_store_n(&slot->state, ESP_CCHI_METRICS_EMPTY, __ATOMIC_RELEASE);
+                return NULL;
+            }
+            memcpy(slot->route, route, len + 1);
+            slot->hash = hash;
+            slot->method = (uint32_t)method;
+            __atomic_store_n(&slot->state, ESP_CCHI_METRICS_READY, __ATOMIC_RELEASE);
+            return slot;
+        }
+        if (state == ESP_CCHI_METRICS_READY &&
+            slot->hash == hash &&
+            slot->method == (uint32_t)method &&
+            strcmp(slot->route, route) == 0)
+        {
+            return slot;
+        }
+        // A slot being claimed may be for this same route, but waiting for it could block the
+        // task, so it's skipped (only the first samples of 2 racing routes can be split)
+        i = (i + 1) % CONFIG_ESP_CCHI_METRICS_MAX_ROUTES;
+    }
+    return NULL;
+}
+
+void esp_cchi_metrics_record_slot(esp_cchi_metrics_slot_t slot,
+                                  esp_err_t err,
+                                  uint32_t latency_us)
+{
+    if (slot == NULL) {
+        __atomic_fetch_add(&esp_cchi_metrics_dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    size_t bucket = 0;
+    while (bucket < ESP_CCHI_METRICS_BUCKETS - 1 &&
+           latency_us > esp_cchi_metrics_bounds_us[bucket])
+    {
+        bucket++;
+    }
+    __atomic_fetch_add(&slot->buckets[bucket], 1, __ATOMIC_RELAXED);
+    if (err != ESP_OK) {
+        __atomic_fetch_add(&slot->errors, 1, __ATOMIC_RELAXED);
+    }
+    uint32_t sum_lo = __atomic_fetch_add(&slot->sum_us_lo, latency_us, __ATOMIC_RELAXED);
+    if (sum_lo + latency_us < sum_lo) {
+        __atomic_fetch_add(&slot->sum_us_hi, 1, __ATOMIC_RELAXED);
+    }
+    // Hits last, so a scrape never sees more hits than bucket samples
+    __atomic_fetch_add(&slot->hits, 1, __ATOMIC_RELEASE);
+}
+
+esp_err_t esp_cchi_metrics_record(const char *route,
+                                  httpd_method_t method,
+                                  esp_err_t err,
+                                  uint32_t latency_us)
+{
+    if (route == NULL) {
+        __atomic_fetch_add(&esp_cchi_metrics_unmatched, 1, __ATOMIC_RELAXED);
+        return ESP_OK;
+    }
+    esp_cchi_metrics_slot_t slot = esp_cchi_metrics_slot(route, method);
+    esp_cchi_metrics_record_slot(slot, err, latency_us);
+    return slot != NULL ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+/**
+ * Output of esp_cchi_metrics_handler, the text is buffered and sent in chunks, the first error
+ * sending a chunk is kept and makes the following writes no-ops
+*/
+struct esp_cchi_metrics_out {
+    httpd_req_t *r;
+    char buf[ESP_CCHI_METRICS_OUT_SIZE];
+    size_t len;
+    esp_err_t err;
+};
+
+static void esp_cchi_metrics_flush(struct esp_cchi_metrics_out *out) {
+    if (out->err == ESP_OK && out->len > 0) {
+        out->err = httpd_resp_send_chunk(out->r, out->buf, (ssize_t)out->len);
+    }
+    out->len = 0;
+}
+
+static void esp_cchi_metrics_printf(struct esp_cchi_metrics_out *out, const char *format, ...) {
+    for (int attempt = 0; attempt < 2 && out->err == ESP_OK; attempt++) {
+        size_t available = sizeof(out->buf) - out->len;
+        va_list args;
+        va_start(args, format);
+        int len = vsnprintf(out->buf + out->len, available, format, args);
+        va_end(args);
+        if (len < 0) {
+            return;
+        }
+        if ((size_t)len < available) {
+            out->len += (size_t)len;
+            return;
+        }
+        // Doesn't fit, the lines are far shorter than the buffer, so it fits once flushed
+        esp_cchi_metrics_flush(out);
+    }
+}
+
+// Writes the labels of a route, its whole pattern escaped as a Prometheus label value
+static void esp_cchi_metrics_labels(struct esp_cchi_metrics_out *out,
+                                    const struct esp_cchi_metrics_route *slot)
+{
+    esp_cchi_metrics_printf(out, "method=\"%s\",route=\"",
+                            http_method_str((enum http_method)slot->method));
+    for (const char *c = slot->route; *c != '\0' && out->err == ESP_OK; c++) {
+        // Room for an escaped character
+        if (sizeof(out->buf) - out->len < 2) {
+            esp_cchi_metrics_flush(out);
+        }
+        if (*c == '\\' || *c == '"') {
+            out->buf[out->len++] = '\\';
+        }
+        out->buf[out->len++] = *c;
+    }
+    esp_cchi_metrics_printf(out, "\"");
+}
+
+esp_err_t esp_cchi_metrics_handler(httpd_req_t *r) {
+    struct esp_cchi_metrics_out out = {
+        .r = r,
+        .len = 0,
+        .err = ESP_OK,
+    };
+    httpd_resp_set_type(r, "text/plain; version=0.0.4");
+
+    static const char *const counters[] = { "requests", "errors" };
+    for (size_t c = 0; c < sizeof(counters) / sizeof(counters[0]); c++) {
+        esp_cchi_metrics_printf(&out, "# TYPE esp_cchi_%s_total counter\n", counters[c]);
+        for (size_t i = 0; i < CONFIG_ESP_CCHI_METRICS_MAX_ROUTES; i++) {
+            struct esp_cchi_metrics_route *slot = &esp_cchi_metrics_routes[i];
+            if (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) != ESP_CCHI_METRICS_READY) {
+                continue;
+            }
+            uint32_t value = __atomic_load_n(c == 0 ? &slot->hits : &slot->errors,
+                                             __ATOMIC_ACQUIRE);
+            esp_cchi_metrics_printf(&out, "esp_cchi_%s_total{", counters[c]);
+            esp_cchi_metrics_labels(&out, slot);
+            esp_cchi_metrics_printf(&out, "} %" PRIu32 "\n", value);
+        }
+    }
+
+    esp_cchi_metrics_printf(&out, "# TYPE esp_cchi_request_duration_seconds histogram\n");
+    for (size_t i = 0; i < CONFIG_ESP_CCHI_METRICS_MAX_ROUTES; i++) {
+        struct esp_cchi_metrics_route *slot = &esp_cchi_metrics_routes[i];
+        if (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) != ESP_CCHI_METRICS_READY) {
+            continue;
+        }
+
+        // The buckets are exported cumulative, as Prometheus expects them
+        uint32_t count = 0;
+        for (size_t b = 0; b < ESP_CCHI_METRICS_BUCKETS; b++) {
+            count += __atomic_load_n(&slot->buckets[b], __ATOMIC_RELAXED);
+            esp_cchi_metrics_printf(&out, "esp_cchi_request_duration_seconds_bucket{");
+            esp_cchi_metrics_labels(&out, slot);
+            esp_cchi_metrics_printf(&out, ",le=\"%s\"} %" PRIu32 "\n",
+                                    esp_cchi_metrics_bounds_le[b], count);
+        }
+        uint32_t sum_hi, sum_lo;
+        do {
+            sum_hi = __atomic_load_n(&slot->sum_us_hi, __ATOMIC_ACQUIRE);
+            sum_lo = __atomic_load_n(&slot->sum_us_lo, __ATOMIC_ACQUIRE);
+        } while (sum_hi != __atomic_load_n(&slot->sum_us_hi, __ATOMIC_ACQUIRE));
+        uint64_t sum_us = ((uint64_t)sum_hi << 32) | sum_lo;
+        esp_cchi_metrics_printf(&out, "esp_cchi_request_duration_seconds_sum{");
+        esp_cchi_metrics_labels(&out, slot);
+        esp_cchi_metrics_printf(&out, "} %" PRIu64 ".%06" PRIu64 "\n",
+                                sum_us / 1000000, sum_us % 1000000);
+        esp_cchi_metrics_printf(&out, "esp_cchi_request_duration_seconds_count{");
+        esp_cchi_metrics_labels(&out, slot);
+        esp_cchi_metrics_printf(&out, "} %" PRIu32 "\n", count);
+    }
+
+    esp_cchi_metrics_printf(&out,
+                            "# TYPE esp_cchi_unmatched_requests_total counter\n"
+                            "esp_cchi_unmatched_requests_total %" PRIu32 "\n"
+                            "# TYPE esp_cchi_metrics_dropped_total counter\n"
+                            "esp_cchi_metrics_dropped_total %" PRIu32 "\n",
+                            __atomic_load_n(&esp_cchi_metrics_unmatched, __ATOMIC_RELAXED),
+                            __atomic_load_n(&esp_cchi_metrics_dropped, __ATOMIC_RELAXED));
+    esp_cchi_metrics_flush(&out);
+    if (out.err != ESP_OK) {
+        return out.err;
+    }
+    return httpd_resp_send_chunk(r, NULL, 0);
+}
@@ -0,0 +1,1529 @@
+#include <esp_http_server.h>
+#include <esp_cchi/arena.h>
+#include <esp_cchi/middleware.h>
+#include <esp_cchi/router.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <middlewares.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "sdkconfig.h"
+
+#ifndef CONFIG_ESP_CCHI_LOGGER_RING_LEN
+#define CONFIG_ESP_CCHI_LOGGER_RING_LEN 64
+#endif
+
+#if (CONFIG_ESP_CCHI_LOGGER_RING_LEN & (CONFIG_ESP_CCHI_LOGGER_RING_LEN - 1)) != 0
+#error "CONFIG_ESP_CCHI_LOGGER_RING_LEN must be a power of 2"
+#endif
+
+// Receive timeouts in a row tolerated while reading a body, the client is given up after that
+#define MIDDLEWARES_BODY_RECV_RETRIES 3
+
+#define MIDDLEWARES_CT_NOT_BUILT 0
+#define MIDDLEWARES_CT_BUILDING  1
+#define MIDDLEWARES_CT_READY     2
+
+static inline char middlewares_lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+// tchar of RFC 9110, the characters allowed in the type and the subtype
+static bool middlewares_is_tchar(char c) {
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+        return true;
+    }
+    return c != '\0' && strchr("!#$%&'*+-.^_`|~", c) != NULL;
+}
+
+static size_t middlewares_skip_ows(const char *str, size_t len, size_t i) {
+    while (i < len && (str[i] == ' ' || str[i] == '\t')) {
+        i++;
+    }
+    return i;
+}
+
+static size_t middlewares_skip_token(const char *str, size_t len, size_t i) {
+    while (i < len && middlewares_is_tchar(str[i])) {
+        i++;
+    }
+    return i;
+}
+
+/**
+ * Finds the "type/subtype" of the media type in "str" (surrounding whitespace and parameters are
+ * skipped, not validated)
+ *
+ * @returns
+ *  - ESP_OK on success, "start" and "media_type_len" delimit it in "str"
+ *  - ESP_ERR_INVALID_SIZE if "str" ends before the media type is known to be complete, only when
+ *    "truncated" is set
+ *  - ESP_FAIL if it's malformed
+*/
+static esp_err_t middlewares_parse_media_type(const char *str,
+                                              size_t len,
+                                              bool truncated,
+                                              size_t *start,
+                                              size_t *media_type_len)
+{
+    size_t type = middlewares_skip_ows(str, len, 0);
+    size_t slash = middlewares_skip_token(str, len, type);
+    if (slash == len && truncated) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (slash == type || slash == len || str[slash] != '/') {
+        return ESP_FAIL;
+    }
+    size_t end = middlewares_skip_token(str, len, slash + 1);
+    size_t next = middlewares_skip_ows(str, len, end);
+    if (next == len && truncated) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (end == slash + 1 || (next < len && str[next] != ';')) {
+        return ESP_FAIL;
+    }
+    *start = type;
+    *media_type_len = end - type;
+    return ESP_OK;
+}
+
+static uint32_t middlewares_hash_nocase(const char *str, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)middlewares_lower(str[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static bool middlewares_eq_nocase(const char *a, const char *b, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (middlewares_lower(a[i]) != middlewares_lower(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Fills the hash table of "allowed", the malformed entries of the list are left out
+static void middlewares_content_types_build(middlewares_content_types_t *allowed) {
+    for (size_t i = 0; i < allowed->list_len; i++) {
+        const char *entry = allowed->list[i];
+        size_t start, len;
+        if (entry == NULL ||
+            middlewares_parse_media_type(entry, strlen(entry), false, &start, &len) != ESP_OK)
+        {
+            continue;
+        }
+        uint32_t hash = middlewares_hash_nocase(entry + start, len);
+        size_t slot = hash % allowed->slots_len;
+        while (allowed->slots[slot].media_type != NULL) {
+            slot = (slot + 1) % allowed->slots_len;
+        }
+        allowed->slots[slot] = (middlewares_media_type_slot_t){
+            .media_type = entry + start,
+            .len = len,
+            .hash = hash,
+        };
+    }
+}
+
+static bool middlewares_content_types_find(middlewares_content_types_t *allowed,
+                                           const char *media_type,
+                                           size_t len)
+{
+    int expected = MIDDLEWARES_CT_NOT_BUILT;
+    if (__atomic_load_n(&allowed->state, __ATOMIC_ACQUIRE) != MIDDLEWARES_CT_READY &&
+        __atomic_compare_exchange_n(&allowed->state, &expected, MIDDLEWARES_CT_BUILDING, false,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    {
+        middlewares_content_types_build(allowed);
+        __atomic_store_n(&allowed->state, MIDDLEWARES_CT_READY, __ATOMIC_RELEASE);
+    }
+
+    if (__atomic_load_n(&allowed->state, __ATOMIC_ACQUIRE) != MIDDLEWARES_CT_READY) {
+        // Another task is building the table, scan the list instead of waiting for it
+        for (size_t i = 0; i < allowed->list_len; i++) {
+            const char *entry = allowed->list[i];
+            size_t start, entry_len;
+            if (entry != NULL &&
+                middlewares_parse_media_type(entry, strlen(entry), false, &start,
+                                             &entry_len) == ESP_OK &&
+                entry_len == len && middlewares_eq_nocase(entry + start, media_type, len))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint32_t hash = middlewares_hash_nocase(media_type, len);
+    for (size_t slot = hash % allowed->slots_len; allowed->slots[slot].media_type != NULL;
+         slot = (slot + 1) % allowed->slots_len)
+    {
+        const middlewares_media_type_slot_t *entry = &allowed->slots[slot];
+        if (entry->hash == hash && entry->len == len &&
+            middlewares_eq_nocase(entry->media_type, media_type, len))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+esp_err_t middlewares_check_content_type(httpd_req_t *r, middlewares_content_types_t *allowed) {
+    if (allowed->list_len == 0) {
+        return ESP_OK;
+    }
+
+    const char *status = "415 Unsupported Media Type";
+    size_t ct_size = httpd_req_get_hdr_value_len(r, "Content-Type") + 1;
+    if (ct_size > MIDDLEWARES_CONTENT_TYPE_MAX_LEN) {
+        ct_size = MIDDLEWARES_CONTENT_TYPE_MAX_LEN;
+    }
+    char *ct_buf = esp_cchi_arena_take(r, ct_size);
+    if (ct_buf == NULL) {
+        httpd_resp_send_err(r, HTTPD_500_INTERNAL_SERVER_ERROR, NULL);
+        return ESP_FAIL;
+    }
+    esp_err_t err = httpd_req_get_hdr_value_str(r, "Content-Type", ct_buf, ct_size);
+    if (err != ESP_OK && err != ESP_ERR_HTTPD_RESULT_TRUNC) {
+        status = HTTPD_400;
+        goto fail;
+    }
+
+    size_t start, len;
+    err = middlewares_parse_media_type(ct_buf, strlen(ct_buf), err == ESP_ERR_HTTPD_RESULT_TRUNC,
+                                       &start, &len);
+    if (err == ESP_FAIL) {
+        status = HTTPD_400;
+        goto fail;
+    }
+    // A media type that doesn't fit in the buffer is longer than any that can be allowed
+    if (err == ESP_OK && middlewares_content_types_find(allowed, ct_buf + start, len)) {
+        esp_cchi_arena_release(r, ct_buf, ct_size);
+        return ESP_OK;
+    }
+
+fail:
+    esp_cchi_arena_release(r, ct_buf, ct_size);
+    httpd_resp_set_status(r, status);
+    httpd_resp_send(r, NULL, 0);
+    return ESP_FAIL;
+}
+
+static const char *TAG = "middlewares_logger";
+
+/**
+ * esp_http_server doesn't tell the status nor the size of the response, so a record has what the
+ * handler returned and the Content-Length of the request instead. "route" is the start of the
+ * pattern, "route_truncated" tells whether it was cut
+*/
+struct middlewares_log_record {
+    uint32_t latency_us;
+    uint32_t req_content_len;
+    esp_err_t handler_result;
+    uint8_t method;
+    bool route_truncated;
+    char route[MIDDLEWARES_LOGGER_ROUTE_LEN];
+};
+
+/**
+ * Bounded MPSC queue, every slot has a sequence number that tells whether it's free for the
+ * producer of position "seq" or filled for the consumer of position "seq - 1". The stored "seq"
+ * is relative to the index of the slot, so the zero-initialized ring starts with every slot free
+*/
+struct middlewares_log_slot {
+    uint32_t seq;
+    struct middlewares_log_record record;
+};
+
+#define MIDDLEWARES_LOG_RING_MASK (CONFIG_ESP_CCHI_LOGGER_RING_LEN - 1)
+
+static struct middlewares_log_slot middlewares_log_ring[CONFIG_ESP_CCHI_LOGGER_RING_LEN];
+static uint32_t middlewares_log_head = 0;
+static uint32_t middlewares_log_tail = 0;
+static uint32_t middlewares_log_dropped = 0;
+static uint32_t middlewares_log_dropped_reported = 0;
+static int middlewares_log_started = 0;
+
+// Claims the next free slot of the ring, NULL if it's full
+static struct middlewares_log_slot *middlewares_log_claim(uint32_t *pos) {
+    uint32_t head = __atomic_load_n(&middlewares_log_head, __ATOMIC_RELAXED);
+    for (;;) {
+        uint32_t index = head & MIDDLEWARES_LOG_RING_MASK;
+        struct middlewares_log_slot *slot = &middlewares_log_ring[index];
+        uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) + index;
+        int32_t diff = (int32_t)(seq - head);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&middlewares_log_head, &head, head + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                *pos = head;
+                return slot;
+            }
+        } else if (diff < 0) {
+            return NULL;
+        } else {
+            head = __atomic_load_n(&middlewares_log_head, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static void middlewares_logger_done(httpd_req_t *r, esp_err_t err, void *arg) {
+    uint32_t pos;
+    struct middlewares_log_slot *slot = middlewares_log_claim(&pos);
+    if (slot == NULL) {
+        __atomic_fetch_add(&middlewares_log_dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    struct middlewares_log_record *record = &slot->record;
+    record->latency_us = (uint32_t)(esp_timer_get_time() - *(int64_t*)arg);
+    record->req_content_len = (uint32_t)r->content_len;
+    record->handler_result = err;
+    record->method = (uint8_t)r->method;
+    const char *route = esp_cchi_get_route_pattern(r);
+    size_t route_len = route != NULL ? strlen(route) : strcspn(r->uri, "?#");
+    if (route == NULL) {
+        route = r->uri;
+    }
+    record->route_truncated = route_len > sizeof(record->route) - 1;
+    if (record->route_truncated) {
+        route_len = sizeof(record->route) - 1;
+    }
+    memcpy(record->route, route, route_len);
+    record->route[route_len] = '\0';
+
+    uint32_t index = pos & MIDDLEWARES_LOG_RING_MASK;
+    __atomic_store_n(&slot->seq, pos + 1 - index, __ATOMIC_RELEASE);
+}
+
+esp_err_t middlewares_logger(httpd_req_t *r) {
+    int64_t *start = esp_cchi_arena_alloc(r, sizeof(int64_t));
+    if (start == NULL || esp_cchi_arena_on_done(r, middlewares_logger_done, start) != ESP_OK) {
+        __atomic_fetch_add(&middlewares_log_dropped, 1, __ATOMIC_RELAXED);
+        return ESP_OK;
+    }
+    *start = esp_timer_get_time();
+    return ESP_OK;
+}
+
+size_t middlewares_logger_flush(void) {
+    size_t flushed = 0;
+    for (;;) {
+        uint32_t tail = middlewares_log_tail;
+        uint32_t index = tail & MIDDLEWARES_LOG_RING_MASK;
+        struct middlewares_log_slot *slot = &middlewares_log_ring[index];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) + index != tail + 1) {
+            break;
+        }
+        // Copied out so the slot is given back before the slow part
+        struct middlewares_log_record record = slot->record;
+        __atomic_store_n(&slot->seq, tail + CONFIG_ESP_CCHI_LOGGER_RING_LEN - index,
+                         __ATOMIC_RELEASE);
+        middlewares_log_tail = tail + 1;
+
+        ESP_LOGI(TAG, "%s %s%s handler=%s %" PRIu32 "us req_len=%" PRIu32,
+                 http_method_str((enum http_method)record.method), record.route,
+                 record.route_truncated ? "..." : "", esp_err_to_name(record.handler_result),
+                 record.latency_us, record.req_content_len);
+        flushed++;
+    }
+
+    uint32_t dropped = __atomic_load_n(&middlewares_log_dropped, __ATOMIC_RELAXED);
+    if (dropped != middlewares_log_dropped_reported) {
+        ESP_LOGW(TAG, "%" PRIu32 " records dropped", dropped - middlewares_log_dropped_reported);
+        middlewares_log_dropped_reported = dropped;
+    }
+    return flushed;
+}
+
+uint32_t middlewares_logger_dropped(void) {
+    return __atomic_load_n(&middlewares_log_dropped, __ATOMIC_RELAXED);
+}
+
+static void middlewares_logger_task(void *arg) {
+    TickType_t period = pdMS_TO_TICKS(*(uint32_t*)arg);
+    if (period == 0) {
+        period = 1;
+    }
+    for (;;) {
+        middlewares_logger_flush();
+        vTaskDelay(period);
+    }
+}
+
+esp_err_t middlewares_logger_start(const middlewares_logger_config_t *config) {
+    if (config == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int expected = 0;
+    if (!__atomic_compare_exchange_n(&middlewares_log_started, &expected, 1, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    static uint32_t flush_period_ms;
+    flush_period_ms = config->flush_period_ms;
+    if (xTaskCreate(middlewares_logger_task, "cchi_logger", config->stack_size, &flush_period_ms,
+                    config->task_priority, NULL) != pdPASS)
+    {
+        __atomic_store_n(&middlewares_log_started, 0, __ATOMIC_RELEASE);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t middlewares_check_body_len(httpd_req_t *r, size_t max_len) {
+    if (r->content_len > max_len) {
+        httpd_resp_set_status(r, "413 Content Too Large");
+        httpd_resp_send(r, NULL, 0);
+        return ESP_FAIL;
+    }
+    // esp_http_server only frames the body by its Content-Length
+    if (httpd_req_get_hdr_value_len(r, "Content-Length") == 0 &&
+        httpd_req_get_hdr_value_len(r, "Transfer-Encoding") > 0)
+    {
+        httpd_resp_send_err(r, HTTPD_411_LENGTH_REQUIRED, NULL);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t middlewares_body_read(httpd_req_t *r,
+                                size_t max_len,
+                                middlewares_body_chunk_fn_t fn,
+                                void *arg)
+{
+    if (r == NULL || fn == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (middlewares_check_body_len(r, max_len) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    char *buf = esp_cchi_arena_take(r, MIDDLEWARES_BODY_CHUNK_LEN);
+    if (buf == NULL) {
+        httpd_resp_send_err(r, HTTPD_500_INTERNAL_SERVER_ERROR, NULL);
+        return ESP_FAIL;
+    }
+    esp_err_t err = ESP_OK;
+    size_t remaining = r->content_len;
+    int timeouts = 0;
+    while (err == ESP_OK && remaining > 0) {
+        int received = httpd_req_recv(r, buf, remaining < MIDDLEWARES_BODY_CHUNK_LEN ?
+                                              remaining : MIDDLEWARES_BODY_CHUNK_LEN);
+        if (received == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts <= MIDDLEWARES_BODY_RECV_RETRIES) {
+            continue;
+        }
+        if (received <= 0) {
+            // 0 is a closed connection, there is nobody to respond to
+            if (received == HTTPD_SOCK_ERR_TIMEOUT) {
+                httpd_resp_send_err(r, HTTPD_408_REQ_TIMEOUT, NULL);
+            }
+            err = ESP_FAIL;
+            break;
+        }
+        timeouts = 0;
+        remaining -= (size_t)received;
+        err = fn(r, buf, (size_t)received, arg);
+    }
+    if (err == ESP_OK) {
+        err = fn(r, buf, 0, arg);
+    }
+    esp_cchi_arena_release(r, buf, MIDDLEWARES_BODY_CHUNK_LEN);
+    return err;
+}
+
+esp_err_t middlewares_form_parser_init(middlewares_form_parser_t *parser,
+                                       char *buf,
+                                       size_t buf_size,
+                                       middlewares_form_field_fn_t fn,
+                                       void *arg)
+{
+    if (parser == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // A NULL .buf is rejected by middlewares_form_feed
+    *parser = (middlewares_form_parser_t){ 0 };
+    // Room for the NULs of the key and the value, middlewares_form_end_key relies on it
+    if (buf == NULL || buf_size < 2 || fn == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    parser->buf = buf;
+    parser->buf_size = buf_size;
+    parser->fn = fn;
+    parser->arg = arg;
+    return ESP_OK;
+}
+
+static int middlewares_hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c = middlewares_lower(c);
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+// Appends a decoded byte to the field, keeping room for the NULs of the key and the value
+static esp_err_t middlewares_form_put(middlewares_form_parser_t *parser, char c) {
+    size_t reserved = parser->in_value ? 1 : 2;
+    if (parser->len + 1 + reserved > parser->buf_size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    parser->buf[parser->len++] = c;
+    return ESP_OK;
+}
+
+// An escape that turned out not to be one is kept as it is
+static esp_err_t middlewares_form_put_escape(middlewares_form_parser_t *parser) {
+    esp_err_t err = ESP_OK;
+    if (parser->escape >= 1) {
+        err = middlewares_form_put(parser, '%');
+    }
+    if (err == ESP_OK && parser->escape == 2) {
+        err = middlewares_form_put(parser, parser->escape_digit);
+    }
+    parser->escape = 0;
+    return err;
+}
+
+static void middlewares_form_end_key(middlewares_form_parser_t *parser) {
+    parser->buf[parser->len++] = '\0';
+    parser->key_len = parser->len - 1;
+    parser->in_value = true;
+}
+
+static esp_err_t middlewares_form_end_field(httpd_req_t *r, middlewares_form_parser_t *parser) {
+    esp_err_t err = middlewares_form_put_escape(parser);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (!parser->in_value) {
+        // Empty fields ("a=1&&b=2") are skipped
+        if (parser->len == 0) {
+            return ESP_OK;
+        }
+        middlewares_form_end_key(parser);
+    }
+    parser->buf[parser->len] = '\0';
+    const char *value = parser->buf + parser->key_len + 1;
+    err = parser->fn(r, parser->buf, parser->key_len, value, parser->len - parser->key_len - 1,
+                     parser->arg);
+    parser->len = 0;
+    parser->key_len = 0;
+    parser->in_value = false;
+    return err;
+}
+
+esp_err_t middlewares_form_feed(httpd_req_t *r, const char *chunk, size_t len, void *arg) {
+    middlewares_form_parser_t *parser = (middlewares_form_parser_t*)arg;
+    if (parser == NULL || parser->buf == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (len == 0) {
+        return middlewares_form_end_field(r, parser);
+    }
+    for (size_t i = 0; i < len; i++) {
+        char c = chunk[i];
+        esp_err_t err = ESP_OK;
+        if (parser->escape != 0) {
+            int digit = middlewares_hex_value(c);
+            if (digit >= 0 && parser->escape == 1) {
+                parser->escape_digit = c;
+                parser->escape = 2;
+                continue;
+            }
+            if (digit >= 0) {
+                parser->escape = 0;
+                c = (char)(middlewares_hex_value(parser->escape_digit) * 16 + digit);
+                if ((err = middlewares_form_put(parser, c)) != ESP_OK) {
+                    return err;
+                }
+                continue;
+            }
+            if ((err = middlewares_form_put_escape(parser)) != ESP_OK) {
+                return err;
+            }
+        }
+
+        if (c == '&') {
+            err = middlewares_form_end_field(r, parser);
+        } else if (c == '=' && !parser->in_value) {
+            middlewares_form_end_key(parser);
+        } else if (c == '%') {
+            parser->escape = 1;
+        } else {
+            err = middlewares_form_put(parser, c == '+' ? ' ' : c);
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+// What the JSON tokenizer expects next (middlewares_json_parser_t.expect)
+#define MIDDLEWARES_JSON_EXPECT_VALUE        0
+#define MIDDLEWARES_JSON_EXPECT_VALUE_OR_END 1
+#define MIDDLEWARES_JSON_EXPECT_KEY          2
+#define MIDDLEWARES_JSON_EXPECT_KEY_OR_END   3
+#define MIDDLEWARES_JSON_EXPECT_COLON        4
+#define MIDDLEWARES_JSON_EXPECT_COMMA_OR_END 5
+#define MIDDLEWARES_JSON_EXPECT_NOTHING      6
+
+// Token being read by the JSON tokenizer (middlewares_json_parser_t.lex)
+#define MIDDLEWARES_JSON_LEX_NONE    0
+#define MIDDLEWARES_JSON_LEX_STRING  1
+#define MIDDLEWARES_JSON_LEX_ESCAPE  2
+#define MIDDLEWARES_JSON_LEX_UNICODE 3
+#define MIDDLEWARES_JSON_LEX_NUMBER  4
+#define MIDDLEWARES_JSON_LEX_LITERAL 5
+
+esp_err_t middlewares_json_parser_init(middlewares_json_parser_t *parser,
+                                       char *buf,
+                                       size_t buf_size,
+                                       middlewares_json_token_fn_t fn,
+                                       void *arg)
+{
+    if (parser == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // A NULL .buf is rejected by middlewares_json_feed
+    *parser = (middlewares_json_parser_t){ 0 };
+    if (buf == NULL || buf_size == 0 || fn == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    parser->buf = buf;
+    parser->buf_size = buf_size;
+    parser->expect = MIDDLEWARES_JSON_EXPECT_VALUE;
+    parser->lex = MIDDLEWARES_JSON_LEX_NONE;
+    parser->fn = fn;
+    parser->arg = arg;
+    return ESP_OK;
+}
+
+static inline bool middlewares_is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// Appends a byte to the token, keeping room for its NUL
+static esp_err_t middlewares_json_put(middlewares_json_parser_t *parser, char c) {
+    if (parser->len + 2 > parser->buf_size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    parser->buf[parser->len++] = c;
+    return ESP_OK;
+}
+
+// Appends the code point of a \uXXXX escape as UTF-8, surrogate pairs are joined
+static esp_err_t middlewares_json_put_unicode(middlewares_json_parser_t *parser) {
+    uint32_t code_point = parser->unicode;
+    if (code_point >= 0xd800 && code_point <= 0xdbff) {
+        if (parser->high_surrogate != 0) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        parser->high_surrogate = (uint16_t)code_point;
+        return ESP_OK;
+    }
+    if (code_point >= 0xdc00 && code_point <= 0xdfff) {
+        if (parser->high_surrogate == 0) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        code_point = 0x10000 + ((uint32_t)(parser->high_surrogate - 0xd800) << 10) +
+                     (code_point - 0xdc00);
+        parser->high_surrogate = 0;
+    } else if (parser->high_surrogate != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    char utf8[4];
+    size_t len;
+    if (code_point < 0x80) {
+        utf8[0] = (char)code_point;
+        len = 1;
+    } else if (code_point < 0x800) {
+        utf8[0] = (char)(0xc0 | (code_point >> 6));
+        utf8[1] = (char)(0x80 | (code_point & 0x3f));
+        len = 2;
+    } else if (code_point < 0x10000) {
+        utf8[0] = (char)(0xe0 | (code_point >> 12));
+        utf8[1] = (char)(0x80 | ((code_point >> 6) & 0x3f));
+        utf8[2] = (char)(0x80 | (code_point & 0x3f));
+        len = 3;
+    } else {
+        utf8[0] = (char)(0xf0 | (code_point >> 18));
+        utf8[1] = (char)(0x80 | ((code_point >> 12) & 0x3f));
+        utf8[2] = (char)(0x80 | ((code_point >> 6) & 0x3f));
+        utf8[3] = (char)(0x80 | (code_point & 0x3f));
+        len = 4;
+    }
+    for (size_t i = 0; i < len; i++) {
+        esp_err_t err = middlewares_json_put(parser, utf8[i]);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+static bool middlewares_json_is_number(const char *it) {
+    if (*it == '-') {
+        it++;
+    }
+    if (*it == '0') {
+        it++;
+    } else if (middlewares_is_digit(*it)) {
+        while (middlewares_is_digit(*it)) {
+            it++;
+        }
+    } else {
+        return false;
+    }
+    if (*it == '.') {
+        it++;
+        if (!middlewares_is_digit(*it)) {
+            return false;
+        }
+        while (middlewares_is_digit(*it)) {
+            it++;
+        }
+    }
+    if (*it == 'e' || *it == 'E') {
+        it++;
+        if (*it == '+' || *it == '-') {
+            it++;
+        }
+        if (!middlewares_is_digit(*it)) {
+            return false;
+        }
+        while (middlewares_is_digit(*it)) {
+            it++;
+        }
+    }
+    return *it == '\0';
+}
+
+// Passes a value (or the end of a container) to the callback, the container goes on after it
+static esp_err_t middlewares_json_value(httpd_req_t *r,
+                                        middlewares_json_parser_t *parser,
+                                        middlewares_json_token_t token,
+                                        const char *text,
+                                        size_t len)
+{
+    parser->expect = parser->depth == 0 ? MIDDLEWARES_JSON_EXPECT_NOTHING :
+                                          MIDDLEWARES_JSON_EXPECT_COMMA_OR_END;
+    return parser->fn(r, token, text, len, parser->depth, parser->arg);
+}
+
+static esp_err_t middlewares_json_end_string(httpd_req_t *r, middlewares_json_parser_t *parser) {
+    parser->lex = MIDDLEWARES_JSON_LEX_NONE;
+    if (parser->high_surrogate != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    parser->buf[parser->len] = '\0';
+    if (!parser->is_key) {
+        return middlewares_json_value(r, parser, MIDDLEWARES_JSON_STRING, parser->buf,
+                                      parser->len);
+    }
+    parser->expect = MIDDLEWARES_JSON_EXPECT_COLON;
+    return parser->fn(r, MIDDLEWARES_JSON_KEY, parser->buf, parser->len, parser->depth,
+                      parser->arg);
+}
+
+static esp_err_t middlewares_json_end_number(httpd_req_t *r, middlewares_json_parser_t *parser) {
+    parser->lex = MIDDLEWARES_JSON_LEX_NONE;
+    parser->buf[parser->len] = '\0';
+    if (!middlewares_json_is_number(parser->buf)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return middlewares_json_value(r, parser, MIDDLEWARES_JSON_NUMBER, parser->buf, parser->len);
+}
+
+static esp_err_t middlewares_json_begin_container(httpd_req_t *r,
+                                                  middlewares_json_parser_t *parser,
+                                                  bool array)
+{
+    if (parser->depth == MIDDLEWARES_JSON_MAX_DEPTH) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    esp_err_t err = parser->fn(r, array ? MIDDLEWARES_JSON_ARRAY_BEGIN :
+                                          MIDDLEWARES_JSON_OBJECT_BEGIN,
+                               NULL, 0, parser->depth, parser->arg);
+    if (array) {
+        parser->arrays |= (uint32_t)1 << parser->depth;
+    } else {
+        parser->arrays &= ~((uint32_t)1 << parser->depth);
+    }
+    parser->depth++;
+    parser->expect = array ? MIDDLEWARES_JSON_EXPECT_VALUE_OR_END :
+                             MIDDLEWARES_JSON_EXPECT_KEY_OR_END;
+    return err;
+}
+
+// Only reached inside a container, "c" is ']' or '}'
+static esp_err_t middlewares_json_end_container(httpd_req_t *r,
+                                                middlewares_json_parser_t *parser,
+                                                char c)
+{
+    bool array = (parser->arrays >> (parser->depth - 1)) & 1;
+    if (array != (c == ']')) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    parser->depth--;
+    return middlewares_json_value(r, parser, array ? MIDDLEWARES_JSON_ARRAY_END :
+                                                     MIDDLEWARES_JSON_OBJECT_END,
+                                  NULL, 0);
+}
+
+static esp_err_t middlewares_json_begin_value(httpd_req_t *r,
+                                              middlewares_json_parser_t *parser,
+                                              char c)
+{
+    parser->len = 0;
+    switch (c) {
+    case '{': case '[':
+        return middlewares_json_begin_container(r, parser, c == '[');
+    case '"':
+        parser->lex = MIDDLEWARES_JSON_LEX_STRING;
+        parser->is_key = false;
+        return ESP_OK;
+    case 't':
+        parser->literal = "true";
+        break;
+    case 'f':
+        parser->literal = "false";
+        break;
+    case 'n':
+        parser->literal = "null";
+        break;
+    default:
+        if (c != '-' && !middlewares_is_digit(c)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        parser->lex = MIDDLEWARES_JSON_LEX_NUMBER;
+        return middlewares_json_put(parser, c);
+    }
+    parser->lex = MIDDLEWARES_JSON_LEX_LITERAL;
+    parser->literal_len = 1;
+    return ESP_OK;
+}
+
+// Char of the escape "\<c>", -1 if it's not one ("\u" escapes are read apart)
+static int middlewares_json_unescape(char c) {
+    switch (c) {
+    case '"': case '\\': case '/':
+        return c;
+    case 'b':
+        return '\b';
+    case 'f':
+        return '\f';
+    case 'n':
+        return '\n';
+    case 'r':
+        return '\r';
+    case 't':
+        return '\t';
+    default:
+        return -1;
+    }
+}
+
+// Reads a char of the string being read
+static esp_err_t middlewares_json_string_char(httpd_req_t *r,
+                                              middlewares_json_parser_t *parser,
+                                              char c)
+{
+    if (parser->lex == MIDDLEWARES_JSON_LEX_UNICODE) {
+        int digit = middlewares_hex_value(c);
+        if (digit < 0) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        parser->unicode = (uint16_t)(parser->unicode * 16 + digit);
+        if (++parser->unicode_digits < 4) {
+            return ESP_OK;
+        }
+        parser->lex = MIDDLEWARES_JSON_LEX_STRING;
+        return middlewares_json_put_unicode(parser);
+    }
+    if (parser->lex == MIDDLEWARES_JSON_LEX_ESCAPE) {
+        if (c == 'u') {
+            parser->lex = MIDDLEWARES_JSON_LEX_UNICODE;
+            parser->unicode = 0;
+            parser->unicode_digits = 0;
+            return ESP_OK;
+        }
+        int unescaped = middlewares_json_unescape(c);
+        if (unescaped < 0 || parser->high_surrogate != 0) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        parser->lex = MIDDLEWARES_JSON_LEX_STRING;
+        return middlewares_json_put(parser, (char)unescaped);
+    }
+    if (c == '"') {
+        return middlewares_json_end_string(r, parser);
+    }
+    if (c == '\\') {
+        parser->lex = MIDDLEWARES_JSON_LEX_ESCAPE;
+        return ESP_OK;
+    }
+    // A high surrogate must be followed by the escape of its pair
+    if ((unsigned char)c < 0x20 || parser->high_surrogate != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return middlewares_json_put(parser, c);
+}
+
+static esp_err_t middlewares_json_char(httpd_req_t *r, middlewares_json_parser_t *parser, char c) {
+    switch (parser->lex) {
+    case MIDDLEWARES_JSON_LEX_STRING: case MIDDLEWARES_JSON_LEX_ESCAPE:
+    case MIDDLEWARES_JSON_LEX_UNICODE:
+        return middlewares_json_string_char(r, parser, c);
+    case MIDDLEWARES_JSON_LEX_LITERAL:
+        if (c != parser->literal[parser->literal_len]) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (parser->literal[++parser->literal_len] != '\0') {
+            return ESP_OK;
+        }
+        parser->lex = MIDDLEWARES_JSON_LEX_NONE;
+        return middlewares_json_value(r, parser,
+                                      parser->literal[0] == 't' ? MIDDLEWARES_JSON_TRUE :
+                                      parser->literal[0] == 'f' ? MIDDLEWARES_JSON_FALSE :
+                                                                  MIDDLEWARES_JSON_NULL,
+                                      NULL, 0);
+    case MIDDLEWARES_JSON_LEX_NUMBER: {
+        if (middlewares_is_digit(c) || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E') {
+            return middlewares_json_put(parser, c);
+        }
+        // The char after the number is read as any char after a value
+        esp_err_t err = middlewares_json_end_number(r, parser);
+        if (err != ESP_OK) {
+            return err;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+
+    if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+        return ESP_OK;
+    }
+    switch (parser->expect) {
+    case MIDDLEWARES_JSON_EXPECT_VALUE_OR_END:
+        if (c == ']') {
+            return middlewares_json_end_container(r, parser, c);
+        }
+        return middlewares_json_begin_value(r, parser, c);
+    case MIDDLEWARES_JSON_EXPECT_VALUE:
+        return middlewares_json_begin_value(r, parser, c);
+    case MIDDLEWARES_JSON_EXPECT_KEY_OR_END:
+        if (c == '}') {
+            return middlewares_json_end_container(r, parser, c);
+        }
+        // fall through
+    case MIDDLEWARES_JSON_EXPECT_KEY:
+        if (c != '"') {
+            return ESP_ERR_INVALID_ARG;
+        }
+        parser->lex = MIDDLEWARES_JSON_LEX_STRING;
+        parser->is_key = true;
+        parser->len = 0;
+        return ESP_OK;
+    case MIDDLEWARES_JSON_EXPECT_COLON:
+        if (c != ':') {
+            return ESP_ERR_INVALID_ARG;
+        }
+        parser->expect = MIDDLEWARES_JSON_EXPECT_VALUE;
+        return ESP_OK;
+    case MIDDLEWARES_JSON_EXPECT_COMMA_OR_END:
+        if (c == ']' || c == '}') {
+            return middlewares_json_end_container(r, parser, c);
+        }
+        if (c != ',') {
+            return ESP_ERR_INVALID_ARG;
+        }
+        parser->expect = ((parser->arrays >> (parser->depth - 1)) & 1) ?
+                         MIDDLEWARES_JSON_EXPECT_VALUE : MIDDLEWARES_JSON_EXPECT_KEY;
+        return ESP_OK;
+    default:
+        // Anything but whitespace after the top-level value
+        return ESP_ERR_INVALID_ARG;
+    }
+}
+
+esp_err_t middlewares_json_feed(httpd_req_t *r, const char *chunk, size_t len, void *arg) {
+    middlewares_json_parser_t *parser = (middlewares_json_parser_t*)arg;
+    if (parser == NULL || parser->buf == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (len == 0) {
+        // A top-level number is only known to be complete at the end of the body
+        if (parser->lex == MIDDLEWARES_JSON_LEX_NUMBER) {
+            esp_err_t err = middlewares_json_end_number(r, parser);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        return parser->lex == MIDDLEWARES_JSON_LEX_NONE &&
+               parser->expect == MIDDLEWARES_JSON_EXPECT_NOTHING ? ESP_OK : ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < len; i++) {
+        esp_err_t err = middlewares_json_char(r, parser, chunk[i]);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+/**
+ * Cached response, "data" has the key followed by the body. "prev" and "next" link it in the LRU
+ * list, "chain" in its bucket. An entry that is unlinked (evicted or invalidated) while a request
+ * is sending it ("refs") is marked "stale" and freed by the last one
+*/
+struct middlewares_cache_entry {
+    struct middlewares_cache_entry *prev;
+    struct middlewares_cache_entry *next;
+    struct middlewares_cache_entry *chain;
+    uint32_t hash;
+    uint32_t refs;
+    bool stale;
+    const char *type;
+    const char *cache_control;
+    size_t size;
+    size_t key_len;
+    size_t body_len;
+    char etag[MIDDLEWARES_CACHE_ETAG_LEN];
+    char data[];
+};
+
+/**
+ * Miss of a request, kept in its arena until the final handler stores the body with
+ * middlewares_cache_send. The misses of the requests being handled by a task are stacked
+*/
+struct middlewares_cache_miss {
+    httpd_req_t *r;
+    middlewares_cache_t *cache;
+    uint32_t generation;
+    uint32_t hash;
+    struct middlewares_cache_miss *prev;
+    size_t key_len;
+    char key[];
+};
+
+static _Thread_local struct middlewares_cache_miss *middlewares_cache_pending = NULL;
+
+esp_err_t middlewares_cache_init(middlewares_cache_t *cache, size_t budget) {
+    if (cache == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    SemaphoreHandle_t lock = xSemaphoreCreateMutex();
+    if (lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    *cache = (middlewares_cache_t){
+        .budget = budget,
+        .lock = lock,
+    };
+    return ESP_OK;
+}
+
+void middlewares_cache_deinit(middlewares_cache_t *cache) {
+    if (cache == NULL || cache->lock == NULL) {
+        return;
+    }
+    struct middlewares_cache_entry *entry = cache->head;
+    while (entry != NULL) {
+        struct middlewares_cache_entry *next = entry->next;
+        free(entry);
+        entry = next;
+    }
+    vSemaphoreDelete((SemaphoreHandle_t)cache->lock);
+    *cache = (middlewares_cache_t){0};
+}
+
+static uint32_t middlewares_hash(const void *data, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ ((const unsigned char*)data)[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Key of the cached response of "r": the route pattern followed by the value of every URI param,
+ * each one after a NUL, or the URI path if it was not routed by esp_cchi
+ *
+ * @returns Whether the key fits in "key" (MIDDLEWARES_CACHE_KEY_LEN bytes)
+*/
+static bool middlewares_cache_key(httpd_req_t *r, char *key, size_t *key_len) {
+    const char *route = esp_cchi_get_route_pattern(r);
+    if (route == NULL) {
+        size_t len = strcspn(r->uri, "?#");
+        if (len >= MIDDLEWARES_CACHE_KEY_LEN) {
+            return false;
+        }
+        memcpy(key, r->uri, len);
+        *key_len = len;
+        return true;
+    }
+
+    size_t len = strlen(route);
+    if (len >= MIDDLEWARES_CACHE_KEY_LEN) {
+        return false;
+    }
+    memcpy(key, route, len);
+    size_t count = esp_cchi_get_uri_param_count(r);
+    for (size_t i = 0; i < count; i++) {
+        esp_cchi_uri_param_t param;
+        if (esp_cchi_get_uri_param_at(r, i, &param) != ESP_OK ||
+            len + 1 + param.len >= MIDDLEWARES_CACHE_KEY_LEN)
+        {
+            return false;
+        }
+        key[len++] = '\0';
+        memcpy(key + len, r->uri + param.offset, param.len);
+        len += param.len;
+    }
+    *key_len = len;
+    return true;
+}
+
+// The following functions are called with the lock of the cache taken
+
+static struct middlewares_cache_entry **middlewares_cache_bucket(middlewares_cache_t *cache,
+                                                                 uint32_t hash)
+{
+    return &cache->buckets[hash % MIDDLEWARES_CACHE_BUCKETS];
+}
+
+static struct middlewares_cache_entry *middlewares_cache_find(middlewares_cache_t *cache,
+                                                              const char *key,
+                                                              size_t key_len,
+                                                              uint32_t hash)
+{
+    struct middlewares_cache_entry *entry = *middlewares_cache_bucket(cache, hash);
+    for (; entry != NULL; entry = entry->chain) {
+        if (entry->hash == hash && entry->key_len == key_len &&
+            memcmp(entry->data, key, key_len) == 0)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void middlewares_cache_link_front(middlewares_cache_t *cache,
+                                         struct middlewares_cache_entry *entry)
+{
+    entry->prev = NULL;
+    entry->next = cache->head;
+    if (cache->head != NULL) {
+        cache->head->prev = entry;
+    } else {
+        cache->tail = entry;
+    }
+    cache->head = entry;
+}
+
+// Links a new entry in the LRU list, as the most recently used, and in its bucket
+static void middlewares_cache_link(middlewares_cache_t *cache,
+                                   struct middlewares_cache_entry *entry)
+{
+    struct middlewares_cache_entry **bucket = middlewares_cache_bucket(cache, entry->hash);
+    entry->chain = *bucket;
+    *bucket = entry;
+    middlewares_cache_link_front(cache, entry);
+}
+
+static void middlewares_cache_detach(middlewares_cache_t *cache,
+                                     struct middlewares_cache_entry *entry)
+{
+    if (entry->prev != NULL) {
+        entry->prev->next = entry->next;
+    } else {
+        cache->head = entry->next;
+    }
+    if (entry->next != NULL) {
+        entry->next->prev = entry->prev;
+    } else {
+        cache->tail = entry->prev;
+    }
+}
+
+static void middlewares_cache_drop(middlewares_cache_t *cache,
+                                   struct middlewares_cache_entry *entry)
+{
+    struct middlewares_cache_entry **link = middlewares_cache_bucket(cache, entry->hash);
+    while (*link != entry) {
+        link = &(*link)->chain;
+    }
+    *link = entry->chain;
+    middlewares_cache_detach(cache, entry);
+    cache->used -= entry->size;
+    if (entry->refs == 0) {
+        free(entry);
+    } else {
+        entry->stale = true;
+    }
+}
+
+// "*" or a list of ETags that has "etag", weak ones (W/"...") included as If-None-Match compares
+// them weakly
+static bool middlewares_cache_not_modified(httpd_req_t *r, const char *etag) {
+    char value[4 * MIDDLEWARES_CACHE_ETAG_LEN];
+    esp_err_t err = httpd_req_get_hdr_value_str(r, "If-None-Match", value, sizeof(value));
+    if (err != ESP_OK && err != ESP_ERR_HTTPD_RESULT_TRUNC) {
+        return false;
+    }
+    size_t start = middlewares_skip_ows(value, strlen(value), 0);
+    return strcmp(value + start, "*") == 0 || strstr(value, etag) != NULL;
+}
+
+// Whether the Cache-Control "value" has the no-store directive
+static bool middlewares_cache_no_store(const char *value) {
+    size_t len = strlen(value);
+    size_t i = 0;
+    while (i < len) {
+        size_t start = middlewares_skip_ows(value, len, i);
+        size_t end = middlewares_skip_token(value, len, start);
+        if (end - start == 8 && middlewares_eq_nocase(value + start, "no-store", 8)) {
+            return true;
+        }
+        const char *comma = memchr(value + end, ',', len - end);
+        if (comma == NULL) {
+            break;
+        }
+        i = (size_t)(comma - value) + 1;
+    }
+    return false;
+}
+
+// 304 only answers a 200 response, any other status is sent as is
+static esp_err_t middlewares_cache_respond(httpd_req_t *r,
+                                           const char *status,
+                                           const char *cache_control,
+                                           const char *type,
+                                           const char *etag,
+                                           const char *body,
+                                           size_t body_len)
+{
+    bool ok = strncmp(status, "200", 3) == 0;
+    if (ok) {
+        httpd_resp_set_hdr(r, "ETag", etag);
+    }
+    if (cache_control != NULL) {
+        httpd_resp_set_hdr(r, "Cache-Control", cache_control);
+    }
+    if (ok && middlewares_cache_not_modified(r, etag)) {
+        httpd_resp_set_status(r, "304 Not Modified");
+        return httpd_resp_send(r, NULL, 0);
+    }
+    httpd_resp_set_status(r, status);
+    httpd_resp_set_type(r, type);
+    return httpd_resp_send(r, body, (ssize_t)body_len);
+}
+
+static void middlewares_cache_miss_done(httpd_req_t *r, esp_err_t err, void *arg) {
+    (void)r;
+    (void)err;
+    struct middlewares_cache_miss *miss = (struct middlewares_cache_miss*)arg;
+    if (middlewares_cache_pending == miss) {
+        middlewares_cache_pending = miss->prev;
+    }
+}
+
+esp_err_t middlewares_cache_serve(httpd_req_t *r, middlewares_cache_t *cache) {
+    if (r->method != HTTP_GET || cache->lock == NULL) {
+        return ESP_OK;
+    }
+    char key[MIDDLEWARES_CACHE_KEY_LEN];
+    size_t key_len;
+    if (!middlewares_cache_key(r, key, &key_len)) {
+        return ESP_OK;
+    }
+    uint32_t hash = middlewares_hash(key, key_len);
+
+    xSemaphoreTake((SemaphoreHandle_t)cache->lock, portMAX_DELAY);
+    struct middlewares_cache_entry *entry = middlewares_cache_find(cache, key, key_len, hash);
+    uint32_t generation = cache->generation;
+    if (entry != NULL) {
+        middlewares_cache_detach(cache, entry);
+        middlewares_cache_link_front(cache, entry);
+        entry->refs++;
+        cache->hits++;
+    } else {
+        cache->misses++;
+    }
+    xSemaphoreGive((SemaphoreHandle_t)cache->lock);
+
+    if (entry == NULL) {
+        struct middlewares_cache_miss *miss = esp_cchi_arena_alloc(r, sizeof(*miss) + key_len);
+        if (miss != NULL &&
+            esp_cchi_arena_on_done(r, middlewares_cache_miss_done, miss) == ESP_OK)
+        {
+            miss->r = r;
+            miss->cache = cache;
+            miss->generation = generation;
+            miss->hash = hash;
+            miss->key_len = key_len;
+            memcpy(miss->key, key, key_len);
+            miss->prev = middlewares_cache_pending;
+            middlewares_cache_pending = miss;
+        }
+        return ESP_OK;
+    }
+
+    // Sent without the lock, the entry can't be freed while it's referenced
+    esp_err_t err = middlewares_cache_respond(r, HTTPD_200, entry->cache_control, entry->type,
+                                              entry->etag, entry->data + entry->key_len,
+                                              entry->body_len);
+    xSemaphoreTake((SemaphoreHandle_t)cache->lock, portMAX_DELAY);
+    if (--entry->refs == 0 && entry->stale) {
+        free(entry);
+    }
+    xSemaphoreGive((SemaphoreHandle_t)cache->lock);
+    return err == ESP_OK ? ESP_CCHI_MW_RESPONDED : err;
+}
+
+static void middlewares_cache_store(const struct middlewares_cache_miss *miss,
+                                    const char *cache_control,
+                                    const char *type,
+                                    const char *etag,
+                                    const char *body,
+                                    size_t body_len)
+{
+    middlewares_cache_t *cache = miss->cache;
+    size_t size = sizeof(struct middlewares_cache_entry) + miss->key_len + body_len;
+    if (size > cache->budget) {
+        return;
+    }
+    struct middlewares_cache_entry *entry = malloc(size);
+    if (entry == NULL) {
+        return;
+    }
+    entry->hash = miss->hash;
+    entry->refs = 0;
+    entry->stale = false;
+    entry->type = type;
+    entry->cache_control = cache_control;
+    entry->size = size;
+    entry->key_len = miss->key_len;
+    entry->body_len = body_len;
+    strcpy(entry->etag, etag);
+    memcpy(entry->data, miss->key, miss->key_len);
+    if (body_len > 0) {
+        memcpy(entry->data + miss->key_len, body, body_len);
+    }
+
+    xSemaphoreTake((SemaphoreHandle_t)cache->lock, portMAX_DELAY);
+    if (cache->generation != miss->generation) {
+        // Invalidated while the body was being built, it may be stale already
+        xSemaphoreGive((SemaphoreHandle_t)cache->lock);
+        free(entry);
+        return;
+    }
+    struct middlewares_cache_entry *old = middlewares_cache_find(cache, miss->key, miss->key_len,
+                                                                 miss->hash);
+    if (old != NULL) {
+        middlewares_cache_drop(cache, old);
+    }
+    while (cache->used + size > cache->budget) {
+        middlewares_cache_drop(cache, cache->tail);
+    }
+    middlewares_cache_link(cache, entry);
+    cache->used += size;
+    xSemaphoreGive((SemaphoreHandle_t)cache->lock);
+}
+
+esp_err_t middlewares_cache_send(httpd_req_t *r, const char *type, const char *body, ssize_t len) {
+    return middlewares_cache_send_with(r, HTTPD_200, NULL, type, body, len);
+}
+
+esp_err_t middlewares_cache_send_with(httpd_req_t *r,
+                                      const char *status,
+                                      const char *cache_control,
+                                      const char *type,
+                                      const char *body,
+                                      ssize_t len)
+{
+    size_t body_len = 0;
+    if (body != NULL) {
+        body_len = len == HTTPD_RESP_USE_STRLEN ? strlen(body) : (size_t)len;
+    }
+    char etag[MIDDLEWARES_CACHE_ETAG_LEN];
+    snprintf(etag, sizeof(etag), "\"%08" PRIx32 "-%zx\"",
+             middlewares_hash(body, body_len), body_len);
+
+    struct middlewares_cache_miss *miss = middlewares_cache_pending;
+    if (miss != NULL && miss->r == r) {
+        // Popped, so responding twice doesn't store twice
+        middlewares_cache_pending = miss->prev;
+        if (strncmp(status, "200", 3) == 0 &&
+            (cache_control == NULL || !middlewares_cache_no_store(cache_control)))
+        {
+            middlewares_cache_store(miss, cache_control, type, etag, body, body_len);
+        }
+    }
+    return middlewares_cache_respond(r, status, cache_control, type, etag, body, body_len);
+}
+
+void middlewares_cache_invalidate(middlewares_cache_t *cache, const char *route) {
+    if (cache == NULL || cache->lock == NULL) {
+        return;
+    }
+    size_t route_len = route != NULL ? strlen(route) : 0;
+    xSemaphoreTake((SemaphoreHandle_t)cache->lock, portMAX_DELAY);
+    cache->generation++;
+    struct middlewares_cache_entry *entry = cache->head;
+    while (entry != NULL) {
+        struct middlewares_cache_entry *next = entry->next;
+        if (route == NULL ||
+            (entry->key_len >= route_len && memcmp(entry->data, route, route_len) == 0 &&
+             (entry->key_len == route_len || entry->data[route_len] == '\0')))
+        {
+            middlewares_cache_drop(cache, entry);
+        }
+        entry = next;
+    }
+    xSemaphoreGive((SemaphoreHandle_t)cache->lock);
+}
+
+// Hash of the IP address of the client of "r", never 0 (the key of the free slots)
+static uint32_t middlewares_rate_client(httpd_req_t *r) {
+    int sockfd = httpd_req_to_sockfd(r);
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    bool has_addr = getpeername(sockfd, (struct sockaddr*)&addr, &addr_len) == 0;
+    uint32_t hash;
+    if (has_addr && addr.ss_family == AF_INET6) {
+        struct sockaddr_in6 *addr6 = (struct sockaddr_in6*)&addr;
+        hash = middlewares_hash(&addr6->sin6_addr, sizeof(addr6->sin6_addr));
+    } else if (has_addr && addr.ss_family == AF_INET) {
+        struct sockaddr_in *addr4 = (struct sockaddr_in*)&addr;
+        hash = middlewares_hash(&addr4->sin_addr, sizeof(addr4->sin_addr));
+    } else {
+        hash = middlewares_hash(&sockfd, sizeof(sockfd));
+    }
+    return hash != 0 ? hash : 1;
+}
+
+// Bucket of a client that is full again after 2^31 us at most, the burst is capped below that
+#define MIDDLEWARES_RATE_MAX_TOLERANCE_US (INT32_MAX - 1000000)
+
+/**
+ * How far "tat" is ahead of "now", 0 if it's behind (the bucket is full) or further ahead than
+ * "max", which only happens after the clock wrapped (every 2^32 us) past an idle bucket
+*/
+static uint32_t middlewares_rate_ahead(uint32_t tat, uint32_t now, uint32_t max) {
+    uint32_t ahead = tat - now;
+    return (int32_t)ahead < 0 || ahead > max ? 0 : ahead;
+}
+
+/**
+ * Slot of the client "key", claimed if it has none. If there is no free slot in the probed ones,
+ * the slot of an idle client (its bucket is full, so forgetting it changes nothing) is taken over.
+ * Claims and takeovers are compare-and-swaps of the key, a client that loses the slot to another
+ * one is let through untracked
+*/
+static middlewares_rate_slot_t *middlewares_rate_find(middlewares_rate_limit_t *limit,
+                                                      uint32_t key,
+                                                      uint32_t now,
+                                                      uint32_t max_ahead)
+{
+    size_t probes = limit->slots_len < MIDDLEWARES_RATE_MAX_PROBES ?
+                    limit->slots_len : MIDDLEWARES_RATE_MAX_PROBES;
+    size_t i = key % limit->slots_len;
+    middlewares_rate_slot_t *idle = NULL;
+    uint32_t idle_key = 0;
+    for (size_t probe = 0; probe < probes; probe++, i = (i + 1) % limit->slots_len) {
+        middlewares_rate_slot_t *slot = &limit->slots[i];
+        uint32_t slot_key = __atomic_load_n(&slot->key, __ATOMIC_ACQUIRE);
+        if (slot_key == 0 &&
+            __atomic_compare_exchange_n(&slot->key, &slot_key, key, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            return slot;
+        }
+        if (slot_key == key) {
+            return slot;
+        }
+        uint32_t tat = __atomic_load_n(&slot->tat, __ATOMIC_RELAXED);
+        if (idle == NULL && middlewares_rate_ahead(tat, now, max_ahead) == 0) {
+            idle = slot;
+            idle_key = slot_key;
+        }
+    }
+    if (idle == NULL) {
+        return NULL;
+    }
+    // Fails if the slot was claimed meanwhile, by this client too ("idle_key" is then updated)
+    if (__atomic_compare_exchange_n(&idle->key, &idle_key, key, false,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) || idle_key == key)
+    {
+        return idle;
+    }
+    return NULL;
+}
+
+static esp_err_t middlewares_rate_reject(httpd_req_t *r, uint32_t wait_us) {
+    char retry_after[12];
+    snprintf(retry_after, sizeof(retry_after), "%" PRIu32, (wait_us + 999999) / 1000000);
+    httpd_resp_set_status(r, "429 Too Many Requests");
+    httpd_resp_set_hdr(r, "Retry-After", retry_after);
+    httpd_resp_send(r, NULL, 0);
+    return ESP_FAIL;
+}
+
+esp_err_t middlewares_check_rate(httpd_req_t *r, middlewares_rate_limit_t *limit) {
+    if (limit->slots_len == 0 || limit->rate_per_s == 0) {
+        return ESP_OK;
+    }
+    // GCRA, the token bucket kept as the time it's full again ("tat"): a request takes a token
+    // by pushing it "interval" further, the bucket is empty when it's more than "tolerance" ahead.
+    // The tolerance is computed from the burst rather than from the rounded interval
+    uint32_t interval = limit->rate_per_s < 1000000 ? 1000000 / limit->rate_per_s : 1;
+    uint64_t tolerance_us = limit->burst > 1 ?
+                            (uint64_t)(limit->burst - 1) * 1000000 / limit->rate_per_s : 0;
+    uint32_t tolerance = tolerance_us < MIDDLEWARES_RATE_MAX_TOLERANCE_US ?
+                         (uint32_t)tolerance_us : MIDDLEWARES_RATE_MAX_TOLERANCE_US;
+    uint32_t now = (uint32_t)esp_timer_get_time();
+    middlewares_rate_slot_t *slot = middlewares_rate_find(limit, middlewares_rate_client(r), now,
+                                                          tolerance + interval);
+    if (slot == NULL) {
+        __atomic_fetch_add(&limit->untracked, 1, __ATOMIC_RELAXED);
+        return ESP_OK;
+    }
+
+    uint32_t tat = __atomic_load_n(&slot->tat, __ATOMIC_RELAXED);
+    for (;;) {
+        // Behind "now" the bucket is full, a slot taken over has the tat of its idle client
+        uint32_t ahead = middlewares_rate_ahead(tat, now, tolerance + interval);
+        if (ahead > tolerance) {
+            __atomic_fetch_add(&limit->limited, 1, __ATOMIC_RELAXED);
+            return middlewares_rate_reject(r, ahead - tolerance);
+        }
+        if (__atomic_compare_exchange_n(&slot->tat, &tat, now + ahead + interval, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+            return ESP_OK;
+        }
+    }
+}
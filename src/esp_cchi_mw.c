@@ -1,5 +1,8 @@
 #include <esp_http_server.h>
 #include <esp_cchi/middleware.h>
+#include <stdlib.h>
+
+#define __ESP_CCHI_MW_MIN_CAP 4
 
 esp_err_t esp_cchi_mw_create_group(esp_cchi_mw_group_t *mw_group) {
     if (mw_group == NULL) {
@@ -14,17 +17,33 @@ esp_err_t esp_cchi_mw_delete_group(esp_cchi_mw_group_t *mw_group) {
         return ESP_ERR_INVALID_ARG;
     }
     free(mw_group->__mw_array);
-    mw_group->__mw_array = NULL;
-    mw_group->__mw_array_len = 0;
+    free(mw_group->__after_array);
+    *mw_group = (esp_cchi_mw_group_t){ 0 };
     return ESP_OK;
 }
 
+// "array" with room for one more element, its capacity doubles when it's full, NULL if there is no
+// memory available ("array" is left untouched)
+static void *esp_cchi_mw_reserve(void *array, size_t len, size_t *cap, size_t elem_size) {
+    if (len < *cap) {
+        return array;
+    }
+    size_t new_cap = *cap == 0 ? __ESP_CCHI_MW_MIN_CAP : *cap * 2;
+    void *temp_ptr = realloc(array, elem_size * new_cap);
+    if (temp_ptr != NULL) {
+        *cap = new_cap;
+    }
+    return temp_ptr;
+}
+
 esp_err_t esp_cchi_mw_use(esp_cchi_mw_group_t *mw_group, esp_err_t (*middleware)(httpd_req_t *)) {
     if (mw_group == NULL || middleware == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
-    esp_err_t (**temp_ptr)(httpd_req_t *) = realloc(mw_group->__mw_array,
-                                                    sizeof(temp_ptr) * (mw_group->__mw_array_len + 1));
+    esp_err_t (**temp_ptr)(httpd_req_t *) = esp_cchi_mw_reserve(mw_group->__mw_array,
+                                                                mw_group->__mw_array_len,
+                                                                &mw_group->__mw_array_cap,
+                                                                sizeof(*temp_ptr));
     if (temp_ptr == NULL) {
         return ESP_ERR_NO_MEM;
     }
@@ -33,3 +52,22 @@ esp_err_t esp_cchi_mw_use(esp_cchi_mw_group_t *mw_group, esp_err_t (*middleware)
     mw_group->__mw_array_len++;
     return ESP_OK;
 }
+
+esp_err_t esp_cchi_mw_use_after(esp_cchi_mw_group_t *mw_group,
+                                void (*hook)(httpd_req_t *, esp_err_t))
+{
+    if (mw_group == NULL || hook == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    void (**temp_ptr)(httpd_req_t *, esp_err_t) = esp_cchi_mw_reserve(mw_group->__after_array,
+                                                                      mw_group->__after_array_len,
+                                                                      &mw_group->__after_array_cap,
+                                                                      sizeof(*temp_ptr));
+    if (temp_ptr == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    mw_group->__after_array = temp_ptr;
+    mw_group->__after_array[mw_group->__after_array_len] = hook;
+    mw_group->__after_array_len++;
+    return ESP_OK;
+}
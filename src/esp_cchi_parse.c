@@ -0,0 +1,248 @@
+#include <esp_http_server.h>
+#include <esp_cchi/router.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+static inline char esp_cchi_lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+static bool esp_cchi_view_eq_nocase(esp_cchi_view_t view, const char *str) {
+    size_t i = 0;
+    for (; i < view.len; i++) {
+        if (str[i] == '\0' || esp_cchi_lower(view.data[i]) != str[i]) {
+            return false;
+        }
+    }
+    return str[i] == '\0';
+}
+
+// Accumulates the decimal digits of "view" into "value", stops with ESP_ERR_INVALID_SIZE as soon as
+// the value would exceed "max", so it never overflows
+static esp_err_t esp_cchi_view_to_dec(esp_cchi_view_t view, uint64_t max, uint64_t *value) {
+    if (view.len == 0) {
+        return ESP_FAIL;
+    }
+    uint64_t acc = 0;
+    esp_err_t err = ESP_OK;
+    for (size_t i = 0; i < view.len; i++) {
+        char c = view.data[i];
+        if (c < '0' || c > '9') {
+            return ESP_FAIL;
+        }
+        unsigned digit = (unsigned)(c - '0');
+        // Keep looking for malformed characters, they take precedence over the overflow
+        if (err == ESP_OK && acc > (max - digit) / 10) {
+            err = ESP_ERR_INVALID_SIZE;
+        }
+        acc = acc * 10 + digit;
+    }
+    if (err == ESP_OK) {
+        *value = acc;
+    }
+    return err;
+}
+
+esp_err_t esp_cchi_view_to_u32(esp_cchi_view_t view, uint32_t *value) {
+    if (view.data == NULL || value == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint64_t acc;
+    esp_err_t err = esp_cchi_view_to_dec(view, UINT32_MAX, &acc);
+    if (err == ESP_OK) {
+        *value = (uint32_t)acc;
+    }
+    return err;
+}
+
+esp_err_t esp_cchi_view_to_i64(esp_cchi_view_t view, int64_t *value) {
+    if (view.data == NULL || value == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    bool negative = false;
+    if (view.len > 0 && (view.data[0] == '-' || view.data[0] == '+')) {
+        negative = view.data[0] == '-';
+        view.data++;
+        view.len--;
+    }
+    uint64_t acc;
+    esp_err_t err = esp_cchi_view_to_dec(view,
+                                         negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX,
+                                         &acc);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (!negative) {
+        *value = (int64_t)acc;
+    } else if (acc == (uint64_t)INT64_MAX + 1) {
+        *value = INT64_MIN;
+    } else {
+        *value = -(int64_t)acc;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_cchi_view_to_hex(esp_cchi_view_t view, uint64_t *value) {
+    if (view.data == NULL || value == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (view.len == 0) {
+        return ESP_FAIL;
+    }
+    uint64_t acc = 0;
+    size_t significant = 0;
+    for (size_t i = 0; i < view.len; i++) {
+        char c = esp_cchi_lower(view.data[i]);
+        unsigned digit;
+        if (c >= '0' && c <= '9') {
+            digit = (unsigned)(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            digit = (unsigned)(c - 'a' + 10);
+        } else {
+            return ESP_FAIL;
+        }
+        // Leading zeros don't count towards the 16 digits that fit in 64 bits
+        if (significant > 0 || digit != 0) {
+            significant++;
+        }
+        acc = (acc << 4) | digit;
+    }
+    if (significant > sizeof(uint64_t) * 2) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    *value = acc;
+    return ESP_OK;
+}
+
+esp_err_t esp_cchi_view_to_bool(esp_cchi_view_t view, bool *value) {
+    if (view.data == NULL || value == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (esp_cchi_view_eq(view, "1") || esp_cchi_view_eq_nocase(view, "true")) {
+        *value = true;
+        return ESP_OK;
+    }
+    if (esp_cchi_view_eq(view, "0") || esp_cchi_view_eq_nocase(view, "false")) {
+        *value = false;
+        return ESP_OK;
+    }
+    return ESP_FAIL;
+}
+
+esp_err_t esp_cchi_view_to_enum(esp_cchi_view_t view,
+                                const esp_cchi_enum_entry_t *table,
+                                size_t table_len,
+                                int *value)
+{
+    if (view.data == NULL || (table == NULL && table_len > 0) || value == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < table_len; i++) {
+        if (table[i].name != NULL && esp_cchi_view_eq(view, table[i].name)) {
+            *value = table[i].value;
+            return ESP_OK;
+        }
+    }
+    return ESP_FAIL;
+}
+
+esp_err_t esp_cchi_get_uri_param_u32(httpd_req_t *r, const char *uri_param, uint32_t *value) {
+    esp_cchi_view_t view;
+    esp_err_t err = esp_cchi_get_uri_param_view(r, uri_param, &view);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return esp_cchi_view_to_u32(view, value);
+}
+
+esp_err_t esp_cchi_get_uri_param_i64(httpd_req_t *r, const char *uri_param, int64_t *value) {
+    esp_cchi_view_t view;
+    esp_err_t err = esp_cchi_get_uri_param_view(r, uri_param, &view);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return esp_cchi_view_to_i64(view, value);
+}
+
+esp_err_t esp_cchi_get_uri_param_hex(httpd_req_t *r, const char *uri_param, uint64_t *value) {
+    esp_cchi_view_t view;
+    esp_err_t err = esp_cchi_get_uri_param_view(r, uri_param, &view);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return esp_cchi_view_to_hex(view, value);
+}
+
+esp_err_t esp_cchi_get_uri_param_bool(httpd_req_t *r, const char *uri_param, bool *value) {
+    esp_cchi_view_t view;
+    esp_err_t err = esp_cchi_get_uri_param_view(r, uri_param, &view);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return esp_cchi_view_to_bool(view, value);
+}
+
+esp_err_t esp_cchi_get_uri_param_enum(httpd_req_t *r,
+                                      const char *uri_param,
+                                      const esp_cchi_enum_entry_t *table,
+                                      size_t table_len,
+                                      int *value)
+{
+    esp_cchi_view_t view;
+    esp_err_t err = esp_cchi_get_uri_param_view(r, uri_param, &view);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return esp_cchi_view_to_enum(view, table, table_len, value);
+}
+
+esp_err_t esp_cchi_get_query_param_u32(httpd_req_t *r, const char *key, uint32_t *value) {
+    esp_cchi_view_t view;
+    esp_err_t err = esp_cchi_get_query_param_view(r, key, &view);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return esp_cchi_view_to_u32(view, value);
+}
+
+esp_err_t esp_cchi_get_query_param_i64(httpd_req_t *r, const char *key, int64_t *value) {
+    esp_cchi_view_t view;
+    esp_err_t err = esp_cchi_get_query_param_view(r, key, &view);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return esp_cchi_view_to_i64(view, value);
+}
+
+esp_err_t esp_cchi_get_query_param_hex(httpd_req_t *r, const char *key, uint64_t *value) {
+    esp_cchi_view_t view;
+    esp_err_t err = esp_cchi_get_query_param_view(r, key, &view);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return esp_cchi_view_to_hex(view, value);
+}
+
+esp_err_t esp_cchi_get_query_param_bool(httpd_req_t *r, const char *key, bool *value) {
+    esp_cchi_view_t view;
+    esp_err_t err = esp_cchi_get_query_param_view(r, key, &view);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return esp_cchi_view_to_bool(view, value);
+}
+
+esp_err_t esp_cchi_get_query_param_enum(httpd_req_t *r,
+                                        const char *key,
+                                        const esp_cchi_enum_entry_t *table,
+                                        size_t table_len,
+                                        int *value)
+{
+    esp_cchi_view_t view;
+    esp_err_t err = esp_cchi_get_query_param_view(r, key, &view);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return esp_cchi_view_to_enum(view, table, table_len, value);
+}
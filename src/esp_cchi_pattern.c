@@ -0,0 +1,409 @@
+#include <esp_http_server.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "esp_cchi_pattern.h"
+
+const char *esp_cchi_next_param(const char *pattern) {
+    for (const char *it = strpbrk(pattern, "{*"); it != NULL; it = strpbrk(it + 1, "{*")) {
+        if (esp_cchi_is_param(it)) {
+            return it;
+        }
+    }
+    return NULL;
+}
+
+const char *esp_cchi_param_end(const char *param) {
+    if ((*param) == '*') {
+        return param;
+    }
+    // Fast path for the params without regexp, the name has none of the characters the full scan
+    // cares about
+    const char *it = param + 1 + strcspn(param + 1, "}:{[\\");
+    if ((*it) == '}') {
+        return it;
+    }
+
+    size_t depth = 0;
+    bool in_class = false;
+    for (it = param + 1; (*it) != '\0'; it++) {
+        if ((*it) == '\\' && (*(it + 1)) != '\0') {
+            it++;
+            continue;
+        }
+        if (in_class) {
+            in_class = (*it) != ']';
+            continue;
+        }
+        if ((*it) == '[') {
+            in_class = true;
+        } else if ((*it) == '{') {
+            depth++;
+        } else if ((*it) == '}') {
+            if (depth == 0) {
+                return it;
+            }
+            depth--;
+        }
+    }
+    return NULL;
+}
+
+size_t esp_cchi_param_name_len(const char *name) {
+    size_t len = strcspn(name, ":}");
+    if (len >= 3 && memcmp(name + len - 3, "...", 3) == 0) {
+        len -= 3;
+    }
+    return len;
+}
+
+bool esp_cchi_param_is_wildcard(const char *param) {
+    if ((*param) == '*') {
+        return true;
+    }
+    const char *name = param + 1;
+    size_t len = strcspn(name, ":}");
+    return len >= 3 && memcmp(name + len - 3, "...", 3) == 0;
+}
+
+void esp_cchi_param_regexp(const char *param, const char **regexp, size_t *regexp_len) {
+    const char *param_end = esp_cchi_param_end(param);
+    const char *colon_pos = memchr(param, ':', param_end - param);
+    if (colon_pos == NULL) {
+        *regexp = NULL;
+        *regexp_len = 0;
+        return;
+    }
+    *regexp = colon_pos + 1;
+    *regexp_len = param_end - colon_pos - 1;
+}
+
+// Rank of a URI param in the specificity order, the lower the more specific
+static int esp_cchi_param_rank(const char *param, const char *param_end) {
+    return (esp_cchi_param_is_wildcard(param) ? 2 : 0) +
+           (memchr(param, ':', param_end - param) == NULL ? 1 : 0);
+}
+
+int esp_cchi_specificity_cmp(const char *a, const char *b) {
+    while ((*a) != '\0' && (*b) != '\0') {
+        bool a_param = esp_cchi_is_param(a);
+        bool b_param = esp_cchi_is_param(b);
+        if (a_param != b_param) {
+            return a_param ? 1 : -1;
+        }
+        if (!a_param) {
+            if ((*a) != (*b)) {
+                return (unsigned char)(*a) - (unsigned char)(*b);
+            }
+            a++;
+            b++;
+            continue;
+        }
+        const char *a_end = esp_cchi_param_end(a);
+        const char *b_end = esp_cchi_param_end(b);
+        int a_rank = esp_cchi_param_rank(a, a_end);
+        int b_rank = esp_cchi_param_rank(b, b_end);
+        if (a_rank != b_rank) {
+            return a_rank - b_rank;
+        }
+        a = a_end + 1;
+        b = b_end + 1;
+    }
+    // The longer pattern has more literal parts or params left
+    return ((*b) != '\0') - ((*a) != '\0');
+}
+
+static inline void esp_cchi_set_add(uint32_t *set, unsigned char c) {
+    set[c >> 5] |= (uint32_t)1 << (c & 31);
+}
+
+static inline bool esp_cchi_set_has(const uint32_t *set, unsigned char c) {
+    return (set[c >> 5] & ((uint32_t)1 << (c & 31))) != 0;
+}
+
+static void esp_cchi_set_add_range(uint32_t *set, unsigned char from, unsigned char to) {
+    for (unsigned c = from; c <= to; c++) {
+        esp_cchi_set_add(set, (unsigned char)c);
+    }
+}
+
+// Adds the class of the escape "\<c>" to "set", returns false if it's not a class escape
+static bool esp_cchi_set_add_escape(uint32_t *set, char c) {
+    uint32_t class_set[8] = { 0 };
+    switch (c) {
+    case 'd': case 'D':
+        esp_cchi_set_add_range(class_set, '0', '9');
+        break;
+    case 'w': case 'W':
+        esp_cchi_set_add_range(class_set, '0', '9');
+        esp_cchi_set_add_range(class_set, 'a', 'z');
+        esp_cchi_set_add_range(class_set, 'A', 'Z');
+        esp_cchi_set_add(class_set, '_');
+        break;
+    case 's': case 'S':
+        esp_cchi_set_add_range(class_set, '\t', '\r');
+        esp_cchi_set_add(class_set, ' ');
+        break;
+    default:
+        return false;
+    }
+    bool negated = c == 'D' || c == 'W' || c == 'S';
+    for (size_t i = 0; i < 8; i++) {
+        set[i] |= negated ? ~class_set[i] : class_set[i];
+    }
+    return true;
+}
+
+// Parses the "[...]" class that starts at "*it" (pointing after the '['), returns false if it's
+// malformed
+static bool esp_cchi_parse_class(const char **it, const char *end, uint32_t *set) {
+    bool negated = false;
+    if ((*it) < end && (**it) == '^') {
+        negated = true;
+        (*it)++;
+    }
+    bool first = true;
+    while ((*it) < end && ((**it) != ']' || first)) {
+        first = false;
+        unsigned char from = (unsigned char)(**it);
+        if (from == '\\') {
+            if ((*it) + 1 >= end) {
+                return false;
+            }
+            (*it)++;
+            if (esp_cchi_set_add_escape(set, **it)) {
+                (*it)++;
+                continue;
+            }
+            from = (unsigned char)(**it);
+        }
+        (*it)++;
+        if ((*it) + 1 < end && (**it) == '-' && (*((*it) + 1)) != ']') {
+            unsigned char to = (unsigned char)(*((*it) + 1));
+            if (to < from) {
+                return false;
+            }
+            esp_cchi_set_add_range(set, from, to);
+            (*it) += 2;
+            continue;
+        }
+        esp_cchi_set_add(set, from);
+    }
+    if ((*it) == end) {
+        return false;
+    }
+    (*it)++;
+    if (negated) {
+        for (size_t i = 0; i < 8; i++) {
+            set[i] = ~set[i];
+        }
+    }
+    return true;
+}
+
+static bool esp_cchi_parse_number(const char **it, const char *end, uint16_t *number) {
+    const char *start = *it;
+    uint32_t value = 0;
+    while ((*it) < end && (**it) >= '0' && (**it) <= '9') {
+        value = value * 10 + ((**it) - '0');
+        if (value >= ESP_CCHI_CONSTRAINT_UNBOUNDED) {
+            return false;
+        }
+        (*it)++;
+    }
+    *number = (uint16_t)value;
+    return (*it) != start;
+}
+
+// Parses the quantifier that follows an atom (if any), returns false if it's malformed
+static bool esp_cchi_parse_quantifier(const char **it,
+                                      const char *end,
+                                      struct esp_cchi_atom *atom)
+{
+    atom->min = 1;
+    atom->max = 1;
+    if ((*it) == end) {
+        return true;
+    }
+    switch (**it) {
+    case '*':
+        atom->min = 0;
+        atom->max = ESP_CCHI_CONSTRAINT_UNBOUNDED;
+        (*it)++;
+        return true;
+    case '+':
+        atom->max = ESP_CCHI_CONSTRAINT_UNBOUNDED;
+        (*it)++;
+        return true;
+    case '?':
+        atom->min = 0;
+        (*it)++;
+        return true;
+    case '{':
+        (*it)++;
+        if (!esp_cchi_parse_number(it, end, &atom->min)) {
+            return false;
+        }
+        atom->max = atom->min;
+        if ((*it) < end && (**it) == ',') {
+            (*it)++;
+            atom->max = ESP_CCHI_CONSTRAINT_UNBOUNDED;
+            if ((*it) < end && (**it) != '}' && !esp_cchi_parse_number(it, end, &atom->max)) {
+                return false;
+            }
+        }
+        if ((*it) == end || (**it) != '}' || atom->max < atom->min) {
+            return false;
+        }
+        (*it)++;
+        return true;
+    default:
+        return true;
+    }
+}
+
+esp_err_t esp_cchi_constraint_compile(const char *regexp,
+                                      size_t regexp_len,
+                                      struct esp_cchi_constraint *constraint)
+{
+    const char *it = regexp;
+    const char *end = regexp + regexp_len;
+
+    if (it < end && (*it) == '^') {
+        it++;
+    }
+    if (end > it && (*(end - 1)) == '$' && (end - 1 == it || (*(end - 2)) != '\\')) {
+        end--;
+    }
+
+    memset(constraint, 0, sizeof(struct esp_cchi_constraint));
+    while (it < end) {
+        if (constraint->atoms_len == ESP_CCHI_CONSTRAINT_MAX_ATOMS) {
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        struct esp_cchi_atom *atom = &constraint->atoms[constraint->atoms_len];
+
+        switch (*it) {
+        case '(': case ')': case '|':
+            return ESP_ERR_NOT_SUPPORTED;
+        case '*': case '+': case '?': case '{': case '}': case ']': case '^': case '$':
+            return ESP_ERR_INVALID_ARG;
+        case '.':
+            memset(atom->set, 0xff, sizeof(atom->set));
+            it++;
+            break;
+        case '[':
+            it++;
+            if (!esp_cchi_parse_class(&it, end, atom->set)) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            break;
+        case '\\':
+            it++;
+            if (it == end) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            if (!esp_cchi_set_add_escape(atom->set, *it)) {
+                esp_cchi_set_add(atom->set, (unsigned char)(*it));
+            }
+            it++;
+            break;
+        default:
+            esp_cchi_set_add(atom->set, (unsigned char)(*it));
+            it++;
+            break;
+        }
+
+        if (!esp_cchi_parse_quantifier(&it, end, atom)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        constraint->atoms_len++;
+    }
+    return ESP_OK;
+}
+
+// Positions 0..HTTPD_MAX_URI_LEN of a value, one bit each
+#define ESP_CCHI_POSITIONS_WORDS ((HTTPD_MAX_URI_LEN + 1 + 31) / 32)
+
+static inline bool esp_cchi_positions_has(const uint32_t *positions, size_t position) {
+    return (positions[position >> 5] >> (position & 31)) & 1;
+}
+
+/**
+ * Runs the atoms over the value keeping the set of positions reached so far instead of
+ * backtracking, so the cost is linear in the value length whatever the regexp ("a*a*a*b" against
+ * a long run of 'a' included). An atom reaches the position "q" from a position "p" of the set if
+ * q - p is within its bounds and all of the characters in between are in its class: the "p" that
+ * qualify form a window that only moves forward as "q" grows, so the reached positions are counted
+ * while sliding it
+*/
+static bool esp_cchi_atoms_match(const struct esp_cchi_atom *atoms,
+                                 size_t atoms_len,
+                                 const char *value,
+                                 size_t value_len)
+{
+    if (value_len > HTTPD_MAX_URI_LEN) {
+        return false;
+    }
+    uint32_t from[ESP_CCHI_POSITIONS_WORDS] = { 1 };
+    uint32_t to[ESP_CCHI_POSITIONS_WORDS];
+    size_t words = value_len / 32 + 1;
+
+    for (size_t i = 0; i < atoms_len; i++) {
+        const struct esp_cchi_atom *atom = &atoms[i];
+        memset(to, 0, sizeof(uint32_t) * words);
+        bool reached = false;
+        // The window is [removed, added), "floor" is the first position after the last character
+        // that is not in the class
+        size_t added = 0;
+        size_t removed = 0;
+        size_t floor = 0;
+        size_t count = 0;
+        for (size_t q = 0; q <= value_len; q++) {
+            if (q > 0 && !esp_cchi_set_has(atom->set, (unsigned char)value[q - 1])) {
+                floor = q;
+            }
+            for (; q >= atom->min && added <= q - atom->min; added++) {
+                if (added >= removed) {
+                    count += esp_cchi_positions_has(from, added);
+                }
+            }
+            size_t lo = atom->max != ESP_CCHI_CONSTRAINT_UNBOUNDED && q > atom->max
+                        ? q - atom->max : 0;
+            for (lo = lo > floor ? lo : floor; removed < lo; removed++) {
+                if (removed < added) {
+                    count -= esp_cchi_positions_has(from, removed);
+                }
+            }
+            if (count > 0) {
+                to[q >> 5] |= (uint32_t)1 << (q & 31);
+                reached = true;
+            }
+        }
+        if (!reached) {
+            return false;
+        }
+        memcpy(from, to, sizeof(uint32_t) * words);
+    }
+    return esp_cchi_positions_has(from, value_len);
+}
+
+bool esp_cchi_constraint_match(const struct esp_cchi_constraint *constraint,
+                               const char *value,
+                               size_t value_len)
+{
+    // Fast path for the most common constraints, a single class like "[0-9]+" or "[a-f0-9]{32}"
+    if (constraint->atoms_len == 1) {
+        const struct esp_cchi_atom *atom = &constraint->atoms[0];
+        if (value_len < atom->min || value_len > atom->max) {
+            return false;
+        }
+        for (size_t i = 0; i < value_len; i++) {
+            if (!esp_cchi_set_has(atom->set, (unsigned char)value[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+    return esp_cchi_atoms_match(constraint->atoms, constraint->atoms_len, value, value_len);
+}
@@ -0,0 +1,119 @@
+/**
+ * ============== Pattern helpers (private) ===============
+ * Helpers shared by the matchers of esp_cchi for the "{<uri_param>:<regexp>}" syntax.
+ *
+ * The regexp of a URI param is compiled once, when the route is set up, into a small sequence of
+ * character classes with repetition bounds, so evaluating it does not allocate, does not need a
+ * general regex engine and takes linear time in the length of the value. Supported syntax:
+ *
+ *  - Literal characters, "." and escapes ("\d", "\w", "\s", their negations and "\<char>")
+ *  - Character classes with ranges and negation ("[a-f0-9]", "[^/]")
+ *  - Quantifiers "*", "+", "?", "{n}", "{n,}" and "{n,m}"
+ *  - "^" at the start and "$" at the end, which are implicit anyway (the whole value must match)
+ *
+ * Groups and alternations are not supported
+ *
+ * A param whose name ends with "..." ("{path...}") is a wildcard, its value can span several
+ * segments. A "*" that ends the pattern right after a forward slash is a wildcard named "*" that
+ * also matches an empty value, so "/static/" "*" matches "/static/" and everything under it
+*/
+#pragma once
+
+#include <esp_http_server.h>
+#include <esp_cchi/compiled.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// struct esp_cchi_constraint is defined in esp_cchi/compiled.h, the generated tables embed it
+
+/**
+ * @param pattern Pointer into a pattern (they start with '/', so the character before a '*' is
+ *        always part of it)
+ *
+ * @returns Whether a URI param starts at "pattern": a '{' or a "*" wildcard
+*/
+static inline bool esp_cchi_is_param(const char *pattern) {
+    return (*pattern) == '{' ||
+           ((*pattern) == '*' && (*(pattern - 1)) == '/' && (*(pattern + 1)) == '\0');
+}
+
+/**
+ * @returns Pointer to the first URI param at or after "pattern", NULL if there is none
+*/
+const char *esp_cchi_next_param(const char *pattern);
+
+/**
+ * @param param Pointer to the '{' that opens the URI param, or to a "*" wildcard
+ *
+ * @returns Pointer to the '}' that closes the URI param (braces of the regexp quantifiers are
+ * skipped), NULL if the URI param is not closed. For a "*" wildcard, "param" itself
+*/
+const char *esp_cchi_param_end(const char *param);
+
+/**
+ * @param param Pointer to the '{' that opens the URI param, or to a "*" wildcard
+ *
+ * @returns Pointer to the name of the URI param, its length is given by esp_cchi_param_name_len
+*/
+static inline const char *esp_cchi_param_name(const char *param) {
+    return (*param) == '{' ? param + 1 : param;
+}
+
+/**
+ * @param name Pointer returned by esp_cchi_param_name
+ *
+ * @returns Length of the name, without the "..." of a wildcard
+*/
+size_t esp_cchi_param_name_len(const char *name);
+
+/**
+ * @param param Pointer to the '{' that opens the URI param, or to a "*" wildcard
+ *
+ * @returns Whether the value of the param can span several segments
+*/
+bool esp_cchi_param_is_wildcard(const char *param);
+
+/**
+ * @param param Pointer to the '{' that opens the URI param, or to a "*" wildcard
+ *
+ * @returns Shortest value of the param, 0 for a "*" wildcard and 1 for the rest
+*/
+static inline size_t esp_cchi_param_min_len(const char *param) {
+    return (*param) == '*' ? 0 : 1;
+}
+
+/**
+ * Compares how specific two patterns are, walking them side by side: a literal character beats a
+ * URI param, a URI param beats a wildcard and a URI param (or wildcard) with a regexp beats one
+ * without it. Every matcher resolves overlapping routes with this order
+ *
+ * @returns < 0 if "a" is more specific than "b", > 0 if it's less specific and 0 if they are
+ * equally specific
+*/
+int esp_cchi_specificity_cmp(const char *a, const char *b);
+
+/**
+ * @param param Pointer to the '{' that opens the URI param
+ * @param[out] regexp Pointer to the regexp of the URI param, NULL if it has none
+ * @param[out] regexp_len Length of the regexp
+*/
+void esp_cchi_param_regexp(const char *param, const char **regexp, size_t *regexp_len);
+
+/**
+ * @returns
+ *  - ESP_OK on success
+ *  - ESP_ERR_INVALID_ARG if the regexp is malformed
+ *  - ESP_ERR_NOT_SUPPORTED if the regexp uses syntax that is not supported
+*/
+esp_err_t esp_cchi_constraint_compile(const char *regexp,
+                                      size_t regexp_len,
+                                      struct esp_cchi_constraint *constraint);
+
+/**
+ * @returns Whether the whole "value" matches the constraint, always false for a value longer than
+ * HTTPD_MAX_URI_LEN if the constraint has more than one atom
+*/
+bool esp_cchi_constraint_match(const struct esp_cchi_constraint *constraint,
+                               const char *value,
+                               size_t value_len);
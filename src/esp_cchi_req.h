@@ -0,0 +1,42 @@
+/**
+ * ============== Request context (private) ===============
+ * What the dispatchers of esp_cchi set as the .user_ctx of a request while its handler runs, so
+ * the URI params, the route and the .user_ctx of the route can be read from the request
+*/
+#pragma once
+
+#include <esp_http_server.h>
+#include <stdalign.h>
+#include <stdint.h>
+#include "esp_cchi_tree.h"
+
+// First word of the contexts, tells the route contexts and the request contexts apart from
+// whatever the .user_ctx of a handler called directly points to
+#define __ESP_CCHI_CTX_TAG     0xCC41C7A6u
+#define __ESP_CCHI_REQ_CTX_TAG 0xCC41C7E0u
+
+/**
+ * Context of a request being handled, lives in the stack of the function that dispatches the
+ * request and is set as the .user_ctx of the request while the handler runs
+*/
+struct esp_cchi_req_ctx {
+    uint32_t tag;
+    const char *ref_uri;
+    void *user_ctx;
+    // Route of the Router object that matched, NULL for the other dispatchers
+    const struct esp_cchi_route *route;
+    struct esp_cchi_params params;
+    // Index of the query string, built in the request arena on the first access
+    const struct esp_cchi_query *query;
+};
+
+/**
+ * Tag of the context pointed by "user_ctx", 0 if it can't be one of them. Only aligned pointers are
+ * read, as the .user_ctx of a handler called directly can point to anything, e.g. a string
+*/
+static inline uint32_t esp_cchi_ctx_tag(const void *user_ctx) {
+    if (user_ctx == NULL || ((uintptr_t)user_ctx & (alignof(uint32_t) - 1)) != 0) {
+        return 0;
+    }
+    return *(const uint32_t*)user_ctx;
+}
@@ -1,69 +1,366 @@
 #include <esp_http_server.h>
 #include <esp_cchi/router.h>
+#include <esp_cchi/arena.h>
+#include <esp_cchi/compiled.h>
+#include <esp_cchi/metrics.h>
+#include <esp_cchi/middleware.h>
+#include <esp_timer.h>
+#include <stdalign.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include "esp_cchi_req.h"
+#include "esp_cchi_tree.h"
+#include "sdkconfig.h"
 
-#define __ESP_CCHI_CTX_MAGIC_SIZE 19
-static const char *const esp_cchi_ctx_magic = "ESP_CCHI_CTX_MAGIC";
+#define __ESP_CCHI_REGISTRY_MIN_SIZE 16
 
+/**
+ * Context of a route set up with esp_cchi_setup_hd_uri, lives in the .user_ctx of the httpd_uri_t.
+ * "constraints" has the compiled regexp of every URI param (NULL if the param has none), they
+ * live in the same block as the context. The literal routes ("is_static") are only indexed by
+ * the registry, the rest of them are also linked in esp_cchi_param_routes. "shadowed_by" counts the
+ * routes of esp_cchi_param_routes that come before this one and could match the same URIs
+*/
 struct esp_cchi_ctx {
-    char magic[__ESP_CCHI_CTX_MAGIC_SIZE];
+    uint32_t tag;
     const char *ref_uri;
+    size_t ref_uri_len;
+    uint32_t hash;
+    bool is_static;
+    size_t prefix_len;
+    size_t shadowed_by;
+    void *user_ctx;
+    esp_err_t (*handler)(httpd_req_t *r);
+    // Slot of the metrics, resolved when the route is set up unless it's for any method
+    esp_cchi_metrics_slot_t metrics;
+    bool any_method;
+    const struct esp_cchi_constraint *constraints[CONFIG_ESP_CCHI_MAX_URI_PARAMS];
+    struct esp_cchi_ctx *next_param;
+    struct esp_cchi_ctx_block *block;
 };
 
-static bool esp_cchi_uri_match_fn(const char *ref_uri, const char *uri, size_t match_upto) {
-    while (((*ref_uri) != '\0') && ((*uri) != '\0')) {
-        if ((*ref_uri) != '{') {
-            if ((*ref_uri) != (*uri)) {
-                return false;
-            }
-            ref_uri++;
-            uri++;
-            continue;
+/**
+ * Contexts of the routes set up by one call to esp_cchi_setup_hd_uris, followed by the compiled
+ * regexps of all of them, in a single allocation. It's freed when the last of its routes is
+ * deleted, "live" counts the ones that are not
+*/
+struct esp_cchi_ctx_block {
+    size_t live;
+    struct esp_cchi_ctx ctxs[];
+};
+
+_Static_assert(alignof(struct esp_cchi_constraint) <= alignof(struct esp_cchi_ctx),
+               "the regexps are placed right after the contexts of a block");
+
+/**
+ * Key and value of an item of the query string, offsets in the decoded copy of the query string
+*/
+struct esp_cchi_query_item {
+    uint16_t key_offset;
+    uint16_t key_len;
+    uint16_t value_offset;
+    uint16_t value_len;
+};
+
+/**
+ * Index of the query string of a request, "buf" is a copy of the query string, percent-decoded
+ * while it was copied, with the items one after another
+*/
+struct esp_cchi_query {
+    const char *buf;
+    size_t len;
+    struct esp_cchi_query_item items[];
+};
+
+struct esp_cchi_router {
+    esp_cchi_tree_node_t root;
+    httpd_handle_t server;
+    uint64_t methods;
+    // Routes that could not be inserted, the tree may still point into their patterns
+    struct esp_cchi_route *retired;
+    // Route groups only: the router that owns the group, whose tree has the routes of the group,
+    // and the prefix of the group relative to it
+    struct esp_cchi_router *parent;
+    char *prefix;
+    esp_cchi_mw_group_t mws;
+    struct esp_cchi_router *groups;
+    struct esp_cchi_router *next_group;
+};
+
+/**
+ * Contexts set up by esp_cchi_setup_hd_uri indexed by the hash of their pattern, open addressing
+ * with linear probing, never more than half full. The matcher only receives the copy of the
+ * pattern that esp_http_server keeps, so this is the way of finding the compiled regexps of a
+ * route, and since a literal pattern is the URI itself, it's also an O(1) lookup of the literal
+ * route of a URI
+*/
+static struct esp_cchi_ctx **esp_cchi_registry = NULL;
+static size_t esp_cchi_registry_size = 0;
+static size_t esp_cchi_registry_len = 0;
+static size_t esp_cchi_static_len = 0;
+
+/**
+ * Routes with URI params in specificity order, the first one that matches a URI is the one that
+ * handles it
+*/
+static struct esp_cchi_ctx *esp_cchi_param_routes = NULL;
+
+static uint32_t esp_cchi_registry_hash(const char *ref_uri, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char)ref_uri[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static const struct esp_cchi_ctx *esp_cchi_registry_find(const char *ref_uri, size_t len) {
+    if (esp_cchi_registry_len == 0) {
+        return NULL;
+    }
+    size_t mask = esp_cchi_registry_size - 1;
+    uint32_t hash = esp_cchi_registry_hash(ref_uri, len);
+    for (size_t i = hash & mask; esp_cchi_registry[i] != NULL; i = (i + 1) & mask) {
+        const struct esp_cchi_ctx *ctx = esp_cchi_registry[i];
+        if (ctx->hash == hash &&
+            ctx->ref_uri_len == len &&
+            memcmp(ctx->ref_uri, ref_uri, len) == 0)
+        {
+            return ctx;
         }
-        ref_uri = strchr(ref_uri, '}');
-        ref_uri++;
+    }
+    return NULL;
+}
 
-        const char *slash_pos = strchr(uri, '/');
-        const char *temp_uri = strchr(uri, *ref_uri);
+static void esp_cchi_registry_put(struct esp_cchi_ctx **registry,
+                                  size_t size,
+                                  struct esp_cchi_ctx *ctx)
+{
+    size_t i = ctx->hash & (size - 1);
+    while (registry[i] != NULL) {
+        i = (i + 1) & (size - 1);
+    }
+    registry[i] = ctx;
+}
+
+// Grows the registry (once) so "len" more contexts can be added without growing it again
+static esp_err_t esp_cchi_registry_reserve(size_t len) {
+    size_t size = esp_cchi_registry_size == 0 ? __ESP_CCHI_REGISTRY_MIN_SIZE
+                                              : esp_cchi_registry_size;
+    while ((esp_cchi_registry_len + len) * 2 > size) {
+        size *= 2;
+    }
+    if (size == esp_cchi_registry_size) {
+        return ESP_OK;
+    }
+    struct esp_cchi_ctx **registry = calloc(size, sizeof(struct esp_cchi_ctx*));
+    if (registry == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (size_t i = 0; i < esp_cchi_registry_size; i++) {
+        if (esp_cchi_registry[i] != NULL) {
+            esp_cchi_registry_put(registry, size, esp_cchi_registry[i]);
+        }
+    }
+    free(esp_cchi_registry);
+    esp_cchi_registry = registry;
+    esp_cchi_registry_size = size;
+    return ESP_OK;
+}
 
-        const char *last_char = temp_uri;
+// The registry must have been reserved
+static void esp_cchi_registry_add(struct esp_cchi_ctx *ctx) {
+    esp_cchi_registry_put(esp_cchi_registry, esp_cchi_registry_size, ctx);
+    esp_cchi_registry_len++;
+}
 
-        if ((*ref_uri) != '\0') {
-            while (1) {
-                temp_uri = strchr(temp_uri + 1, *ref_uri);
-                if (temp_uri == NULL) {
-                    break;
-                }
-                if (slash_pos != NULL && slash_pos < temp_uri) {
-                    break;
-                }
-                last_char = temp_uri;
-            }
+static void esp_cchi_registry_remove(const struct esp_cchi_ctx *ctx) {
+    size_t mask = esp_cchi_registry_size - 1;
+    size_t i = ctx->hash & mask;
+    while (esp_cchi_registry[i] != ctx) {
+        i = (i + 1) & mask;
+    }
+    // Backward shift, the entries after the hole that would not be found anymore are moved into it
+    size_t hole = i;
+    for (i = (i + 1) & mask; esp_cchi_registry[i] != NULL; i = (i + 1) & mask) {
+        size_t home = esp_cchi_registry[i]->hash & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            esp_cchi_registry[hole] = esp_cchi_registry[i];
+            hole = i;
         }
+    }
+    esp_cchi_registry[hole] = NULL;
+
+    if (--esp_cchi_registry_len == 0) {
+        free(esp_cchi_registry);
+        esp_cchi_registry = NULL;
+        esp_cchi_registry_size = 0;
+    }
+}
+
+// Whether two routes with URI params could match the same URI, judging by their literal prefixes
+static bool esp_cchi_may_overlap(const struct esp_cchi_ctx *a, const struct esp_cchi_ctx *b) {
+    size_t len = a->prefix_len < b->prefix_len ? a->prefix_len : b->prefix_len;
+    return memcmp(a->ref_uri, b->ref_uri, len) == 0;
+}
 
-        if (last_char == NULL) {
+/**
+ * Matches "uri" (up to "uri_len") against the pattern "ref_uri", recording the URI params in
+ * "params" if it's not NULL. A param value is never empty (but the one of a "*" wildcard) and
+ * never crosses a forward slash (but the one of a wildcard), if the character that follows the
+ * param appears several times, the longest value is tried first. "constraints" has the compiled
+ * regexps of the pattern indexed by param, if it's NULL the regexps are ignored
+*/
+static bool esp_cchi_pattern_match(const char *ref_uri,
+                                   const struct esp_cchi_constraint *const *constraints,
+                                   size_t param_index,
+                                   const char *uri,
+                                   size_t uri_len,
+                                   struct esp_cchi_params *params)
+{
+    while ((*ref_uri) != '\0' && !esp_cchi_is_param(ref_uri)) {
+        if (uri_len == 0 || (*ref_uri) != (*uri)) {
             return false;
         }
+        ref_uri++;
+        uri++;
+        uri_len--;
+    }
 
-        // TODO: Not quite sure if this line does what I want it to do :/
-        if ((last_char - uri) < 1) {
+    if ((*ref_uri) == '\0') {
+        return uri_len == 0;
+    }
+
+    const char *param_end = esp_cchi_param_end(ref_uri);
+    char tail = *(param_end + 1);
+    const struct esp_cchi_constraint *constraint = NULL;
+    if (constraints != NULL) {
+        constraint = constraints[param_index];
+    }
+
+    bool wildcard = esp_cchi_param_is_wildcard(ref_uri);
+    size_t max_len = uri_len;
+    if (!wildcard) {
+        const char *slash_pos = memchr(uri, '/', uri_len);
+        max_len = slash_pos != NULL ? (size_t)(slash_pos - uri) : uri_len;
+    }
+
+    struct esp_cchi_capture *capture = NULL;
+    if (params != NULL) {
+        if (params->len == CONFIG_ESP_CCHI_MAX_URI_PARAMS) {
             return false;
         }
+        capture = &params->items[params->len++];
+        capture->name = esp_cchi_param_name(ref_uri);
+        capture->offset = uri - params->base;
+    }
 
-        uri = last_char;
+    // A param that ends the segment takes all of it, a wildcard that ends the pattern all the rest
+    bool takes_all = tail == '\0' || (!wildcard && tail == '/');
+    for (size_t end = max_len + 1; end-- > esp_cchi_param_min_len(ref_uri);) {
+        if (!takes_all && (end == max_len || uri[end] != tail)) {
+            continue;
+        }
+        if (constraint != NULL && !esp_cchi_constraint_match(constraint, uri, end)) {
+            continue;
+        }
+        if (capture != NULL) {
+            capture->len = end;
+        }
+        if (esp_cchi_pattern_match(param_end + 1,
+                                   constraints,
+                                   param_index + 1,
+                                   uri + end,
+                                   uri_len - end,
+                                   params))
+        {
+            return true;
+        }
+        if (takes_all) {
+            break;
+        }
+    }
 
-        if (slash_pos != NULL && uri > slash_pos) {
-            return false;
+    if (params != NULL) {
+        params->len--;
+    }
+    return false;
+}
+
+// Literal route equal to "uri", the registry is only hashed if there are literal routes
+static const struct esp_cchi_ctx *esp_cchi_static_find(const char *uri, size_t uri_len) {
+    if (esp_cchi_static_len == 0) {
+        return NULL;
+    }
+    const struct esp_cchi_ctx *ctx = esp_cchi_registry_find(uri, uri_len);
+    return (ctx != NULL && ctx->is_static) ? ctx : NULL;
+}
+
+// Whether "ctx" matches "uri", the literal parts are compared first and the regexps only if needed
+static bool esp_cchi_ctx_match(const struct esp_cchi_ctx *ctx, const char *uri, size_t uri_len) {
+    return esp_cchi_pattern_match(ctx->ref_uri, NULL, 0, uri, uri_len, NULL) &&
+           esp_cchi_pattern_match(ctx->ref_uri, ctx->constraints, 0, uri, uri_len, NULL);
+}
+
+/**
+ * Returns the route set up with esp_cchi_setup_hd_uri that must handle "uri", that is the literal
+ * route equal to "uri" or else the first route with URI params that matches it in specificity
+ * order. "until" is where the search of routes with URI params stops (not included), NULL if all of
+ * them must be tried
+*/
+static const struct esp_cchi_ctx *esp_cchi_registry_route(const char *uri,
+                                                          size_t uri_len,
+                                                          const struct esp_cchi_ctx *until)
+{
+    const struct esp_cchi_ctx *ctx = esp_cchi_static_find(uri, uri_len);
+    if (ctx != NULL) {
+        return ctx;
+    }
+    for (ctx = esp_cchi_param_routes; ctx != until; ctx = ctx->next_param) {
+        if (esp_cchi_ctx_match(ctx, uri, uri_len)) {
+            return ctx;
         }
     }
+    return NULL;
+}
 
-    if (((*uri) != '\0') || ((*ref_uri) != '\0')) {
+/**
+ * esp_http_server calls this once per registered URI handler, in registration order, until one of
+ * them matches. To make the result independent of that order, a route only matches if there is no
+ * more specific route set up with esp_cchi_setup_hd_uri that also matches: literal routes beat
+ * routes with URI params, which beat the routes that were not set up (like the catch-all of the
+ * router)
+*/
+static bool esp_cchi_uri_match_fn(const char *ref_uri, const char *uri, size_t match_upto) {
+    if (strcmp(ref_uri, ESP_CCHI_ROUTER_CATCH_ALL_URI) == 0) {
+        return esp_cchi_registry_len == 0 || esp_cchi_registry_route(uri, match_upto, NULL) == NULL;
+    }
+    // Most of the routes are discarded by the literal parts, the registry is only looked up for the
+    // routes that could match
+    if (!esp_cchi_pattern_match(ref_uri, NULL, 0, uri, match_upto, NULL)) {
         return false;
     }
-
-    return true;
+    const char *param = esp_cchi_next_param(ref_uri);
+    if (param == NULL) {
+        // Literal, nothing is more specific than an exact match
+        return true;
+    }
+    const struct esp_cchi_ctx *ctx = esp_cchi_registry_find(ref_uri, strlen(ref_uri));
+    if (ctx == NULL) {
+        return esp_cchi_registry_route(uri, match_upto, NULL) == NULL;
+    }
+    if (strchr(param, ':') != NULL &&
+        !esp_cchi_pattern_match(ref_uri, ctx->constraints, 0, uri, match_upto, NULL))
+    {
+        return false;
+    }
+    if (ctx->shadowed_by == 0) {
+        return esp_cchi_static_find(uri, match_upto) == NULL;
+    }
+    const struct esp_cchi_ctx *route = esp_cchi_registry_route(uri, match_upto, ctx);
+    // The same pattern may have been set up several times (one per method)
+    return route == NULL || strcmp(route->ref_uri, ref_uri) == 0;
 }
 
 static bool esp_cchi_is_valid_uri(const char *uri) {
@@ -71,15 +368,28 @@ static bool esp_cchi_is_valid_uri(const char *uri) {
         return false;
     }
     uri++;
+    size_t params_len = 0;
     while ((*uri) != '\0') {
-        if ((*uri) != '{') {
+        if (!esp_cchi_is_param(uri)) {
             uri++;
             continue;
         }
-        const char *param_end = strchr(uri, '}');
+        const char *param_end = esp_cchi_param_end(uri);
         if (param_end == NULL) {
             return false;
         }
+        if (++params_len > CONFIG_ESP_CCHI_MAX_URI_PARAMS) {
+            return false;
+        }
+        const char *regexp;
+        size_t regexp_len;
+        esp_cchi_param_regexp(uri, &regexp, &regexp_len);
+        struct esp_cchi_constraint constraint;
+        if (regexp != NULL &&
+            esp_cchi_constraint_compile(regexp, regexp_len, &constraint) != ESP_OK)
+        {
+            return false;
+        }
         uri = param_end + 1;
         if ((*uri) == '{') {
             return false;
@@ -88,6 +398,64 @@ static bool esp_cchi_is_valid_uri(const char *uri) {
     return true;
 }
 
+// Runs the handler of a matched route in the request arena, timing it in "metrics" if metrics are
+// enabled
+static esp_err_t esp_cchi_run_handler(httpd_req_t *r,
+                                      esp_cchi_metrics_slot_t metrics,
+                                      esp_err_t (*handler)(httpd_req_t *r))
+{
+#if CONFIG_ESP_CCHI_METRICS
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = esp_cchi_arena_run(r, handler);
+    esp_cchi_metrics_record_slot(metrics, err, (uint32_t)(esp_timer_get_time() - start));
+    return err;
+#else
+    (void)metrics;
+    return esp_cchi_arena_run(r, handler);
+#endif
+}
+
+// Answers a request that the Router object or a compiled table has no route for
+static esp_err_t esp_cchi_send_unmatched(httpd_req_t *r, httpd_err_code_t error) {
+#if CONFIG_ESP_CCHI_METRICS
+    esp_cchi_metrics_record(NULL, (httpd_method_t)r->method, ESP_FAIL, 0);
+#endif
+    return httpd_resp_send_err(r, error, NULL);
+}
+
+// Handler installed by esp_cchi_setup_hd_uri, captures the URI params before calling the handler
+static esp_err_t esp_cchi_uri_handler(httpd_req_t *r) {
+    struct esp_cchi_ctx *ctx = (struct esp_cchi_ctx*)r->user_ctx;
+
+    struct esp_cchi_req_ctx req_ctx;
+    req_ctx.tag = __ESP_CCHI_REQ_CTX_TAG;
+    req_ctx.ref_uri = ctx->ref_uri;
+    req_ctx.user_ctx = ctx->user_ctx;
+    req_ctx.route = NULL;
+    req_ctx.query = NULL;
+    req_ctx.params.base = r->uri;
+    req_ctx.params.len = 0;
+    esp_cchi_pattern_match(ctx->ref_uri,
+                           ctx->constraints,
+                           0,
+                           r->uri,
+                           strcspn(r->uri, "?#"),
+                           &req_ctx.params);
+
+    esp_cchi_metrics_slot_t metrics = ctx->metrics;
+#if CONFIG_ESP_CCHI_METRICS
+    if (ctx->any_method) {
+        metrics = esp_cchi_metrics_slot(ctx->ref_uri, (httpd_method_t)r->method);
+    }
+#endif
+
+    r->user_ctx = &req_ctx;
+    esp_err_t err = esp_cchi_run_handler(r, metrics, ctx->handler);
+    r->user_ctx = ctx;
+
+    return err;
+}
+
 esp_err_t esp_cchi_setup_hd_config(httpd_config_t *hd_cfg) {
     if (hd_cfg == NULL) {
         return ESP_ERR_INVALID_ARG;
@@ -96,39 +464,174 @@ esp_err_t esp_cchi_setup_hd_config(httpd_config_t *hd_cfg) {
     return ESP_OK;
 }
 
+// Number of URI params of "uri" that have a regexp
+static size_t esp_cchi_constraints_count(const char *uri) {
+    size_t constraints_len = 0;
+    for (const char *it = esp_cchi_next_param(uri); it != NULL; it = esp_cchi_next_param(it)) {
+        if (memchr(it, ':', esp_cchi_param_end(it) - it) != NULL) {
+            constraints_len++;
+        }
+        it = esp_cchi_param_end(it) + 1;
+    }
+    return constraints_len;
+}
+
+/**
+ * Fills the context of an already validated route, compiling its regexps in "*constraint" (moved
+ * past them), and adds it to the registry and esp_cchi_param_routes
+*/
+static void esp_cchi_ctx_init(struct esp_cchi_ctx *ctx,
+                              struct esp_cchi_ctx_block *block,
+                              const httpd_uri_t *hd_uri,
+                              struct esp_cchi_constraint **constraint)
+{
+    ctx->tag = __ESP_CCHI_CTX_TAG;
+    ctx->ref_uri = hd_uri->uri;
+    ctx->ref_uri_len = strlen(hd_uri->uri);
+    ctx->hash = esp_cchi_registry_hash(ctx->ref_uri, ctx->ref_uri_len);
+    const char *first_param = esp_cchi_next_param(hd_uri->uri);
+    ctx->is_static = first_param == NULL;
+    ctx->prefix_len = first_param != NULL ? (size_t)(first_param - hd_uri->uri) : ctx->ref_uri_len;
+    ctx->shadowed_by = 0;
+    ctx->user_ctx = hd_uri->user_ctx;
+    ctx->handler = hd_uri->handler;
+    ctx->block = block;
+    ctx->any_method = false;
+#ifdef HTTP_ANY
+    ctx->any_method = (int)hd_uri->method == HTTP_ANY;
+#endif
+    ctx->metrics = NULL;
+#if CONFIG_ESP_CCHI_METRICS
+    if (!ctx->any_method) {
+        ctx->metrics = esp_cchi_metrics_slot(ctx->ref_uri, hd_uri->method);
+    }
+#endif
+
+    // The regexps are compiled once here, the pattern was already validated
+    size_t param_index = 0;
+    for (const char *it = esp_cchi_next_param(hd_uri->uri);
+         it != NULL;
+         it = esp_cchi_next_param(it))
+    {
+        const char *regexp;
+        size_t regexp_len;
+        esp_cchi_param_regexp(it, &regexp, &regexp_len);
+        ctx->constraints[param_index] = NULL;
+        if (regexp != NULL) {
+            esp_cchi_constraint_compile(regexp, regexp_len, *constraint);
+            ctx->constraints[param_index] = (*constraint)++;
+        }
+        param_index++;
+        it = esp_cchi_param_end(it) + 1;
+    }
+
+    esp_cchi_registry_add(ctx);
+    ctx->next_param = NULL;
+    if (ctx->is_static) {
+        esp_cchi_static_len++;
+    } else {
+        // After the ones that are as specific, so equal patterns keep their registration order
+        struct esp_cchi_ctx **it = &esp_cchi_param_routes;
+        while ((*it) != NULL && esp_cchi_specificity_cmp((*it)->ref_uri, ctx->ref_uri) <= 0) {
+            if (esp_cchi_may_overlap(*it, ctx)) {
+                ctx->shadowed_by++;
+            }
+            it = &(*it)->next_param;
+        }
+        ctx->next_param = *it;
+        *it = ctx;
+        for (struct esp_cchi_ctx *next = ctx->next_param; next != NULL; next = next->next_param) {
+            if (esp_cchi_may_overlap(next, ctx)) {
+                next->shadowed_by++;
+            }
+        }
+    }
+}
+
 esp_err_t esp_cchi_setup_hd_uri(httpd_uri_t *hd_uri) {
-    if (hd_uri == NULL || hd_uri->uri == NULL) {
+    return esp_cchi_setup_hd_uris(hd_uri, 1);
+}
+
+esp_err_t esp_cchi_setup_hd_uris(httpd_uri_t *hd_uris, size_t len) {
+    if (hd_uris == NULL || len == 0) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    if (!esp_cchi_is_valid_uri(hd_uri->uri)) {
-        return ESP_ERR_INVALID_ARG;
+    size_t constraints_len = 0;
+    for (size_t i = 0; i < len; i++) {
+        const httpd_uri_t *hd_uri = &hd_uris[i];
+        if (hd_uri->uri == NULL ||
+            hd_uri->handler == esp_cchi_uri_handler ||
+            (hd_uri->handler == NULL && esp_cchi_ctx_tag(hd_uri->user_ctx) == __ESP_CCHI_CTX_TAG) ||
+            !esp_cchi_is_valid_uri(hd_uri->uri))
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+        constraints_len += esp_cchi_constraints_count(hd_uri->uri);
     }
 
-    struct esp_cchi_ctx *ctx = malloc(sizeof(struct esp_cchi_ctx));
-    if (ctx == NULL) {
+    struct esp_cchi_ctx_block *block = malloc(sizeof(struct esp_cchi_ctx_block) +
+                                              sizeof(struct esp_cchi_ctx) * len +
+                                              sizeof(struct esp_cchi_constraint) * constraints_len);
+    if (block == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (esp_cchi_registry_reserve(len) != ESP_OK) {
+        free(block);
         return ESP_ERR_NO_MEM;
     }
 
-    strcpy(ctx->magic, esp_cchi_ctx_magic);
-    ctx->ref_uri = hd_uri->uri;
-
-    hd_uri->user_ctx = ctx;
+    block->live = len;
+    struct esp_cchi_constraint *constraint = (struct esp_cchi_constraint*)(block->ctxs + len);
+    for (size_t i = 0; i < len; i++) {
+        esp_cchi_ctx_init(&block->ctxs[i], block, &hd_uris[i], &constraint);
+        hd_uris[i].user_ctx = &block->ctxs[i];
+        // Without a handler the route is only given its context, like before the handler was
+        // wrapped, the URI params are then captured on every lookup
+        if (hd_uris[i].handler != NULL) {
+            hd_uris[i].handler = esp_cchi_uri_handler;
+        }
+    }
 
     return ESP_OK;
 }
 
 esp_err_t esp_cchi_delete_hd_uri(httpd_uri_t *hd_uri, bool no_dangling_ctx) {
-    if (hd_uri == NULL || hd_uri->user_ctx) {
+    if (hd_uri == NULL || hd_uri->user_ctx == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    struct esp_cchi_ctx *ctx = (struct esp_cchi_ctx*)hd_uri->user_ctx;
-    if (strcmp(ctx->magic, esp_cchi_ctx_magic) != 0) {
+    if (esp_cchi_ctx_tag(hd_uri->user_ctx) != __ESP_CCHI_CTX_TAG) {
         return ESP_ERR_INVALID_ARG;
     }
+    struct esp_cchi_ctx *ctx = (struct esp_cchi_ctx*)hd_uri->user_ctx;
+
+    esp_cchi_registry_remove(ctx);
+    if (ctx->is_static) {
+        esp_cchi_static_len--;
+    } else {
+        struct esp_cchi_ctx **it = &esp_cchi_param_routes;
+        while ((*it) != ctx) {
+            it = &(*it)->next_param;
+        }
+        *it = ctx->next_param;
+        for (struct esp_cchi_ctx *next = ctx->next_param; next != NULL; next = next->next_param) {
+            if (esp_cchi_may_overlap(next, ctx)) {
+                next->shadowed_by--;
+            }
+        }
+    }
 
-    free(ctx);
+    if (hd_uri->handler == esp_cchi_uri_handler) {
+        hd_uri->handler = ctx->handler;
+    }
+
+    // Deleting it twice fails, while the other routes of the block keep it alive
+    ctx->tag = 0;
+    struct esp_cchi_ctx_block *block = ctx->block;
+    if (--block->live == 0) {
+        free(block);
+    }
 
     if (no_dangling_ctx) {
         hd_uri->user_ctx = NULL;
@@ -137,102 +640,966 @@ esp_err_t esp_cchi_delete_hd_uri(httpd_uri_t *hd_uri, bool no_dangling_ctx) {
     return ESP_OK;
 }
 
+/**
+ * Returns the capture table of the request, if the request didn't went through a dispatcher of
+ * esp_cchi (the handler was called directly), the URI params are captured in "tmp"
+*/
+static const struct esp_cchi_params *esp_cchi_req_params(httpd_req_t *r,
+                                                         struct esp_cchi_params *tmp)
+{
+    if (r == NULL || r->user_ctx == NULL) {
+        return NULL;
+    }
+    uint32_t tag = esp_cchi_ctx_tag(r->user_ctx);
+    if (tag == __ESP_CCHI_REQ_CTX_TAG) {
+        return &((struct esp_cchi_req_ctx*)r->user_ctx)->params;
+    }
+    if (tag != __ESP_CCHI_CTX_TAG) {
+        return NULL;
+    }
+    struct esp_cchi_ctx *ctx = (struct esp_cchi_ctx*)r->user_ctx;
+    tmp->base = r->uri;
+    tmp->len = 0;
+    esp_cchi_pattern_match(ctx->ref_uri, ctx->constraints, 0, r->uri, strcspn(r->uri, "?#"), tmp);
+    return tmp;
+}
+
+static const struct esp_cchi_capture *esp_cchi_params_find(const struct esp_cchi_params *params,
+                                                           const char *uri_param)
+{
+    size_t uri_param_len = strlen(uri_param);
+    for (size_t i = 0; i < params->len; i++) {
+        const struct esp_cchi_capture *capture = &params->items[i];
+        if (esp_cchi_param_name_len(capture->name) == uri_param_len &&
+            memcmp(capture->name, uri_param, uri_param_len) == 0)
+        {
+            return capture;
+        }
+    }
+    return NULL;
+}
+
 esp_err_t esp_cchi_get_uri_param(httpd_req_t *r,
                                  const char *uri_param,
                                  char *buf,
                                  size_t buf_len,
                                  size_t *bytes_written)
 {
-    if (r == NULL || r->user_ctx == NULL || uri_param == NULL) {
+    if (uri_param == NULL || buf == NULL || bytes_written == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
-    struct esp_cchi_ctx *ctx = (struct esp_cchi_ctx*)r->user_ctx;
+    struct esp_cchi_params tmp;
+    const struct esp_cchi_params *params = esp_cchi_req_params(r, &tmp);
+    if (params == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const struct esp_cchi_capture *capture = esp_cchi_params_find(params, uri_param);
+    if (capture == NULL) {
+        *bytes_written = 0;
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (capture->len > buf_len) {
+        *bytes_written = 0;
+        return ESP_FAIL;
+    }
+    memcpy(buf, r->uri + capture->offset, capture->len);
+    *bytes_written = capture->len;
+    return ESP_OK;
+}
 
-    if (strcmp(ctx->magic, esp_cchi_ctx_magic) != 0) {
+size_t esp_cchi_get_uri_param_len(httpd_req_t *r, const char *uri_param) {
+    if (uri_param == NULL) {
+        return 0;
+    }
+    struct esp_cchi_params tmp;
+    const struct esp_cchi_params *params = esp_cchi_req_params(r, &tmp);
+    if (params == NULL) {
+        return 0;
+    }
+
+    const struct esp_cchi_capture *capture = esp_cchi_params_find(params, uri_param);
+    if (capture == NULL) {
+        // Param not found
+        return 0;
+    }
+    return capture->len;
+}
+
+esp_err_t esp_cchi_get_uri_param_view(httpd_req_t *r,
+                                      const char *uri_param,
+                                      esp_cchi_view_t *view)
+{
+    if (uri_param == NULL || view == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct esp_cchi_params tmp;
+    const struct esp_cchi_params *params = esp_cchi_req_params(r, &tmp);
+    if (params == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    size_t uri_param_len = strlen(uri_param);
+    const struct esp_cchi_capture *capture = esp_cchi_params_find(params, uri_param);
+    if (capture == NULL) {
+        *view = (esp_cchi_view_t){ 0 };
+        return ESP_ERR_NOT_FOUND;
+    }
+    view->data = r->uri + capture->offset;
+    view->len = capture->len;
+    return ESP_OK;
+}
+
+size_t esp_cchi_get_uri_param_count(httpd_req_t *r) {
+    struct esp_cchi_params tmp;
+    const struct esp_cchi_params *params = esp_cchi_req_params(r, &tmp);
+    if (params == NULL) {
+        return 0;
+    }
+    return params->len;
+}
 
-    const char *traverse_ref_uri = ctx->ref_uri;
-    const char *traverse_uri = r->uri;
+static void esp_cchi_capture_to_param(const struct esp_cchi_capture *capture,
+                                      esp_cchi_uri_param_t *param)
+{
+    param->name = capture->name;
+    param->name_len = esp_cchi_param_name_len(capture->name);
+    param->offset = capture->offset;
+    param->len = capture->len;
+}
 
-    while (((*traverse_ref_uri) != '\0') && ((*traverse_uri) != '\0')) {
-        if ((*traverse_ref_uri) != '{') {
-            traverse_ref_uri++;
-            traverse_uri++;
-            continue;
+esp_err_t esp_cchi_get_uri_param_at(httpd_req_t *r, size_t index, esp_cchi_uri_param_t *param) {
+    if (param == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct esp_cchi_params tmp;
+    const struct esp_cchi_params *params = esp_cchi_req_params(r, &tmp);
+    if (params == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (index >= params->len) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    esp_cchi_capture_to_param(&params->items[index], param);
+    return ESP_OK;
+}
+
+esp_err_t esp_cchi_find_uri_param(httpd_req_t *r,
+                                  const char *uri_param,
+                                  esp_cchi_uri_param_t *param)
+{
+    if (uri_param == NULL || param == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct esp_cchi_params tmp;
+    const struct esp_cchi_params *params = esp_cchi_req_params(r, &tmp);
+    if (params == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const struct esp_cchi_capture *capture = esp_cchi_params_find(params, uri_param);
+    if (capture == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    esp_cchi_capture_to_param(capture, param);
+    return ESP_OK;
+}
+
+void *esp_cchi_get_user_ctx(httpd_req_t *r) {
+    if (r == NULL || r->user_ctx == NULL) {
+        return NULL;
+    }
+    uint32_t tag = esp_cchi_ctx_tag(r->user_ctx);
+    if (tag == __ESP_CCHI_REQ_CTX_TAG) {
+        return ((struct esp_cchi_req_ctx*)r->user_ctx)->user_ctx;
+    }
+    if (tag != __ESP_CCHI_CTX_TAG) {
+        return NULL;
+    }
+    return ((struct esp_cchi_ctx*)r->user_ctx)->user_ctx;
+}
+
+const char *esp_cchi_get_route_pattern(httpd_req_t *r) {
+    if (r == NULL || r->user_ctx == NULL) {
+        return NULL;
+    }
+    uint32_t tag = esp_cchi_ctx_tag(r->user_ctx);
+    if (tag == __ESP_CCHI_REQ_CTX_TAG) {
+        return ((struct esp_cchi_req_ctx*)r->user_ctx)->ref_uri;
+    }
+    if (tag != __ESP_CCHI_CTX_TAG) {
+        return NULL;
+    }
+    return ((struct esp_cchi_ctx*)r->user_ctx)->ref_uri;
+}
+
+static int esp_cchi_hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/**
+ * Copies "len" bytes of "src" into "dst" decoding "%XX" escapes and turning '+' into ' ', a '%'
+ * that is not followed by 2 hexadecimal digits is copied as is. Returns the decoded length, which
+ * is never longer than "len"
+*/
+static size_t esp_cchi_query_decode(char *dst, const char *src, size_t len) {
+    size_t written = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = src[i];
+        if (c == '+') {
+            c = ' ';
+        } else if (c == '%' && i + 2 < len) {
+            int high = esp_cchi_hex_value(src[i + 1]);
+            int low = esp_cchi_hex_value(src[i + 2]);
+            if (high >= 0 && low >= 0) {
+                c = (char)((high << 4) | low);
+                i += 2;
+            }
         }
-        const char *param_end = strchr(traverse_ref_uri, '}');
-        size_t ref_param_len = param_end - traverse_ref_uri - 1;
-        const char *colon_pos = strchr(traverse_ref_uri, ':');
-        if (colon_pos != NULL && colon_pos < param_end) {
-            ref_param_len = colon_pos - traverse_ref_uri - 1;
+        dst[written++] = c;
+    }
+    return written;
+}
+
+// Builds the index of the query string of "r" in its arena, in one pass over the query string
+static esp_err_t esp_cchi_query_build(httpd_req_t *r, const struct esp_cchi_query **query) {
+    static const struct esp_cchi_query empty = { .buf = "", .len = 0 };
+
+    size_t path_len = strcspn(r->uri, "?#");
+    if (r->uri[path_len] != '?') {
+        *query = &empty;
+        return ESP_OK;
+    }
+    const char *raw = r->uri + path_len + 1;
+    size_t raw_len = strcspn(raw, "#");
+
+    // Every '&' may start a new item
+    size_t items_cap = 1;
+    for (const char *it = memchr(raw, '&', raw_len);
+         it != NULL;
+         it = memchr(it + 1, '&', raw_len - (size_t)(it + 1 - raw)))
+    {
+        items_cap++;
+    }
+    struct esp_cchi_query *index = esp_cchi_arena_alloc(r, sizeof(struct esp_cchi_query) +
+                                                           sizeof(struct esp_cchi_query_item) *
+                                                           items_cap);
+    char *buf = esp_cchi_arena_alloc(r, raw_len > 0 ? raw_len : 1);
+    if (index == NULL || buf == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    index->buf = buf;
+    index->len = 0;
+    size_t written = 0;
+    const char *end = raw + raw_len;
+    for (const char *it = raw; it < end;) {
+        const char *pair_end = memchr(it, '&', (size_t)(end - it));
+        if (pair_end == NULL) {
+            pair_end = end;
         }
-        if (uri_param_len != ref_param_len) {
-            traverse_ref_uri = param_end + 1;
-            traverse_uri = strchr(traverse_uri, *(param_end + 1));
-            continue;
+        if (pair_end > it) {
+            const char *eq_pos = memchr(it, '=', (size_t)(pair_end - it));
+            const char *key_end = eq_pos != NULL ? eq_pos : pair_end;
+            struct esp_cchi_query_item *item = &index->items[index->len++];
+            item->key_offset = (uint16_t)written;
+            item->key_len = (uint16_t)esp_cchi_query_decode(buf + written, it, key_end - it);
+            written += item->key_len;
+            item->value_offset = (uint16_t)written;
+            item->value_len = 0;
+            if (eq_pos != NULL) {
+                item->value_len = (uint16_t)esp_cchi_query_decode(buf + written,
+                                                                  eq_pos + 1,
+                                                                  pair_end - eq_pos - 1);
+                written += item->value_len;
+            }
         }
-        if (strncmp(traverse_ref_uri + 1, uri_param, ref_param_len) != 0) {
-            traverse_ref_uri = param_end + 1;
-            traverse_uri = strchr(traverse_uri, *(param_end + 1));
-            continue;
+        it = pair_end + 1;
+    }
+    *query = index;
+    return ESP_OK;
+}
+
+// Index of the query string of a request routed by esp_cchi, built on the first call
+static esp_err_t esp_cchi_req_query(httpd_req_t *r, const struct esp_cchi_query **query) {
+    if (r == NULL || esp_cchi_ctx_tag(r->user_ctx) != __ESP_CCHI_REQ_CTX_TAG) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct esp_cchi_req_ctx *req_ctx = (struct esp_cchi_req_ctx*)r->user_ctx;
+    if (req_ctx->query == NULL) {
+        esp_err_t err = esp_cchi_query_build(r, &req_ctx->query);
+        if (err != ESP_OK) {
+            return err;
         }
-        const char *param_content_end = strchr(traverse_uri, *(param_end + 1));
-        size_t param_content_len = param_content_end - traverse_uri;
-        if (param_content_len > buf_len) {
-            *bytes_written = 0;
-            return ESP_FAIL;
+    }
+    *query = req_ctx->query;
+    return ESP_OK;
+}
+
+static const struct esp_cchi_query_item *esp_cchi_query_find(const struct esp_cchi_query *query,
+                                                             const char *key)
+{
+    size_t key_len = strlen(key);
+    for (size_t i = 0; i < query->len; i++) {
+        const struct esp_cchi_query_item *item = &query->items[i];
+        if (item->key_len == key_len && memcmp(query->buf + item->key_offset, key, key_len) == 0) {
+            return item;
         }
-        strncpy(buf, traverse_uri, param_content_len);
-        *bytes_written = param_content_len;
-        return ESP_OK;
+    }
+    return NULL;
+}
+
+esp_err_t esp_cchi_get_query_param_view(httpd_req_t *r, const char *key, esp_cchi_view_t *view) {
+    if (key == NULL || view == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const struct esp_cchi_query *query;
+    esp_err_t err = esp_cchi_req_query(r, &query);
+    if (err != ESP_OK) {
+        return err;
+    }
+    const struct esp_cchi_query_item *item = esp_cchi_query_find(query, key);
+    if (item == NULL) {
+        *view = (esp_cchi_view_t){ 0 };
+        return ESP_ERR_NOT_FOUND;
+    }
+    view->data = query->buf + item->value_offset;
+    view->len = item->value_len;
+    return ESP_OK;
+}
+
+esp_err_t esp_cchi_get_query_param(httpd_req_t *r,
+                                   const char *key,
+                                   char *buf,
+                                   size_t buf_len,
+                                   size_t *bytes_written)
+{
+    if (buf == NULL || bytes_written == NULL) {
+        return ESP_ERR_INVALID_ARG;
     }
     *bytes_written = 0;
-    return ESP_ERR_NOT_FOUND;
+    esp_cchi_view_t view;
+    esp_err_t err = esp_cchi_get_query_param_view(r, key, &view);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (view.len > buf_len) {
+        return ESP_FAIL;
+    }
+    memcpy(buf, view.data, view.len);
+    *bytes_written = view.len;
+    return ESP_OK;
 }
 
-size_t esp_cchi_get_uri_param_len(httpd_req_t *r, const char *uri_param) {
-    if (r == NULL || r->user_ctx == NULL || uri_param == NULL) {
+size_t esp_cchi_get_query_param_len(httpd_req_t *r, const char *key) {
+    esp_cchi_view_t view;
+    if (esp_cchi_get_query_param_view(r, key, &view) != ESP_OK) {
         return 0;
     }
-    struct esp_cchi_ctx *ctx = (struct esp_cchi_ctx*)r->user_ctx;
-    if (strcmp(ctx->magic, esp_cchi_ctx_magic) != 0) {
+    return view.len;
+}
+
+size_t esp_cchi_get_query_param_count(httpd_req_t *r) {
+    const struct esp_cchi_query *query;
+    if (esp_cchi_req_query(r, &query) != ESP_OK) {
         return 0;
     }
+    return query->len;
+}
 
-    size_t uri_param_len = strlen(uri_param);
-
-    const char *traverse_ref_uri = ctx->ref_uri;
-    const char *traverse_uri = r->uri;
+esp_err_t esp_cchi_get_query_param_at(httpd_req_t *r,
+                                      size_t index,
+                                      esp_cchi_query_param_t *param)
+{
+    if (param == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const struct esp_cchi_query *query;
+    esp_err_t err = esp_cchi_req_query(r, &query);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (index >= query->len) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    const struct esp_cchi_query_item *item = &query->items[index];
+    param->key.data = query->buf + item->key_offset;
+    param->key.len = item->key_len;
+    param->value.data = query->buf + item->value_offset;
+    param->value.len = item->value_len;
+    return ESP_OK;
+}
 
-    while ((*traverse_ref_uri) != '\0' && (*traverse_uri) != '\0') {
-        if ((*traverse_ref_uri) != '{') {
-            traverse_ref_uri++;
-            traverse_uri++;
+/**
+ * Registers "handler" as the catch-all of "server" for every method in "methods" (bit
+ * (1 << method)), or once for all methods when esp_http_server supports HTTP_ANY, so the routes
+ * never take more than one handler slot per method and esp_http_server only scans those. On
+ * failure the handlers registered before it are unregistered
+*/
+static esp_err_t esp_cchi_register_catch_all(httpd_handle_t server,
+                                             uint64_t methods,
+                                             esp_err_t (*handler)(httpd_req_t *r),
+                                             void *user_ctx)
+{
+    httpd_uri_t catch_all = {
+        .uri = ESP_CCHI_ROUTER_CATCH_ALL_URI,
+        .handler = handler,
+        .user_ctx = user_ctx,
+    };
+#ifdef HTTP_ANY
+    (void)methods;
+    catch_all.method = HTTP_ANY;
+    return httpd_register_uri_handler(server, &catch_all);
+#else
+    for (unsigned method = 0; method < 64; method++) {
+        if ((methods & ((uint64_t)1 << method)) == 0) {
             continue;
         }
-        const char *param_end = strchr(traverse_ref_uri, '}');
-        size_t ref_param_len = param_end - traverse_ref_uri - 1;
-        const char *colon_pos = strchr(traverse_ref_uri, ':');
-        if (colon_pos != NULL && colon_pos < param_end) {
-            ref_param_len = colon_pos - traverse_ref_uri - 1;
+        catch_all.method = (httpd_method_t)method;
+        esp_err_t err = httpd_register_uri_handler(server, &catch_all);
+        if (err != ESP_OK) {
+            // Leaving the server as it was
+            while (method-- > 0) {
+                if ((methods & ((uint64_t)1 << method)) != 0) {
+                    httpd_unregister_uri_handler(server,
+                                                 ESP_CCHI_ROUTER_CATCH_ALL_URI,
+                                                 (httpd_method_t)method);
+                }
+            }
+            return err;
         }
-        if (uri_param_len != ref_param_len) {
-            traverse_ref_uri = param_end + 1;
-            traverse_uri = strchr(traverse_uri, *(param_end + 1));
+    }
+    return ESP_OK;
+#endif
+}
+
+static void esp_cchi_unregister_catch_all(httpd_handle_t server, uint64_t methods) {
+#ifdef HTTP_ANY
+    (void)methods;
+    httpd_unregister_uri_handler(server, ESP_CCHI_ROUTER_CATCH_ALL_URI, HTTP_ANY);
+#else
+    for (unsigned method = 0; method < 64; method++) {
+        if ((methods & ((uint64_t)1 << method)) != 0) {
+            httpd_unregister_uri_handler(server,
+                                         ESP_CCHI_ROUTER_CATCH_ALL_URI,
+                                         (httpd_method_t)method);
+        }
+    }
+#endif
+}
+
+// Longest name of a method of http_parser ("UNSUBSCRIBE") followed by ", "
+#define ESP_CCHI_ALLOW_ITEM_LEN (sizeof("UNSUBSCRIBE") - 1 + 2)
+
+// Answers 405 to a request whose path matched routes of other methods, listing them in "Allow"
+static esp_err_t esp_cchi_send_not_allowed(httpd_req_t *r, uint64_t methods) {
+    // Room for every method a route can have. A 405 is answered before the request has an
+    // arena, so it's still less stack than a routed request takes
+    char allow[64 * ESP_CCHI_ALLOW_ITEM_LEN + 1];
+    size_t len = 0;
+    for (unsigned method = 0; method < 64; method++) {
+        if ((methods & ((uint64_t)1 << method)) == 0) {
             continue;
         }
-        if (strncmp(traverse_ref_uri + 1, uri_param, ref_param_len) != 0) {
-            traverse_ref_uri = param_end + 1;
-            traverse_uri = strchr(traverse_uri, *(param_end + 1));
+        const char *name = http_method_str((enum http_method)method);
+        size_t name_len = strlen(name);
+        if (name_len > ESP_CCHI_ALLOW_ITEM_LEN - 2) {
             continue;
         }
-        const char *param_content_end = strchr(traverse_uri, *(param_end + 1));
-        return param_content_end - traverse_uri;
+        if (len > 0) {
+            allow[len++] = ',';
+            allow[len++] = ' ';
+        }
+        memcpy(allow + len, name, name_len);
+        len += name_len;
+    }
+    allow[len] = '\0';
+    // The header is sent before returning, so it can live in the stack
+    httpd_resp_set_hdr(r, "Allow", allow);
+    return esp_cchi_send_unmatched(r, HTTPD_405_METHOD_NOT_ALLOWED);
+}
+
+// Whether the group or any of the routers above it has middlewares
+static bool esp_cchi_router_has_mws(const struct esp_cchi_router *group) {
+    for (; group != NULL; group = group->parent) {
+        if (group->mws.__mw_array_len > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Runs the middlewares of the routers above "group" and then the ones of "group"
+static esp_err_t esp_cchi_router_run_mws(const struct esp_cchi_router *group, httpd_req_t *r) {
+    if (group->parent != NULL) {
+        esp_err_t err = esp_cchi_router_run_mws(group->parent, r);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    for (size_t i = 0; i < group->mws.__mw_array_len; i++) {
+        esp_err_t err = group->mws.__mw_array[i](r);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t esp_cchi_router_run_route(httpd_req_t *r) {
+    const struct esp_cchi_route *route = ((struct esp_cchi_req_ctx*)r->user_ctx)->route;
+    esp_err_t err = esp_cchi_router_run_mws(route->group, r);
+    if (err != ESP_OK) {
+        return err == ESP_CCHI_MW_RESPONDED ? ESP_OK : err;
+    }
+    return route->handler(r);
+}
+
+static esp_err_t esp_cchi_router_dispatch(httpd_req_t *r) {
+    struct esp_cchi_router *router = (struct esp_cchi_router*)r->user_ctx;
+
+    // The URI params are captured while the tree is walked, so the handler never parses the URI
+    // again
+    struct esp_cchi_req_ctx req_ctx;
+    req_ctx.params.base = r->uri;
+    req_ctx.params.len = 0;
+
+    size_t path_len = strcspn(r->uri, "?#");
+    const esp_cchi_tree_node_t *node = esp_cchi_tree_find(&router->root,
+                                                          r->uri,
+                                                          path_len,
+                                                          &req_ctx.params);
+    if (node == NULL) {
+        return esp_cchi_send_unmatched(r, HTTPD_404_NOT_FOUND);
+    }
+
+    const struct esp_cchi_route *route = esp_cchi_node_routes(node);
+    while (route != NULL && (int)route->method != r->method) {
+        route = route->next;
+    }
+    if (route == NULL) {
+        uint64_t methods = 0;
+        for (route = esp_cchi_node_routes(node); route != NULL; route = route->next) {
+            methods |= (uint64_t)1 << route->method;
+        }
+        return esp_cchi_send_not_allowed(r, methods);
+    }
+
+    req_ctx.tag = __ESP_CCHI_REQ_CTX_TAG;
+    req_ctx.ref_uri = route->pattern;
+    req_ctx.user_ctx = route->user_ctx;
+    req_ctx.route = route;
+    req_ctx.query = NULL;
+
+    // The middlewares of the groups are shared by all of their routes, they run in the arena of
+    // the request like the handler
+    r->user_ctx = &req_ctx;
+    esp_err_t err = esp_cchi_run_handler(r,
+                                         route->metrics,
+                                         esp_cchi_router_has_mws(route->group) ?
+                                         esp_cchi_router_run_route : route->handler);
+    r->user_ctx = router;
+
+    return err;
+}
+
+esp_err_t esp_cchi_router_create(esp_cchi_router_handle_t *router) {
+    if (router == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct esp_cchi_router *new_router = calloc(1, sizeof(struct esp_cchi_router));
+    if (new_router == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    new_router->root.prefix = "";
+    *router = new_router;
+    return ESP_OK;
+}
+
+static void esp_cchi_router_free_routes(struct esp_cchi_router *router) {
+    esp_cchi_tree_free(&router->root);
+    while (router->retired != NULL) {
+        struct esp_cchi_route *next = router->retired->next;
+        free(router->retired->pattern);
+        free(router->retired);
+        router->retired = next;
+    }
+}
+
+// Frees everything the router owns but the struct itself
+static void esp_cchi_router_free(struct esp_cchi_router *router) {
+    esp_cchi_router_free_routes(router);
+    while (router->groups != NULL) {
+        struct esp_cchi_router *next = router->groups->next_group;
+        esp_cchi_router_free(router->groups);
+        free(router->groups);
+        router->groups = next;
+    }
+    esp_cchi_mw_delete_group(&router->mws);
+    free(router->prefix);
+}
+
+esp_err_t esp_cchi_router_delete(esp_cchi_router_handle_t router) {
+    if (router == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (router->parent != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_cchi_router_free(router);
+    free(router);
+    return ESP_OK;
+}
+
+// The router whose tree has the routes of "router", the router itself if it's not a group
+static struct esp_cchi_router *esp_cchi_router_top(struct esp_cchi_router *router) {
+    while (router->parent != NULL) {
+        router = router->parent;
+    }
+    return router;
+}
+
+// "pattern" prefixed by the prefixes of "group" and of the groups above it, NULL if there is no
+// memory available
+static char *esp_cchi_router_join(const struct esp_cchi_router *group, const char *pattern) {
+    size_t pattern_len = strlen(pattern);
+    size_t len = pattern_len;
+    for (const struct esp_cchi_router *it = group; it->parent != NULL; it = it->parent) {
+        len += strlen(it->prefix);
+    }
+    char *joined = malloc(len + 1);
+    if (joined == NULL) {
+        return NULL;
+    }
+    size_t pos = len - pattern_len;
+    memcpy(joined + pos, pattern, pattern_len + 1);
+    for (const struct esp_cchi_router *it = group; it->parent != NULL; it = it->parent) {
+        size_t prefix_len = strlen(it->prefix);
+        pos -= prefix_len;
+        memcpy(joined + pos, it->prefix, prefix_len);
+    }
+    return joined;
+}
+
+// Inserts a route in the tree of "top", "pattern" is owned by the route from now on
+static esp_err_t esp_cchi_router_insert(struct esp_cchi_router *top,
+                                        char *pattern,
+                                        httpd_method_t method,
+                                        esp_err_t (*handler)(httpd_req_t *r),
+                                        void *user_ctx,
+                                        const struct esp_cchi_router *group)
+{
+    struct esp_cchi_route *route = malloc(sizeof(struct esp_cchi_route));
+    if (route == NULL) {
+        free(pattern);
+        return ESP_ERR_NO_MEM;
+    }
+    route->pattern = pattern;
+    route->method = method;
+    route->handler = handler;
+    route->user_ctx = user_ctx;
+    route->group = group;
+    route->metrics = NULL;
+    route->next = NULL;
+
+    esp_err_t err = esp_cchi_tree_insert(&top->root, route);
+    if (err == ESP_ERR_NO_MEM) {
+        route->next = top->retired;
+        top->retired = route;
+        return err;
+    }
+    if (err != ESP_OK) {
+        free(route->pattern);
+        free(route);
+        return err;
+    }
+
+#if CONFIG_ESP_CCHI_METRICS
+    if (top->server != NULL) {
+        route->metrics = esp_cchi_metrics_slot(route->pattern, method);
+    }
+#endif
+
+    uint64_t method_bit = (uint64_t)1 << method;
+#ifndef HTTP_ANY
+    if (top->server != NULL && (top->methods & method_bit) == 0) {
+        err = esp_cchi_register_catch_all(top->server, method_bit, esp_cchi_router_dispatch, top);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+#endif
+    top->methods |= method_bit;
+    return ESP_OK;
+}
+
+esp_err_t esp_cchi_router_handle(esp_cchi_router_handle_t router, const httpd_uri_t *hd_uri) {
+    if (router == NULL || hd_uri == NULL || hd_uri->uri == NULL || hd_uri->handler == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!esp_cchi_is_valid_uri(hd_uri->uri) || (unsigned)hd_uri->method >= 64) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    char *pattern = esp_cchi_router_join(router, hd_uri->uri);
+    if (pattern == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    // The routes of a group live in the tree of the router on top, with the full pattern, so a
+    // lookup walks the common prefix of a group once and prunes the group as soon as it fails
+    return esp_cchi_router_insert(esp_cchi_router_top(router),
+                                  pattern,
+                                  hd_uri->method,
+                                  hd_uri->handler,
+                                  hd_uri->user_ctx,
+                                  router);
+}
+
+// A prefix is a valid pattern that doesn't end with '/', so joining it with a pattern (that starts
+// with '/') makes a valid pattern
+static bool esp_cchi_is_valid_prefix(const char *prefix) {
+    size_t len = strlen(prefix);
+    return len > 1 &&
+           prefix[len - 1] != '/' &&
+           !esp_cchi_is_param(prefix + len - 1) &&
+           esp_cchi_is_valid_uri(prefix);
+}
+
+esp_err_t esp_cchi_router_route(esp_cchi_router_handle_t router,
+                                const char *prefix,
+                                esp_cchi_router_handle_t *group)
+{
+    if (router == NULL || prefix == NULL || group == NULL || !esp_cchi_is_valid_prefix(prefix)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct esp_cchi_router *new_group = calloc(1, sizeof(struct esp_cchi_router));
+    if (new_group == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    new_group->prefix = strdup(prefix);
+    if (new_group->prefix == NULL) {
+        free(new_group);
+        return ESP_ERR_NO_MEM;
+    }
+    new_group->root.prefix = "";
+    new_group->parent = router;
+    new_group->next_group = router->groups;
+    router->groups = new_group;
+    *group = new_group;
+    return ESP_OK;
+}
+
+// Moves the routes of the tree under "node" to the tree of "top", prefixing their patterns with
+// the prefixes of "sub" and of the groups above it
+static esp_err_t esp_cchi_router_move(struct esp_cchi_router *top,
+                                      const struct esp_cchi_router *sub,
+                                      const esp_cchi_tree_node_t *node)
+{
+    for (const struct esp_cchi_route *route = esp_cchi_node_routes(node);
+         route != NULL;
+         route = route->next)
+    {
+        char *pattern = esp_cchi_router_join(sub, route->pattern);
+        if (pattern == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        esp_err_t err = esp_cchi_router_insert(top,
+                                               pattern,
+                                               route->method,
+                                               route->handler,
+                                               route->user_ctx,
+                                               route->group);
+        if (err != ESP_OK) {
+            return err;
+        }
     }
+    for (size_t i = 0; i < node->children_len; i++) {
+        esp_err_t err = esp_cchi_router_move(top, sub, node->children[i]);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    for (size_t i = 0; i < node->params_len; i++) {
+        esp_err_t err = esp_cchi_router_move(top, sub, node->params[i]);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
 
-    // Param not found
-    return 0;
+esp_err_t esp_cchi_router_mount(esp_cchi_router_handle_t router,
+                                const char *prefix,
+                                esp_cchi_router_handle_t sub)
+{
+    if (router == NULL || prefix == NULL || sub == NULL || !esp_cchi_is_valid_prefix(prefix)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (sub->parent != NULL || sub->server != NULL || esp_cchi_router_top(router) == sub) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    char *sub_prefix = strdup(prefix);
+    if (sub_prefix == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    sub->prefix = sub_prefix;
+    sub->parent = router;
+    sub->next_group = router->groups;
+    router->groups = sub;
+
+    // The routes are copied to the tree on top, from now on the tree of "sub" is unused
+    esp_err_t err = esp_cchi_router_move(esp_cchi_router_top(router), sub, &sub->root);
+    esp_cchi_router_free_routes(sub);
+    sub->methods = 0;
+    return err;
+}
+
+esp_err_t esp_cchi_router_use(esp_cchi_router_handle_t router,
+                              esp_err_t (*middleware)(httpd_req_t *r))
+{
+    if (router == NULL || middleware == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return esp_cchi_mw_use(&router->mws, middleware);
+}
+
+#if CONFIG_ESP_CCHI_METRICS
+// Resolves the metrics slots of the routes under "node", once their patterns are final
+static void esp_cchi_router_resolve_metrics(const esp_cchi_tree_node_t *node) {
+    for (struct esp_cchi_route *route = esp_cchi_node_routes(node);
+         route != NULL;
+         route = route->next)
+    {
+        if (route->metrics == NULL) {
+            route->metrics = esp_cchi_metrics_slot(route->pattern, route->method);
+        }
+    }
+    for (size_t i = 0; i < node->children_len; i++) {
+        esp_cchi_router_resolve_metrics(node->children[i]);
+    }
+    for (size_t i = 0; i < node->params_len; i++) {
+        esp_cchi_router_resolve_metrics(node->params[i]);
+    }
+}
+#endif
+
+esp_err_t esp_cchi_router_attach(esp_cchi_router_handle_t router, httpd_handle_t server) {
+    if (router == NULL || server == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (router->server != NULL || router->parent != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t err = esp_cchi_register_catch_all(server,
+                                                router->methods,
+                                                esp_cchi_router_dispatch,
+                                                router);
+    if (err != ESP_OK) {
+        return err;
+    }
+    router->server = server;
+#if CONFIG_ESP_CCHI_METRICS
+    esp_cchi_router_resolve_metrics(&router->root);
+#endif
+    return ESP_OK;
+}
+
+esp_err_t esp_cchi_router_detach(esp_cchi_router_handle_t router) {
+    if (router == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (router->server == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_cchi_unregister_catch_all(router->server, router->methods);
+    router->server = NULL;
+    return ESP_OK;
+}
+
+static esp_err_t esp_cchi_compiled_dispatch(httpd_req_t *r) {
+    const esp_cchi_compiled_table_t *table = (const esp_cchi_compiled_table_t*)r->user_ctx;
+
+    struct esp_cchi_req_ctx req_ctx;
+    req_ctx.params.base = r->uri;
+    req_ctx.params.len = 0;
+
+    size_t path_len = strcspn(r->uri, "?#");
+    // Literal routes first, nothing is more specific than an exact match
+    const esp_cchi_compiled_group_t *group = NULL;
+    int static_index = table->find_static(r->uri, path_len);
+    if (static_index >= 0) {
+        group = &table->groups[static_index];
+    } else {
+        const esp_cchi_tree_node_t *node = esp_cchi_tree_find(table->tree,
+                                                              r->uri,
+                                                              path_len,
+                                                              &req_ctx.params);
+        group = node != NULL ? (const esp_cchi_compiled_group_t*)node->endpoint : NULL;
+    }
+    if (group == NULL) {
+        return esp_cchi_send_unmatched(r, HTTPD_404_NOT_FOUND);
+    }
+
+    const esp_cchi_compiled_route_t *route = NULL;
+    uint64_t methods = 0;
+    for (size_t i = 0; i < group->routes_len; i++) {
+        if ((int)group->routes[i].method == r->method) {
+            route = &group->routes[i];
+            break;
+        }
+        methods |= (uint64_t)1 << group->routes[i].method;
+    }
+    if (route == NULL) {
+        return esp_cchi_send_not_allowed(r, methods);
+    }
+
+    req_ctx.tag = __ESP_CCHI_REQ_CTX_TAG;
+    req_ctx.ref_uri = group->pattern;
+    req_ctx.user_ctx = route->user_ctx;
+    req_ctx.route = NULL;
+    req_ctx.query = NULL;
+
+    r->user_ctx = &req_ctx;
+    esp_err_t err = esp_cchi_run_handler(r,
+                                         route->metrics != NULL ? *route->metrics : NULL,
+                                         route->handler);
+    r->user_ctx = (void*)table;
+
+    return err;
+}
+
+esp_err_t esp_cchi_compiled_attach(const esp_cchi_compiled_table_t *table, httpd_handle_t server) {
+    if (table == NULL || server == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+#if CONFIG_ESP_CCHI_METRICS
+    for (size_t i = 0; i < table->groups_len; i++) {
+        const esp_cchi_compiled_group_t *group = &table->groups[i];
+        for (size_t j = 0; j < group->routes_len; j++) {
+            const esp_cchi_compiled_route_t *route = &group->routes[j];
+            if (route->metrics != NULL && *route->metrics == NULL) {
+                *route->metrics = esp_cchi_metrics_slot(group->pattern, route->method);
+            }
+        }
+    }
+#endif
+    return esp_cchi_register_catch_all(server,
+                                       table->methods,
+                                       esp_cchi_compiled_dispatch,
+                                       (void*)table);
+}
+
+esp_err_t esp_cchi_compiled_detach(const esp_cchi_compiled_table_t *table, httpd_handle_t server) {
+    if (table == NULL || server == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_cchi_unregister_catch_all(server, table->methods);
+    return ESP_OK;
 }
@@ -0,0 +1,337 @@
+#include <esp_http_server.h>
+#include <esp_cchi/arena.h>
+#include <esp_cchi/router.h>
+#include <esp_cchi/static.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include "sdkconfig.h"
+
+#ifndef CONFIG_ESP_CCHI_STATIC_CHUNK_LEN
+#define CONFIG_ESP_CCHI_STATIC_CHUNK_LEN 1024
+#endif
+
+// Longest path of a file (base path included) that can be served
+#define ESP_CCHI_STATIC_PATH_LEN 256
+#define ESP_CCHI_STATIC_ETAG_LEN 48
+
+struct esp_cchi_static_type {
+    const char *ext;
+    const char *type;
+};
+
+static const struct esp_cchi_static_type esp_cchi_static_types[] = {
+    { "html", "text/html" },
+    { "htm", "text/html" },
+    { "css", "text/css" },
+    { "js", "text/javascript" },
+    { "mjs", "text/javascript" },
+    { "json", "application/json" },
+    { "map", "application/json" },
+    { "txt", "text/plain" },
+    { "xml", "application/xml" },
+    { "svg", "image/svg+xml" },
+    { "png", "image/png" },
+    { "jpg", "image/jpeg" },
+    { "jpeg", "image/jpeg" },
+    { "gif", "image/gif" },
+    { "webp", "image/webp" },
+    { "ico", "image/x-icon" },
+    { "woff", "font/woff" },
+    { "woff2", "font/woff2" },
+    { "wasm", "application/wasm" },
+    { "pdf", "application/pdf" },
+};
+
+static const char *esp_cchi_static_type_of(const char *path) {
+    const char *slash = strrchr(path, '/');
+    const char *dot = strrchr(slash != NULL ? slash : path, '.');
+    if (dot != NULL) {
+        for (size_t i = 0; i < sizeof(esp_cchi_static_types) / sizeof(esp_cchi_static_types[0]);
+             i++)
+        {
+            if (strcasecmp(dot + 1, esp_cchi_static_types[i].ext) == 0) {
+                return esp_cchi_static_types[i].type;
+            }
+        }
+    }
+    return "application/octet-stream";
+}
+
+static int esp_cchi_static_hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/**
+ * Writes the path of the file that "rel" (the wildcard of the request) names into "path": the
+ * base path, '/', "rel" percent-decoded and the index file if "rel" is a directory. Room is kept
+ * for a ".gz" suffix
+ *
+ * @returns
+ *  - ESP_OK on success
+ *  - ESP_ERR_NOT_FOUND if "rel" has a ".." segment, a '\' or an escaped NUL, or the path is
+ *    too long
+*/
+static esp_err_t esp_cchi_static_path(const esp_cchi_static_config_t *config,
+                                      esp_cchi_view_t rel,
+                                      char *path,
+                                      size_t *path_len)
+{
+    const size_t max_len = ESP_CCHI_STATIC_PATH_LEN - sizeof(".gz");
+    size_t len = strlen(config->base_path);
+    if (len + 1 > max_len) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    memcpy(path, config->base_path, len);
+    path[len++] = '/';
+
+    size_t segment = len;
+    for (size_t i = 0; i < rel.len; i++) {
+        char c = rel.data[i];
+        if (c == '%' && i + 2 < rel.len &&
+            esp_cchi_static_hex_value(rel.data[i + 1]) >= 0 &&
+            esp_cchi_static_hex_value(rel.data[i + 2]) >= 0)
+        {
+            c = (char)(esp_cchi_static_hex_value(rel.data[i + 1]) * 16 +
+                       esp_cchi_static_hex_value(rel.data[i + 2]));
+            i += 2;
+        }
+        if (c == '\0' || c == '\\' || len + 1 > max_len) {
+            return ESP_ERR_NOT_FOUND;
+        }
+        if (c == '/') {
+            if (len - segment == 2 && path[segment] == '.' && path[segment + 1] == '.') {
+                return ESP_ERR_NOT_FOUND;
+            }
+            segment = len + 1;
+        }
+        path[len++] = c;
+    }
+    if (len - segment == 2 && path[segment] == '.' && path[segment + 1] == '.') {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    if (path[len - 1] == '/') {
+        const char *index = config->index != NULL ? config->index : "index.html";
+        size_t index_len = strlen(index);
+        if (len + index_len > max_len) {
+            return ESP_ERR_NOT_FOUND;
+        }
+        memcpy(path + len, index, index_len);
+        len += index_len;
+    }
+    path[len] = '\0';
+    *path_len = len;
+    return ESP_OK;
+}
+
+// Whether Accept-Encoding allows gzip, an explicit "gzip" wins over "*"
+static bool esp_cchi_static_accepts_gzip(httpd_req_t *r) {
+    char value[128];
+    esp_err_t err = httpd_req_get_hdr_value_str(r, "Accept-Encoding", value, sizeof(value));
+    if (err != ESP_OK && err != ESP_ERR_HTTPD_RESULT_TRUNC) {
+        return false;
+    }
+    int gzip = -1;
+    int any = -1;
+    char *item = value;
+    while (item != NULL) {
+        char *next = strchr(item, ',');
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+        item += strspn(item, " \t");
+        size_t len = strcspn(item, " \t;");
+        const char *q = strstr(item + len, "q=");
+        int allowed = (q == NULL || strtod(q + 2, NULL) > 0) ? 1 : 0;
+        if (len == 4 && strncasecmp(item, "gzip", 4) == 0) {
+            gzip = allowed;
+        } else if (len == 1 && item[0] == '*') {
+            any = allowed;
+        }
+        item = next;
+    }
+    return gzip >= 0 ? gzip == 1 : any == 1;
+}
+
+// "*" or a list of ETags that has "etag" (If-None-Match compares them weakly)
+static bool esp_cchi_static_not_modified(httpd_req_t *r, const char *etag) {
+    char value[4 * ESP_CCHI_STATIC_ETAG_LEN];
+    esp_err_t err = httpd_req_get_hdr_value_str(r, "If-None-Match", value, sizeof(value));
+    if (err != ESP_OK && err != ESP_ERR_HTTPD_RESULT_TRUNC) {
+        return false;
+    }
+    return strcmp(value + strspn(value, " \t"), "*") == 0 || strstr(value, etag) != NULL;
+}
+
+/**
+ * Hash of the content of "file", for the filesystems without modification times, "file" is left
+ * at its start
+*/
+static esp_err_t esp_cchi_static_hash(FILE *file, char *buf, size_t buf_size, uint32_t *hash) {
+    *hash = 2166136261u;
+    size_t read;
+    while ((read = fread(buf, 1, buf_size, file)) > 0) {
+        for (size_t i = 0; i < read; i++) {
+            *hash = (*hash ^ (unsigned char)buf[i]) * 16777619u;
+        }
+    }
+    if (ferror(file)) {
+        return ESP_FAIL;
+    }
+    rewind(file);
+    return ESP_OK;
+}
+
+/**
+ * Sends the file named by "rel", "path" is a buffer of ESP_CCHI_STATIC_PATH_LEN bytes and "buf" one
+ * of CONFIG_ESP_CCHI_STATIC_CHUNK_LEN bytes
+*/
+static esp_err_t esp_cchi_static_send(httpd_req_t *r,
+                                      const esp_cchi_static_config_t *config,
+                                      esp_cchi_view_t rel,
+                                      char *path,
+                                      char *buf)
+{
+    size_t path_len;
+    if (esp_cchi_static_path(config, rel, path, &path_len) != ESP_OK) {
+        return httpd_resp_send_err(r, HTTPD_404_NOT_FOUND, NULL);
+    }
+    // The type is the one of the file asked for, not of its ".gz"
+    const char *type = esp_cchi_static_type_of(path);
+
+    struct stat st;
+    bool gzip = false;
+    if (esp_cchi_static_accepts_gzip(r)) {
+        memcpy(path + path_len, ".gz", sizeof(".gz"));
+        gzip = stat(path, &st) == 0 && S_ISREG(st.st_mode);
+        if (!gzip) {
+            path[path_len] = '\0';
+        }
+    }
+    if (!gzip && (stat(path, &st) != 0 || !S_ISREG(st.st_mode))) {
+        return httpd_resp_send_err(r, HTTPD_404_NOT_FOUND, NULL);
+    }
+
+    FILE *file = NULL;
+    char etag[ESP_CCHI_STATIC_ETAG_LEN];
+    if (st.st_mtime != 0) {
+        snprintf(etag, sizeof(etag), "\"%" PRIx64 "-%" PRIx64 "%s\"", (uint64_t)st.st_size,
+                 (uint64_t)st.st_mtime, gzip ? "-gz" : "");
+    } else {
+        uint32_t hash;
+        file = fopen(path, "rb");
+        if (file == NULL ||
+            esp_cchi_static_hash(file, buf, CONFIG_ESP_CCHI_STATIC_CHUNK_LEN, &hash) != ESP_OK)
+        {
+            if (file != NULL) {
+                fclose(file);
+            }
+            return httpd_resp_send_err(r, HTTPD_500_INTERNAL_SERVER_ERROR, NULL);
+        }
+        snprintf(etag, sizeof(etag), "\"%" PRIx64 "-h%08" PRIx32 "%s\"", (uint64_t)st.st_size,
+                 hash, gzip ? "-gz" : "");
+    }
+
+    httpd_resp_set_hdr(r, "ETag", etag);
+    httpd_resp_set_hdr(r, "Vary", "Accept-Encoding");
+    if (config->cache_control != NULL) {
+        httpd_resp_set_hdr(r, "Cache-Control", config->cache_control);
+    }
+    if (esp_cchi_static_not_modified(r, etag)) {
+        if (file != NULL) {
+            fclose(file);
+        }
+        httpd_resp_set_status(r, "304 Not Modified");
+        return httpd_resp_send(r, NULL, 0);
+    }
+
+    if (file == NULL && (file = fopen(path, "rb")) == NULL) {
+        return httpd_resp_send_err(r, HTTPD_500_INTERNAL_SERVER_ERROR, NULL);
+    }
+    httpd_resp_set_type(r, type);
+    if (gzip) {
+        httpd_resp_set_hdr(r, "Content-Encoding", "gzip");
+    }
+
+    esp_err_t err = ESP_OK;
+    size_t read;
+    while (err == ESP_OK && (read = fread(buf, 1, CONFIG_ESP_CCHI_STATIC_CHUNK_LEN, file)) > 0) {
+        err = httpd_resp_send_chunk(r, buf, (ssize_t)read);
+    }
+    if (err == ESP_OK && ferror(file)) {
+        // The status is already sent, the response is cut short (no last chunk)
+        err = ESP_FAIL;
+    }
+    fclose(file);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return httpd_resp_send_chunk(r, NULL, 0);
+}
+
+esp_err_t esp_cchi_static_handler(httpd_req_t *r) {
+    const esp_cchi_static_config_t *config = esp_cchi_get_user_ctx(r);
+    esp_cchi_view_t rel;
+    if (config == NULL || config->base_path == NULL ||
+        esp_cchi_get_uri_param_view(r, "*", &rel) != ESP_OK)
+    {
+        return httpd_resp_send_err(r, HTTPD_500_INTERNAL_SERVER_ERROR, NULL);
+    }
+
+    // The chunk is the larger buffer of a request, it's taken from the arena, which the default
+    // CONFIG_ESP_CCHI_REQ_ARENA_SIZE has room for
+    char path[ESP_CCHI_STATIC_PATH_LEN];
+    char *buf = esp_cchi_arena_take(r, CONFIG_ESP_CCHI_STATIC_CHUNK_LEN);
+    if (buf == NULL) {
+        return httpd_resp_send_err(r, HTTPD_500_INTERNAL_SERVER_ERROR, NULL);
+    }
+    esp_err_t err = esp_cchi_static_send(r, config, rel, path, buf);
+    esp_cchi_arena_release(r, buf, CONFIG_ESP_CCHI_STATIC_CHUNK_LEN);
+    return err;
+}
+
+esp_err_t esp_cchi_router_static(esp_cchi_router_handle_t router,
+                                 const char *prefix,
+                                 const esp_cchi_static_config_t *config)
+{
+    if (router == NULL || prefix == NULL || config == NULL || config->base_path == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t prefix_len = strlen(prefix);
+    if (prefix_len > 0 && prefix[prefix_len - 1] == '/') {
+        return ESP_ERR_INVALID_ARG;
+    }
+    char *pattern = malloc(prefix_len + sizeof("/*"));
+    if (pattern == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(pattern, prefix, prefix_len);
+    memcpy(pattern + prefix_len, "/*", sizeof("/*"));
+
+    // The pattern is copied by the router
+    httpd_uri_t hd_uri = {
+        .uri = pattern,
+        .method = HTTP_GET,
+        .handler = esp_cchi_static_handler,
+        .user_ctx = (void*)config,
+    };
+    esp_err_t err = esp_cchi_router_handle(router, &hd_uri);
+    free(pattern);
+    return err;
+}
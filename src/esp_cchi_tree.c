@@ -0,0 +1,439 @@
+#include <esp_http_server.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_cchi_tree.h"
+
+// The arrays and regexps belong to the tree, the public layout only makes them const for the
+// generated tables
+static inline esp_cchi_tree_node_t **esp_cchi_node_array(const esp_cchi_tree_node_t *const *array) {
+    return (esp_cchi_tree_node_t**)array;
+}
+
+static esp_err_t esp_cchi_node_append(const esp_cchi_tree_node_t *const **array,
+                                      size_t *array_len,
+                                      size_t index,
+                                      esp_cchi_tree_node_t *node)
+{
+    esp_cchi_tree_node_t **temp_ptr = realloc(esp_cchi_node_array(*array),
+                                              sizeof(*temp_ptr) * ((*array_len) + 1));
+    if (temp_ptr == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memmove(&temp_ptr[index + 1], &temp_ptr[index], sizeof(*temp_ptr) * ((*array_len) - index));
+    temp_ptr[index] = node;
+    *array = (const esp_cchi_tree_node_t *const *)temp_ptr;
+    (*array_len)++;
+    return ESP_OK;
+}
+
+// Static children are kept sorted by their first character, returns the index where "label" is or
+// should be inserted
+static size_t esp_cchi_node_child_index(const esp_cchi_tree_node_t *node, char label) {
+    size_t lo = 0;
+    size_t hi = node->children_len;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if ((unsigned char)node->children[mid]->prefix[0] < (unsigned char)label) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static esp_cchi_tree_node_t *esp_cchi_node_static_child(const esp_cchi_tree_node_t *node,
+                                                        char label)
+{
+    size_t i = esp_cchi_node_child_index(node, label);
+    if (i < node->children_len && node->children[i]->prefix[0] == label) {
+        return esp_cchi_node_array(node->children)[i];
+    }
+    return NULL;
+}
+
+static esp_cchi_tree_node_t *esp_cchi_node_insert_static(esp_cchi_tree_node_t *node,
+                                                         const char *literal,
+                                                         size_t literal_len)
+{
+    while (literal_len > 0) {
+        size_t i = esp_cchi_node_child_index(node, *literal);
+        if (i == node->children_len || node->children[i]->prefix[0] != *literal) {
+            esp_cchi_tree_node_t *child = calloc(1, sizeof(esp_cchi_tree_node_t));
+            if (child == NULL) {
+                return NULL;
+            }
+            child->prefix = literal;
+            child->prefix_len = literal_len;
+            if (esp_cchi_node_append(&node->children, &node->children_len, i, child) != ESP_OK) {
+                free(child);
+                return NULL;
+            }
+            return child;
+        }
+
+        esp_cchi_tree_node_t *child = esp_cchi_node_array(node->children)[i];
+        size_t common = 0;
+        while (common < child->prefix_len && common < literal_len &&
+               child->prefix[common] == literal[common])
+        {
+            common++;
+        }
+
+        if (common < child->prefix_len) {
+            // Splitting the edge, "mid" takes the place of "child" and keeps the common part
+            esp_cchi_tree_node_t *mid = calloc(1, sizeof(esp_cchi_tree_node_t));
+            if (mid == NULL) {
+                return NULL;
+            }
+            esp_cchi_tree_node_t **children = malloc(sizeof(*children));
+            if (children == NULL) {
+                free(mid);
+                return NULL;
+            }
+            mid->prefix = child->prefix;
+            mid->prefix_len = common;
+            mid->patterns = child->patterns;
+            children[0] = child;
+            mid->children = (const esp_cchi_tree_node_t *const *)children;
+            mid->children_len = 1;
+            child->prefix += common;
+            child->prefix_len -= common;
+            esp_cchi_node_array(node->children)[i] = mid;
+            child = mid;
+        }
+
+        literal += common;
+        literal_len -= common;
+        node = child;
+    }
+    return node;
+}
+
+// Position of a param node in the specificity order, the lower the sooner it's tried
+static int esp_cchi_node_param_rank(const esp_cchi_tree_node_t *param) {
+    return (param->wildcard ? 2 : 0) + (param->constraint == NULL ? 1 : 0);
+}
+
+/**
+ * Same order as esp_cchi_specificity_cmp: the rank of the params first, then what follows them, a
+ * literal character beats the end of the pattern and two literal characters compare by value
+*/
+static int esp_cchi_node_param_cmp(const esp_cchi_tree_node_t *a, const esp_cchi_tree_node_t *b) {
+    int rank = esp_cchi_node_param_rank(a) - esp_cchi_node_param_rank(b);
+    if (rank != 0 || a->tail == b->tail) {
+        return rank;
+    }
+    if (a->tail == '\0' || b->tail == '\0') {
+        return a->tail == '\0' ? 1 : -1;
+    }
+    return (unsigned char)a->tail - (unsigned char)b->tail;
+}
+
+// The "{...}" text of the param in the pattern, only a "*" wildcard takes an empty value and its
+// name is the whole param
+static const char *esp_cchi_node_key(const esp_cchi_tree_node_t *param) {
+    return param->min_len == 0 ? param->name : param->name - 1;
+}
+
+static esp_cchi_tree_node_t *esp_cchi_node_param_child(const esp_cchi_tree_node_t *node,
+                                                       const char *key,
+                                                       size_t key_len,
+                                                       char tail)
+{
+    for (size_t i = 0; i < node->params_len; i++) {
+        const esp_cchi_tree_node_t *param = node->params[i];
+        const char *param_key = esp_cchi_node_key(param);
+        size_t param_key_len = esp_cchi_param_end(param_key) - param_key + 1;
+        if (param->tail == tail && param_key_len == key_len &&
+            strncmp(param_key, key, key_len) == 0)
+        {
+            return esp_cchi_node_array(node->params)[i];
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t esp_cchi_node_insert_param(esp_cchi_tree_node_t *node,
+                                            const char *key,
+                                            size_t key_len,
+                                            char tail,
+                                            esp_cchi_tree_node_t **inserted)
+{
+    *inserted = esp_cchi_node_param_child(node, key, key_len, tail);
+    if ((*inserted) != NULL) {
+        return ESP_OK;
+    }
+
+    esp_cchi_tree_node_t *param = calloc(1, sizeof(esp_cchi_tree_node_t));
+    if (param == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    param->name = esp_cchi_param_name(key);
+    param->tail = tail;
+    param->wildcard = esp_cchi_param_is_wildcard(key);
+    param->min_len = esp_cchi_param_min_len(key);
+
+    const char *regexp;
+    size_t regexp_len;
+    esp_cchi_param_regexp(key, &regexp, &regexp_len);
+    if (regexp != NULL) {
+        struct esp_cchi_constraint *constraint = malloc(sizeof(struct esp_cchi_constraint));
+        if (constraint == NULL) {
+            free(param);
+            return ESP_ERR_NO_MEM;
+        }
+        esp_err_t err = esp_cchi_constraint_compile(regexp, regexp_len, constraint);
+        if (err != ESP_OK) {
+            free(constraint);
+            free(param);
+            return err;
+        }
+        param->constraint = constraint;
+    }
+
+    // After the params that are as specific, so they keep their registration order
+    size_t index = 0;
+    while (index < node->params_len && esp_cchi_node_param_cmp(node->params[index], param) <= 0) {
+        index++;
+    }
+    if (esp_cchi_node_append(&node->params, &node->params_len, index, param) != ESP_OK) {
+        free((void*)param->constraint);
+        free(param);
+        return ESP_ERR_NO_MEM;
+    }
+    *inserted = param;
+    return ESP_OK;
+}
+
+// Counts a new node with routes in the nodes along the path of "pattern", which is already inserted
+static void esp_cchi_tree_count_pattern(esp_cchi_tree_node_t *node, const char *pattern) {
+    while (true) {
+        node->patterns++;
+        if ((*pattern) == '\0') {
+            return;
+        }
+        if (esp_cchi_is_param(pattern)) {
+            const char *param_end = esp_cchi_param_end(pattern);
+            node = esp_cchi_node_param_child(node,
+                                             pattern,
+                                             param_end - pattern + 1,
+                                             *(param_end + 1));
+            pattern = param_end + 1;
+        } else {
+            node = esp_cchi_node_static_child(node, *pattern);
+            pattern += node->prefix_len;
+        }
+    }
+}
+
+esp_err_t esp_cchi_tree_insert(esp_cchi_tree_node_t *root, struct esp_cchi_route *route) {
+    esp_cchi_tree_node_t *node = root;
+    const char *pattern = route->pattern;
+
+    while ((*pattern) != '\0') {
+        if (esp_cchi_is_param(pattern)) {
+            const char *param_end = esp_cchi_param_end(pattern);
+            esp_err_t err = esp_cchi_node_insert_param(node,
+                                                       pattern,
+                                                       param_end - pattern + 1,
+                                                       *(param_end + 1),
+                                                       &node);
+            if (err != ESP_OK) {
+                return err;
+            }
+            pattern = param_end + 1;
+        } else {
+            const char *literal_end = esp_cchi_next_param(pattern);
+            if (literal_end == NULL) {
+                literal_end = pattern + strlen(pattern);
+            }
+            node = esp_cchi_node_insert_static(node, pattern, literal_end - pattern);
+            if (node == NULL) {
+                return ESP_ERR_NO_MEM;
+            }
+            pattern = literal_end;
+        }
+    }
+
+    for (struct esp_cchi_route *it = esp_cchi_node_routes(node); it != NULL; it = it->next) {
+        if (it->method == route->method) {
+            return ESP_ERR_HTTPD_HANDLER_EXISTS;
+        }
+    }
+    if (node->endpoint == NULL) {
+        node->pattern = route->pattern;
+        esp_cchi_tree_count_pattern(root, route->pattern);
+    }
+    route->next = esp_cchi_node_routes(node);
+    node->endpoint = route;
+    return ESP_OK;
+}
+
+static const esp_cchi_tree_node_t *esp_cchi_tree_find_param(const esp_cchi_tree_node_t *param,
+                                                            const char *path,
+                                                            size_t path_len,
+                                                            size_t value_len,
+                                                            struct esp_cchi_params *params)
+{
+    if (param->constraint != NULL &&
+        !esp_cchi_constraint_match(param->constraint, path, value_len))
+    {
+        return NULL;
+    }
+
+    struct esp_cchi_capture *capture = &params->items[params->len++];
+    capture->name = param->name;
+    capture->offset = path - params->base;
+    capture->len = value_len;
+
+    const esp_cchi_tree_node_t *found = esp_cchi_tree_find(param,
+                                                           path + value_len,
+                                                           path_len - value_len,
+                                                           params);
+    if (found == NULL) {
+        params->len--;
+    }
+    return found;
+}
+
+/**
+ * Lengths the value of "param" can have at the start of "path", from the longest to the shortest:
+ * returns the longest one below "below", SIZE_MAX if there is none. A value ends at an occurrence
+ * of the tail of the param, the one of a param that ends the pattern takes the rest of the segment
+ * (the rest of the path for a wildcard)
+*/
+static size_t esp_cchi_param_value_len(const esp_cchi_tree_node_t *param,
+                                       const char *path,
+                                       size_t path_len,
+                                       size_t segment_len,
+                                       size_t below)
+{
+    if (!param->wildcard) {
+        if (param->tail == '/' || (param->tail == '\0' && segment_len == path_len)) {
+            return segment_len > 0 && segment_len < below ? segment_len : SIZE_MAX;
+        }
+        if (param->tail == '\0') {
+            return SIZE_MAX;
+        }
+        path_len = segment_len;
+    } else if (param->tail == '\0') {
+        return path_len >= param->min_len && path_len < below ? path_len : SIZE_MAX;
+    }
+    for (size_t end = below < path_len ? below : path_len; end-- > param->min_len;) {
+        if (path[end] == param->tail) {
+            return end;
+        }
+    }
+    return SIZE_MAX;
+}
+
+const esp_cchi_tree_node_t *esp_cchi_tree_find(const esp_cchi_tree_node_t *node,
+                                               const char *path,
+                                               size_t path_len,
+                                               struct esp_cchi_params *params)
+{
+    if (path_len == 0 && node->endpoint != NULL) {
+        return node;
+    }
+
+    // Literal edges always win over params
+    const esp_cchi_tree_node_t *child = path_len > 0 ? esp_cchi_node_static_child(node, *path)
+                                                     : NULL;
+    if (child != NULL && child->prefix_len <= path_len &&
+        memcmp(child->prefix, path, child->prefix_len) == 0)
+    {
+        const esp_cchi_tree_node_t *found = esp_cchi_tree_find(child,
+                                                               path + child->prefix_len,
+                                                               path_len - child->prefix_len,
+                                                               params);
+        if (found != NULL) {
+            return found;
+        }
+    }
+
+    if (node->params_len == 0 || params->len == CONFIG_ESP_CCHI_MAX_URI_PARAMS) {
+        return NULL;
+    }
+
+    const char *slash_pos = memchr(path, '/', path_len);
+    size_t segment_len = slash_pos != NULL ? (size_t)(slash_pos - path) : path_len;
+
+    // The first match is usually the answer: params are sorted in specificity order and every value
+    // reaches the same pattern when the subtree of the param has only one. Otherwise the shorter
+    // values and the next params that are as specific (they differ further in the pattern) are
+    // tried too and the most specific pattern wins, its captures are redone if a later attempt
+    // overwrote them
+    size_t base_len = params->len;
+    const esp_cchi_tree_node_t *best = NULL;
+    size_t best_index = 0;
+    size_t best_len = 0;
+    bool captured = false;
+    for (size_t i = 0; i < node->params_len; i++) {
+        const esp_cchi_tree_node_t *param = node->params[i];
+        if (best != NULL && esp_cchi_node_param_cmp(node->params[best_index], param) != 0) {
+            break;
+        }
+        for (size_t len = esp_cchi_param_value_len(param, path, path_len, segment_len, SIZE_MAX);
+             len != SIZE_MAX;
+             len = esp_cchi_param_value_len(param, path, path_len, segment_len, len))
+        {
+            if (params->len != base_len) {
+                params->len = base_len;
+                captured = false;
+            }
+            const esp_cchi_tree_node_t *found = esp_cchi_tree_find_param(param,
+                                                                         path,
+                                                                         path_len,
+                                                                         len,
+                                                                         params);
+            if (found == NULL) {
+                continue;
+            }
+            captured = best == NULL ||
+                       esp_cchi_specificity_cmp(found->pattern, best->pattern) < 0;
+            if (captured) {
+                best = found;
+                best_index = i;
+                best_len = len;
+            }
+            if (param->patterns == 1) {
+                break;
+            }
+        }
+    }
+    if (best != NULL && !captured) {
+        params->len = base_len;
+        esp_cchi_tree_find_param(node->params[best_index], path, path_len, best_len, params);
+    }
+    return best;
+}
+
+void esp_cchi_tree_free(esp_cchi_tree_node_t *root) {
+    while (root->endpoint != NULL) {
+        struct esp_cchi_route *route = esp_cchi_node_routes(root);
+        root->endpoint = route->next;
+        free(route->pattern);
+        free(route);
+    }
+    esp_cchi_tree_node_t **children = esp_cchi_node_array(root->children);
+    for (size_t i = 0; i < root->children_len; i++) {
+        esp_cchi_tree_free(children[i]);
+        free(children[i]);
+    }
+    esp_cchi_tree_node_t **params = esp_cchi_node_array(root->params);
+    for (size_t i = 0; i < root->params_len; i++) {
+        esp_cchi_tree_free(params[i]);
+        free((void*)params[i]->constraint);
+        free(params[i]);
+    }
+    free(children);
+    free(params);
+    root->children = NULL;
+    root->children_len = 0;
+    root->params = NULL;
+    root->params_len = 0;
+    root->patterns = 0;
+    root->pattern = NULL;
+}
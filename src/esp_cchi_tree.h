@@ -0,0 +1,96 @@
+/**
+ * ============== Route tree (private) ===============
+ * Compressed radix tree used by the Router object and the compiled tables, every pattern is split
+ * in literal edges and "{param}" edges, so a lookup walks the URI once instead of walking every
+ * pattern
+*/
+#pragma once
+
+#include <esp_http_server.h>
+#include <esp_cchi/router.h>
+#include <esp_cchi/metrics.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "esp_cchi_pattern.h"
+
+#ifndef CONFIG_ESP_CCHI_MAX_URI_PARAMS
+#define CONFIG_ESP_CCHI_MAX_URI_PARAMS 8
+#endif
+
+/**
+ * Captured URI param, kept small because the capture table lives in the stack of the httpd task.
+ * "name" points into the pattern (see esp_cchi_param_name), its length is given by
+ * esp_cchi_param_name_len
+*/
+struct esp_cchi_capture {
+    const char *name;
+    uint16_t offset;
+    uint16_t len;
+};
+
+/**
+ * Capture table filled while matching, "base" is the string the offsets are relative to
+*/
+struct esp_cchi_params {
+    const char *base;
+    size_t len;
+    struct esp_cchi_capture items[CONFIG_ESP_CCHI_MAX_URI_PARAMS];
+};
+
+/**
+ * Endpoint of the tree, one per pattern + method pair. "group" is the router (or route group) the
+ * route was registered through, its middlewares run before "handler". "metrics" is the slot of the
+ * route, resolved once its router is attached (NULL if CONFIG_ESP_CCHI_METRICS is disabled)
+*/
+struct esp_cchi_route {
+    char *pattern;
+    httpd_method_t method;
+    esp_err_t (*handler)(httpd_req_t *r);
+    void *user_ctx;
+    const struct esp_cchi_router *group;
+    esp_cchi_metrics_slot_t metrics;
+    struct esp_cchi_route *next;
+};
+
+/**
+ * The nodes of the tree are esp_cchi_tree_node_t (see esp_cchi/compiled.h), the tree owns their
+ * arrays and regexps even though the public layout makes them const. The endpoint of a node is the
+ * list of its routes, one per method, and the names and prefixes point into the route patterns
+*/
+static inline struct esp_cchi_route *esp_cchi_node_routes(const esp_cchi_tree_node_t *node) {
+    return (struct esp_cchi_route*)node->endpoint;
+}
+
+/**
+ * Inserts "route" in the tree, on success the tree takes the ownership of "route" and its
+ * pattern (the nodes point into route->pattern)
+ *
+ * @returns
+ *  - ESP_OK on success
+ *  - ESP_ERR_NO_MEM if there is no memory available, nodes created before the failure may point
+ *    into route->pattern, so it must be kept alive until the tree is freed
+ *  - ESP_ERR_INVALID_ARG or ESP_ERR_NOT_SUPPORTED if the regexp of a param can't be compiled
+ *  - ESP_ERR_HTTPD_HANDLER_EXISTS if the pattern is already registered with the same method
+*/
+esp_err_t esp_cchi_tree_insert(esp_cchi_tree_node_t *root, struct esp_cchi_route *route);
+
+/**
+ * @param params Capture table, the values of the params of the matched node are recorded in it,
+ *        params->base must be set by the caller
+ *
+ * Walks the trees of the Router object and the ones of the compiled tables
+ *
+ * @returns The node that matches "path" and has an endpoint, NULL if there is none. When several
+ * nodes match, the one whose pattern is the most specific (esp_cchi_specificity_cmp)
+*/
+const esp_cchi_tree_node_t *esp_cchi_tree_find(const esp_cchi_tree_node_t *root,
+                                               const char *path,
+                                               size_t path_len,
+                                               struct esp_cchi_params *params);
+
+/**
+ * Frees all of the nodes and routes hanging from "root" (not "root" itself)
+*/
+void esp_cchi_tree_free(esp_cchi_tree_node_t *root);
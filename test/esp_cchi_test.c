@@ -0,0 +1,91 @@
+#include <esp_cchi/router.h>
+#include <esp_http_server.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_cchi_test.h"
+
+static size_t test_failures = 0;
+
+void test_fail(const char *file, int line, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "%s:%d: ", file, line);
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    test_failures++;
+}
+
+int test_report(const char *name) {
+    if (test_failures > 0) {
+        fprintf(stderr, "%s: %zu checks failed\n", name, test_failures);
+        return EXIT_FAILURE;
+    }
+    printf("%s: ok\n", name);
+    return EXIT_SUCCESS;
+}
+
+httpd_handle_t test_server_start(void) {
+    httpd_config_t hd_config = HTTPD_DEFAULT_CONFIG();
+    hd_config.max_uri_handlers = 64;
+    httpd_handle_t server = NULL;
+    if (esp_cchi_setup_hd_config(&hd_config) != ESP_OK ||
+        httpd_start(&server, &hd_config) != ESP_OK)
+    {
+        fprintf(stderr, "the server can't be started\n");
+        exit(EXIT_FAILURE);
+    }
+    return server;
+}
+
+esp_err_t test_echo_handler(httpd_req_t *r) {
+    char buf[512];
+    const char *pattern = esp_cchi_get_route_pattern(r);
+    int len = snprintf(buf, sizeof(buf), "%s", pattern != NULL ? pattern : "(none)");
+    size_t count = esp_cchi_get_uri_param_count(r);
+    for (size_t i = 0; i < count && len < (int)sizeof(buf); i++) {
+        esp_cchi_uri_param_t param;
+        if (esp_cchi_get_uri_param_at(r, i, &param) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        len += snprintf(buf + len, sizeof(buf) - len, " %.*s=%.*s",
+                        (int)param.name_len, param.name, (int)param.len, r->uri + param.offset);
+    }
+    return httpd_resp_sendstr(r, buf);
+}
+
+void test_request_init(test_request_t *req,
+                       httpd_handle_t server,
+                       httpd_method_t method,
+                       const char *uri)
+{
+    if (httpd_host_exchange_init(&req->exchange, server, method, uri) != ESP_OK) {
+        fprintf(stderr, "invalid request %s\n", uri);
+        exit(EXIT_FAILURE);
+    }
+    req->exchange.resp_buf = req->body;
+    req->exchange.resp_buf_size = sizeof(req->body) - 1;
+    req->body[0] = '\0';
+    req->summary[0] = '\0';
+}
+
+const char *test_request_run(test_request_t *req) {
+    httpd_host_exchange_run(&req->exchange);
+    return test_request_wait(req);
+}
+
+const char *test_request_wait(test_request_t *req) {
+    httpd_host_exchange_wait(&req->exchange);
+    size_t len = req->exchange.resp_len;
+    req->body[len < sizeof(req->body) - 1 ? len : sizeof(req->body) - 1] = '\0';
+    snprintf(req->summary, sizeof(req->summary), "%.3s %s", req->exchange.status, req->body);
+    return req->summary;
+}
+
+const char *test_run(httpd_handle_t server, httpd_method_t method, const char *uri) {
+    static test_request_t req;
+    test_request_init(&req, server, method, uri);
+    return test_request_run(&req);
+}
@@ -0,0 +1,98 @@
+/**
+ * ============== Host tests ===============
+ * Helpers shared by the host tests, every test is a standalone executable run by ctest. Requests
+ * go through the esp_http_server stand-in of host/, so the matchers are exercised the same way a
+ * real server does it
+*/
+#pragma once
+
+#include <esp_http_server.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_CHECK(cond)                                                                          \
+    do {                                                                                          \
+        if (!(cond)) {                                                                            \
+            test_fail(__FILE__, __LINE__, "%s", #cond);                                           \
+        }                                                                                         \
+    } while (0)
+
+#define TEST_CHECK_STR(actual, expected)                                                          \
+    do {                                                                                          \
+        const char *__actual = (actual);                                                          \
+        const char *__expected = (expected);                                                      \
+        if (__actual == NULL || strcmp(__actual, __expected) != 0) {                              \
+            test_fail(__FILE__, __LINE__, "%s is \"%s\", expected \"%s\"",                        \
+                      #actual, __actual != NULL ? __actual : "(null)", __expected);               \
+        }                                                                                         \
+    } while (0)
+
+#define TEST_CHECK_ERR(actual, expected)                                                          \
+    do {                                                                                          \
+        esp_err_t __actual = (actual);                                                            \
+        esp_err_t __expected = (expected);                                                        \
+        if (__actual != __expected) {                                                             \
+            test_fail(__FILE__, __LINE__, "%s is %s, expected %s", #actual,                       \
+                      esp_err_to_name(__actual), esp_err_to_name(__expected));                    \
+        }                                                                                         \
+    } while (0)
+
+void test_fail(const char *file, int line, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+/**
+ * Prints the summary of the test
+ *
+ * @returns Exit status of the test, EXIT_FAILURE if any check failed
+*/
+int test_report(const char *name);
+
+/**
+ * Starts a server configured with esp_cchi_setup_hd_config, aborts the test if it can't
+*/
+httpd_handle_t test_server_start(void);
+
+/**
+ * Handler that answers with the pattern of the route and the URI params it captured, in capture
+ * order: "<pattern> <name>=<value> ..."
+*/
+esp_err_t test_echo_handler(httpd_req_t *r);
+
+/**
+ * Request made by the tests, the response body is recorded in "body" (NUL terminated, truncated
+ * to its size) and "summary" is "<status code> <body>"
+*/
+typedef struct test_request {
+    httpd_host_exchange_t exchange;
+    char body[1024];
+    char summary[1040];
+} test_request_t;
+
+/**
+ * Initializes the request, headers and body can be added to req->exchange before running it
+*/
+void test_request_init(test_request_t *req,
+                       httpd_handle_t server,
+                       httpd_method_t method,
+                       const char *uri);
+
+/**
+ * Runs the request and waits until it's completed (async copies included)
+ *
+ * @returns req->summary
+*/
+const char *test_request_run(test_request_t *req);
+
+/**
+ * Waits until the async copies of a request already run with httpd_host_exchange_run are completed
+ *
+ * @returns req->summary
+*/
+const char *test_request_wait(test_request_t *req);
+
+/**
+ * Runs a request with no headers nor body, the result lives in a static buffer until the next call
+ *
+ * @returns "<status code> <body>"
+*/
+const char *test_run(httpd_handle_t server, httpd_method_t method, const char *uri);
@@ -0,0 +1,186 @@
+/**
+ * Request arena: aligned allocations until it's exhausted, buffers taken from it or from the heap
+ * and released (the last one back to the arena), done callbacks called in reverse order once the
+ * handler returns, and nested runs for the same request and for another one
+*/
+#include <esp_cchi/arena.h>
+#include <esp_http_server.h>
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_cchi_test.h"
+
+#define TEST_ALIGN alignof(max_align_t)
+
+// Size of the arena, what is available when the handler starts
+static size_t test_size;
+// Done callbacks called, "<arg>:<error>[ inactive]" each
+static char test_trace[256];
+// Request handled inside the handler of another one
+static httpd_req_t test_other;
+
+static bool test_aligned(const void *ptr) {
+    return (uintptr_t)ptr % TEST_ALIGN == 0;
+}
+
+static esp_err_t test_alloc_handler(httpd_req_t *r) {
+    test_size = esp_cchi_arena_available(r);
+    TEST_CHECK(esp_cchi_arena_is_active(r) && test_size >= 4 * TEST_ALIGN);
+
+    char *a = esp_cchi_arena_alloc(r, 1);
+    char *b = esp_cchi_arena_alloc(r, 1);
+    char *c = esp_cchi_arena_alloc(r, TEST_ALIGN + 1);
+    TEST_CHECK(a != NULL && b == a + TEST_ALIGN && c == b + TEST_ALIGN);
+    TEST_CHECK(test_aligned(a) && test_aligned(b) && test_aligned(c));
+    TEST_CHECK(esp_cchi_arena_available(r) == test_size - 3 * TEST_ALIGN - 1);
+
+    // The rest, once aligned, fits but not one more byte
+    size_t rest = test_size - 4 * TEST_ALIGN;
+    TEST_CHECK(esp_cchi_arena_alloc(r, rest + 1) == NULL);
+    TEST_CHECK(esp_cchi_arena_alloc(r, SIZE_MAX) == NULL);
+    char *d = esp_cchi_arena_alloc(r, rest);
+    TEST_CHECK(d == c + 2 * TEST_ALIGN && test_aligned(d));
+    memset(a, 0xa5, test_size);
+    TEST_CHECK(esp_cchi_arena_available(r) == 0);
+    TEST_CHECK(esp_cchi_arena_alloc(r, 1) == NULL);
+    return ESP_OK;
+}
+
+static void test_alloc(void) {
+    httpd_req_t req = { 0 };
+    TEST_CHECK_ERR(esp_cchi_arena_run(&req, test_alloc_handler), ESP_OK);
+
+    // No arena once the handler has returned, nor for requests that were never run
+    TEST_CHECK(!esp_cchi_arena_is_active(&req) && !esp_cchi_arena_is_active(NULL));
+    TEST_CHECK(esp_cchi_arena_alloc(&req, 1) == NULL);
+    TEST_CHECK(esp_cchi_arena_available(&req) == 0);
+    TEST_CHECK_ERR(esp_cchi_arena_run(NULL, test_alloc_handler), ESP_ERR_INVALID_ARG);
+    TEST_CHECK_ERR(esp_cchi_arena_run(&req, NULL), ESP_ERR_INVALID_ARG);
+}
+
+static esp_err_t test_take_handler(httpd_req_t *r) {
+    test_size = esp_cchi_arena_available(r);
+    char *base = esp_cchi_arena_take(r, 0);
+    TEST_CHECK(base != NULL && esp_cchi_arena_available(r) == test_size - 1);
+    esp_cchi_arena_release(r, base, 0);
+    TEST_CHECK(esp_cchi_arena_available(r) == test_size);
+
+    char *buf = esp_cchi_arena_take(r, 100);
+    TEST_CHECK(buf == base && esp_cchi_arena_available(r) == test_size - 100);
+    esp_cchi_arena_release(r, buf, 100);
+    TEST_CHECK(esp_cchi_arena_available(r) == test_size);
+
+    // Allocated after it, the buffer can't be given back
+    buf = esp_cchi_arena_take(r, 100);
+    char *after = esp_cchi_arena_alloc(r, TEST_ALIGN);
+    size_t available = esp_cchi_arena_available(r);
+    esp_cchi_arena_release(r, buf, 100);
+    TEST_CHECK(after != NULL && esp_cchi_arena_available(r) == available);
+
+    // Too large for the arena, from the heap (ASan reports it if it's not freed), the arena buffer
+    // taken before it goes back to the arena
+    buf = esp_cchi_arena_take(r, available / 2);
+    char *heap = esp_cchi_arena_take(r, test_size);
+    TEST_CHECK(buf != NULL && heap != NULL && test_aligned(heap));
+    TEST_CHECK(heap < base || heap >= base + test_size);
+    memset(heap, 0x5a, test_size);
+    size_t left = esp_cchi_arena_available(r);
+    esp_cchi_arena_release(r, heap, test_size);
+    TEST_CHECK(esp_cchi_arena_available(r) == left);
+    esp_cchi_arena_release(r, buf, available / 2);
+    TEST_CHECK(esp_cchi_arena_available(r) == available);
+    return ESP_OK;
+}
+
+static void test_take(void) {
+    httpd_req_t req = { 0 };
+    TEST_CHECK_ERR(esp_cchi_arena_run(&req, test_take_handler), ESP_OK);
+
+    // Without arena, always from the heap
+    char *buf = esp_cchi_arena_take(&req, 16);
+    TEST_CHECK(buf != NULL);
+    memset(buf, 0, 16);
+    esp_cchi_arena_release(&req, buf, 16);
+    esp_cchi_arena_release(NULL, esp_cchi_arena_take(NULL, 0), 0);
+}
+
+static void test_done_add(httpd_req_t *r, esp_err_t err, void *arg) {
+    size_t len = strlen(test_trace);
+    snprintf(test_trace + len, sizeof(test_trace) - len, "%s%s:%s%s", len > 0 ? " " : "",
+             (const char*)arg, esp_err_to_name(err),
+             esp_cchi_arena_is_active(r) ? "" : " inactive");
+}
+
+static esp_err_t test_done_handler(httpd_req_t *r) {
+    TEST_CHECK_ERR(esp_cchi_arena_on_done(NULL, test_done_add, "x"), ESP_ERR_INVALID_ARG);
+    TEST_CHECK_ERR(esp_cchi_arena_on_done(r, NULL, "x"), ESP_ERR_INVALID_ARG);
+    TEST_CHECK_ERR(esp_cchi_arena_on_done(r, test_done_add, "1"), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_arena_on_done(r, test_done_add, "2"), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_arena_on_done(r, test_done_add, "3"), ESP_OK);
+    TEST_CHECK_STR(test_trace, "");
+
+    // No room left for another one
+    while (esp_cchi_arena_alloc(r, 1) != NULL) {
+    }
+    TEST_CHECK_ERR(esp_cchi_arena_on_done(r, test_done_add, "4"), ESP_ERR_NO_MEM);
+    return ESP_ERR_NOT_FOUND;
+}
+
+static void test_done(void) {
+    httpd_req_t req = { 0 };
+    test_trace[0] = '\0';
+    TEST_CHECK_ERR(esp_cchi_arena_on_done(&req, test_done_add, "x"), ESP_ERR_INVALID_STATE);
+    TEST_CHECK_ERR(esp_cchi_arena_run(&req, test_done_handler), ESP_ERR_NOT_FOUND);
+    // With the error of the handler, while the arena is still there
+    TEST_CHECK_STR(test_trace, "3:ESP_ERR_NOT_FOUND 2:ESP_ERR_NOT_FOUND 1:ESP_ERR_NOT_FOUND");
+}
+
+static esp_err_t test_other_handler(httpd_req_t *r) {
+    TEST_CHECK(r == &test_other && esp_cchi_arena_available(r) == test_size);
+    TEST_CHECK(esp_cchi_arena_alloc(r, 8) != NULL);
+    TEST_CHECK_ERR(esp_cchi_arena_on_done(r, test_done_add, "other"), ESP_OK);
+    return ESP_FAIL;
+}
+
+static esp_err_t test_inner_handler(httpd_req_t *r) {
+    // Same arena as the outer handler, not a new one
+    TEST_CHECK(esp_cchi_arena_available(r) == test_size - 16);
+    TEST_CHECK(esp_cchi_arena_alloc(r, 16) != NULL);
+    TEST_CHECK_ERR(esp_cchi_arena_on_done(r, test_done_add, "inner"), ESP_OK);
+    return ESP_ERR_TIMEOUT;
+}
+
+static esp_err_t test_outer_handler(httpd_req_t *r) {
+    test_size = esp_cchi_arena_available(r);
+    TEST_CHECK(esp_cchi_arena_alloc(r, 16) != NULL);
+    TEST_CHECK_ERR(esp_cchi_arena_run(r, test_inner_handler), ESP_ERR_TIMEOUT);
+    TEST_CHECK_STR(test_trace, "");
+    size_t available = esp_cchi_arena_available(r);
+    TEST_CHECK(available <= test_size - 32);
+
+    // Another request has its own arena, dropped when its handler returns
+    TEST_CHECK_ERR(esp_cchi_arena_run(&test_other, test_other_handler), ESP_FAIL);
+    TEST_CHECK_STR(test_trace, "other:ESP_FAIL");
+    TEST_CHECK(!esp_cchi_arena_is_active(&test_other));
+    TEST_CHECK(esp_cchi_arena_is_active(r) && esp_cchi_arena_available(r) == available);
+    test_trace[0] = '\0';
+    return ESP_OK;
+}
+
+static void test_nested(void) {
+    httpd_req_t req = { 0 };
+    test_trace[0] = '\0';
+    TEST_CHECK_ERR(esp_cchi_arena_run(&req, test_outer_handler), ESP_OK);
+    TEST_CHECK_STR(test_trace, "inner:ESP_OK");
+    TEST_CHECK(!esp_cchi_arena_is_active(&req));
+}
+
+int main(void) {
+    test_alloc();
+    test_take();
+    test_done();
+    test_nested();
+    return test_report("test_arena");
+}
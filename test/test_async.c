@@ -0,0 +1,124 @@
+/**
+ * Worker pool with a worker held by the test: the worker reads the URI params from its copy of the
+ * request, a full queue is answered with 503 from the httpd task, and every request handed to the
+ * pool is completed, whatever its handler did
+*/
+#include <esp_cchi/async.h>
+#include <esp_cchi/router.h>
+#include <esp_http_server.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_cchi_test.h"
+
+static pthread_mutex_t test_gate_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t test_gate_cond = PTHREAD_COND_INITIALIZER;
+static bool test_gate_open = false;
+static size_t test_started = 0;
+
+// Runs in the worker, held until the test opens the gate
+static esp_err_t test_async_handler(httpd_req_t *r) {
+    pthread_mutex_lock(&test_gate_lock);
+    test_started++;
+    pthread_cond_broadcast(&test_gate_cond);
+    while (!test_gate_open) {
+        pthread_cond_wait(&test_gate_cond, &test_gate_lock);
+    }
+    pthread_mutex_unlock(&test_gate_lock);
+
+    esp_cchi_view_t id;
+    esp_cchi_view_t q = { 0 };
+    if (esp_cchi_get_uri_param_view(r, "id", &id) != ESP_OK ||
+        (id.len == 4 && memcmp(id.data, "fail", 4) == 0))
+    {
+        // No response, the request must be completed anyway
+        return ESP_FAIL;
+    }
+    esp_cchi_get_query_param_view(r, "q", &q);
+    bool in_copy = id.data >= r->uri && id.data < r->uri + sizeof(r->uri);
+
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%s id=%.*s q=%.*s %s", esp_cchi_get_route_pattern(r),
+             (int)id.len, id.data, (int)q.len, q.data != NULL ? q.data : "",
+             in_copy ? "copy" : "original");
+    return httpd_resp_sendstr(r, buf);
+}
+
+esp_cchi_async_handler(test_async_offload, test_async_handler)
+
+static void test_wait_started(size_t count) {
+    pthread_mutex_lock(&test_gate_lock);
+    while (test_started < count) {
+        pthread_cond_wait(&test_gate_cond, &test_gate_lock);
+    }
+    pthread_mutex_unlock(&test_gate_lock);
+}
+
+static void test_set_gate(bool open) {
+    pthread_mutex_lock(&test_gate_lock);
+    test_gate_open = open;
+    pthread_cond_broadcast(&test_gate_cond);
+    pthread_mutex_unlock(&test_gate_lock);
+}
+
+static void test_offload(void) {
+    esp_cchi_async_config_t config = ESP_CCHI_ASYNC_DEFAULT_CONFIG();
+    config.workers = 1;
+    config.queue_len = 1;
+    config.retry_after_s = 7;
+    TEST_CHECK_ERR(esp_cchi_async_start(&config), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_async_start(&config), ESP_ERR_INVALID_STATE);
+
+    httpd_handle_t server = test_server_start();
+    esp_cchi_router_handle_t router = NULL;
+    TEST_CHECK_ERR(esp_cchi_router_create(&router), ESP_OK);
+    httpd_uri_t hd_uri = {
+        .uri = "/jobs/{id}",
+        .method = HTTP_GET,
+        .handler = test_async_offload,
+    };
+    TEST_CHECK_ERR(esp_cchi_router_handle(router, &hd_uri), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_router_attach(router, server), ESP_OK);
+
+    // Taken by the worker, which holds it
+    static test_request_t running;
+    test_request_init(&running, server, HTTP_GET, "/jobs/a?q=1");
+    TEST_CHECK_ERR(httpd_host_exchange_run(&running.exchange), ESP_OK);
+    // The httpd task reuses the request once the handler returns, the worker must not read it
+    memset((char*)running.exchange.req.uri, 'z', strlen(running.exchange.req.uri));
+    test_wait_started(1);
+
+    // Waits in the queue, which is then full
+    static test_request_t queued;
+    test_request_init(&queued, server, HTTP_GET, "/jobs/b?q=2");
+    TEST_CHECK_ERR(httpd_host_exchange_run(&queued.exchange), ESP_OK);
+    TEST_CHECK(queued.exchange.async_pending == 1);
+
+    static test_request_t rejected;
+    test_request_init(&rejected, server, HTTP_GET, "/jobs/c");
+    TEST_CHECK_STR(test_request_run(&rejected), "503 Service Unavailable");
+    TEST_CHECK_STR(httpd_host_exchange_resp_hdr(&rejected.exchange, "Retry-After"), "7");
+    TEST_CHECK(rejected.exchange.async_pending == 0);
+    TEST_CHECK(esp_cchi_async_rejected() == 1);
+
+    test_set_gate(true);
+    TEST_CHECK_STR(test_request_wait(&running), "200 /jobs/{id} id=a q=1 copy");
+    TEST_CHECK_STR(test_request_wait(&queued), "200 /jobs/{id} id=b q=2 copy");
+
+    // test_request_run only returns once the copy is completed, even if nothing was sent
+    static test_request_t failed;
+    test_request_init(&failed, server, HTTP_GET, "/jobs/fail");
+    test_request_run(&failed);
+    TEST_CHECK(failed.exchange.async_pending == 0);
+    TEST_CHECK(!failed.exchange.resp_sent);
+    TEST_CHECK(esp_cchi_async_rejected() == 1);
+
+    httpd_stop(server);
+    esp_cchi_router_delete(router);
+}
+
+int main(void) {
+    test_offload();
+    return test_report("test_async");
+}
@@ -0,0 +1,233 @@
+/**
+ * Incremental body parsers: the form parser and the JSON tokenizer fed one byte at a time and in
+ * one chunk, the documents they reject and the buffers they refuse, then a JSON body read with
+ * middlewares_body_read
+*/
+#include <esp_cchi/router.h>
+#include <esp_http_server.h>
+#include <middlewares.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_cchi_test.h"
+
+static char test_log[1024];
+
+static void test_log_add(const char *fmt, const char *text, size_t len, size_t depth) {
+    size_t used = strlen(test_log);
+    snprintf(test_log + used, sizeof(test_log) - used, fmt, (int)depth, (int)len, text);
+}
+
+static esp_err_t test_form_field(httpd_req_t *r,
+                                 const char *key,
+                                 size_t key_len,
+                                 const char *value,
+                                 size_t value_len,
+                                 void *arg)
+{
+    (void)r;
+    (void)arg;
+    size_t used = strlen(test_log);
+    snprintf(test_log + used, sizeof(test_log) - used, "[%.*s=%.*s]", (int)key_len, key,
+             (int)value_len, value);
+    return ESP_OK;
+}
+
+static esp_err_t test_json_token(httpd_req_t *r,
+                                 middlewares_json_token_t token,
+                                 const char *text,
+                                 size_t len,
+                                 size_t depth,
+                                 void *arg)
+{
+    (void)r;
+    (void)arg;
+    static const char *const fmts[] = {
+        [MIDDLEWARES_JSON_OBJECT_BEGIN] = "{%d%.*s ",
+        [MIDDLEWARES_JSON_OBJECT_END] = "}%d%.*s ",
+        [MIDDLEWARES_JSON_ARRAY_BEGIN] = "[%d%.*s ",
+        [MIDDLEWARES_JSON_ARRAY_END] = "]%d%.*s ",
+        [MIDDLEWARES_JSON_KEY] = "k%d:%.*s ",
+        [MIDDLEWARES_JSON_STRING] = "s%d:%.*s ",
+        [MIDDLEWARES_JSON_NUMBER] = "n%d:%.*s ",
+        [MIDDLEWARES_JSON_TRUE] = "true%d%.*s ",
+        [MIDDLEWARES_JSON_FALSE] = "false%d%.*s ",
+        [MIDDLEWARES_JSON_NULL] = "null%d%.*s ",
+    };
+    test_log_add(fmts[token], text != NULL ? text : "", len, depth);
+    return ESP_OK;
+}
+
+// Feeds "body" to "feed" whole or one byte at a time, then the empty chunk
+static esp_err_t test_feed(middlewares_body_chunk_fn_t feed,
+                           void *parser,
+                           const char *body,
+                           bool bytewise)
+{
+    size_t len = strlen(body);
+    esp_err_t err = ESP_OK;
+    if (bytewise) {
+        for (size_t i = 0; i < len && err == ESP_OK; i++) {
+            err = feed(NULL, body + i, 1, parser);
+        }
+    } else if (len > 0) {
+        err = feed(NULL, body, len, parser);
+    }
+    return err == ESP_OK ? feed(NULL, NULL, 0, parser) : err;
+}
+
+static esp_err_t test_form(const char *body, size_t buf_size, bool bytewise) {
+    char buf[64];
+    middlewares_form_parser_t form;
+    test_log[0] = '\0';
+    esp_err_t err = middlewares_form_parser_init(&form, buf, buf_size, test_form_field, NULL);
+    return err == ESP_OK ? test_feed(middlewares_form_feed, &form, body, bytewise) : err;
+}
+
+static esp_err_t test_json(const char *body, size_t buf_size, bool bytewise) {
+    char buf[64];
+    middlewares_json_parser_t json;
+    test_log[0] = '\0';
+    esp_err_t err = middlewares_json_parser_init(&json, buf, buf_size, test_json_token, NULL);
+    return err == ESP_OK ? test_feed(middlewares_json_feed, &json, body, bytewise) : err;
+}
+
+static void test_form_parser(void) {
+    for (int bytewise = 0; bytewise < 2; bytewise++) {
+        TEST_CHECK_ERR(test_form("a=1&&b=x%20y+z&c&d=%zz%4", 64, bytewise), ESP_OK);
+        TEST_CHECK_STR(test_log, "[a=1][b=x y z][c=][d=%zz%4]");
+        // Key, value and their NULs
+        TEST_CHECK_ERR(test_form("ab=cd", 6, bytewise), ESP_OK);
+        TEST_CHECK_ERR(test_form("ab=cde", 6, bytewise), ESP_ERR_INVALID_SIZE);
+        TEST_CHECK_ERR(test_form("=&=", 2, bytewise), ESP_OK);
+        TEST_CHECK_STR(test_log, "[=][=]");
+    }
+
+    // Too small for the NULs of a field, and the parser is then rejected
+    char buf[2];
+    middlewares_form_parser_t form;
+    for (size_t buf_size = 0; buf_size < 2; buf_size++) {
+        TEST_CHECK_ERR(middlewares_form_parser_init(&form, buf, buf_size, test_form_field, NULL),
+                       ESP_ERR_INVALID_ARG);
+        TEST_CHECK_ERR(middlewares_form_feed(NULL, "=", 1, &form), ESP_ERR_INVALID_ARG);
+        TEST_CHECK_ERR(middlewares_form_feed(NULL, NULL, 0, &form), ESP_ERR_INVALID_ARG);
+    }
+    TEST_CHECK_ERR(middlewares_form_parser_init(&form, NULL, 8, test_form_field, NULL),
+                   ESP_ERR_INVALID_ARG);
+    TEST_CHECK_ERR(middlewares_form_parser_init(&form, buf, 2, NULL, NULL), ESP_ERR_INVALID_ARG);
+    TEST_CHECK_ERR(middlewares_form_feed(NULL, "a", 1, NULL), ESP_ERR_INVALID_ARG);
+}
+
+static void test_json_tokenizer(void) {
+    for (int bytewise = 0; bytewise < 2; bytewise++) {
+        TEST_CHECK_ERR(test_json(" {\"a\": [1, -2.5e+3, true, false, null, []],\n"
+                                 "  \"b\": {\"c\\n\": \"x\\\"\\/\\u00e9\\ud83d\\ude00\"}, "
+                                 "\"d\": {}} ", 64, bytewise), ESP_OK);
+        TEST_CHECK_STR(test_log, "{0 k1:a [1 n2:1 n2:-2.5e+3 true2 false2 null2 [2 ]2 ]1 "
+                                 "k1:b {1 k2:c\n s2:x\"/\xc3\xa9\xf0\x9f\x98\x80 }1 k1:d {1 }1 "
+                                 "}0 ");
+        TEST_CHECK_ERR(test_json("42", 64, bytewise), ESP_OK);
+        TEST_CHECK_STR(test_log, "n0:42 ");
+        TEST_CHECK_ERR(test_json("\"\"", 64, bytewise), ESP_OK);
+        TEST_CHECK_STR(test_log, "s0: ");
+        // The string and its NUL
+        TEST_CHECK_ERR(test_json("[\"abc\"]", 4, bytewise), ESP_OK);
+        TEST_CHECK_ERR(test_json("[\"abcd\"]", 4, bytewise), ESP_ERR_INVALID_SIZE);
+        TEST_CHECK_ERR(test_json("12345", 4, bytewise), ESP_ERR_INVALID_SIZE);
+    }
+
+    static const char *const invalid[] = {
+        "", " ", "{", "[1", "{\"a\":1,}", "[1,]", "[1 2]", "{\"a\"}", "{\"a\" 1}", "{1:2}",
+        "[1]]", "{]", "[}", "01", "-", "1.", "1e", ".5", "+1", "1]", "\"abc", "tru", "trux",
+        "nul", "[1]x", "1 2", "\"\\x\"", "\"\\u12g4\"", "\"\\ud83d\"", "\"\\ud83dx\"",
+        "\"\\ude00\"", "\"\\ud83d\\u0041\"", "\"a\tb\"", "'a'",
+    };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        for (int bytewise = 0; bytewise < 2; bytewise++) {
+            esp_err_t err = test_json(invalid[i], 64, bytewise);
+            if (err != ESP_ERR_INVALID_ARG) {
+                test_fail(__FILE__, __LINE__, "%s is %s, expected ESP_ERR_INVALID_ARG",
+                          invalid[i], esp_err_to_name(err));
+            }
+        }
+    }
+
+    char deep[2 * MIDDLEWARES_JSON_MAX_DEPTH + 3];
+    memset(deep, '[', MIDDLEWARES_JSON_MAX_DEPTH);
+    memset(deep + MIDDLEWARES_JSON_MAX_DEPTH, ']', MIDDLEWARES_JSON_MAX_DEPTH);
+    deep[2 * MIDDLEWARES_JSON_MAX_DEPTH] = '\0';
+    TEST_CHECK_ERR(test_json(deep, 64, false), ESP_OK);
+    memmove(deep + 1, deep, 2 * MIDDLEWARES_JSON_MAX_DEPTH + 1);
+    deep[0] = '[';
+    strcat(deep, "]");
+    TEST_CHECK_ERR(test_json(deep, 64, false), ESP_ERR_INVALID_SIZE);
+
+    char buf[1];
+    middlewares_json_parser_t json;
+    TEST_CHECK_ERR(middlewares_json_parser_init(&json, buf, 0, test_json_token, NULL),
+                   ESP_ERR_INVALID_ARG);
+    TEST_CHECK_ERR(middlewares_json_feed(NULL, "1", 1, &json), ESP_ERR_INVALID_ARG);
+    TEST_CHECK_ERR(middlewares_json_parser_init(&json, buf, 1, test_json_token, NULL), ESP_OK);
+    TEST_CHECK_ERR(test_feed(middlewares_json_feed, &json, "[\"\",[]]", true), ESP_OK);
+    TEST_CHECK_ERR(middlewares_json_feed(NULL, "1", 1, NULL), ESP_ERR_INVALID_ARG);
+}
+
+static esp_err_t test_json_handler(httpd_req_t *r) {
+    char buf[32];
+    middlewares_json_parser_t json;
+    test_log[0] = '\0';
+    middlewares_json_parser_init(&json, buf, sizeof(buf), test_json_token, NULL);
+    esp_err_t err = middlewares_body_read(r, 1024, middlewares_json_feed, &json);
+    if (err == ESP_ERR_INVALID_ARG || err == ESP_ERR_INVALID_SIZE) {
+        return httpd_resp_send_err(r, HTTPD_400_BAD_REQUEST, NULL);
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+    return httpd_resp_sendstr(r, test_log);
+}
+
+static void test_body_read(void) {
+    httpd_handle_t server = test_server_start();
+    esp_cchi_router_handle_t router = NULL;
+    TEST_CHECK_ERR(esp_cchi_router_create(&router), ESP_OK);
+    httpd_uri_t hd_uri = {
+        .uri = "/json",
+        .method = HTTP_POST,
+        .handler = test_json_handler,
+    };
+    TEST_CHECK_ERR(esp_cchi_router_handle(router, &hd_uri), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_router_attach(router, server), ESP_OK);
+
+    // Longer than a chunk of middlewares_body_read, the tokens fit in the response
+    static char body[2 * MIDDLEWARES_BODY_CHUNK_LEN];
+    static char expected[sizeof(test_log)];
+    size_t len = snprintf(body, sizeof(body), "[");
+    size_t expected_len = snprintf(expected, sizeof(expected), "[0 ");
+    for (int i = 0; len < MIDDLEWARES_BODY_CHUNK_LEN + 64; i++) {
+        len += snprintf(body + len, sizeof(body) - len, "%s%d", i > 0 ? "," : "", i);
+        expected_len += snprintf(expected + expected_len, sizeof(expected) - expected_len,
+                                 "n1:%d ", i);
+    }
+    snprintf(body + len, sizeof(body) - len, "]");
+    snprintf(expected + expected_len, sizeof(expected) - expected_len, "]0 ");
+
+    test_request_t req;
+    test_request_init(&req, server, HTTP_POST, "/json");
+    httpd_host_exchange_set_body(&req.exchange, body, strlen(body));
+    const char *summary = test_request_run(&req);
+    TEST_CHECK(strncmp(summary, "200 ", 4) == 0 && strcmp(req.body, expected) == 0);
+
+    test_request_init(&req, server, HTTP_POST, "/json");
+    httpd_host_exchange_set_body(&req.exchange, "{\"a\":", 5);
+    TEST_CHECK_STR(test_request_run(&req), "400 400 Bad Request");
+
+    httpd_stop(server);
+    esp_cchi_router_delete(router);
+}
+
+int main(void) {
+    test_form_parser();
+    test_json_tokenizer();
+    test_body_read();
+    return test_report("test_body");
+}
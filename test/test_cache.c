@@ -0,0 +1,128 @@
+/**
+ * Response cache: hits and 304s, the responses it must not store (not 200, or no-store), the
+ * Cache-Control of a stored response sent with its hits, then enough entries to chain several in a
+ * bucket, evicted and invalidated
+*/
+#include <esp_cchi/router.h>
+#include <esp_http_server.h>
+#include <middlewares.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_cchi_test.h"
+
+static middlewares_cache_t test_cache;
+static size_t test_calls = 0;
+
+middlewares_cache(test_cache_mw, &test_cache)
+
+// The body has the number of calls, a body served from the cache has the one it was built with
+static esp_err_t test_item_handler(httpd_req_t *r) {
+    esp_cchi_view_t id;
+    if (esp_cchi_get_uri_param_view(r, "id", &id) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    char body[64];
+    int len = snprintf(body, sizeof(body), "item %.*s #%zu", (int)id.len, id.data, ++test_calls);
+    if (id.len == 4 && memcmp(id.data, "gone", 4) == 0) {
+        return middlewares_cache_send_with(r, "404 Not Found", NULL, HTTPD_TYPE_TEXT, body, len);
+    }
+    if (id.len == 7 && memcmp(id.data, "private", 7) == 0) {
+        return middlewares_cache_send_with(r, HTTPD_200, "private, No-Store", HTTPD_TYPE_TEXT,
+                                           body, len);
+    }
+    if (id.len == 6 && memcmp(id.data, "public", 6) == 0) {
+        return middlewares_cache_send_with(r, HTTPD_200, "public, max-age=60", HTTPD_TYPE_TEXT,
+                                           body, len);
+    }
+    return middlewares_cache_send(r, HTTPD_TYPE_TEXT, body, len);
+}
+
+static void test_cache_responses(httpd_handle_t server) {
+    TEST_CHECK_ERR(middlewares_cache_init(&test_cache, 4096), ESP_OK);
+    test_calls = 0;
+
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/items/a"), "200 item a #1");
+    static test_request_t req;
+    test_request_init(&req, server, HTTP_GET, "/items/a?q=1");
+    TEST_CHECK_STR(test_request_run(&req), "200 item a #1");
+    TEST_CHECK(test_cache.hits == 1 && test_cache.misses == 1);
+
+    static char etag[MIDDLEWARES_CACHE_ETAG_LEN];
+    snprintf(etag, sizeof(etag), "%s", httpd_host_exchange_resp_hdr(&req.exchange, "ETag"));
+    test_request_init(&req, server, HTTP_GET, "/items/a");
+    httpd_host_exchange_add_hdr(&req.exchange, "If-None-Match", etag);
+    TEST_CHECK_STR(test_request_run(&req), "304 ");
+
+    // Neither stored nor answered 304
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/items/gone"), "404 item gone #2");
+    test_request_init(&req, server, HTTP_GET, "/items/gone");
+    httpd_host_exchange_add_hdr(&req.exchange, "If-None-Match", "*");
+    TEST_CHECK_STR(test_request_run(&req), "404 item gone #3");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/items/private"), "200 item private #4");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/items/private"), "200 item private #5");
+
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/items/public"), "200 item public #6");
+    test_request_init(&req, server, HTTP_GET, "/items/public");
+    TEST_CHECK_STR(test_request_run(&req), "200 item public #6");
+    TEST_CHECK_STR(httpd_host_exchange_resp_hdr(&req.exchange, "Cache-Control"),
+                   "public, max-age=60");
+
+    middlewares_cache_deinit(&test_cache);
+}
+
+static void test_cache_index(httpd_handle_t server) {
+    // Room for fewer entries than requested, the first ones are evicted
+    TEST_CHECK_ERR(middlewares_cache_init(&test_cache, 4096), ESP_OK);
+    test_calls = 0;
+    const size_t count = 4 * MIDDLEWARES_CACHE_BUCKETS;
+    char uri[32];
+    char expected[64];
+    for (size_t i = 0; i < count; i++) {
+        snprintf(uri, sizeof(uri), "/items/%zu", i);
+        snprintf(expected, sizeof(expected), "200 item %zu #%zu", i, i + 1);
+        TEST_CHECK_STR(test_run(server, HTTP_GET, uri), expected);
+    }
+    TEST_CHECK(test_cache.used <= test_cache.budget);
+
+    // The most recent ones are hits, in the order they are chained in their buckets
+    for (size_t i = count; i-- > count - 8;) {
+        snprintf(uri, sizeof(uri), "/items/%zu", i);
+        snprintf(expected, sizeof(expected), "200 item %zu #%zu", i, i + 1);
+        TEST_CHECK_STR(test_run(server, HTTP_GET, uri), expected);
+    }
+    TEST_CHECK(test_cache.hits == 8);
+    snprintf(expected, sizeof(expected), "200 item 0 #%zu", count + 1);
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/items/0"), expected);
+
+    middlewares_cache_invalidate(&test_cache, "/items/{id}");
+    TEST_CHECK(test_cache.head == NULL && test_cache.used == 0);
+    for (size_t i = 0; i < MIDDLEWARES_CACHE_BUCKETS; i++) {
+        TEST_CHECK(test_cache.buckets[i] == NULL);
+    }
+    snprintf(uri, sizeof(uri), "/items/%zu", count - 1);
+    snprintf(expected, sizeof(expected), "200 item %zu #%zu", count - 1, count + 2);
+    TEST_CHECK_STR(test_run(server, HTTP_GET, uri), expected);
+
+    middlewares_cache_deinit(&test_cache);
+}
+
+int main(void) {
+    httpd_handle_t server = test_server_start();
+    esp_cchi_router_handle_t router = NULL;
+    TEST_CHECK_ERR(esp_cchi_router_create(&router), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_router_use(router, test_cache_mw), ESP_OK);
+    httpd_uri_t hd_uri = {
+        .uri = "/items/{id}",
+        .method = HTTP_GET,
+        .handler = test_item_handler,
+    };
+    TEST_CHECK_ERR(esp_cchi_router_handle(router, &hd_uri), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_router_attach(router, server), ESP_OK);
+
+    test_cache_responses(server);
+    test_cache_index(server);
+
+    httpd_stop(server);
+    esp_cchi_router_delete(router);
+    return test_report("test_cache");
+}
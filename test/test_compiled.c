@@ -0,0 +1,124 @@
+/**
+ * Compiled route table (test_compiled_routes.txt): the tree emitted by the generator and the
+ * requests routed through it
+*/
+#include <esp_cchi/compiled.h>
+#include <esp_cchi/router.h>
+#include <esp_http_server.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_cchi_test.h"
+#include "test_compiled_routes.h"
+
+esp_err_t test_ctx_handler(httpd_req_t *r) {
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%s %s",
+             esp_cchi_get_route_pattern(r), (const char*)esp_cchi_get_user_ctx(r));
+    return httpd_resp_sendstr(r, buf);
+}
+
+// Checks the node and its subtree, returns the number of endpoints found in it
+static size_t test_check_node(const esp_cchi_tree_node_t *node) {
+    size_t endpoints = 0;
+    if (node->endpoint != NULL) {
+        const esp_cchi_compiled_group_t *group = node->endpoint;
+        TEST_CHECK(group >= &test_compiled_routes.groups[test_compiled_routes.static_len]);
+        TEST_CHECK(group < &test_compiled_routes.groups[test_compiled_routes.groups_len]);
+        TEST_CHECK(node->pattern != NULL);
+        endpoints++;
+    }
+    for (size_t i = 0; i < node->children_len; i++) {
+        const esp_cchi_tree_node_t *child = node->children[i];
+        TEST_CHECK(child->prefix_len > 0 && child->name == NULL);
+        if (i > 0) {
+            TEST_CHECK((unsigned char)node->children[i - 1]->prefix[0] <
+                       (unsigned char)child->prefix[0]);
+        }
+        endpoints += test_check_node(child);
+    }
+    for (size_t i = 0; i < node->params_len; i++) {
+        const esp_cchi_tree_node_t *param = node->params[i];
+        TEST_CHECK(param->name != NULL && param->prefix_len == 0);
+        // Params with a regexp first, wildcards last
+        if (i > 0) {
+            const esp_cchi_tree_node_t *previous = node->params[i - 1];
+            TEST_CHECK(previous->wildcard <= param->wildcard);
+            TEST_CHECK(previous->wildcard != param->wildcard ||
+                       (previous->constraint == NULL) <= (param->constraint == NULL));
+        }
+        endpoints += test_check_node(param);
+    }
+    TEST_CHECK(node->patterns == endpoints);
+    return endpoints;
+}
+
+static void test_tree(void) {
+    const esp_cchi_compiled_table_t *table = &test_compiled_routes;
+    TEST_CHECK(table->static_len == 2);
+    TEST_CHECK(table->groups_len == 8);
+    TEST_CHECK(test_check_node(table->tree) == table->groups_len - table->static_len);
+
+    // The two regexps of /hex are the same, they share the compiled constraint
+    const esp_cchi_tree_node_t *node = table->tree;
+    const char *path = "/hex/";
+    while (node != NULL && (*path) != '\0') {
+        const esp_cchi_tree_node_t *next = NULL;
+        for (size_t i = 0; i < node->children_len; i++) {
+            if (strncmp(path, node->children[i]->prefix, node->children[i]->prefix_len) == 0) {
+                next = node->children[i];
+            }
+        }
+        path += next != NULL ? next->prefix_len : 0;
+        node = next;
+    }
+    TEST_CHECK(node != NULL && node->params_len == 1);
+    if (node != NULL && node->params_len == 1) {
+        const esp_cchi_tree_node_t *a = node->params[0];
+        TEST_CHECK(a->tail == '/' && a->children_len == 1);
+        if (a->children_len == 1 && a->children[0]->params_len == 1) {
+            const esp_cchi_tree_node_t *b = a->children[0]->params[0];
+            TEST_CHECK(b->tail == '\0' && b->constraint == a->constraint);
+        }
+    }
+}
+
+static void test_dispatch(void) {
+    httpd_handle_t server = test_server_start();
+    TEST_CHECK_ERR(esp_cchi_compiled_attach(&test_compiled_routes, server), ESP_OK);
+
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/health"), "200 /health");
+    TEST_CHECK_STR(test_run(server, HTTP_POST, "/users"), "200 /users");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/users/42"), "200 /users/{id} by id");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/users/42?x=1"), "200 /users/{id} by id");
+    TEST_CHECK_STR(test_run(server, HTTP_DELETE, "/users/42"), "200 /users/{id} id=42");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/users/bob"), "200 /users/{name} by name");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/users/42/posts/7"),
+                   "200 /users/{id}/posts/{post} id=42 post=7");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/users/42/posts/x"), "404 404 Not Found");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/hex/ff/0a"), "200 /hex/{a}/{b} a=ff b=0a");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/hex/ff/0g"), "404 404 Not Found");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/files/a/b/meta"),
+                   "200 /files/{path...}/meta path=a/b");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/static/"), "200 /static/* *=");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/static/x/y"), "200 /static/* *=x/y");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/nope"), "404 404 Not Found");
+
+    // 405 for literal routes and for routes with URI params, "/users/bob" only matches {name}
+    test_request_t req;
+    test_request_init(&req, server, HTTP_PUT, "/users");
+    TEST_CHECK_STR(test_request_run(&req), "405 405 Method Not Allowed");
+    TEST_CHECK_STR(httpd_host_exchange_resp_hdr(&req.exchange, "Allow"), "GET, POST");
+    test_request_init(&req, server, HTTP_DELETE, "/users/bob");
+    TEST_CHECK_STR(test_request_run(&req), "405 405 Method Not Allowed");
+    TEST_CHECK_STR(httpd_host_exchange_resp_hdr(&req.exchange, "Allow"), "GET");
+
+    TEST_CHECK_ERR(esp_cchi_compiled_detach(&test_compiled_routes, server), ESP_OK);
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/health"), "404 404 Not Found");
+    httpd_stop(server);
+}
+
+int main(void) {
+    test_tree();
+    test_dispatch();
+    return test_report("test_compiled");
+}
@@ -0,0 +1,134 @@
+/**
+ * Regexps of the URI params: the supported syntax, the rejected one, and matching in linear time
+ * whatever the regexp, checked against a backtracking reference on random regexps
+*/
+#include <esp_http_server.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_cchi_pattern.h"
+#include "esp_cchi_test.h"
+
+static bool test_match(const char *regexp, const char *value) {
+    struct esp_cchi_constraint constraint;
+    esp_err_t err = esp_cchi_constraint_compile(regexp, strlen(regexp), &constraint);
+    if (err != ESP_OK) {
+        test_fail(__FILE__, __LINE__, "%s is rejected: %s", regexp, esp_err_to_name(err));
+        return false;
+    }
+    return esp_cchi_constraint_match(&constraint, value, strlen(value));
+}
+
+static esp_err_t test_compile(const char *regexp) {
+    struct esp_cchi_constraint constraint;
+    return esp_cchi_constraint_compile(regexp, strlen(regexp), &constraint);
+}
+
+static void test_accepted(void) {
+    TEST_CHECK(test_match("[0-9]+", "42"));
+    TEST_CHECK(!test_match("[0-9]+", "4a"));
+    TEST_CHECK(!test_match("[0-9]+", ""));
+    TEST_CHECK(test_match("^[a-f0-9]{4}$", "beef"));
+    TEST_CHECK(!test_match("[a-f0-9]{4}", "beefy"));
+    TEST_CHECK(test_match("[a-z]+[0-9]*", "abc123"));
+    TEST_CHECK(test_match("[a-z]+[0-9]*", "abc"));
+    TEST_CHECK(!test_match("[a-z]+[0-9]*", "123"));
+    TEST_CHECK(test_match(".*\\.json", "a.b.json"));
+    TEST_CHECK(!test_match(".*\\.json", "a.json.x"));
+    TEST_CHECK(test_match("[a-f0-9]{2,4}-\\d{1,3}", "ab-1"));
+    TEST_CHECK(!test_match("[a-f0-9]{2,4}-\\d{1,3}", "abcde-1"));
+    TEST_CHECK(!test_match("[a-f0-9]{2,4}-\\d{1,3}", "ab-1234"));
+    TEST_CHECK(test_match("a?b?c", "c"));
+    TEST_CHECK(test_match("a?b?c", "ac"));
+    TEST_CHECK(test_match("a?b?c", "abc"));
+    TEST_CHECK(!test_match("a?b?c", "bac"));
+    TEST_CHECK(test_match("x{0}y", "y"));
+    TEST_CHECK(test_match("a*b*", ""));
+    TEST_CHECK(test_match("v\\d+\\.\\d+", "v1.22"));
+    TEST_CHECK(test_match("[^/]+\\w", "a-b"));
+
+    // Adjacent unbounded atoms that overlap, the value is walked once per atom
+    char value[HTTPD_MAX_URI_LEN + 1];
+    memset(value, 'a', HTTPD_MAX_URI_LEN);
+    value[HTTPD_MAX_URI_LEN] = '\0';
+    TEST_CHECK(!test_match(".*.*.*.*.*.*.*b", value));
+    TEST_CHECK(!test_match("a*a*a*a*a*a*a*b", value));
+    TEST_CHECK(!test_match("[a-z]*a*\\w*.+b", value));
+    value[HTTPD_MAX_URI_LEN - 1] = 'b';
+    TEST_CHECK(test_match(".*.*.*.*.*.*.*b", value));
+    TEST_CHECK(test_match("a*a*a*a*a*a*a*b", value));
+}
+
+static void test_rejected(void) {
+    TEST_CHECK_ERR(test_compile("a**"), ESP_ERR_INVALID_ARG);
+    TEST_CHECK_ERR(test_compile("+a"), ESP_ERR_INVALID_ARG);
+    TEST_CHECK_ERR(test_compile("[a-"), ESP_ERR_INVALID_ARG);
+    TEST_CHECK_ERR(test_compile("a{3,1}"), ESP_ERR_INVALID_ARG);
+    TEST_CHECK_ERR(test_compile("a{2"), ESP_ERR_INVALID_ARG);
+    TEST_CHECK_ERR(test_compile("a\\"), ESP_ERR_INVALID_ARG);
+    TEST_CHECK_ERR(test_compile("(a|b)+"), ESP_ERR_NOT_SUPPORTED);
+    TEST_CHECK_ERR(test_compile("a|b"), ESP_ERR_NOT_SUPPORTED);
+    TEST_CHECK_ERR(test_compile("abcdefghi"), ESP_ERR_NOT_SUPPORTED);
+    TEST_CHECK_ERR(test_compile("abcdefgh"), ESP_OK);
+}
+
+// Backtracking reference, exponential but fine for the short values below
+static bool test_reference(const struct esp_cchi_atom *atoms,
+                           size_t atoms_len,
+                           const char *value,
+                           size_t value_len)
+{
+    if (atoms_len == 0) {
+        return value_len == 0;
+    }
+    for (size_t count = 0; count <= value_len && count <= atoms->max; count++) {
+        if (count > 0) {
+            unsigned char c = (unsigned char)value[count - 1];
+            if (((atoms->set[c >> 5] >> (c & 31)) & 1) == 0) {
+                break;
+            }
+        }
+        if (count >= atoms->min &&
+            test_reference(atoms + 1, atoms_len - 1, value + count, value_len - count))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void test_random(void) {
+    static const char *atoms[] = {"a", "b", "[ab]", "."};
+    static const char *quantifiers[] = {"", "*", "+", "?", "{2}", "{1,3}", "{2,}", "{0,1}"};
+    srand(1);
+    for (size_t i = 0; i < 2000; i++) {
+        char regexp[64] = "";
+        size_t atoms_len = 1 + rand() % 5;
+        for (size_t j = 0; j < atoms_len; j++) {
+            strcat(regexp, atoms[rand() % 4]);
+            strcat(regexp, quantifiers[rand() % 8]);
+        }
+        struct esp_cchi_constraint constraint;
+        TEST_CHECK_ERR(esp_cchi_constraint_compile(regexp, strlen(regexp), &constraint), ESP_OK);
+
+        char value[16];
+        size_t value_len = rand() % 10;
+        for (size_t j = 0; j < value_len; j++) {
+            value[j] = "abc"[rand() % 3];
+        }
+        value[value_len] = '\0';
+        bool expected = test_reference(constraint.atoms, constraint.atoms_len, value, value_len);
+        if (esp_cchi_constraint_match(&constraint, value, value_len) != expected) {
+            test_fail(__FILE__, __LINE__, "%s against \"%s\" is %s", regexp, value,
+                      expected ? "a mismatch" : "a match");
+        }
+    }
+}
+
+int main(void) {
+    test_accepted();
+    test_rejected();
+    test_random();
+    return test_report("test_constraint");
+}
@@ -0,0 +1,146 @@
+/**
+ * Content-Type allow-list: parameters and case ignored, malformed and missing headers answered 400,
+ * headers longer than MIDDLEWARES_CONTENT_TYPE_MAX_LEN, the scan of the list while another task
+ * builds the hash table, and tasks racing to build it
+*/
+#include <esp_cchi/router.h>
+#include <esp_http_server.h>
+#include <middlewares.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_cchi_test.h"
+
+#define TEST_THREADS 4
+
+// "bad" is malformed, it's left out of the table
+static const char *const test_types[] = { "application/json", "bad", " Text/Plain " };
+static middlewares_media_type_slot_t test_slots[2 * 3 + 1];
+static middlewares_content_types_t test_allowed;
+
+static esp_err_t test_check_mw(httpd_req_t *r) {
+    return middlewares_check_content_type(r, &test_allowed);
+}
+
+static void test_allowed_reset(int state) {
+    memset(test_slots, 0, sizeof(test_slots));
+    test_allowed = (middlewares_content_types_t){
+        .list = test_types,
+        .list_len = 3,
+        .slots = test_slots,
+        .slots_len = sizeof(test_slots) / sizeof(test_slots[0]),
+        .state = state,
+    };
+}
+
+static const char *test_post(test_request_t *req, httpd_handle_t server, const char *type) {
+    test_request_init(req, server, HTTP_POST, "/in");
+    if (type != NULL) {
+        httpd_host_exchange_add_hdr(&req->exchange, "Content-Type", type);
+    }
+    return test_request_run(req);
+}
+
+static void test_media_types(httpd_handle_t server) {
+    static test_request_t req;
+    test_allowed_reset(0);
+
+    TEST_CHECK_STR(test_post(&req, server, "application/json"), "200 /in");
+    // Built by the first request, without the malformed entry
+    TEST_CHECK(test_allowed.state != 0);
+    size_t used = 0;
+    for (size_t i = 0; i < test_allowed.slots_len; i++) {
+        used += test_slots[i].media_type != NULL;
+    }
+    TEST_CHECK(used == 2);
+
+    TEST_CHECK_STR(test_post(&req, server, "Application/JSON; charset=utf-8"), "200 /in");
+    TEST_CHECK_STR(test_post(&req, server, "application/json ;charset=utf-8"), "200 /in");
+    TEST_CHECK_STR(test_post(&req, server, "  text/plain"), "200 /in");
+    TEST_CHECK_STR(test_post(&req, server, "TEXT/PLAIN;format=flowed"), "200 /in");
+
+    TEST_CHECK_STR(test_post(&req, server, "text/html"), "415 ");
+    TEST_CHECK_STR(test_post(&req, server, "application/jso"), "415 ");
+    TEST_CHECK_STR(test_post(&req, server, "application/jsonx"), "415 ");
+    TEST_CHECK_STR(test_post(&req, server, "bad"), "400 ");
+    TEST_CHECK_STR(test_post(&req, server, NULL), "400 ");
+    TEST_CHECK_STR(test_post(&req, server, ""), "400 ");
+    TEST_CHECK_STR(test_post(&req, server, "/json"), "400 ");
+    TEST_CHECK_STR(test_post(&req, server, "application/"), "400 ");
+    TEST_CHECK_STR(test_post(&req, server, "application/json x"), "400 ");
+    TEST_CHECK_STR(test_post(&req, server, "application json"), "400 ");
+
+    // Parameters cut by the buffer don't matter, a media type cut by it is never allowed
+    static char long_type[2 * MIDDLEWARES_CONTENT_TYPE_MAX_LEN];
+    snprintf(long_type, sizeof(long_type), "application/json; boundary=");
+    memset(long_type + strlen(long_type), 'x', MIDDLEWARES_CONTENT_TYPE_MAX_LEN);
+    TEST_CHECK_STR(test_post(&req, server, long_type), "200 /in");
+    snprintf(long_type, sizeof(long_type), "application/");
+    memset(long_type + strlen(long_type), 'x', MIDDLEWARES_CONTENT_TYPE_MAX_LEN);
+    TEST_CHECK_STR(test_post(&req, server, long_type), "415 ");
+    long_type[MIDDLEWARES_CONTENT_TYPE_MAX_LEN - 1] = '\0';
+    TEST_CHECK_STR(test_post(&req, server, long_type), "415 ");
+
+    // Another task is building the table, the list is scanned instead
+    test_allowed_reset(1);
+    TEST_CHECK_STR(test_post(&req, server, "text/plain; charset=utf-8"), "200 /in");
+    TEST_CHECK_STR(test_post(&req, server, "APPLICATION/json"), "200 /in");
+    TEST_CHECK_STR(test_post(&req, server, "text/html"), "415 ");
+    TEST_CHECK_STR(test_post(&req, server, "bad"), "400 ");
+    TEST_CHECK(test_allowed.state == 1 && test_slots[0].media_type == NULL);
+}
+
+struct test_worker {
+    pthread_t thread;
+    httpd_handle_t server;
+    size_t allowed;
+    test_request_t req;
+};
+
+static void *test_worker_run(void *arg) {
+    struct test_worker *worker = (struct test_worker*)arg;
+    for (int i = 0; i < 200; i++) {
+        const char *type = i % 2 == 0 ? "application/json" : "text/plain; charset=utf-8";
+        worker->allowed += strcmp(test_post(&worker->req, worker->server, type), "200 /in") == 0;
+    }
+    return NULL;
+}
+
+// Every task can be the first one, the others scan the list until the table is ready
+static void test_build_race(httpd_handle_t server) {
+    static struct test_worker workers[TEST_THREADS];
+    for (int round = 0; round < 20; round++) {
+        test_allowed_reset(0);
+        for (size_t i = 0; i < TEST_THREADS; i++) {
+            workers[i].server = server;
+            workers[i].allowed = 0;
+            pthread_create(&workers[i].thread, NULL, test_worker_run, &workers[i]);
+        }
+        for (size_t i = 0; i < TEST_THREADS; i++) {
+            pthread_join(workers[i].thread, NULL);
+            TEST_CHECK(workers[i].allowed == 200);
+        }
+        TEST_CHECK(test_allowed.state == 2);
+    }
+}
+
+int main(void) {
+    httpd_handle_t server = test_server_start();
+    esp_cchi_router_handle_t router = NULL;
+    TEST_CHECK_ERR(esp_cchi_router_create(&router), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_router_use(router, test_check_mw), ESP_OK);
+    httpd_uri_t hd_uri = {
+        .uri = "/in",
+        .method = HTTP_POST,
+        .handler = test_echo_handler,
+    };
+    TEST_CHECK_ERR(esp_cchi_router_handle(router, &hd_uri), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_router_attach(router, server), ESP_OK);
+
+    test_media_types(server);
+    test_build_race(server);
+
+    httpd_stop(server);
+    esp_cchi_router_delete(router);
+    return test_report("test_content_type");
+}
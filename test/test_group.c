@@ -0,0 +1,178 @@
+/**
+ * Route groups and mounted routers: routes of nested groups and of a mounted router reached with
+ * their full pattern in the router on top, groups pruned when their prefix doesn't match (a
+ * sibling prefix that starts the same, a constrained param), the middlewares of the groups run
+ * parent first, and the routers that can't be mounted
+*/
+#include <esp_cchi/middleware.h>
+#include <esp_cchi/router.h>
+#include <esp_http_server.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_cchi_test.h"
+
+// Middlewares that ran, in order, and "h" for the handler
+static char test_trace[32];
+
+#define TEST_MW(name, mark)                                                                       \
+    static esp_err_t test_mw_##name(httpd_req_t *r) {                                             \
+        strcat(test_trace, mark);                                                                 \
+        return ESP_OK;                                                                            \
+    }
+
+TEST_MW(top, "T")
+TEST_MW(api, "A")
+TEST_MW(files, "F")
+TEST_MW(deep, "D")
+
+// Stops the request when the query has "stop", or answers it when it has "cached"
+static esp_err_t test_mw_admin(httpd_req_t *r) {
+    strcat(test_trace, "N");
+    if (strstr(r->uri, "?stop") != NULL) {
+        return ESP_FAIL;
+    }
+    if (strstr(r->uri, "?cached") != NULL) {
+        httpd_resp_sendstr(r, "cached");
+        return ESP_CCHI_MW_RESPONDED;
+    }
+    return ESP_OK;
+}
+
+// "<pattern> <trace>"
+static esp_err_t test_trace_handler(httpd_req_t *r) {
+    strcat(test_trace, "h");
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%s %s", esp_cchi_get_route_pattern(r), test_trace);
+    return httpd_resp_sendstr(r, buf);
+}
+
+static test_request_t test_req;
+
+// Runs "uri" with the trace cleared, test_req.summary has the response
+static esp_err_t test_group_run(httpd_handle_t server, httpd_method_t method, const char *uri) {
+    test_trace[0] = '\0';
+    test_request_init(&test_req, server, method, uri);
+    esp_err_t err = httpd_host_exchange_run(&test_req.exchange);
+    test_request_wait(&test_req);
+    return err;
+}
+
+static esp_err_t test_add(esp_cchi_router_handle_t router,
+                          const char *uri,
+                          esp_err_t (*handler)(httpd_req_t *r))
+{
+    httpd_uri_t hd_uri = {
+        .uri = uri,
+        .method = HTTP_GET,
+        .handler = handler,
+    };
+    return esp_cchi_router_handle(router, &hd_uri);
+}
+
+static void test_groups(httpd_handle_t server) {
+    TEST_CHECK_ERR(test_group_run(server, HTTP_GET, "/health"), ESP_OK);
+    TEST_CHECK_STR(test_req.summary, "200 /health Th");
+    TEST_CHECK_ERR(test_group_run(server, HTTP_GET, "/api/v1/users"), ESP_OK);
+    TEST_CHECK_STR(test_req.summary, "200 /api/v1/users TAh");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/api/v1/users/7"), "200 /api/v1/users/{id} id=7");
+
+    // Parent first, down to the nested group
+    TEST_CHECK_ERR(test_group_run(server, HTTP_GET, "/api/v1/admin/stats"), ESP_OK);
+    TEST_CHECK_STR(test_req.summary, "200 /api/v1/admin/stats TANh");
+    TEST_CHECK_ERR(test_group_run(server, HTTP_GET, "/api/v1/admin/stats?stop"), ESP_FAIL);
+    TEST_CHECK_STR(test_trace, "TAN");
+    TEST_CHECK_ERR(test_group_run(server, HTTP_GET, "/api/v1/admin/stats?cached"), ESP_OK);
+    TEST_CHECK_STR(test_req.summary, "200 cached");
+    TEST_CHECK_STR(test_trace, "TAN");
+
+    // Starts like "/api/v1", neither its routes nor its middlewares
+    TEST_CHECK_ERR(test_group_run(server, HTTP_GET, "/api/v10/users"), ESP_OK);
+    TEST_CHECK_STR(test_req.summary, "200 /api/v10/users Th");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/api/v10/admin/stats"), "404 404 Not Found");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/api/v1"), "404 404 Not Found");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/api/v1/"), "404 404 Not Found");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/api/v2/users"), "404 404 Not Found");
+
+    // The prefix has a param, the whole group is skipped when its constraint fails
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/devices/12/"), "200 /devices/{id:[0-9]+}/ id=12");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/devices/12/state"),
+                   "200 /devices/{id:[0-9]+}/state id=12");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/devices/ab/state"), "404 404 Not Found");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/devices/12"), "404 404 Not Found");
+
+    // No middleware for the requests that are not routed
+    TEST_CHECK_ERR(test_group_run(server, HTTP_POST, "/api/v1/admin/stats"), ESP_OK);
+    TEST_CHECK_STR(test_req.summary, "405 405 Method Not Allowed");
+    TEST_CHECK_STR(test_trace, "");
+}
+
+static void test_mounted(httpd_handle_t server) {
+    // Routes and groups of the router mounted, with the middlewares of "/api/v1" before its own
+    TEST_CHECK_ERR(test_group_run(server, HTTP_GET, "/api/v1/files/list"), ESP_OK);
+    TEST_CHECK_STR(test_req.summary, "200 /api/v1/files/list TAFh");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/api/v1/files/a.txt"),
+                   "200 /api/v1/files/{name} name=a.txt");
+    TEST_CHECK_ERR(test_group_run(server, HTTP_GET, "/api/v1/files/deep/x"), ESP_OK);
+    TEST_CHECK_STR(test_req.summary, "200 /api/v1/files/deep/x TAFDh");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/list"), "404 404 Not Found");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/deep/x"), "404 404 Not Found");
+}
+
+int main(void) {
+    httpd_handle_t server = test_server_start();
+    esp_cchi_router_handle_t router = NULL;
+    TEST_CHECK_ERR(esp_cchi_router_create(&router), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_router_use(router, test_mw_top), ESP_OK);
+    TEST_CHECK_ERR(test_add(router, "/health", test_trace_handler), ESP_OK);
+
+    esp_cchi_router_handle_t api = NULL;
+    esp_cchi_router_handle_t admin = NULL;
+    esp_cchi_router_handle_t api10 = NULL;
+    esp_cchi_router_handle_t devices = NULL;
+    TEST_CHECK_ERR(esp_cchi_router_route(router, "/api/v1", &api), ESP_OK);
+    // Added before the middleware, which runs for it anyway
+    TEST_CHECK_ERR(test_add(api, "/users", test_trace_handler), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_router_use(api, test_mw_api), ESP_OK);
+    TEST_CHECK_ERR(test_add(api, "/users/{id}", test_echo_handler), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_router_route(api, "/admin", &admin), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_router_use(admin, test_mw_admin), ESP_OK);
+    TEST_CHECK_ERR(test_add(admin, "/stats", test_trace_handler), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_router_route(router, "/api/v10", &api10), ESP_OK);
+    TEST_CHECK_ERR(test_add(api10, "/users", test_trace_handler), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_router_route(router, "/devices/{id:[0-9]+}", &devices), ESP_OK);
+    TEST_CHECK_ERR(test_add(devices, "/", test_echo_handler), ESP_OK);
+    TEST_CHECK_ERR(test_add(devices, "/state", test_echo_handler), ESP_OK);
+
+    // A router built apart, with a group of its own
+    esp_cchi_router_handle_t files = NULL;
+    esp_cchi_router_handle_t deep = NULL;
+    TEST_CHECK_ERR(esp_cchi_router_create(&files), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_router_use(files, test_mw_files), ESP_OK);
+    TEST_CHECK_ERR(test_add(files, "/{name}", test_echo_handler), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_router_route(files, "/deep", &deep), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_router_use(deep, test_mw_deep), ESP_OK);
+    TEST_CHECK_ERR(test_add(deep, "/x", test_trace_handler), ESP_OK);
+
+    esp_cchi_router_handle_t invalid = NULL;
+    TEST_CHECK_ERR(esp_cchi_router_route(router, "/", &invalid), ESP_ERR_INVALID_ARG);
+    TEST_CHECK_ERR(esp_cchi_router_route(router, "/x/", &invalid), ESP_ERR_INVALID_ARG);
+    TEST_CHECK_ERR(esp_cchi_router_route(router, "/x/{id", &invalid), ESP_ERR_INVALID_ARG);
+    TEST_CHECK(invalid == NULL);
+    TEST_CHECK_ERR(esp_cchi_router_mount(api, "files", files), ESP_ERR_INVALID_ARG);
+    TEST_CHECK_ERR(esp_cchi_router_mount(api, "/files", files), ESP_OK);
+    // Mounted already, a group, or the router on top
+    TEST_CHECK_ERR(esp_cchi_router_mount(router, "/again", files), ESP_ERR_INVALID_STATE);
+    TEST_CHECK_ERR(esp_cchi_router_mount(router, "/again", devices), ESP_ERR_INVALID_STATE);
+    TEST_CHECK_ERR(esp_cchi_router_mount(api, "/again", router), ESP_ERR_INVALID_STATE);
+    TEST_CHECK_ERR(esp_cchi_router_attach(files, server), ESP_ERR_INVALID_STATE);
+    TEST_CHECK_ERR(esp_cchi_router_attach(router, server), ESP_OK);
+    // Added to the mounted router once attached, it goes to the router on top as well
+    TEST_CHECK_ERR(test_add(files, "/list", test_trace_handler), ESP_OK);
+
+    test_groups(server);
+    test_mounted(server);
+
+    httpd_stop(server);
+    esp_cchi_router_delete(router);
+    return test_report("test_group");
+}
@@ -0,0 +1,158 @@
+/**
+ * Access logger: the lines logged for the records of the ring (method, route cut at
+ * MIDDLEWARES_LOGGER_ROUTE_LEN - 1 characters, handler result and request length), the records
+ * dropped once the ring is full, counted and reported once, and the ring reused after a flush
+*/
+#include <esp_cchi/router.h>
+#include <esp_http_server.h>
+#include <middlewares.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "esp_cchi_test.h"
+
+// Kconfig default, the host build has no menuconfig
+#ifndef CONFIG_ESP_CCHI_LOGGER_RING_LEN
+#define CONFIG_ESP_CCHI_LOGGER_RING_LEN 64
+#endif
+
+#define TEST_LONG_ROUTE "/api/v1/organizations/{org}/members/{id}"
+
+// Lines logged by the last flush, with the latencies written as "N"
+static char test_log[(CONFIG_ESP_CCHI_LOGGER_RING_LEN + 2) * 128];
+
+static esp_err_t test_fail_handler(httpd_req_t *r) {
+    httpd_resp_send_err(r, HTTPD_404_NOT_FOUND, NULL);
+    return ESP_ERR_NOT_FOUND;
+}
+
+// Keeps the lines that the logger writes to stderr in test_log
+static size_t test_flush(void) {
+    FILE *file = tmpfile();
+    if (file == NULL) {
+        test_fail(__FILE__, __LINE__, "no temporary file for the log");
+        return 0;
+    }
+    fflush(stderr);
+    int saved = dup(STDERR_FILENO);
+    dup2(fileno(file), STDERR_FILENO);
+    size_t flushed = middlewares_logger_flush();
+    fflush(stderr);
+    dup2(saved, STDERR_FILENO);
+    close(saved);
+
+    static char raw[sizeof(test_log)];
+    rewind(file);
+    size_t len = fread(raw, 1, sizeof(raw) - 1, file);
+    raw[len] = '\0';
+    fclose(file);
+
+    // " 412us " -> " Nus "
+    char *out = test_log;
+    for (const char *it = raw; *it != '\0';) {
+        size_t digits = strspn(it + 1, "0123456789");
+        if (*it == ' ' && digits > 0 && strncmp(it + 1 + digits, "us ", 3) == 0) {
+            memcpy(out, " N", 2);
+            out += 2;
+            it += 1 + digits;
+        } else {
+            *out++ = *it++;
+        }
+    }
+    *out = '\0';
+    return flushed;
+}
+
+static size_t test_count_lines(const char *log, const char *line) {
+    size_t count = 0;
+    for (const char *it = strstr(log, line); it != NULL; it = strstr(it + 1, line)) {
+        count++;
+    }
+    return count;
+}
+
+static void test_logger_lines(httpd_handle_t server) {
+    TEST_CHECK(test_flush() == 0 && middlewares_logger_dropped() == 0);
+    TEST_CHECK_STR(test_log, "");
+
+    static test_request_t req;
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/items/1?q=2"), "200 /items/{id} id=1");
+    test_request_init(&req, server, HTTP_POST, "/items/2");
+    httpd_host_exchange_set_body(&req.exchange, "hello", 5);
+    TEST_CHECK_STR(test_request_run(&req), "200 /items/{id} id=2");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/api/v1/organizations/o/members/m"),
+                   "200 " TEST_LONG_ROUTE " org=o id=m");
+    TEST_CHECK_STR(test_run(server, HTTP_DELETE, "/fail"), "404 404 Not Found");
+
+    TEST_CHECK(test_flush() == 4);
+    static char expected[512];
+    snprintf(expected, sizeof(expected),
+             "I (middlewares_logger): GET /items/{id} handler=ESP_OK Nus req_len=0\n"
+             "I (middlewares_logger): POST /items/{id} handler=ESP_OK Nus req_len=5\n"
+             "I (middlewares_logger): GET %.*s... handler=ESP_OK Nus req_len=0\n"
+             "I (middlewares_logger): DELETE /fail handler=ESP_ERR_NOT_FOUND Nus req_len=0\n",
+             MIDDLEWARES_LOGGER_ROUTE_LEN - 1, TEST_LONG_ROUTE);
+    TEST_CHECK_STR(test_log, expected);
+}
+
+static void test_logger_full(httpd_handle_t server) {
+    // The records that don't fit are dropped, the first ones are kept
+    char uri[32];
+    for (size_t i = 0; i < CONFIG_ESP_CCHI_LOGGER_RING_LEN + 10; i++) {
+        snprintf(uri, sizeof(uri), "/items/%zu", i);
+        TEST_CHECK(strncmp(test_run(server, HTTP_GET, uri), "200 ", 4) == 0);
+    }
+    TEST_CHECK(middlewares_logger_dropped() == 10);
+    TEST_CHECK(test_flush() == CONFIG_ESP_CCHI_LOGGER_RING_LEN);
+    TEST_CHECK(test_count_lines(test_log, "I (middlewares_logger): GET /items/{id} handler=ESP_OK "
+                                          "Nus req_len=0\n") == CONFIG_ESP_CCHI_LOGGER_RING_LEN);
+    TEST_CHECK(test_count_lines(test_log, "\n") == CONFIG_ESP_CCHI_LOGGER_RING_LEN + 1);
+    const char *last = strstr(test_log, "W (");
+    TEST_CHECK(last != NULL);
+    TEST_CHECK_STR(last, "W (middlewares_logger): 10 records dropped\n");
+
+    // Reported once, the count is kept
+    TEST_CHECK(test_flush() == 0 && middlewares_logger_dropped() == 10);
+    TEST_CHECK_STR(test_log, "");
+
+    // The whole ring again, after its positions wrapped once
+    for (size_t i = 0; i < CONFIG_ESP_CCHI_LOGGER_RING_LEN; i++) {
+        TEST_CHECK_STR(test_run(server, HTTP_DELETE, "/fail"), "404 404 Not Found");
+    }
+    TEST_CHECK(middlewares_logger_dropped() == 10);
+    TEST_CHECK(test_flush() == CONFIG_ESP_CCHI_LOGGER_RING_LEN);
+    TEST_CHECK(test_count_lines(test_log, "I (middlewares_logger): DELETE /fail "
+                                          "handler=ESP_ERR_NOT_FOUND Nus req_len=0\n") ==
+               CONFIG_ESP_CCHI_LOGGER_RING_LEN);
+    TEST_CHECK(test_count_lines(test_log, "\n") == CONFIG_ESP_CCHI_LOGGER_RING_LEN);
+}
+
+int main(void) {
+    httpd_handle_t server = test_server_start();
+    esp_cchi_router_handle_t router = NULL;
+    TEST_CHECK_ERR(esp_cchi_router_create(&router), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_router_use(router, middlewares_logger), ESP_OK);
+    httpd_uri_t hd_uri = {
+        .uri = "/items/{id}",
+        .method = HTTP_GET,
+        .handler = test_echo_handler,
+    };
+    TEST_CHECK_ERR(esp_cchi_router_handle(router, &hd_uri), ESP_OK);
+    hd_uri.method = HTTP_POST;
+    TEST_CHECK_ERR(esp_cchi_router_handle(router, &hd_uri), ESP_OK);
+    hd_uri.uri = TEST_LONG_ROUTE;
+    hd_uri.method = HTTP_GET;
+    TEST_CHECK_ERR(esp_cchi_router_handle(router, &hd_uri), ESP_OK);
+    hd_uri.uri = "/fail";
+    hd_uri.method = HTTP_DELETE;
+    hd_uri.handler = test_fail_handler;
+    TEST_CHECK_ERR(esp_cchi_router_handle(router, &hd_uri), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_router_attach(router, server), ESP_OK);
+
+    test_logger_lines(server);
+    test_logger_full(server);
+
+    httpd_stop(server);
+    esp_cchi_router_delete(router);
+    return test_report("test_logger");
+}
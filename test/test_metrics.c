@@ -0,0 +1,132 @@
+/**
+ * Route metrics, built with CONFIG_ESP_CCHI_METRICS: the slots resolved when the routes are
+ * registered by the three ways of routing, and the whole patterns in the export
+*/
+#include <esp_cchi/compiled.h>
+#include <esp_cchi/metrics.h>
+#include <esp_cchi/router.h>
+#include <esp_http_server.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_cchi_test.h"
+#include "test_metrics_routes.h"
+
+#define TEST_LEGACY_PATTERN   "/legacy/{id}/with/a/pattern/longer/than/forty/seven/chars"
+#define TEST_ROUTER_PATTERN   "/router/{name}/with/a/pattern/longer/than/forty/seven/chars"
+#define TEST_COMPILED_PATTERN "/compiled/{id}/with/a/pattern/longer/than/forty/seven/chars"
+
+static char test_export[16384];
+
+// Responds to a request with esp_cchi_metrics_handler, the export is left in test_export
+static void test_scrape(httpd_handle_t server) {
+    httpd_host_exchange_t exchange;
+    TEST_CHECK_ERR(httpd_host_exchange_init(&exchange, server, HTTP_GET, "/metrics"), ESP_OK);
+    exchange.resp_buf = test_export;
+    exchange.resp_buf_size = sizeof(test_export) - 1;
+    TEST_CHECK_ERR(esp_cchi_metrics_handler(&exchange.req), ESP_OK);
+    test_export[exchange.resp_len < sizeof(test_export) ? exchange.resp_len : 0] = '\0';
+}
+
+#define TEST_CHECK_EXPORTED(line)                                                                 \
+    do {                                                                                          \
+        if (strstr(test_export, line "\n") == NULL) {                                             \
+            test_fail(__FILE__, __LINE__, "\"%s\" is not exported", line);                        \
+        }                                                                                         \
+    } while (0)
+
+static void test_slots(void) {
+    esp_cchi_metrics_slot_t get = esp_cchi_metrics_slot("/slots/{id}", HTTP_GET);
+    TEST_CHECK(get != NULL);
+    TEST_CHECK(esp_cchi_metrics_slot("/slots/{id}", HTTP_GET) == get);
+    TEST_CHECK(esp_cchi_metrics_slot("/slots/{id}", HTTP_POST) != get);
+    TEST_CHECK(esp_cchi_metrics_slot("/slots/{id}x", HTTP_GET) != get);
+    TEST_CHECK(esp_cchi_metrics_slot(NULL, HTTP_GET) == NULL);
+
+    esp_cchi_metrics_record_slot(get, ESP_OK, 50);
+    esp_cchi_metrics_record_slot(get, ESP_FAIL, 300);
+    TEST_CHECK_ERR(esp_cchi_metrics_record("/slots/{id}", HTTP_GET, ESP_OK, 2000000), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_metrics_record("/quo\"te\\", HTTP_GET, ESP_OK, 0), ESP_OK);
+}
+
+static void test_routes(void) {
+    // Legacy routes, the slot is resolved by esp_cchi_setup_hd_uri
+    httpd_handle_t legacy_server = test_server_start();
+    httpd_uri_t legacy_uri = {
+        .uri = TEST_LEGACY_PATTERN,
+        .method = HTTP_GET,
+        .handler = test_echo_handler,
+    };
+    TEST_CHECK_ERR(esp_cchi_setup_hd_uri(&legacy_uri), ESP_OK);
+    TEST_CHECK_ERR(httpd_register_uri_handler(legacy_server, &legacy_uri), ESP_OK);
+    TEST_CHECK_STR(test_run(legacy_server, HTTP_GET,
+                            "/legacy/1/with/a/pattern/longer/than/forty/seven/chars"),
+                   "200 " TEST_LEGACY_PATTERN " id=1");
+    TEST_CHECK_STR(test_run(legacy_server, HTTP_GET,
+                            "/legacy/2/with/a/pattern/longer/than/forty/seven/chars"),
+                   "200 " TEST_LEGACY_PATTERN " id=2");
+
+    // Router object, resolved when it's attached, and for the routes added after that
+    httpd_handle_t router_server = test_server_start();
+    esp_cchi_router_handle_t router = NULL;
+    esp_cchi_router_handle_t group = NULL;
+    TEST_CHECK_ERR(esp_cchi_router_create(&router), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_router_route(router, "/router", &group), ESP_OK);
+    httpd_uri_t router_uri = {
+        .uri = "/{name}/with/a/pattern/longer/than/forty/seven/chars",
+        .method = HTTP_GET,
+        .handler = test_echo_handler,
+    };
+    TEST_CHECK_ERR(esp_cchi_router_handle(group, &router_uri), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_router_attach(router, router_server), ESP_OK);
+    router_uri.uri = "/late";
+    TEST_CHECK_ERR(esp_cchi_router_handle(router, &router_uri), ESP_OK);
+    TEST_CHECK_STR(test_run(router_server, HTTP_GET,
+                            "/router/a/with/a/pattern/longer/than/forty/seven/chars"),
+                   "200 " TEST_ROUTER_PATTERN " name=a");
+    TEST_CHECK_STR(test_run(router_server, HTTP_GET, "/late"), "200 /late");
+    TEST_CHECK_STR(test_run(router_server, HTTP_GET, "/nowhere"), "404 404 Not Found");
+
+    // Compiled table, resolved when it's attached, the patterns have their regexps stripped
+    httpd_handle_t compiled_server = test_server_start();
+    TEST_CHECK_ERR(esp_cchi_compiled_attach(&test_metrics_routes, compiled_server), ESP_OK);
+    TEST_CHECK_STR(test_run(compiled_server, HTTP_GET,
+                            "/compiled/7/with/a/pattern/longer/than/forty/seven/chars"),
+                   "200 " TEST_COMPILED_PATTERN " id=7");
+
+    test_scrape(router_server);
+
+    httpd_stop(legacy_server);
+    esp_cchi_delete_hd_uri(&legacy_uri, true);
+    httpd_stop(router_server);
+    esp_cchi_router_delete(router);
+    httpd_stop(compiled_server);
+}
+
+int main(void) {
+    test_slots();
+    test_routes();
+
+    TEST_CHECK_EXPORTED("esp_cchi_requests_total{method=\"GET\",route=\"/slots/{id}\"} 3");
+    TEST_CHECK_EXPORTED("esp_cchi_errors_total{method=\"GET\",route=\"/slots/{id}\"} 1");
+    TEST_CHECK_EXPORTED("esp_cchi_request_duration_seconds_bucket"
+                        "{method=\"GET\",route=\"/slots/{id}\",le=\"0.0001\"} 1");
+    TEST_CHECK_EXPORTED("esp_cchi_request_duration_seconds_bucket"
+                        "{method=\"GET\",route=\"/slots/{id}\",le=\"1\"} 2");
+    TEST_CHECK_EXPORTED("esp_cchi_request_duration_seconds_sum"
+                        "{method=\"GET\",route=\"/slots/{id}\"} 2.000350");
+    TEST_CHECK_EXPORTED("esp_cchi_requests_total{method=\"POST\",route=\"/slots/{id}\"} 0");
+    TEST_CHECK_EXPORTED("esp_cchi_requests_total{method=\"GET\",route=\"/quo\\\"te\\\\\"} 1");
+
+    TEST_CHECK_EXPORTED("esp_cchi_requests_total{method=\"GET\",route=\""
+                        TEST_LEGACY_PATTERN "\"} 2");
+    TEST_CHECK_EXPORTED("esp_cchi_requests_total{method=\"GET\",route=\""
+                        TEST_ROUTER_PATTERN "\"} 1");
+    TEST_CHECK_EXPORTED("esp_cchi_request_duration_seconds_count{method=\"GET\",route=\""
+                        TEST_ROUTER_PATTERN "\"} 1");
+    TEST_CHECK_EXPORTED("esp_cchi_requests_total{method=\"GET\",route=\"/late\"} 1");
+    TEST_CHECK_EXPORTED("esp_cchi_requests_total{method=\"GET\",route=\""
+                        TEST_COMPILED_PATTERN "\"} 1");
+    TEST_CHECK_EXPORTED("esp_cchi_unmatched_requests_total 1");
+    TEST_CHECK_EXPORTED("esp_cchi_metrics_dropped_total 0");
+    return test_report("test_metrics");
+}
@@ -0,0 +1,209 @@
+/**
+ * Middleware chains: static chains of 1 and of 16 middlewares, middleware groups whose arrays
+ * double their capacity from 4, a chain stopped by an error or by ESP_CCHI_MW_RESPONDED (ESP_OK
+ * for esp_http_server), and after hooks called in reverse order with what the chain returns
+*/
+#include <esp_cchi/middleware.h>
+#include <esp_cchi/router.h>
+#include <esp_http_server.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_cchi_test.h"
+
+// Middlewares and handlers that ran, in order, and the after hooks with what they saw
+static char test_trace[64];
+static char test_after[128];
+
+#define TEST_MW(n)                                                                                \
+    static esp_err_t test_mw_##n(httpd_req_t *r) {                                                \
+        strcat(test_trace, #n);                                                                   \
+        return ESP_OK;                                                                            \
+    }
+
+TEST_MW(0) TEST_MW(1) TEST_MW(2) TEST_MW(3) TEST_MW(4) TEST_MW(5) TEST_MW(6) TEST_MW(7)
+TEST_MW(8) TEST_MW(9) TEST_MW(a) TEST_MW(b) TEST_MW(c) TEST_MW(d) TEST_MW(e) TEST_MW(f)
+
+static esp_err_t test_mw_stop(httpd_req_t *r) {
+    strcat(test_trace, "!");
+    return ESP_FAIL;
+}
+
+// Like a cache hit, the response is sent by the middleware
+static esp_err_t test_mw_responded(httpd_req_t *r) {
+    strcat(test_trace, "R");
+    httpd_resp_sendstr(r, "cached");
+    return ESP_CCHI_MW_RESPONDED;
+}
+
+static esp_err_t test_final_handler(httpd_req_t *r) {
+    strcat(test_trace, "h");
+    return httpd_resp_sendstr(r, test_trace);
+}
+
+// Final handler that fails without sending anything
+static esp_err_t test_fail_handler(httpd_req_t *r) {
+    strcat(test_trace, "h");
+    return ESP_ERR_NOT_FOUND;
+}
+
+static void test_after_add(const char *hook, esp_err_t err) {
+    size_t len = strlen(test_after);
+    snprintf(test_after + len, sizeof(test_after) - len, "%s%s:%s", len > 0 ? " " : "", hook,
+             err == ESP_CCHI_MW_RESPONDED ? "RESPONDED" : esp_err_to_name(err));
+}
+
+static void test_after_1(httpd_req_t *r, esp_err_t err) {
+    test_after_add("1", err);
+}
+
+static void test_after_2(httpd_req_t *r, esp_err_t err) {
+    test_after_add("2", err);
+}
+
+static esp_cchi_mw_build_static(test_static_one, test_final_handler, test_mw_0)
+static esp_cchi_mw_build_static(test_static_full, test_final_handler,
+                                test_mw_0, test_mw_1, test_mw_2, test_mw_3,
+                                test_mw_4, test_mw_5, test_mw_6, test_mw_7,
+                                test_mw_8, test_mw_9, test_mw_a, test_mw_b,
+                                test_mw_c, test_mw_d, test_mw_e, test_mw_f)
+static esp_cchi_mw_build_static(test_static_stop, test_final_handler,
+                                test_mw_0, test_mw_stop, test_mw_1)
+static esp_cchi_mw_build_static(test_static_responded, test_final_handler,
+                                test_mw_0, test_mw_responded, test_mw_1)
+
+static esp_cchi_mw_group_t test_group;
+
+static esp_cchi_mw_build(test_group_chain, &test_group, test_final_handler)
+static esp_cchi_mw_build(test_group_fail, &test_group, test_fail_handler)
+
+static test_request_t test_req;
+
+// Runs "uri" with the traces cleared, test_req.summary has the response
+static esp_err_t test_chain_run(httpd_handle_t server, const char *uri) {
+    test_trace[0] = '\0';
+    test_after[0] = '\0';
+    test_request_init(&test_req, server, HTTP_GET, uri);
+    esp_err_t err = httpd_host_exchange_run(&test_req.exchange);
+    test_request_wait(&test_req);
+    return err;
+}
+
+static void test_static_chains(httpd_handle_t server) {
+    TEST_CHECK_ERR(test_chain_run(server, "/static/one"), ESP_OK);
+    TEST_CHECK_STR(test_req.summary, "200 0h");
+    TEST_CHECK_ERR(test_chain_run(server, "/static/full"), ESP_OK);
+    TEST_CHECK_STR(test_req.summary, "200 0123456789abcdefh");
+
+    TEST_CHECK_ERR(test_chain_run(server, "/static/stop"), ESP_FAIL);
+    TEST_CHECK_STR(test_trace, "0!");
+    TEST_CHECK_ERR(test_chain_run(server, "/static/responded"), ESP_OK);
+    TEST_CHECK_STR(test_trace, "0R");
+    TEST_CHECK_STR(test_req.summary, "200 cached");
+}
+
+static void test_group_capacity(void) {
+    TEST_CHECK_ERR(esp_cchi_mw_create_group(NULL), ESP_ERR_INVALID_ARG);
+    TEST_CHECK_ERR(esp_cchi_mw_create_group(&test_group), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_mw_use(NULL, test_mw_0), ESP_ERR_INVALID_ARG);
+    TEST_CHECK_ERR(esp_cchi_mw_use(&test_group, NULL), ESP_ERR_INVALID_ARG);
+    TEST_CHECK_ERR(esp_cchi_mw_use_after(NULL, test_after_1), ESP_ERR_INVALID_ARG);
+    TEST_CHECK_ERR(esp_cchi_mw_use_after(&test_group, NULL), ESP_ERR_INVALID_ARG);
+    TEST_CHECK(test_group.__mw_array == NULL && test_group.__mw_array_cap == 0);
+
+    esp_err_t (*const mws[])(httpd_req_t *) = {
+        test_mw_0, test_mw_1, test_mw_2, test_mw_3, test_mw_4, test_mw_5, test_mw_6, test_mw_7,
+        test_mw_8,
+    };
+    // Capacity after adding the i-th middleware
+    static const size_t caps[] = { 4, 4, 4, 4, 8, 8, 8, 8, 16 };
+    for (size_t i = 0; i < sizeof(mws) / sizeof(mws[0]); i++) {
+        TEST_CHECK_ERR(esp_cchi_mw_use(&test_group, mws[i]), ESP_OK);
+        TEST_CHECK(test_group.__mw_array_len == i + 1 && test_group.__mw_array_cap == caps[i]);
+    }
+    for (size_t i = 0; i < 5; i++) {
+        TEST_CHECK_ERR(esp_cchi_mw_use_after(&test_group, i % 2 == 0 ? test_after_1 : test_after_2),
+                       ESP_OK);
+        TEST_CHECK(test_group.__after_array_len == i + 1 &&
+                   test_group.__after_array_cap == caps[i]);
+    }
+
+    TEST_CHECK_ERR(esp_cchi_mw_delete_group(NULL), ESP_ERR_INVALID_ARG);
+    TEST_CHECK_ERR(esp_cchi_mw_delete_group(&test_group), ESP_OK);
+    TEST_CHECK(test_group.__mw_array == NULL && test_group.__mw_array_len == 0 &&
+               test_group.__after_array == NULL && test_group.__after_array_cap == 0);
+}
+
+static void test_group_chains(httpd_handle_t server) {
+    TEST_CHECK_ERR(esp_cchi_mw_create_group(&test_group), ESP_OK);
+    TEST_CHECK_ERR(test_chain_run(server, "/group"), ESP_OK);
+    TEST_CHECK_STR(test_req.summary, "200 h");
+
+    esp_err_t (*const mws[])(httpd_req_t *) = {
+        test_mw_0, test_mw_1, test_mw_2, test_mw_3, test_mw_4, test_mw_5,
+    };
+    for (size_t i = 0; i < sizeof(mws) / sizeof(mws[0]); i++) {
+        TEST_CHECK_ERR(esp_cchi_mw_use(&test_group, mws[i]), ESP_OK);
+    }
+    TEST_CHECK_ERR(esp_cchi_mw_use_after(&test_group, test_after_1), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_mw_use_after(&test_group, test_after_2), ESP_OK);
+
+    // The hooks run in reverse order, with the result of the final handler
+    TEST_CHECK_ERR(test_chain_run(server, "/group"), ESP_OK);
+    TEST_CHECK_STR(test_req.summary, "200 012345h");
+    TEST_CHECK_STR(test_after, "2:ESP_OK 1:ESP_OK");
+    TEST_CHECK_ERR(test_chain_run(server, "/group/fail"), ESP_ERR_NOT_FOUND);
+    TEST_CHECK_STR(test_trace, "012345h");
+    TEST_CHECK_STR(test_after, "2:ESP_ERR_NOT_FOUND 1:ESP_ERR_NOT_FOUND");
+    esp_cchi_mw_delete_group(&test_group);
+
+    // Stopped by a middleware, the hooks see its error, ESP_CCHI_MW_RESPONDED becomes ESP_OK
+    TEST_CHECK_ERR(esp_cchi_mw_create_group(&test_group), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_mw_use(&test_group, test_mw_0), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_mw_use(&test_group, test_mw_responded), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_mw_use(&test_group, test_mw_1), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_mw_use_after(&test_group, test_after_1), ESP_OK);
+    TEST_CHECK_ERR(test_chain_run(server, "/group"), ESP_OK);
+    TEST_CHECK_STR(test_req.summary, "200 cached");
+    TEST_CHECK_STR(test_trace, "0R");
+    TEST_CHECK_STR(test_after, "1:RESPONDED");
+
+    test_group.__mw_array[1] = test_mw_stop;
+    TEST_CHECK_ERR(test_chain_run(server, "/group"), ESP_FAIL);
+    TEST_CHECK_STR(test_trace, "0!");
+    TEST_CHECK_STR(test_after, "1:ESP_FAIL");
+    esp_cchi_mw_delete_group(&test_group);
+}
+
+int main(void) {
+    httpd_handle_t server = test_server_start();
+    esp_cchi_router_handle_t router = NULL;
+    TEST_CHECK_ERR(esp_cchi_router_create(&router), ESP_OK);
+    static const struct {
+        const char *uri;
+        esp_err_t (*handler)(httpd_req_t *r);
+    } routes[] = {
+        { "/static/one", test_static_one },
+        { "/static/full", test_static_full },
+        { "/static/stop", test_static_stop },
+        { "/static/responded", test_static_responded },
+        { "/group", test_group_chain },
+        { "/group/fail", test_group_fail },
+    };
+    for (size_t i = 0; i < sizeof(routes) / sizeof(routes[0]); i++) {
+        httpd_uri_t hd_uri = {
+            .uri = routes[i].uri,
+            .method = HTTP_GET,
+            .handler = routes[i].handler,
+        };
+        TEST_CHECK_ERR(esp_cchi_router_handle(router, &hd_uri), ESP_OK);
+    }
+    TEST_CHECK_ERR(esp_cchi_router_attach(router, server), ESP_OK);
+
+    test_static_chains(server);
+    test_group_capacity();
+    test_group_chains(server);
+
+    httpd_stop(server);
+    esp_cchi_router_delete(router);
+    return test_report("test_mw");
+}
@@ -0,0 +1,246 @@
+/**
+ * Typed URI params: the bounds of every type, the malformed values and the ones that overflow, then
+ * the same parsers reached through the URI param and query string getters
+*/
+#include <esp_cchi/router.h>
+#include <esp_http_server.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_cchi_test.h"
+
+static esp_cchi_view_t test_view(const char *str) {
+    return (esp_cchi_view_t){ str, strlen(str) };
+}
+
+static void test_u32(void) {
+    uint32_t value = 7;
+    TEST_CHECK_ERR(esp_cchi_view_to_u32(test_view("0"), &value), ESP_OK);
+    TEST_CHECK(value == 0);
+    TEST_CHECK_ERR(esp_cchi_view_to_u32(test_view("007"), &value), ESP_OK);
+    TEST_CHECK(value == 7);
+    TEST_CHECK_ERR(esp_cchi_view_to_u32(test_view("4294967295"), &value), ESP_OK);
+    TEST_CHECK(value == UINT32_MAX);
+
+    // "value" is only written on success
+    value = 7;
+    TEST_CHECK_ERR(esp_cchi_view_to_u32(test_view("4294967296"), &value), ESP_ERR_INVALID_SIZE);
+    TEST_CHECK_ERR(esp_cchi_view_to_u32(test_view("99999999999999999999999"), &value),
+                   ESP_ERR_INVALID_SIZE);
+    // Malformed takes precedence over the overflow
+    TEST_CHECK_ERR(esp_cchi_view_to_u32(test_view("99999999999x"), &value), ESP_FAIL);
+    TEST_CHECK_ERR(esp_cchi_view_to_u32(test_view(""), &value), ESP_FAIL);
+    TEST_CHECK_ERR(esp_cchi_view_to_u32(test_view("-1"), &value), ESP_FAIL);
+    TEST_CHECK_ERR(esp_cchi_view_to_u32(test_view("+1"), &value), ESP_FAIL);
+    TEST_CHECK_ERR(esp_cchi_view_to_u32(test_view(" 1"), &value), ESP_FAIL);
+    TEST_CHECK_ERR(esp_cchi_view_to_u32(test_view("1 "), &value), ESP_FAIL);
+    TEST_CHECK(value == 7);
+
+    // The view ends before the NUL
+    TEST_CHECK_ERR(esp_cchi_view_to_u32((esp_cchi_view_t){ "12x", 2 }, &value), ESP_OK);
+    TEST_CHECK(value == 12);
+    TEST_CHECK_ERR(esp_cchi_view_to_u32((esp_cchi_view_t){ NULL, 0 }, &value),
+                   ESP_ERR_INVALID_ARG);
+    TEST_CHECK_ERR(esp_cchi_view_to_u32(test_view("1"), NULL), ESP_ERR_INVALID_ARG);
+}
+
+static void test_i64(void) {
+    int64_t value = 7;
+    TEST_CHECK_ERR(esp_cchi_view_to_i64(test_view("9223372036854775807"), &value), ESP_OK);
+    TEST_CHECK(value == INT64_MAX);
+    TEST_CHECK_ERR(esp_cchi_view_to_i64(test_view("-9223372036854775808"), &value), ESP_OK);
+    TEST_CHECK(value == INT64_MIN);
+    TEST_CHECK_ERR(esp_cchi_view_to_i64(test_view("+42"), &value), ESP_OK);
+    TEST_CHECK(value == 42);
+    TEST_CHECK_ERR(esp_cchi_view_to_i64(test_view("-0"), &value), ESP_OK);
+    TEST_CHECK(value == 0);
+    TEST_CHECK_ERR(esp_cchi_view_to_i64(test_view("-1"), &value), ESP_OK);
+    TEST_CHECK(value == -1);
+
+    value = 7;
+    TEST_CHECK_ERR(esp_cchi_view_to_i64(test_view("9223372036854775808"), &value),
+                   ESP_ERR_INVALID_SIZE);
+    TEST_CHECK_ERR(esp_cchi_view_to_i64(test_view("-9223372036854775809"), &value),
+                   ESP_ERR_INVALID_SIZE);
+    TEST_CHECK_ERR(esp_cchi_view_to_i64(test_view("-"), &value), ESP_FAIL);
+    TEST_CHECK_ERR(esp_cchi_view_to_i64(test_view("+"), &value), ESP_FAIL);
+    TEST_CHECK_ERR(esp_cchi_view_to_i64(test_view("--1"), &value), ESP_FAIL);
+    TEST_CHECK_ERR(esp_cchi_view_to_i64(test_view("+-1"), &value), ESP_FAIL);
+    TEST_CHECK_ERR(esp_cchi_view_to_i64(test_view("1-"), &value), ESP_FAIL);
+    TEST_CHECK(value == 7);
+}
+
+static void test_hex(void) {
+    uint64_t value = 7;
+    TEST_CHECK_ERR(esp_cchi_view_to_hex(test_view("ffffffffffffffff"), &value), ESP_OK);
+    TEST_CHECK(value == UINT64_MAX);
+    TEST_CHECK_ERR(esp_cchi_view_to_hex(test_view("DeadBeef"), &value), ESP_OK);
+    TEST_CHECK(value == 0xdeadbeef);
+    // Leading zeros don't count towards the 16 digits
+    TEST_CHECK_ERR(esp_cchi_view_to_hex(test_view("00000000000000000001"), &value), ESP_OK);
+    TEST_CHECK(value == 1);
+
+    value = 7;
+    TEST_CHECK_ERR(esp_cchi_view_to_hex(test_view("10000000000000000"), &value),
+                   ESP_ERR_INVALID_SIZE);
+    TEST_CHECK_ERR(esp_cchi_view_to_hex(test_view("0x1"), &value), ESP_FAIL);
+    TEST_CHECK_ERR(esp_cchi_view_to_hex(test_view("g"), &value), ESP_FAIL);
+    TEST_CHECK_ERR(esp_cchi_view_to_hex(test_view(""), &value), ESP_FAIL);
+    TEST_CHECK(value == 7);
+}
+
+static void test_bool(void) {
+    static const char *const trues[] = { "1", "true", "TRUE", "tRuE" };
+    static const char *const falses[] = { "0", "false", "False" };
+    static const char *const malformed[] = { "", "yes", "tru", "truex", "10", "01", "2" };
+    bool value;
+    for (size_t i = 0; i < sizeof(trues) / sizeof(trues[0]); i++) {
+        value = false;
+        TEST_CHECK_ERR(esp_cchi_view_to_bool(test_view(trues[i]), &value), ESP_OK);
+        TEST_CHECK(value);
+    }
+    for (size_t i = 0; i < sizeof(falses) / sizeof(falses[0]); i++) {
+        value = true;
+        TEST_CHECK_ERR(esp_cchi_view_to_bool(test_view(falses[i]), &value), ESP_OK);
+        TEST_CHECK(!value);
+    }
+    for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++) {
+        TEST_CHECK_ERR(esp_cchi_view_to_bool(test_view(malformed[i]), &value), ESP_FAIL);
+    }
+}
+
+static const esp_cchi_enum_entry_t test_modes[] = {
+    { "off", 0 },
+    { NULL, 5 },
+    { "on", 1 },
+    { "auto", 2 },
+};
+
+static void test_enum(void) {
+    int value = 7;
+    TEST_CHECK_ERR(esp_cchi_view_to_enum(test_view("auto"), test_modes, 4, &value), ESP_OK);
+    TEST_CHECK(value == 2);
+    TEST_CHECK_ERR(esp_cchi_view_to_enum(test_view("off"), test_modes, 4, &value), ESP_OK);
+    TEST_CHECK(value == 0);
+
+    value = 7;
+    TEST_CHECK_ERR(esp_cchi_view_to_enum(test_view("ON"), test_modes, 4, &value), ESP_FAIL);
+    TEST_CHECK_ERR(esp_cchi_view_to_enum(test_view("o"), test_modes, 4, &value), ESP_FAIL);
+    TEST_CHECK_ERR(esp_cchi_view_to_enum(test_view("offf"), test_modes, 4, &value), ESP_FAIL);
+    TEST_CHECK_ERR(esp_cchi_view_to_enum(test_view(""), test_modes, 4, &value), ESP_FAIL);
+    // Only the first entries are looked at
+    TEST_CHECK_ERR(esp_cchi_view_to_enum(test_view("auto"), test_modes, 3, &value), ESP_FAIL);
+    TEST_CHECK_ERR(esp_cchi_view_to_enum(test_view("on"), NULL, 0, &value), ESP_FAIL);
+    TEST_CHECK_ERR(esp_cchi_view_to_enum(test_view("on"), NULL, 1, &value), ESP_ERR_INVALID_ARG);
+    TEST_CHECK(value == 7);
+}
+
+static void test_add(char *buf, size_t size, const char *name, esp_err_t err, const char *value) {
+    size_t len = strlen(buf);
+    snprintf(buf + len, size - len, "%s%s=%s%s%s", len > 0 ? " " : "", name,
+             esp_err_to_name(err), err == ESP_OK ? ":" : "", err == ESP_OK ? value : "");
+}
+
+// Every typed getter over the URI param "v" (or "nope"), and over the query param "q"
+static esp_err_t test_typed_handler(httpd_req_t *r) {
+    char buf[512] = "";
+    char value[32];
+    const char *names[] = { "v", "nope" };
+    for (size_t i = 0; i < 2; i++) {
+        uint32_t u32 = 0;
+        int64_t i64 = 0;
+        uint64_t hex = 0;
+        bool flag = false;
+        int mode = 0;
+        esp_err_t err = esp_cchi_get_uri_param_u32(r, names[i], &u32);
+        snprintf(value, sizeof(value), "%" PRIu32, u32);
+        test_add(buf, sizeof(buf), "u32", err, value);
+        err = esp_cchi_get_uri_param_i64(r, names[i], &i64);
+        snprintf(value, sizeof(value), "%" PRId64, i64);
+        test_add(buf, sizeof(buf), "i64", err, value);
+        err = esp_cchi_get_uri_param_hex(r, names[i], &hex);
+        snprintf(value, sizeof(value), "%" PRIx64, hex);
+        test_add(buf, sizeof(buf), "hex", err, value);
+        err = esp_cchi_get_uri_param_bool(r, names[i], &flag);
+        test_add(buf, sizeof(buf), "bool", err, flag ? "true" : "false");
+        err = esp_cchi_get_uri_param_enum(r, names[i], test_modes, 4, &mode);
+        snprintf(value, sizeof(value), "%d", mode);
+        test_add(buf, sizeof(buf), "enum", err, value);
+    }
+
+    uint32_t u32 = 0;
+    int64_t i64 = 0;
+    uint64_t hex = 0;
+    bool flag = false;
+    int mode = 0;
+    esp_err_t err = esp_cchi_get_query_param_u32(r, "q", &u32);
+    snprintf(value, sizeof(value), "%" PRIu32, u32);
+    test_add(buf, sizeof(buf), "q.u32", err, value);
+    err = esp_cchi_get_query_param_i64(r, "q", &i64);
+    snprintf(value, sizeof(value), "%" PRId64, i64);
+    test_add(buf, sizeof(buf), "q.i64", err, value);
+    err = esp_cchi_get_query_param_hex(r, "q", &hex);
+    snprintf(value, sizeof(value), "%" PRIx64, hex);
+    test_add(buf, sizeof(buf), "q.hex", err, value);
+    err = esp_cchi_get_query_param_bool(r, "q", &flag);
+    test_add(buf, sizeof(buf), "q.bool", err, flag ? "true" : "false");
+    err = esp_cchi_get_query_param_enum(r, "q", test_modes, 4, &mode);
+    snprintf(value, sizeof(value), "%d", mode);
+    test_add(buf, sizeof(buf), "q.enum", err, value);
+    return httpd_resp_sendstr(r, buf);
+}
+
+static void test_getters(void) {
+    httpd_handle_t server = test_server_start();
+    esp_cchi_router_handle_t router = NULL;
+    TEST_CHECK_ERR(esp_cchi_router_create(&router), ESP_OK);
+    httpd_uri_t hd_uri = {
+        .uri = "/typed/{v}",
+        .method = HTTP_GET,
+        .handler = test_typed_handler,
+    };
+    TEST_CHECK_ERR(esp_cchi_router_handle(router, &hd_uri), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_router_attach(router, server), ESP_OK);
+
+    static const char *const nope = "u32=ESP_ERR_NOT_FOUND i64=ESP_ERR_NOT_FOUND "
+                                    "hex=ESP_ERR_NOT_FOUND bool=ESP_ERR_NOT_FOUND "
+                                    "enum=ESP_ERR_NOT_FOUND";
+    char expected[512];
+    snprintf(expected, sizeof(expected),
+             "200 u32=ESP_OK:1 i64=ESP_OK:1 hex=ESP_OK:1 bool=ESP_OK:true enum=ESP_FAIL %s "
+             "q.u32=ESP_FAIL q.i64=ESP_OK:-5000000000 q.hex=ESP_FAIL "
+             "q.bool=ESP_FAIL q.enum=ESP_FAIL", nope);
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/typed/1?q=-5000000000"), expected);
+
+    snprintf(expected, sizeof(expected),
+             "200 u32=ESP_FAIL i64=ESP_FAIL hex=ESP_FAIL bool=ESP_FAIL enum=ESP_OK:2 %s "
+             "q.u32=ESP_ERR_INVALID_SIZE q.i64=ESP_OK:4294967296 q.hex=ESP_OK:4294967296 "
+             "q.bool=ESP_FAIL q.enum=ESP_FAIL", nope);
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/typed/auto?q=4294967296"), expected);
+
+    snprintf(expected, sizeof(expected),
+             "200 u32=ESP_OK:0 i64=ESP_OK:0 hex=ESP_OK:0 bool=ESP_OK:false enum=ESP_FAIL %s "
+             "q.u32=ESP_ERR_NOT_FOUND q.i64=ESP_ERR_NOT_FOUND q.hex=ESP_ERR_NOT_FOUND "
+             "q.bool=ESP_ERR_NOT_FOUND q.enum=ESP_ERR_NOT_FOUND", nope);
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/typed/0"), expected);
+
+    // Decoded before parsing, "%46" is 'F'
+    snprintf(expected, sizeof(expected),
+             "200 u32=ESP_FAIL i64=ESP_FAIL hex=ESP_FAIL bool=ESP_FAIL enum=ESP_OK:0 %s "
+             "q.u32=ESP_FAIL q.i64=ESP_FAIL q.hex=ESP_OK:ff q.bool=ESP_FAIL q.enum=ESP_FAIL",
+             nope);
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/typed/off?q=%46f"), expected);
+
+    httpd_stop(server);
+    esp_cchi_router_delete(router);
+}
+
+int main(void) {
+    test_u32();
+    test_i64();
+    test_hex();
+    test_bool();
+    test_enum();
+    test_getters();
+    return test_report("test_parse");
+}
@@ -0,0 +1,222 @@
+/**
+ * The same route set goes through the three matchers (routes set up with esp_cchi_setup_hd_uri,
+ * the Router object and a compiled route table), they must pick the same route for every URI and
+ * capture the same values. The routes are registered from the least to the most specific.
+ * The routes set up with esp_cchi_setup_hd_uri are also checked on their own: a "/" "*" route and
+ * what happens to their .handler
+*/
+#include <esp_cchi/compiled.h>
+#include <esp_cchi/router.h>
+#include <esp_http_server.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_cchi_test.h"
+#include "test_precedence_routes.h"
+
+// Same order as test_precedence_routes.txt
+static const char *test_patterns[] = {
+    "/x/{id}",
+    "/x/{id}.json",
+    "/f/{name}.{ext}",
+    "/f/{name}.tar.gz",
+    "/w/{rest...}/{y}",
+    "/w/{rest...}/a/{x}",
+    "/t/{b}/{c}",
+    "/t/{a}/x",
+    "/u/{name}",
+    "/u/{id:[0-9]+}",
+    "/u/me",
+    "/d/{a}-{b}",
+    "/d/{a}.{b}",
+    "/s/*",
+};
+
+#define TEST_PATTERNS_LEN (sizeof(test_patterns) / sizeof(test_patterns[0]))
+
+static const struct {
+    const char *uri;
+    const char *expected;
+} test_cases[] = {
+    // Same param, what follows it decides
+    {"/x/a", "200 /x/{id} id=a"},
+    {"/x/a.json", "200 /x/{id}.json id=a"},
+    {"/x/a.b.json", "200 /x/{id}.json id=a.b"},
+    {"/x/a.xml", "200 /x/{id} id=a.xml"},
+    // A shorter value that reaches a more specific pattern beats the longest value
+    {"/f/a.tar.gz", "200 /f/{name}.tar.gz name=a"},
+    {"/f/a.b.tar.gz", "200 /f/{name}.tar.gz name=a.b"},
+    {"/f/a.zip", "200 /f/{name}.{ext} name=a ext=zip"},
+    {"/w/1/a/2", "200 /w/{rest...}/a/{x} rest=1 x=2"},
+    {"/w/1/2/a/3", "200 /w/{rest...}/a/{x} rest=1/2 x=3"},
+    {"/w/1/b/2", "200 /w/{rest...}/{y} rest=1/b y=2"},
+    // Params as specific with different names, the rest of the pattern decides
+    {"/t/1/x", "200 /t/{a}/x a=1"},
+    {"/t/1/y", "200 /t/{b}/{c} b=1 c=y"},
+    {"/u/me", "200 /u/me"},
+    {"/u/42", "200 /u/{id:[0-9]+} id=42"},
+    {"/u/bob", "200 /u/{name} name=bob"},
+    // '-' sorts before '.'
+    {"/d/1-2.3", "200 /d/{a}-{b} a=1 b=2.3"},
+    {"/d/1.2-3", "200 /d/{a}-{b} a=1.2 b=3"},
+    {"/d/1.2", "200 /d/{a}.{b} a=1 b=2"},
+    {"/s/", "200 /s/* *="},
+    {"/s/a/b", "200 /s/* *=a/b"},
+    {"/x/a/b", "404 404 Not Found"},
+    {"/nope", "404 404 Not Found"},
+};
+
+// Compiled tables report their patterns without the regexps ("{id}" for "{id:[0-9]+}")
+static void test_strip_regexps(const char *text, char *stripped, size_t size) {
+    size_t len = 0;
+    bool in_regexp = false;
+    for (; (*text) != '\0' && len + 1 < size; text++) {
+        if (in_regexp && (*text) != '}') {
+            continue;
+        }
+        in_regexp = (*text) == ':';
+        if (!in_regexp) {
+            stripped[len++] = *text;
+        }
+    }
+    stripped[len] = '\0';
+}
+
+static void test_check_cases(httpd_handle_t server, const char *matcher, bool stripped) {
+    for (size_t i = 0; i < sizeof(test_cases) / sizeof(test_cases[0]); i++) {
+        char expected[128];
+        if (stripped) {
+            test_strip_regexps(test_cases[i].expected, expected, sizeof(expected));
+        } else {
+            snprintf(expected, sizeof(expected), "%s", test_cases[i].expected);
+        }
+        const char *actual = test_run(server, HTTP_GET, test_cases[i].uri);
+        if (strcmp(actual, expected) != 0) {
+            test_fail(__FILE__, __LINE__, "%s: %s is \"%s\", expected \"%s\"",
+                      matcher, test_cases[i].uri, actual, expected);
+        }
+    }
+}
+
+static void test_legacy(void) {
+    httpd_handle_t server = test_server_start();
+    httpd_uri_t hd_uris[TEST_PATTERNS_LEN];
+    for (size_t i = 0; i < TEST_PATTERNS_LEN; i++) {
+        hd_uris[i] = (httpd_uri_t){
+            .uri = test_patterns[i],
+            .method = HTTP_GET,
+            .handler = test_echo_handler,
+        };
+    }
+    TEST_CHECK_ERR(esp_cchi_setup_hd_uris(hd_uris, TEST_PATTERNS_LEN), ESP_OK);
+    for (size_t i = 0; i < TEST_PATTERNS_LEN; i++) {
+        TEST_CHECK_ERR(httpd_register_uri_handler(server, &hd_uris[i]), ESP_OK);
+    }
+
+    test_check_cases(server, "legacy", false);
+
+    httpd_stop(server);
+    for (size_t i = 0; i < TEST_PATTERNS_LEN; i++) {
+        TEST_CHECK_ERR(esp_cchi_delete_hd_uri(&hd_uris[i], true), ESP_OK);
+    }
+}
+
+// A route set up as "/*" is a wildcard like any other, it isn't taken for the router catch-all
+static void test_legacy_catch_all(void) {
+    httpd_handle_t server = test_server_start();
+    httpd_uri_t hd_uris[] = {
+        {.uri = "/*", .method = HTTP_GET, .handler = test_echo_handler},
+        {.uri = "/u/{name}", .method = HTTP_GET, .handler = test_echo_handler},
+    };
+    const size_t hd_uris_len = sizeof(hd_uris) / sizeof(hd_uris[0]);
+    TEST_CHECK_ERR(esp_cchi_setup_hd_uris(hd_uris, hd_uris_len), ESP_OK);
+    for (size_t i = 0; i < hd_uris_len; i++) {
+        TEST_CHECK_ERR(httpd_register_uri_handler(server, &hd_uris[i]), ESP_OK);
+    }
+
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/"), "200 /* *=");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/a/b"), "200 /* *=a/b");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/u/bob"), "200 /u/{name} name=bob");
+
+    // Routes of an attached router are only reached when no route set up matches
+    esp_cchi_router_handle_t router = NULL;
+    TEST_CHECK_ERR(esp_cchi_router_create(&router), ESP_OK);
+    httpd_uri_t hd_uri = {.uri = "/r/{id}", .method = HTTP_GET, .handler = test_echo_handler};
+    TEST_CHECK_ERR(esp_cchi_router_handle(router, &hd_uri), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_router_attach(router, server), ESP_OK);
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/r/1"), "200 /* *=r/1");
+    TEST_CHECK_ERR(httpd_unregister_uri_handler(server, "/*", HTTP_GET), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_delete_hd_uri(&hd_uris[0], true), ESP_OK);
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/r/1"), "200 /r/{id} id=1");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/u/bob"), "200 /u/{name} name=bob");
+
+    httpd_stop(server);
+    esp_cchi_router_delete(router);
+    TEST_CHECK_ERR(esp_cchi_delete_hd_uri(&hd_uris[1], true), ESP_OK);
+}
+
+// .handler is wrapped if it's set and put back when deleted, or left for the caller to set
+static void test_legacy_handler(void) {
+    httpd_handle_t server = test_server_start();
+    int user_ctx;
+    httpd_uri_t hd_uris[] = {
+        {.uri = "/h/{id}", .method = HTTP_GET, .handler = test_echo_handler},
+        {.uri = "/n/{id}", .method = HTTP_GET, .user_ctx = &user_ctx},
+    };
+    TEST_CHECK_ERR(esp_cchi_setup_hd_uris(hd_uris, 2), ESP_OK);
+    TEST_CHECK(hd_uris[0].handler != test_echo_handler);
+    TEST_CHECK(hd_uris[1].handler == NULL);
+    TEST_CHECK_ERR(esp_cchi_setup_hd_uri(&hd_uris[0]), ESP_ERR_INVALID_ARG);
+    TEST_CHECK_ERR(esp_cchi_setup_hd_uri(&hd_uris[1]), ESP_ERR_INVALID_ARG);
+
+    hd_uris[1].handler = test_echo_handler;
+    for (size_t i = 0; i < 2; i++) {
+        TEST_CHECK_ERR(httpd_register_uri_handler(server, &hd_uris[i]), ESP_OK);
+    }
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/h/1"), "200 /h/{id} id=1");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/n/2"), "200 /n/{id} id=2");
+
+    httpd_stop(server);
+    TEST_CHECK_ERR(esp_cchi_delete_hd_uri(&hd_uris[0], true), ESP_OK);
+    TEST_CHECK(hd_uris[0].handler == test_echo_handler);
+    TEST_CHECK_ERR(esp_cchi_delete_hd_uri(&hd_uris[1], false), ESP_OK);
+    TEST_CHECK(hd_uris[1].handler == test_echo_handler);
+}
+
+static void test_router(void) {
+    httpd_handle_t server = test_server_start();
+    esp_cchi_router_handle_t router = NULL;
+    TEST_CHECK_ERR(esp_cchi_router_create(&router), ESP_OK);
+    for (size_t i = 0; i < TEST_PATTERNS_LEN; i++) {
+        httpd_uri_t hd_uri = {
+            .uri = test_patterns[i],
+            .method = HTTP_GET,
+            .handler = test_echo_handler,
+        };
+        TEST_CHECK_ERR(esp_cchi_router_handle(router, &hd_uri), ESP_OK);
+    }
+    TEST_CHECK_ERR(esp_cchi_router_attach(router, server), ESP_OK);
+
+    test_check_cases(server, "router", false);
+
+    httpd_stop(server);
+    esp_cchi_router_delete(router);
+}
+
+static void test_compiled(void) {
+    httpd_handle_t server = test_server_start();
+    TEST_CHECK_ERR(esp_cchi_compiled_attach(&test_precedence_routes, server), ESP_OK);
+
+    test_check_cases(server, "compiled", true);
+
+    httpd_stop(server);
+}
+
+int main(void) {
+    test_legacy();
+    test_legacy_catch_all();
+    test_legacy_handler();
+    test_router();
+    test_compiled();
+    return test_report("test_precedence");
+}
@@ -0,0 +1,147 @@
+/**
+ * Query string index: percent-decoding and '+' as space in keys and values, escapes left as they
+ * are, repeated keys, empty values and keys without '=', the copying getters, and values decoded
+ * with a NUL in them that don't match shorter names
+*/
+#include <esp_cchi/router.h>
+#include <esp_http_server.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_cchi_test.h"
+
+// Names in the heap, reading past their NUL is caught by ASan
+static esp_cchi_enum_entry_t test_modes[2];
+
+// "<error>:<value>" of the "flag" query param read as a bool and as an enum
+static esp_err_t test_flag_handler(httpd_req_t *r) {
+    bool flag = false;
+    int mode = 0;
+    esp_err_t bool_err = esp_cchi_get_query_param_bool(r, "flag", &flag);
+    esp_err_t enum_err = esp_cchi_get_query_param_enum(r, "flag", test_modes, 2, &mode);
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%s:%d %s:%d", esp_err_to_name(bool_err), flag,
+             esp_err_to_name(enum_err), mode);
+    return httpd_resp_sendstr(r, buf);
+}
+
+// Appends "view" with the bytes that are not printable as "\XX"
+static void test_add_view(char *buf, size_t size, esp_cchi_view_t view) {
+    for (size_t i = 0; i < view.len; i++) {
+        size_t len = strlen(buf);
+        unsigned char c = (unsigned char)view.data[i];
+        snprintf(buf + len, size - len, c >= 0x20 && c < 0x7f ? "%c" : "\\%02x", c);
+    }
+}
+
+// "<count> [<key>=<value>]... a=<error>[:<value>] copy=<error>[:<value>] len=<len>"
+static esp_err_t test_items_handler(httpd_req_t *r) {
+    char buf[512];
+    size_t count = esp_cchi_get_query_param_count(r);
+    snprintf(buf, sizeof(buf), "%zu", count);
+    for (size_t i = 0; i < count; i++) {
+        esp_cchi_query_param_t param;
+        if (esp_cchi_get_query_param_at(r, i, &param) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        strcat(buf, " [");
+        test_add_view(buf, sizeof(buf), param.key);
+        strcat(buf, "=");
+        test_add_view(buf, sizeof(buf), param.value);
+        strcat(buf, "]");
+    }
+    esp_cchi_query_param_t param;
+    if (esp_cchi_get_query_param_at(r, count, &param) != ESP_ERR_NOT_FOUND) {
+        return ESP_FAIL;
+    }
+
+    esp_cchi_view_t view;
+    esp_err_t err = esp_cchi_get_query_param_view(r, "a", &view);
+    size_t len = strlen(buf);
+    snprintf(buf + len, sizeof(buf) - len, " a=%s%s", esp_err_to_name(err),
+             err == ESP_OK ? ":" : "");
+    if (err == ESP_OK) {
+        test_add_view(buf, sizeof(buf), view);
+    }
+
+    // Copied into a buffer of 4 bytes, without NUL
+    char value[4];
+    size_t written;
+    err = esp_cchi_get_query_param(r, "a", value, sizeof(value), &written);
+    len = strlen(buf);
+    snprintf(buf + len, sizeof(buf) - len, " copy=%s%s", esp_err_to_name(err),
+             err == ESP_OK ? ":" : "");
+    test_add_view(buf, sizeof(buf), (esp_cchi_view_t){ value, written });
+    len = strlen(buf);
+    snprintf(buf + len, sizeof(buf) - len, " len=%zu", esp_cchi_get_query_param_len(r, "a"));
+    return httpd_resp_sendstr(r, buf);
+}
+
+static void test_query_items(httpd_handle_t server) {
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/items"),
+                   "200 0 a=ESP_ERR_NOT_FOUND copy=ESP_ERR_NOT_FOUND len=0");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/items?"),
+                   "200 0 a=ESP_ERR_NOT_FOUND copy=ESP_ERR_NOT_FOUND len=0");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/items?a=1&b=2"),
+                   "200 2 [a=1] [b=2] a=ESP_OK:1 copy=ESP_OK:1 len=1");
+
+    // Escapes in either case, '+' as space, in the keys too
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/items?a=x%2By+z%3d%3D&%61%20b=%7e"),
+                   "200 2 [a=x+y z==] [a b=~] a=ESP_OK:x+y z== copy=ESP_FAIL len=7");
+    // Not followed by 2 hexadecimal digits, copied as is
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/items?a=%4"),
+                   "200 1 [a=%4] a=ESP_OK:%4 copy=ESP_OK:%4 len=2");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/items?a=%&b=%zz&c=%4g&d=100%"),
+                   "200 4 [a=%] [b=%zz] [c=%4g] [d=100%] a=ESP_OK:% copy=ESP_OK:% len=1");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/items?a=%41%4"),
+                   "200 1 [a=A%4] a=ESP_OK:A%4 copy=ESP_OK:A%4 len=3");
+
+    // The first of the repeated keys is found, the others are reached by index
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/items?a=1&a=2&a"),
+                   "200 3 [a=1] [a=2] [a=] a=ESP_OK:1 copy=ESP_OK:1 len=1");
+    // Empty values and keys without '=', empty pairs are skipped
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/items?a&b=&=c&&d==#a=frag"),
+                   "200 4 [a=] [b=] [=c] [d==] a=ESP_OK: copy=ESP_OK: len=0");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/items?%00=x&a=%00%01"),
+                   "200 2 [\\00=x] [a=\\00\\01] a=ESP_OK:\\00\\01 copy=ESP_OK:\\00\\01 len=2");
+    // Keys are case sensitive
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/items?A=1"),
+                   "200 1 [A=1] a=ESP_ERR_NOT_FOUND copy=ESP_ERR_NOT_FOUND len=0");
+}
+
+static void test_query_nul(httpd_handle_t server) {
+    test_modes[0] = (esp_cchi_enum_entry_t){ strdup("1"), 1 };
+    test_modes[1] = (esp_cchi_enum_entry_t){ strdup("on"), 2 };
+
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/flag?flag=1"), "200 ESP_OK:1 ESP_OK:1");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/flag?flag=on"), "200 ESP_FAIL:0 ESP_OK:2");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/flag?flag=1%00xyz"), "200 ESP_FAIL:0 ESP_FAIL:0");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/flag?flag=on%00"), "200 ESP_FAIL:0 ESP_FAIL:0");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/flag?flag=%00"), "200 ESP_FAIL:0 ESP_FAIL:0");
+
+    free((char*)test_modes[0].name);
+    free((char*)test_modes[1].name);
+}
+
+int main(void) {
+    httpd_handle_t server = test_server_start();
+    esp_cchi_router_handle_t router = NULL;
+    TEST_CHECK_ERR(esp_cchi_router_create(&router), ESP_OK);
+    httpd_uri_t hd_uri = {
+        .uri = "/flag",
+        .method = HTTP_GET,
+        .handler = test_flag_handler,
+    };
+    TEST_CHECK_ERR(esp_cchi_router_handle(router, &hd_uri), ESP_OK);
+    hd_uri.uri = "/items";
+    hd_uri.handler = test_items_handler;
+    TEST_CHECK_ERR(esp_cchi_router_handle(router, &hd_uri), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_router_attach(router, server), ESP_OK);
+
+    test_query_items(server);
+    test_query_nul(server);
+
+    httpd_stop(server);
+    esp_cchi_router_delete(router);
+    return test_report("test_query");
+}
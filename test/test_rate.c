@@ -0,0 +1,97 @@
+/**
+ * Rate limiter: a burst answered 429 once it's spent, a rate above 1000 requests per second that
+ * is not clamped to one request per millisecond, and the single slot of a table taken over only
+ * once its client is idle
+*/
+#include <esp_cchi/router.h>
+#include <esp_http_server.h>
+#include <middlewares.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "esp_cchi_test.h"
+
+static middlewares_rate_slot_t test_slots[1];
+static middlewares_rate_limit_t test_limit = {
+    .slots = test_slots,
+    .slots_len = 1,
+};
+
+static esp_err_t test_rate_mw(httpd_req_t *r) {
+    return middlewares_check_rate(r, &test_limit);
+}
+
+static void test_rate_reset(uint32_t rate_per_s, uint32_t burst) {
+    memset(test_slots, 0, sizeof(test_slots));
+    test_limit.rate_per_s = rate_per_s;
+    test_limit.burst = burst;
+    test_limit.limited = 0;
+    test_limit.untracked = 0;
+}
+
+// Request from the client "sockfd", which has no peer address, its socket is its key
+static const char *test_rate_run(test_request_t *req, httpd_handle_t server, int sockfd) {
+    test_request_init(req, server, HTTP_GET, "/ping");
+    req->exchange.sockfd = sockfd;
+    return test_request_run(req);
+}
+
+static void test_rate_limit(httpd_handle_t server) {
+    static test_request_t req;
+
+    test_rate_reset(1, 3);
+    for (int i = 0; i < 3; i++) {
+        TEST_CHECK_STR(test_rate_run(&req, server, 1000), "200 /ping");
+    }
+    TEST_CHECK_STR(test_rate_run(&req, server, 1000), "429 ");
+    TEST_CHECK_STR(httpd_host_exchange_resp_hdr(&req.exchange, "Retry-After"), "1");
+    TEST_CHECK(test_limit.limited == 1);
+
+    // One token every 10 us, there is always one after 200 us
+    test_rate_reset(100000, 1);
+    for (int i = 0; i < 20; i++) {
+        TEST_CHECK_STR(test_rate_run(&req, server, 1000), "200 /ping");
+        usleep(200);
+    }
+    TEST_CHECK(test_limit.limited == 0);
+}
+
+static void test_rate_takeover(httpd_handle_t server) {
+    static test_request_t req;
+
+    // The bucket of the first client is not full again for a second
+    test_rate_reset(1, 1);
+    TEST_CHECK_STR(test_rate_run(&req, server, 1000), "200 /ping");
+    TEST_CHECK_STR(test_rate_run(&req, server, 1001), "200 /ping");
+    TEST_CHECK(test_limit.untracked == 1);
+    TEST_CHECK_STR(test_rate_run(&req, server, 1000), "429 ");
+
+    // Idle after 10 ms, the second client takes the slot over
+    test_rate_reset(100, 1);
+    TEST_CHECK_STR(test_rate_run(&req, server, 1000), "200 /ping");
+    usleep(20000);
+    TEST_CHECK_STR(test_rate_run(&req, server, 1001), "200 /ping");
+    TEST_CHECK_STR(test_rate_run(&req, server, 1001), "429 ");
+    TEST_CHECK(test_limit.untracked == 0 && test_limit.limited == 1);
+}
+
+int main(void) {
+    httpd_handle_t server = test_server_start();
+    esp_cchi_router_handle_t router = NULL;
+    TEST_CHECK_ERR(esp_cchi_router_create(&router), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_router_use(router, test_rate_mw), ESP_OK);
+    httpd_uri_t hd_uri = {
+        .uri = "/ping",
+        .method = HTTP_GET,
+        .handler = test_echo_handler,
+    };
+    TEST_CHECK_ERR(esp_cchi_router_handle(router, &hd_uri), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_router_attach(router, server), ESP_OK);
+
+    test_rate_limit(server);
+    test_rate_takeover(server);
+
+    httpd_stop(server);
+    esp_cchi_router_delete(router);
+    return test_report("test_rate");
+}
@@ -0,0 +1,264 @@
+/**
+ * Static files served from a temporary directory: the precompressed ".gz" variant, conditional
+ * requests, files larger than a chunk, paths that try to leave the base path and a root mount
+*/
+#include <esp_cchi/router.h>
+#include <esp_cchi/static.h>
+#include <esp_http_server.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "esp_cchi_test.h"
+#include "sdkconfig.h"
+
+#ifndef CONFIG_ESP_CCHI_STATIC_CHUNK_LEN
+#define CONFIG_ESP_CCHI_STATIC_CHUNK_LEN 1024
+#endif
+
+#define TEST_BIG_LEN (3 * CONFIG_ESP_CCHI_STATIC_CHUNK_LEN + 17)
+
+// Files of the temporary directory, relative to it, "www" is the base path
+static const struct {
+    const char *name;
+    const char *content;
+} test_files[] = {
+    {"secret.txt", "secret"},
+    {"www/index.html", "<h1>index</h1>"},
+    {"www/app.js", "console.log(1)"},
+    {"www/app.js.gz", "gzipped app.js"},
+    {"www/sub/index.html", "<h1>sub</h1>"},
+};
+
+#define TEST_FILES_LEN (sizeof(test_files) / sizeof(test_files[0]))
+
+static char test_dir[] = "/tmp/esp_cchi_static_XXXXXX";
+static char test_base_path[sizeof(test_dir) + sizeof("/www")];
+static char test_big[TEST_BIG_LEN];
+
+static void test_path(char *path, size_t size, const char *name) {
+    snprintf(path, size, "%s/%s", test_dir, name);
+}
+
+static void test_write_file(const char *name, const char *content, size_t len) {
+    char path[128];
+    test_path(path, sizeof(path), name);
+    FILE *file = fopen(path, "wb");
+    if (file == NULL || fwrite(content, 1, len, file) != len || fclose(file) != 0) {
+        fprintf(stderr, "%s can't be written\n", path);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void test_files_create(void) {
+    char path[128];
+    if (mkdtemp(test_dir) == NULL) {
+        fprintf(stderr, "the temporary directory can't be created\n");
+        exit(EXIT_FAILURE);
+    }
+    snprintf(test_base_path, sizeof(test_base_path), "%s/www", test_dir);
+    test_path(path, sizeof(path), "www");
+    mkdir(path, 0700);
+    test_path(path, sizeof(path), "www/sub");
+    mkdir(path, 0700);
+    for (size_t i = 0; i < TEST_FILES_LEN; i++) {
+        test_write_file(test_files[i].name, test_files[i].content, strlen(test_files[i].content));
+    }
+    for (size_t i = 0; i < sizeof(test_big); i++) {
+        test_big[i] = (char)('a' + i % 26);
+    }
+    test_write_file("www/big.bin", test_big, sizeof(test_big));
+}
+
+static void test_files_remove(void) {
+    char path[128];
+    for (size_t i = 0; i < TEST_FILES_LEN; i++) {
+        test_path(path, sizeof(path), test_files[i].name);
+        unlink(path);
+    }
+    test_path(path, sizeof(path), "www/big.bin");
+    unlink(path);
+    test_path(path, sizeof(path), "www/sub");
+    rmdir(path);
+    test_path(path, sizeof(path), "www");
+    rmdir(path);
+    rmdir(test_dir);
+}
+
+static httpd_handle_t test_static_start(const char *prefix,
+                                        const esp_cchi_static_config_t *config,
+                                        esp_cchi_router_handle_t *router)
+{
+    httpd_handle_t server = test_server_start();
+    TEST_CHECK_ERR(esp_cchi_router_create(router), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_router_static(*router, prefix, config), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_router_attach(*router, server), ESP_OK);
+    return server;
+}
+
+static void test_gzip(void) {
+    const esp_cchi_static_config_t www = {
+        .base_path = test_base_path,
+        .cache_control = "public, max-age=60",
+    };
+    esp_cchi_router_handle_t router = NULL;
+    httpd_handle_t server = test_static_start("/ui", &www, &router);
+
+    test_request_t req;
+    test_request_init(&req, server, HTTP_GET, "/ui/app.js");
+    httpd_host_exchange_add_hdr(&req.exchange, "Accept-Encoding", "deflate, gzip");
+    TEST_CHECK_STR(test_request_run(&req), "200 gzipped app.js");
+    TEST_CHECK_STR(httpd_host_exchange_resp_hdr(&req.exchange, "Content-Encoding"), "gzip");
+    TEST_CHECK_STR(httpd_host_exchange_resp_hdr(&req.exchange, "Vary"), "Accept-Encoding");
+    TEST_CHECK_STR(httpd_host_exchange_resp_hdr(&req.exchange, "Cache-Control"),
+                   "public, max-age=60");
+    // The type is the one of the file asked for
+    TEST_CHECK_STR(req.exchange.type, "text/javascript");
+
+    // Refused with q=0 or not accepted at all, the file itself is sent
+    test_request_init(&req, server, HTTP_GET, "/ui/app.js");
+    httpd_host_exchange_add_hdr(&req.exchange, "Accept-Encoding", "gzip;q=0, *");
+    TEST_CHECK_STR(test_request_run(&req), "200 console.log(1)");
+    TEST_CHECK(httpd_host_exchange_resp_hdr(&req.exchange, "Content-Encoding") == NULL);
+    TEST_CHECK_STR(httpd_host_exchange_resp_hdr(&req.exchange, "Vary"), "Accept-Encoding");
+    test_request_init(&req, server, HTTP_GET, "/ui/app.js");
+    TEST_CHECK_STR(test_request_run(&req), "200 console.log(1)");
+
+    // No ".gz" variant
+    test_request_init(&req, server, HTTP_GET, "/ui/");
+    httpd_host_exchange_add_hdr(&req.exchange, "Accept-Encoding", "gzip");
+    TEST_CHECK_STR(test_request_run(&req), "200 <h1>index</h1>");
+    TEST_CHECK(httpd_host_exchange_resp_hdr(&req.exchange, "Content-Encoding") == NULL);
+    TEST_CHECK_STR(req.exchange.type, "text/html");
+
+    httpd_stop(server);
+    esp_cchi_router_delete(router);
+}
+
+static void test_not_modified(void) {
+    const esp_cchi_static_config_t www = {.base_path = test_base_path};
+    esp_cchi_router_handle_t router = NULL;
+    httpd_handle_t server = test_static_start("/ui", &www, &router);
+
+    char etag[64];
+    char gzip_etag[64];
+    test_request_t req;
+    test_request_init(&req, server, HTTP_GET, "/ui/app.js");
+    TEST_CHECK_STR(test_request_run(&req), "200 console.log(1)");
+    const char *value = httpd_host_exchange_resp_hdr(&req.exchange, "ETag");
+    TEST_CHECK(value != NULL && value[0] == '"');
+    snprintf(etag, sizeof(etag), "%s", value != NULL ? value : "");
+    test_request_init(&req, server, HTTP_GET, "/ui/app.js");
+    httpd_host_exchange_add_hdr(&req.exchange, "Accept-Encoding", "gzip");
+    TEST_CHECK_STR(test_request_run(&req), "200 gzipped app.js");
+    value = httpd_host_exchange_resp_hdr(&req.exchange, "ETag");
+    snprintf(gzip_etag, sizeof(gzip_etag), "%s", value != NULL ? value : "");
+    TEST_CHECK(strcmp(etag, gzip_etag) != 0);
+
+    test_request_init(&req, server, HTTP_GET, "/ui/app.js");
+    httpd_host_exchange_add_hdr(&req.exchange, "If-None-Match", etag);
+    TEST_CHECK_STR(test_request_run(&req), "304 ");
+    TEST_CHECK(req.exchange.resp_len == 0);
+    TEST_CHECK_STR(httpd_host_exchange_resp_hdr(&req.exchange, "ETag"), etag);
+
+    // One of a list, compared weakly
+    char list[160];
+    snprintf(list, sizeof(list), "\"other\", W/%s", gzip_etag);
+    test_request_init(&req, server, HTTP_GET, "/ui/app.js");
+    httpd_host_exchange_add_hdr(&req.exchange, "Accept-Encoding", "gzip");
+    httpd_host_exchange_add_hdr(&req.exchange, "If-None-Match", list);
+    TEST_CHECK_STR(test_request_run(&req), "304 ");
+    test_request_init(&req, server, HTTP_GET, "/ui/app.js");
+    httpd_host_exchange_add_hdr(&req.exchange, "If-None-Match", "*");
+    TEST_CHECK_STR(test_request_run(&req), "304 ");
+
+    // The ETag of the plain file doesn't validate the ".gz" one
+    test_request_init(&req, server, HTTP_GET, "/ui/app.js");
+    httpd_host_exchange_add_hdr(&req.exchange, "Accept-Encoding", "gzip");
+    httpd_host_exchange_add_hdr(&req.exchange, "If-None-Match", etag);
+    TEST_CHECK_STR(test_request_run(&req), "200 gzipped app.js");
+    test_request_init(&req, server, HTTP_GET, "/ui/app.js");
+    httpd_host_exchange_add_hdr(&req.exchange, "If-None-Match", "\"other\"");
+    TEST_CHECK_STR(test_request_run(&req), "200 console.log(1)");
+
+    httpd_stop(server);
+    esp_cchi_router_delete(router);
+}
+
+static void test_chunked(void) {
+    const esp_cchi_static_config_t www = {.base_path = test_base_path};
+    esp_cchi_router_handle_t router = NULL;
+    httpd_handle_t server = test_static_start("/ui", &www, &router);
+
+    static char body[TEST_BIG_LEN + 64];
+    httpd_host_exchange_t exchange;
+    TEST_CHECK_ERR(httpd_host_exchange_init(&exchange, server, HTTP_GET, "/ui/big.bin"), ESP_OK);
+    exchange.resp_buf = body;
+    exchange.resp_buf_size = sizeof(body);
+    TEST_CHECK_ERR(httpd_host_exchange_run(&exchange), ESP_OK);
+    httpd_host_exchange_wait(&exchange);
+    TEST_CHECK(strncmp(exchange.status, "200", 3) == 0);
+    TEST_CHECK(exchange.resp_chunked);
+    TEST_CHECK(exchange.resp_len == TEST_BIG_LEN);
+    TEST_CHECK(memcmp(body, test_big, TEST_BIG_LEN) == 0);
+    TEST_CHECK_STR(exchange.type, "application/octet-stream");
+
+    httpd_stop(server);
+    esp_cchi_router_delete(router);
+}
+
+static void test_traversal(void) {
+    const esp_cchi_static_config_t www = {.base_path = test_base_path};
+    esp_cchi_router_handle_t router = NULL;
+    httpd_handle_t server = test_static_start("/ui", &www, &router);
+
+    // Reachable through the base path, the ".." segments are rejected before and after decoding
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/ui/sub/"), "200 <h1>sub</h1>");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/ui/../secret.txt"), "404 404 Not Found");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/ui/%2e%2e/secret.txt"), "404 404 Not Found");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/ui/%2E%2e/secret.txt"), "404 404 Not Found");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/ui/.%2e/secret.txt"), "404 404 Not Found");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/ui/..%2fsecret.txt"), "404 404 Not Found");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/ui/sub/%2e%2e/%2e%2e/secret.txt"),
+                   "404 404 Not Found");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/ui/sub/%2e%2e"), "404 404 Not Found");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/ui/app.js%00.txt"), "404 404 Not Found");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/ui/..%5csecret.txt"), "404 404 Not Found");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/ui/%61pp.js"), "200 console.log(1)");
+
+    httpd_stop(server);
+    esp_cchi_router_delete(router);
+}
+
+static void test_root_mount(void) {
+    const esp_cchi_static_config_t www = {.base_path = test_base_path};
+    esp_cchi_router_handle_t router = NULL;
+    httpd_handle_t server = test_static_start("", &www, &router);
+
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/"), "200 <h1>index</h1>");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/app.js"), "200 console.log(1)");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/sub/"), "200 <h1>sub</h1>");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/sub"), "404 404 Not Found");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/missing.js"), "404 404 Not Found");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/%2e%2e/secret.txt"), "404 404 Not Found");
+
+    // Only GET is routed
+    test_request_t req;
+    test_request_init(&req, server, HTTP_POST, "/app.js");
+    TEST_CHECK_STR(test_request_run(&req), "405 405 Method Not Allowed");
+
+    httpd_stop(server);
+    esp_cchi_router_delete(router);
+}
+
+int main(void) {
+    test_files_create();
+    test_gzip();
+    test_not_modified();
+    test_chunked();
+    test_traversal();
+    test_root_mount();
+    test_files_remove();
+    return test_report("test_static");
+}
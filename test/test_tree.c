@@ -0,0 +1,166 @@
+/**
+ * Route tree of the Router object: precedence of literal edges, params and wildcards, backtracking
+ * out of branches that fail further down and the CONFIG_ESP_CCHI_MAX_URI_PARAMS limit
+*/
+#include <esp_cchi/router.h>
+#include <esp_http_server.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_cchi_test.h"
+#include "sdkconfig.h"
+
+#ifndef CONFIG_ESP_CCHI_MAX_URI_PARAMS
+#define CONFIG_ESP_CCHI_MAX_URI_PARAMS 8
+#endif
+
+static esp_err_t test_handle(esp_cchi_router_handle_t router,
+                             httpd_method_t method,
+                             const char *pattern)
+{
+    httpd_uri_t hd_uri = {
+        .uri = pattern,
+        .method = method,
+        .handler = test_echo_handler,
+    };
+    return esp_cchi_router_handle(router, &hd_uri);
+}
+
+static void test_precedence(void) {
+    httpd_handle_t server = test_server_start();
+    esp_cchi_router_handle_t router = NULL;
+    TEST_CHECK_ERR(esp_cchi_router_create(&router), ESP_OK);
+
+    // Registered from the least to the most specific, the order must not matter
+    TEST_CHECK_ERR(test_handle(router, HTTP_GET, "/users/{rest...}"), ESP_OK);
+    TEST_CHECK_ERR(test_handle(router, HTTP_GET, "/users/{name}"), ESP_OK);
+    TEST_CHECK_ERR(test_handle(router, HTTP_GET, "/users/{id:[0-9]+}"), ESP_OK);
+    TEST_CHECK_ERR(test_handle(router, HTTP_GET, "/users/me"), ESP_OK);
+    TEST_CHECK_ERR(test_handle(router, HTTP_POST, "/users/me"), ESP_OK);
+    TEST_CHECK_ERR(test_handle(router, HTTP_GET, "/static/*"), ESP_OK);
+    TEST_CHECK_ERR(test_handle(router, HTTP_GET, "/users/me"), ESP_ERR_HTTPD_HANDLER_EXISTS);
+    TEST_CHECK_ERR(esp_cchi_router_attach(router, server), ESP_OK);
+
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/users/me"), "200 /users/me");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/users/42"), "200 /users/{id:[0-9]+} id=42");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/users/bob"), "200 /users/{name} name=bob");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/users/mex"), "200 /users/{name} name=mex");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/users/m"), "200 /users/{name} name=m");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/users/42/x"), "200 /users/{rest...} rest=42/x");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/users/42?x=1"), "200 /users/{id:[0-9]+} id=42");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/users/"), "404 404 Not Found");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/static/"), "200 /static/* *=");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/static/a/b.css"), "200 /static/* *=a/b.css");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/static"), "404 404 Not Found");
+
+    // The path matches, the method doesn't
+    test_request_t req;
+    test_request_init(&req, server, HTTP_DELETE, "/users/me");
+    TEST_CHECK_STR(test_request_run(&req), "405 405 Method Not Allowed");
+    TEST_CHECK_STR(httpd_host_exchange_resp_hdr(&req.exchange, "Allow"), "GET, POST");
+
+    httpd_stop(server);
+    esp_cchi_router_delete(router);
+}
+
+// Every method but DELETE, the Allow header lists them all
+static void test_allow_all(void) {
+    httpd_handle_t server = test_server_start();
+    esp_cchi_router_handle_t router = NULL;
+    TEST_CHECK_ERR(esp_cchi_router_create(&router), ESP_OK);
+    char expected[512] = "";
+    for (int method = HTTP_GET; method <= HTTP_UNLINK; method++) {
+        TEST_CHECK_ERR(test_handle(router, (httpd_method_t)method, "/all"), ESP_OK);
+        size_t len = strlen(expected);
+        snprintf(expected + len, sizeof(expected) - len, "%s%s", len > 0 ? ", " : "",
+                 http_method_str((enum http_method)method));
+    }
+    TEST_CHECK_ERR(esp_cchi_router_attach(router, server), ESP_OK);
+
+    test_request_t req;
+    test_request_init(&req, server, HTTP_DELETE, "/all");
+    TEST_CHECK_STR(test_request_run(&req), "405 405 Method Not Allowed");
+    TEST_CHECK_STR(httpd_host_exchange_resp_hdr(&req.exchange, "Allow"), expected);
+
+    httpd_stop(server);
+    esp_cchi_router_delete(router);
+}
+
+static void test_backtracking(void) {
+    httpd_handle_t server = test_server_start();
+    esp_cchi_router_handle_t router = NULL;
+    TEST_CHECK_ERR(esp_cchi_router_create(&router), ESP_OK);
+
+    TEST_CHECK_ERR(test_handle(router, HTTP_GET, "/a/b/c"), ESP_OK);
+    TEST_CHECK_ERR(test_handle(router, HTTP_GET, "/a/{x}/d"), ESP_OK);
+    TEST_CHECK_ERR(test_handle(router, HTTP_GET, "/p/{x}/q"), ESP_OK);
+    TEST_CHECK_ERR(test_handle(router, HTTP_GET, "/p/{rest...}/z"), ESP_OK);
+    TEST_CHECK_ERR(test_handle(router, HTTP_GET, "/n/{id:[0-9]+}/edit"), ESP_OK);
+    TEST_CHECK_ERR(test_handle(router, HTTP_GET, "/n/{slug}/view"), ESP_OK);
+    TEST_CHECK_ERR(test_handle(router, HTTP_GET, "/files/{name}.{ext}"), ESP_OK);
+    TEST_CHECK_ERR(test_handle(router, HTTP_GET, "/v/{major:[0-9]+}.{minor:[0-9]+}"), ESP_OK);
+    TEST_CHECK_ERR(esp_cchi_router_attach(router, server), ESP_OK);
+
+    // Out of a literal edge into a param
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/a/b/c"), "200 /a/b/c");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/a/b/d"), "200 /a/{x}/d x=b");
+    // Out of a param into a wildcard, the capture of the param is dropped
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/p/1/q"), "200 /p/{x}/q x=1");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/p/1/z"), "200 /p/{rest...}/z rest=1");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/p/1/2/z"), "200 /p/{rest...}/z rest=1/2");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/p/1/2/q"), "404 404 Not Found");
+    // Out of a param whose regexp matched
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/n/12/edit"), "200 /n/{id:[0-9]+}/edit id=12");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/n/12/view"), "200 /n/{slug}/view slug=12");
+    // The longest value is tried first, then the shorter ones
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/files/a.b.c"),
+                   "200 /files/{name}.{ext} name=a.b ext=c");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/v/1.2"),
+                   "200 /v/{major:[0-9]+}.{minor:[0-9]+} major=1 minor=2");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/v/1.2.x"), "404 404 Not Found");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, "/files/.c"), "404 404 Not Found");
+
+    httpd_stop(server);
+    esp_cchi_router_delete(router);
+}
+
+static void test_max_params(void) {
+    httpd_handle_t server = test_server_start();
+    esp_cchi_router_handle_t router = NULL;
+    TEST_CHECK_ERR(esp_cchi_router_create(&router), ESP_OK);
+
+    char pattern[256] = "/max";
+    char uri[256] = "/max";
+    char expected[512] = "200 /max";
+    for (size_t i = 0; i < CONFIG_ESP_CCHI_MAX_URI_PARAMS; i++) {
+        snprintf(pattern + strlen(pattern), sizeof(pattern) - strlen(pattern), "/{p%zu}", i);
+        snprintf(uri + strlen(uri), sizeof(uri) - strlen(uri), "/%zu", i);
+    }
+    strcat(expected, pattern + strlen("/max"));
+    for (size_t i = 0; i < CONFIG_ESP_CCHI_MAX_URI_PARAMS; i++) {
+        snprintf(expected + strlen(expected), sizeof(expected) - strlen(expected),
+                 " p%zu=%zu", i, i);
+    }
+    TEST_CHECK_ERR(test_handle(router, HTTP_GET, pattern), ESP_OK);
+
+    // One more is rejected
+    char too_many[sizeof(pattern) + 16];
+    snprintf(too_many, sizeof(too_many), "/over%s/{last}", pattern + strlen("/max"));
+    TEST_CHECK_ERR(test_handle(router, HTTP_GET, too_many), ESP_ERR_INVALID_ARG);
+
+    TEST_CHECK_ERR(esp_cchi_router_attach(router, server), ESP_OK);
+    TEST_CHECK_STR(test_run(server, HTTP_GET, uri), expected);
+    strcat(uri, "/extra");
+    TEST_CHECK_STR(test_run(server, HTTP_GET, uri), "404 404 Not Found");
+
+    httpd_stop(server);
+    esp_cchi_router_delete(router);
+}
+
+int main(void) {
+    test_precedence();
+    test_allow_all();
+    test_backtracking();
+    test_max_params();
+    return test_report("test_tree");
+}
@@ -0,0 +1,607 @@
+#!/usr/bin/env python3
+"""
+============== Route table generator ===============
+Compiles a route list into a const esp_cchi_compiled_table_t (see include/esp_cchi/compiled.h),
+it's run by the esp_cchi_compile_routes CMake function, not by hand.
+
+The route list has one route per line, "#" starts a comment:
+
+    include "handlers.h"
+    # <method> <pattern> <handler> [<user_ctx>]
+    GET     /health             handle_health
+    GET     /users/{id:[0-9]+}  handle_user     &users_ctx
+
+"include" lines are copied to the generated source, so the handlers and the user contexts can be
+declared there (the handlers are also declared by the generated source, as non-static functions).
+<user_ctx> is a C constant expression, the rest of the line.
+
+The patterns are validated and their regexps compiled here, with the same rules and the same
+result as esp_cchi_setup_hd_uri, so nothing is parsed nor allocated at runtime.
+"""
+
+import argparse
+import os
+import re
+import sys
+
+CONSTRAINT_MAX_ATOMS = 8
+CONSTRAINT_UNBOUNDED = 0xFFFF
+
+
+class RouteError(Exception):
+    pass
+
+
+def is_param(pattern, i):
+    """Whether a param starts at "i": a '{' or a "*" wildcard that ends the pattern after a '/'"""
+    return pattern[i] == "{" or (pattern[i] == "*" and i == len(pattern) - 1 and
+                                 pattern[i - 1] == "/")
+
+
+def is_wildcard(param):
+    """Whether the value of the param ("{...}" or "*") can span several segments"""
+    return param == "*" or re.split(r"[:}]", param[1:], 1)[0].endswith("...")
+
+
+def param_end(pattern, start):
+    """Index of the '}' that closes the param that opens at "start", None if it's not closed"""
+    if pattern[start] == "*":
+        return start
+    depth = 0
+    in_class = False
+    i = start + 1
+    while i < len(pattern):
+        c = pattern[i]
+        if c == "\\" and i + 1 < len(pattern):
+            i += 2
+            continue
+        if in_class:
+            in_class = c != "]"
+        elif c == "[":
+            in_class = True
+        elif c == "{":
+            depth += 1
+        elif c == "}":
+            if depth == 0:
+                return i
+            depth -= 1
+        i += 1
+    return None
+
+
+def split_pattern(pattern):
+    """Yields ("literal", text) and ("param", "{...}") parts, raises RouteError if it's invalid"""
+    if not pattern.startswith("/"):
+        raise RouteError("pattern must start with '/'")
+    i = 0
+    previous = None
+    while i < len(pattern):
+        if not is_param(pattern, i):
+            j = i + 1
+            while j < len(pattern) and not is_param(pattern, j):
+                j += 1
+            previous = "literal"
+            yield previous, pattern[i:j]
+            i = j
+            continue
+        if previous == "param":
+            raise RouteError("two URI params can't be next to each other")
+        end = param_end(pattern, i)
+        if end is None:
+            raise RouteError("URI param is not closed")
+        previous = "param"
+        yield previous, pattern[i:end + 1]
+        i = end + 1
+
+
+def class_escape(c):
+    """Set of the class escape "\\<c>", None if it's not a class escape"""
+    if c in "dD":
+        chars = set(range(ord("0"), ord("9") + 1))
+    elif c in "wW":
+        chars = set(range(ord("0"), ord("9") + 1)) | set(range(ord("a"), ord("z") + 1))
+        chars |= set(range(ord("A"), ord("Z") + 1)) | {ord("_")}
+    elif c in "sS":
+        chars = set(range(ord("\t"), ord("\r") + 1)) | {ord(" ")}
+    else:
+        return None
+    return set(range(256)) - chars if c.isupper() else chars
+
+
+def parse_class(regexp, i):
+    """Parses the class that starts after the '[' at "i", returns (set, index after the ']')"""
+    chars = set()
+    negated = False
+    if i < len(regexp) and regexp[i] == "^":
+        negated = True
+        i += 1
+    first = True
+    while i < len(regexp) and (regexp[i] != "]" or first):
+        first = False
+        start = regexp[i]
+        if start == "\\":
+            if i + 1 >= len(regexp):
+                raise RouteError("malformed regexp")
+            i += 1
+            escape = class_escape(regexp[i])
+            if escape is not None:
+                chars |= escape
+                i += 1
+                continue
+            start = regexp[i]
+        i += 1
+        if i + 1 < len(regexp) and regexp[i] == "-" and regexp[i + 1] != "]":
+            if ord(regexp[i + 1]) < ord(start):
+                raise RouteError("malformed regexp")
+            chars |= set(range(ord(start), ord(regexp[i + 1]) + 1))
+            i += 2
+            continue
+        chars.add(ord(start))
+    if i == len(regexp):
+        raise RouteError("malformed regexp")
+    if negated:
+        chars = set(range(256)) - chars
+    return chars, i + 1
+
+
+def parse_number(regexp, i):
+    match = re.match(r"[0-9]+", regexp[i:])
+    if match is None or int(match.group(0)) >= CONSTRAINT_UNBOUNDED:
+        raise RouteError("malformed regexp")
+    return int(match.group(0)), i + len(match.group(0))
+
+
+def parse_quantifier(regexp, i):
+    """Returns (min, max, index after the quantifier)"""
+    if i == len(regexp):
+        return 1, 1, i
+    c = regexp[i]
+    if c == "*":
+        return 0, CONSTRAINT_UNBOUNDED, i + 1
+    if c == "+":
+        return 1, CONSTRAINT_UNBOUNDED, i + 1
+    if c == "?":
+        return 0, 1, i + 1
+    if c != "{":
+        return 1, 1, i
+    low, i = parse_number(regexp, i + 1)
+    high = low
+    if i < len(regexp) and regexp[i] == ",":
+        i += 1
+        high = CONSTRAINT_UNBOUNDED
+        if i < len(regexp) and regexp[i] != "}":
+            high, i = parse_number(regexp, i)
+    if i == len(regexp) or regexp[i] != "}" or high < low:
+        raise RouteError("malformed regexp")
+    return low, high, i + 1
+
+
+def compile_constraint(regexp):
+    """Same as esp_cchi_constraint_compile, returns a list of (set, min, max) atoms"""
+    if regexp.startswith("^"):
+        regexp = regexp[1:]
+    if regexp.endswith("$") and (len(regexp) == 1 or regexp[-2] != "\\"):
+        regexp = regexp[:-1]
+    atoms = []
+    i = 0
+    while i < len(regexp):
+        if len(atoms) == CONSTRAINT_MAX_ATOMS:
+            raise RouteError("regexp has more than %d atoms" % CONSTRAINT_MAX_ATOMS)
+        c = regexp[i]
+        if c in "()|":
+            raise RouteError("groups and alternations are not supported")
+        if c in "*+?{}]^$":
+            raise RouteError("malformed regexp")
+        if c == ".":
+            chars = set(range(256))
+            i += 1
+        elif c == "[":
+            chars, i = parse_class(regexp, i + 1)
+        elif c == "\\":
+            if i + 1 == len(regexp):
+                raise RouteError("malformed regexp")
+            chars = class_escape(regexp[i + 1])
+            if chars is None:
+                chars = {ord(regexp[i + 1])}
+            i += 2
+        else:
+            chars = {ord(c)}
+            i += 1
+        low, high, i = parse_quantifier(regexp, i)
+        atoms.append((chars, low, high))
+    return atoms
+
+
+def param_rank(param):
+    """Position of a param in the specificity order, the lower the more specific"""
+    return (2 if is_wildcard(param) else 0) + (0 if ":" in param else 1)
+
+
+class Node:
+    """Node of the tree of the routes with URI params, same layout as esp_cchi_tree_node_t"""
+
+    def __init__(self, prefix="", key=None, tail=""):
+        self.prefix = prefix
+        self.key = key
+        self.tail = tail
+        self.children = []
+        self.params = []
+        self.group = None
+        self.patterns = 0
+
+
+def param_node_cmp(a, b):
+    """Same order as the params of the tree of the Router object (see esp_cchi_tree.c)"""
+    rank = param_rank(a.key) - param_rank(b.key)
+    if rank != 0 or a.tail == b.tail:
+        return rank
+    if a.tail == "" or b.tail == "":
+        return 1 if a.tail == "" else -1
+    return ord(a.tail) - ord(b.tail)
+
+
+def insert_static(node, literal):
+    while literal:
+        child = next((c for c in node.children if c.prefix[0] == literal[0]), None)
+        if child is None:
+            child = Node(prefix=literal)
+            node.children.append(child)
+            node.children.sort(key=lambda c: ord(c.prefix[0]))
+            return child
+        common = 0
+        while (common < len(child.prefix) and common < len(literal) and
+               child.prefix[common] == literal[common]):
+            common += 1
+        if common < len(child.prefix):
+            # Splitting the edge, "mid" takes the place of "child" and keeps the common part
+            mid = Node(prefix=child.prefix[:common])
+            child.prefix = child.prefix[common:]
+            mid.children = [child]
+            node.children[node.children.index(child)] = mid
+            child = mid
+        literal = literal[common:]
+        node = child
+    return node
+
+
+def insert_param(node, key, tail):
+    for param in node.params:
+        if param.key == key and param.tail == tail:
+            return param
+    param = Node(key=key, tail=tail)
+    # After the params that are as specific, so they keep their order in the route list
+    index = 0
+    while index < len(node.params) and param_node_cmp(node.params[index], param) <= 0:
+        index += 1
+    node.params.insert(index, param)
+    return param
+
+
+def build_tree(param_groups):
+    """Same tree the Router object builds, "group" is set on the nodes where a pattern ends"""
+    root = Node()
+    for group in param_groups:
+        node = root
+        parts = group["parts"]
+        for i, (kind, text) in enumerate(parts):
+            if kind == "literal":
+                node = insert_static(node, text)
+            else:
+                node = insert_param(node, text, parts[i + 1][1][0] if i + 1 < len(parts) else "")
+        node.group = group
+
+    def count(node):
+        node.patterns = (node.group is not None) + sum(count(child) for child in node.children +
+                                                       node.params)
+        return node.patterns
+    count(root)
+    return root
+
+
+def stripped_pattern(parts):
+    """Pattern without the regexps, they are already compiled"""
+    return "".join(text.split(":", 1)[0] + "}" if kind == "param" and ":" in text else text
+                   for kind, text in parts)
+
+
+def c_string(text):
+    out = []
+    for c in text:
+        if c in "\\\"":
+            out.append("\\" + c)
+        elif 32 <= ord(c) < 127:
+            out.append(c)
+        else:
+            out.append("\\%03o" % ord(c))
+    return '"' + "".join(out) + '"'
+
+
+def c_char(c):
+    return "'\\%s'" % c if c in "\\'" else "'%s'" % c
+
+
+def c_method(method):
+    return "HTTP_" + method.upper().replace("-", "")
+
+
+def parse_routes(path):
+    includes = []
+    groups = {}
+    for line_number, line in enumerate(open(path, encoding="utf-8"), 1):
+        line = re.sub(r"(^|\s)#.*$", "", line).strip()
+        if not line:
+            continue
+        where = "%s:%d: " % (path, line_number)
+        if line.startswith("include"):
+            includes.append(line[len("include"):].strip())
+            continue
+        fields = line.split(None, 3)
+        if len(fields) < 3:
+            raise RouteError(where + "expected <method> <pattern> <handler> [<user_ctx>]")
+        method, pattern, handler = fields[:3]
+        user_ctx = fields[3] if len(fields) == 4 else "NULL"
+        if not re.match(r"^[A-Za-z_][A-Za-z0-9_]*$", handler):
+            raise RouteError(where + "handler must be a function name")
+        try:
+            parts = list(split_pattern(pattern))
+            for kind, text in parts:
+                if kind == "param" and ":" in text:
+                    compile_constraint(text[text.index(":") + 1:-1])
+        except RouteError as err:
+            raise RouteError(where + str(err))
+        group = groups.setdefault(pattern, {"pattern": pattern, "parts": parts, "routes": []})
+        if any(route["method"] == c_method(method) for route in group["routes"]):
+            raise RouteError(where + "%s %s is already in the list" % (method, pattern))
+        group["routes"].append({"method": c_method(method), "handler": handler, "user_ctx": user_ctx})
+    if not groups:
+        raise RouteError("%s: there are no routes" % path)
+    return includes, list(groups.values())
+
+
+def static_finder(name, static_groups):
+    """Switch on the length and then on the first character that tells the candidates apart"""
+    lines = ["static int %s_find_static(const char *path, size_t path_len) {" % name]
+    if not static_groups:
+        lines += ["    (void)path;", "    (void)path_len;", "    return -1;", "}"]
+        return lines
+    by_len = {}
+    for index, group in static_groups:
+        by_len.setdefault(len(group["pattern"]), []).append((index, group["pattern"]))
+    lines.append("    switch (path_len) {")
+    for length in sorted(by_len):
+        candidates = by_len[length]
+        lines.append("    case %d:" % length)
+        if len(candidates) == 1:
+            index, pattern = candidates[0]
+            lines.append("        return memcmp(path, %s, %d) == 0 ? %d : -1;"
+                         % (c_string(pattern), length, index))
+            continue
+        pivot = next(i for i in range(length) if len({p[i] for _, p in candidates}) > 1)
+        lines.append("        switch (path[%d]) {" % pivot)
+        by_char = {}
+        for index, pattern in candidates:
+            by_char.setdefault(pattern[pivot], []).append((index, pattern))
+        for char in sorted(by_char):
+            lines.append("        case %s:" % c_char(char))
+            for index, pattern in by_char[char]:
+                lines.append("            if (memcmp(path, %s, %d) == 0) {"
+                             % (c_string(pattern), length))
+                lines.append("                return %d;" % index)
+                lines.append("            }")
+            lines.append("            return -1;")
+        lines.append("        default:")
+        lines.append("            return -1;")
+        lines.append("        }")
+    lines.append("    default:")
+    lines.append("        return -1;")
+    lines.append("    }")
+    lines.append("}")
+    return lines
+
+
+def emit_tree(name, root, constraint_symbols, static_len):
+    """Emits the nodes children first, so every node only points to nodes already defined"""
+    lines = []
+    counter = [0]
+
+    def emit(node):
+        children = [emit(child) for child in node.children]
+        params = [emit(param) for param in node.params]
+        symbol = "%s_node_%d" % (name, counter[0])
+        counter[0] += 1
+        for suffix, members in (("children", children), ("params", params)):
+            if members:
+                lines.append("static const esp_cchi_tree_node_t *const %s_%s[] = {"
+                             % (symbol, suffix))
+                lines.extend("    &%s," % member for member in members)
+                lines.append("};")
+        lines.append("static const esp_cchi_tree_node_t %s = {" % symbol)
+        if node.key is None:
+            lines.append("    .prefix = %s," % c_string(node.prefix))
+            lines.append("    .prefix_len = %d," % len(node.prefix))
+        else:
+            param_name = node.key if node.key == "*" else node.key[1:]
+            if ":" in param_name:
+                param_name = param_name.split(":", 1)[0] + "}"
+            lines.append("    .name = %s," % c_string(param_name))
+            if ":" in node.key:
+                lines.append("    .constraint = &%s," % constraint_symbols[node.key])
+            lines.append("    .tail = %s," % ("'\\0'" if node.tail == "" else c_char(node.tail)))
+            lines.append("    .wildcard = %s," % ("true" if is_wildcard(node.key) else "false"))
+            lines.append("    .min_len = %d," % (0 if node.key == "*" else 1))
+        for suffix, members in (("children", children), ("params", params)):
+            if members:
+                lines.append("    .%s = %s_%s," % (suffix, symbol, suffix))
+                lines.append("    .%s_len = %d," % (suffix, len(members)))
+        lines.append("    .patterns = %d," % node.patterns)
+        if node.group is not None:
+            lines.append("    .pattern = %s," % c_string(node.group["pattern"]))
+            lines.append("    .endpoint = &%s_groups[%d]," % (name, static_len + node.group["index"]))
+        lines.append("};")
+        lines.append("")
+        return symbol
+
+    return lines, emit(root)
+
+
+def generate(name, routes_path, includes, groups, max_params):
+    static_groups = [g for g in groups if not any(kind == "param" for kind, _ in g["parts"])]
+    param_groups = [g for g in groups if g not in static_groups]
+    groups = static_groups + param_groups
+
+    header = [
+        "/**",
+        " * Generated by esp_cchi_gen_routes.py from %s, do not edit" % os.path.basename(routes_path),
+        "*/",
+        "#pragma once",
+        "",
+        "#include <esp_cchi/compiled.h>",
+        "",
+        "#ifdef __cplusplus",
+        'extern "C" {',
+        "#endif",
+        "",
+        "extern const esp_cchi_compiled_table_t %s;" % name,
+        "",
+        "#ifdef __cplusplus",
+        "}",
+        "#endif",
+        "",
+    ]
+
+    source = [
+        "/**",
+        " * Generated by esp_cchi_gen_routes.py from %s, do not edit" % os.path.basename(routes_path),
+        "*/",
+        "#include <esp_http_server.h>",
+        "#include <esp_cchi/compiled.h>",
+        "#include <stdbool.h>",
+        "#include <stdint.h>",
+        "#include <string.h>",
+        '#include "sdkconfig.h"',
+        '#include "%s.h"' % name,
+    ]
+    source += ["#include %s" % include for include in includes]
+    source += [
+        "",
+        "#if defined(CONFIG_ESP_CCHI_MAX_URI_PARAMS) && CONFIG_ESP_CCHI_MAX_URI_PARAMS < %d"
+        % max_params,
+        '#error "%s has routes with more URI params than CONFIG_ESP_CCHI_MAX_URI_PARAMS"'
+        % os.path.basename(routes_path),
+        "#endif",
+        "",
+    ]
+
+    handlers = sorted({route["handler"] for group in groups for route in group["routes"]})
+    source += ["esp_err_t %s(httpd_req_t *r);" % handler for handler in handlers]
+    source.append("")
+
+    # Equal regexps share the same compiled constraint
+    symbols = {}
+    constraint_symbols = {}
+    for group in param_groups:
+        for kind, text in group["parts"]:
+            if kind != "param" or ":" not in text:
+                continue
+            regexp = text[text.index(":") + 1:-1]
+            if regexp not in symbols:
+                atoms = compile_constraint(regexp)
+                symbol = "%s_constraint_%d" % (name, len(symbols))
+                symbols[regexp] = symbol
+                source.append("static const esp_cchi_constraint_t %s = {" % symbol)
+                source.append("    .atoms_len = %d," % len(atoms))
+                source.append("    .atoms = {")
+                for chars, low, high in atoms:
+                    words = [sum(1 << (c & 31) for c in chars if c >> 5 == word)
+                             for word in range(8)]
+                    source.append("        { .set = { %s }, .min = %d, .max = %d },"
+                                  % (", ".join("0x%08xu" % w for w in words), low, high))
+                source.append("    },")
+                source.append("};")
+                source.append("")
+            constraint_symbols[text] = symbols[regexp]
+
+    # Slots of the metrics of every route, filled when the table is attached
+    routes_len = sum(len(group["routes"]) for group in groups)
+    source.append("static struct esp_cchi_metrics_route *%s_metrics[%d];" % (name, routes_len))
+    source.append("")
+
+    slot = 0
+    for index, group in enumerate(groups):
+        source.append("static const esp_cchi_compiled_route_t %s_routes_%d[] = {" % (name, index))
+        for route in group["routes"]:
+            source.append("    {")
+            source.append("        .method = %s," % route["method"])
+            source.append("        .handler = %s," % route["handler"])
+            source.append("        .user_ctx = (void*)(%s)," % route["user_ctx"])
+            source.append("        .metrics = &%s_metrics[%d]," % (name, slot))
+            source.append("    },")
+            slot += 1
+        source.append("};")
+        source.append("")
+
+    source.append("static const esp_cchi_compiled_group_t %s_groups[] = {" % name)
+    for index, group in enumerate(groups):
+        source.append("    {")
+        source.append("        .pattern = %s," % c_string(stripped_pattern(group["parts"])))
+        source.append("        .routes = %s_routes_%d," % (name, index))
+        source.append("        .routes_len = %d," % len(group["routes"]))
+        source.append("    },")
+    source.append("};")
+    source.append("")
+
+    for index, group in enumerate(param_groups):
+        group["index"] = index
+    tree_lines, root = emit_tree(name, build_tree(param_groups), constraint_symbols,
+                                 len(static_groups))
+    source += tree_lines
+
+    source += static_finder(name, [(i, g) for i, g in enumerate(static_groups)])
+    source.append("")
+
+    methods = sorted({route["method"] for group in groups for route in group["routes"]})
+    source.append("const esp_cchi_compiled_table_t %s = {" % name)
+    source.append("    .groups = %s_groups," % name)
+    source.append("    .groups_len = %d," % len(groups))
+    source.append("    .static_len = %d," % len(static_groups))
+    source.append("    .find_static = %s_find_static," % name)
+    source.append("    .tree = &%s," % root)
+    source.append("    .methods = %s," % " | ".join("((uint64_t)1 << %s)" % m for m in methods))
+    source.append("};")
+    source.append("")
+    return "\n".join(header), "\n".join(source)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("--name", required=True, help="name of the generated table")
+    parser.add_argument("--output-dir", required=True)
+    parser.add_argument("routes", help="route list")
+    args = parser.parse_args()
+
+    if not re.match(r"^[A-Za-z_][A-Za-z0-9_]*$", args.name):
+        sys.exit("error: --name must be a C identifier")
+    try:
+        includes, groups = parse_routes(args.routes)
+        max_params = 1
+        for group in groups:
+            params = [text for kind, text in group["parts"] if kind == "param"]
+            max_params = max(max_params, len(params))
+        header, source = generate(args.name, args.routes, includes, groups, max_params)
+    except RouteError as err:
+        sys.exit("error: %s" % err)
+    except OSError as err:
+        sys.exit("error: %s" % err)
+
+    os.makedirs(args.output_dir, exist_ok=True)
+    for extension, content in ((".h", header), (".c", source)):
+        path = os.path.join(args.output_dir, args.name + extension)
+        # Only touched if it changes, so the sources that include the header aren't rebuilt
+        if os.path.exists(path) and open(path, encoding="utf-8").read() == content:
+            continue
+        with open(path, "w", encoding="utf-8") as output:
+            output.write(content)
+
+
+if __name__ == "__main__":
+    main()